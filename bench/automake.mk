@@ -0,0 +1,11 @@
+BENCH_FOLDER = bench
+pofswitch_bench_SOURCES += $(pofswitch_SOURCES) \
+						   $(BENCH_FOLDER)/pof_bench.c \
+						   $(BENCH_FOLDER)/pof_bench_forward.c \
+						   $(BENCH_FOLDER)/pof_bench_primitive.c \
+						   $(BENCH_FOLDER)/pof_bench_table.c
+pofswitch_bench_CPPFLAGS = -DPOF_BENCH_ON $(AM_CPPFLAGS)
+
+bench: pofswitch_bench$(EXEEXT)
+CLEANFILES = pofswitch_bench$(EXEEXT)
+.PHONY: bench
@@ -0,0 +1,350 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_bench.h"
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+
+volatile uint64_t pofbench_sink = 0;
+
+//  POFBENCH_OPT(OPT,OPTSTR,LONG,FUNC,HELP)
+#define POFBENCH_OPTS \
+    POFBENCH_OPT('n',"n:","iteration",iteration,"Operations timed in one round. Default is 1000000.") \
+    POFBENCH_OPT('r',"r:","round",round,"Rounds of one case. Default is 5.")                     \
+    POFBENCH_OPT('o',"o:","output",output,"Write the result to the file instead of stdout.")      \
+    POFBENCH_OPT('t',"t:","table",table,"forward: Flow tables in the pipeline. Default is 2.")    \
+    POFBENCH_OPT('e',"e:","entry",entry,"forward: Flow entries in each table. Default is 100. " \
+                 "table: Most entries swept. Default is 4096.")                                 \
+    POFBENCH_OPT('k',"k:","table-type",table_type,"forward: Types of the tables after the first MM table, " \
+                 "cycled, in mm,lpm,em,dt. Default is mm. table: Types swept. Default is all.")  \
+    POFBENCH_OPT('a',"a:","action",action,"forward: Actions of the last table, in drop, output, " \
+                 "set and modify. Default is output.")                                           \
+    POFBENCH_OPT('w',"w:","worker",worker,"forward: Time 1 to this many workers. Default is 4.")  \
+    POFBENCH_OPT('l',"l:","length",length,"forward: Packet length in byte. Default is 64.")       \
+    POFBENCH_OPT('s',"s","stage-latency",stage_latency,"forward: Keep the stage latency measurement " \
+                 "on, as the switch does.")                                                      \
+    POFBENCH_OPT('h',"h","help",help,"Print help message.")
+
+static uint32_t
+bench_opt_iteration(struct pofbench_arg *arg, char *optarg)
+{
+    arg->iteration = strtoul(optarg, NULL, 0);
+    if(arg->iteration == 0){
+        fprintf(stderr, "The iteration must be positive.\n");
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_round(struct pofbench_arg *arg, char *optarg)
+{
+    arg->round = strtoul(optarg, NULL, 0);
+    if(arg->round == 0 || arg->round > POFBENCH_ROUND_MAX){
+        fprintf(stderr, "The round must be in 1..%u.\n", POFBENCH_ROUND_MAX);
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_output(struct pofbench_arg *arg, char *optarg)
+{
+    FILE *fp;
+
+    if((fp = fopen(optarg, "w")) == NULL){
+        fprintf(stderr, "Open %s fail.\n", optarg);
+        return POF_ERROR;
+    }
+    if(arg->out != stdout){
+        fclose(arg->out);
+    }
+    arg->out = fp;
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_table(struct pofbench_arg *arg, char *optarg)
+{
+    arg->table_num = strtoul(optarg, NULL, 0);
+    if(arg->table_num == 0 || arg->table_num > POFBENCH_TABLE_MAX){
+        fprintf(stderr, "The table must be in 1..%u.\n", POFBENCH_TABLE_MAX);
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_entry(struct pofbench_arg *arg, char *optarg)
+{
+    arg->entry_num = strtoul(optarg, NULL, 0);
+    if(arg->entry_num == 0){
+        fprintf(stderr, "The entry must be positive.\n");
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_table_type(struct pofbench_arg *arg, char *optarg)
+{
+    arg->table_type = optarg;
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_action(struct pofbench_arg *arg, char *optarg)
+{
+    arg->action = optarg;
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_worker(struct pofbench_arg *arg, char *optarg)
+{
+    arg->worker_num = strtoul(optarg, NULL, 0);
+    if(arg->worker_num == 0 || arg->worker_num > POFBENCH_WORKER_MAX){
+        fprintf(stderr, "The worker must be in 1..%u.\n", POFBENCH_WORKER_MAX);
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_length(struct pofbench_arg *arg, char *optarg)
+{
+    arg->packet_len = strtoul(optarg, NULL, 0);
+    if(arg->packet_len < POFBENCH_PACKET_LEN_MIN || arg->packet_len > POF_MTU_LENGTH){
+        fprintf(stderr, "The length must be in %u..%u.\n", POFBENCH_PACKET_LEN_MIN, POF_MTU_LENGTH);
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_stage_latency(struct pofbench_arg *arg, char *optarg)
+{
+    arg->stage_latency = TRUE;
+    return POF_OK;
+}
+
+static uint32_t
+bench_opt_help(struct pofbench_arg *arg, char *optarg)
+{
+    printf("Usage: pofswitch_bench [options] suite\n");
+    printf("Suites:\n");
+#define POFBENCH_SUITE(NAME,HELP) printf("  %-28s%s\n",#NAME,HELP);
+    POFBENCH_SUITES
+#undef POFBENCH_SUITE
+
+    printf("Options:\n");
+#define POFBENCH_OPT(OPT,OPTSTR,LONG,FUNC,HELP) \
+    printf("  -%c, --%-24s%s\n",OPT,LONG,HELP);
+    POFBENCH_OPTS
+#undef POFBENCH_OPT
+    exit(0);
+}
+
+/***********************************************************************
+ * Get the monotonic time.
+ * Form:     uint64_t pofbench_now()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   time in nanosecond
+ * Discribe: This function returns the monotonic time in nanosecond.
+ ***********************************************************************/
+uint64_t pofbench_now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_double_cmp(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/***********************************************************************
+ * Time one benchmark case.
+ * Form:     void pofbench_run(const struct pofbench_arg *arg, \
+ *                             pofbench_loop loop, \
+ *                             void *ctx, \
+ *                             struct pofbench_result *res)
+ * Input:    arguments, loop of the case, context of the loop
+ * Output:   result
+ * Return:   VOID
+ * Discribe: This function warms the case up with a tenth of the
+ *           iterations, then times arg->round rounds of arg->iteration
+ *           operations each. The median and the minimum of the rounds
+ *           are reported in nanosecond per operation.
+ ***********************************************************************/
+void pofbench_run(const struct pofbench_arg *arg, pofbench_loop loop, \
+                  void *ctx, struct pofbench_result *res)
+{
+    uint64_t start;
+    uint32_t i;
+
+    loop(ctx, arg->iteration / 10 + 1);
+
+    res->round = arg->round;
+    for(i=0; i<arg->round; i++){
+        start = pofbench_now();
+        loop(ctx, arg->iteration);
+        res->ns[i] = (double)(pofbench_now() - start) / arg->iteration;
+    }
+
+    pofbench_result_stat(res);
+    return;
+}
+
+/* Names of the table types in the options and the results. */
+const char *pofbench_table_type_str[POF_MAX_TABLE_TYPE] = {"mm", "lpm", "em", "dt"};
+
+/***********************************************************************
+ * Parse the table types.
+ * Form:     uint32_t pofbench_table_type_parse(const char *str, \
+ *                                              uint8_t *type, \
+ *                                              uint32_t *num)
+ * Input:    types separated by comma, such as "mm,em,dt"
+ * Output:   type of each one, type number
+ * Return:   POF_OK or POF_ERROR
+ * Discribe: This function turns the names of the table types into
+ *           POF_MM_TABLE and so on. There are POFBENCH_TABLE_MAX names
+ *           at most.
+ ***********************************************************************/
+uint32_t pofbench_table_type_parse(const char *str, uint8_t *type, uint32_t *num){
+    char buf[128], *tok, *save;
+    uint32_t t;
+
+    *num = 0;
+    strncpy(buf, str, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for(tok=strtok_r(buf, ",", &save); tok!=NULL; tok=strtok_r(NULL, ",", &save)){
+        for(t=0; t<POF_MAX_TABLE_TYPE; t++){
+            if(strcmp(tok, pofbench_table_type_str[t]) == 0){
+                break;
+            }
+        }
+        if(t == POF_MAX_TABLE_TYPE || *num == POFBENCH_TABLE_MAX){
+            fprintf(stderr, "Bad table type: %s\n", tok);
+            return POF_ERROR;
+        }
+        type[(*num)++] = t;
+    }
+    if(*num == 0){
+        fprintf(stderr, "No table type.\n");
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Sum up the rounds of one case.
+ * Form:     void pofbench_result_stat(struct pofbench_result *res)
+ * Input:    result with the time of each round
+ * Output:   result
+ * Return:   VOID
+ * Discribe: This function sets the median and the minimum of the
+ *           res->round rounds timed in res->ns.
+ ***********************************************************************/
+void pofbench_result_stat(struct pofbench_result *res){
+    double sorted[POFBENCH_ROUND_MAX];
+
+    memcpy(sorted, res->ns, res->round * sizeof(double));
+    qsort(sorted, res->round, sizeof(double), bench_double_cmp);
+    res->min = sorted[0];
+    res->median = (res->round % 2) ? sorted[res->round / 2] : \
+                  (sorted[res->round / 2 - 1] + sorted[res->round / 2]) / 2;
+    return;
+}
+
+int main(int argc, char *argv[]){
+    struct pofbench_arg arg = {
+        POFBENCH_ITERATION_DEFAULT,
+        POFBENCH_ROUND_DEFAULT,
+        stdout,
+        POFBENCH_TABLE_DEFAULT,
+        0,
+        POFBENCH_WORKER_DEFAULT,
+        POFBENCH_PACKET_LEN_DEFAULT,
+        FALSE,
+        NULL,
+        POFBENCH_ACTION_DEFAULT
+    };
+    struct option long_options[] = {
+#define POFBENCH_OPT(OPT,OPTSTR,LONG,FUNC,HELP) {LONG,OPTSTR[1]==':',NULL,OPT},
+        POFBENCH_OPTS
+#undef POFBENCH_OPT
+        {NULL,0,NULL,0}
+    };
+    char optstring[] = ""
+#define POFBENCH_OPT(OPT,OPTSTR,LONG,FUNC,HELP) OPTSTR
+        POFBENCH_OPTS
+#undef POFBENCH_OPT
+        ;
+    uint32_t ret = POF_ERROR;
+    char *suite;
+    int ch;
+
+    while((ch=getopt_long(argc, argv, optstring, long_options, NULL)) != -1){
+        switch(ch){
+#define POFBENCH_OPT(OPT,OPTSTR,LONG,FUNC,HELP)             \
+            case OPT:                                       \
+                if(bench_opt_##FUNC(&arg, optarg) != POF_OK) \
+                    return 1;                               \
+                break;
+
+            POFBENCH_OPTS
+#undef POFBENCH_OPT
+            default:
+                return 1;
+        }
+    }
+
+    if(optind >= argc){
+        bench_opt_help(&arg, NULL);
+    }
+    suite = argv[optind];
+
+#define POFBENCH_SUITE(NAME,HELP)                   \
+    if(strcmp(suite, #NAME) == 0){                  \
+        ret = pofbench_##NAME(&arg);                \
+    }else
+    POFBENCH_SUITES
+#undef POFBENCH_SUITE
+    {
+        fprintf(stderr, "Unknown suite: %s\n", suite);
+    }
+
+    if(arg.out != stdout){
+        fclose(arg.out);
+    }
+    return (ret == POF_OK) ? 0 : 1;
+}
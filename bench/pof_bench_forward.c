@@ -0,0 +1,589 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_bench.h"
+#include <pthread.h>
+#include <string.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* In-memory ports the packets come in from and go out to. */
+#define FORWARD_PORT_NUM        (4)
+
+/* Distinct packets generated at most. The packets are reused round by
+ * round, so only the longest runs cycle through them. */
+#define FORWARD_PACKET_POOL_MAX (1 << 20)
+
+/* One of this many packets is timed for the latency percentiles. */
+#define FORWARD_SAMPLE          (16)
+
+/* Offsets in the packets, which are Ethernet, IPv4 and UDP. */
+#define FORWARD_ETH_DST_B       (0)
+#define FORWARD_IP_TTL_B        (22 * POF_BITNUM_IN_BYTE)
+#define FORWARD_IP_CHECKSUM_B   (24 * POF_BITNUM_IN_BYTE)
+#define FORWARD_IP_HEADER_B     (14 * POF_BITNUM_IN_BYTE)
+#define FORWARD_IP_DST_B        (30 * POF_BITNUM_IN_BYTE)
+#define FORWARD_UDP_DST_B       (36 * POF_BITNUM_IN_BYTE)
+
+/* The tables look up the IPv4 destination and the UDP destination port.
+ * Entry j of every table matches the flow j. */
+static const pof_match forward_match[] = {
+    {0, FORWARD_IP_DST_B, 32},
+    {1, FORWARD_UDP_DST_B, 16},
+};
+#define FORWARD_MATCH_NUM (sizeof(forward_match) / sizeof(forward_match[0]))
+#define FORWARD_KEY_LEN   (32 + 16)
+
+/* Actions of the last table.
+ * FORWARD_ACTION(NAME) */
+#define FORWARD_ACTIONS \
+    FORWARD_ACTION(drop)   \
+    FORWARD_ACTION(output) \
+    FORWARD_ACTION(set)    \
+    FORWARD_ACTION(modify)
+
+enum forward_action{
+#define FORWARD_ACTION(NAME) FORWARD_ACTION_##NAME,
+    FORWARD_ACTIONS
+#undef FORWARD_ACTION
+    FORWARD_ACTION_NUM
+};
+
+struct forward_ctx{
+    const struct pofbench_arg *arg;
+    uint8_t  type[POFBENCH_TABLE_MAX];     /* Type of each table of the pipeline. */
+    uint8_t  table_id[POFBENCH_TABLE_MAX];
+    uint8_t  ID[POFBENCH_TABLE_MAX];       /* Global table ID. */
+    uint32_t action;
+
+    uint8_t  *packet;                      /* Pregenerated packets. */
+    uint32_t packet_num;
+
+    uint32_t round_num;                    /* Rounds, the first one warming up. */
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+};
+
+struct forward_worker{
+    struct forward_ctx *ctx;
+    task_t   tid;
+    uint32_t first;                        /* Packets forwarded in each round. */
+    uint32_t num;
+
+    uint64_t sent;
+    uint64_t error;
+    struct pofdp_hist hist;
+};
+
+/* Packets output by the calling worker. */
+static __thread uint64_t forward_sent = 0;
+
+/* The in-memory ports take the packet out and count it, as the send
+ * task counts the packet sent through the physical port. */
+static uint32_t forward_send(struct pofdp_packet *dpp){
+    struct pofdp_port_stats *ps = pofdp_port_stats_self(dpp->output_port_id);
+
+    ps->tx_packets++;
+    ps->tx_bytes += dpp->output_whole_len;
+    pofbench_sink += dpp->buf_out[0];
+    free(dpp->buf_out);
+    forward_sent++;
+    return POF_OK;
+}
+
+static void forward_put16(uint8_t *p, uint16_t v){
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+    return;
+}
+
+static void forward_put32(uint8_t *p, uint32_t v){
+    forward_put16(p, (uint16_t)(v >> 16));
+    forward_put16(p + 2, (uint16_t)v);
+    return;
+}
+
+static uint32_t forward_ip_dst(uint32_t flow){
+    return 0x0a000000 + flow;
+}
+
+static uint16_t forward_udp_dst(uint32_t flow){
+    return (uint16_t)(flow * 7 + 1);
+}
+
+/* Build a UDP packet of the flow. */
+static void forward_packet_init(uint8_t *p, uint32_t len, uint32_t flow){
+    uint32_t sum = 0, i;
+
+    memset(p, 0, len);
+    p[0] = 0x02; p[5] = 0x01;                       /* Destination MAC. */
+    p[6] = 0x02; p[11] = 0x02;                      /* Source MAC. */
+    forward_put16(p + 12, 0x0800);                  /* IPv4. */
+
+    p[14] = 0x45;
+    forward_put16(p + 16, len - 14);
+    p[22] = 64;                                     /* TTL. */
+    p[23] = 17;                                     /* UDP. */
+    forward_put32(p + 26, 0x0a010001);
+    forward_put32(p + 30, forward_ip_dst(flow));
+    for(i=0; i<20; i+=2){
+        sum += (p[14 + i] << 8) | p[15 + i];
+    }
+    while(sum >> 16){
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    forward_put16(p + 24, (uint16_t)~sum);
+
+    forward_put16(p + 34, 1234);
+    forward_put16(p + 36, forward_udp_dst(flow));
+    forward_put16(p + 38, len - 34);
+    for(i=42; i<len; i++){
+        p[i] = (uint8_t)i;
+    }
+    return;
+}
+
+/* Pregenerate the packets of random flows, entering from every port. */
+static uint32_t forward_packet_pool_init(struct forward_ctx *c){
+    const struct pofbench_arg *arg = c->arg;
+    uint32_t i, seed = 1;
+
+    c->packet_num = (arg->iteration < FORWARD_PACKET_POOL_MAX) ? arg->iteration : FORWARD_PACKET_POOL_MAX;
+    c->packet = malloc((size_t)c->packet_num * arg->packet_len);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(c->packet);
+
+    for(i=0; i<c->packet_num; i++){
+        seed = seed * 1103515245 + 12345;
+        forward_packet_init(c->packet + (size_t)i * arg->packet_len, arg->packet_len, \
+                            (seed >> 8) % arg->entry_num);
+    }
+    return POF_OK;
+}
+
+static uint32_t forward_parse(struct forward_ctx *c){
+    const struct pofbench_arg *arg = c->arg;
+    uint8_t types[POFBENCH_TABLE_MAX], table_num[POF_MAX_TABLE_TYPE] = {0};
+    uint32_t i, type_num;
+
+    c->action = FORWARD_ACTION_NUM;
+#define FORWARD_ACTION(NAME)                    \
+    if(strcmp(arg->action, #NAME) == 0){        \
+        c->action = FORWARD_ACTION_##NAME;      \
+    }
+    FORWARD_ACTIONS
+#undef FORWARD_ACTION
+    if(c->action == FORWARD_ACTION_NUM){
+        fprintf(stderr, "Unknown action: %s\n", arg->action);
+        return POF_ERROR;
+    }
+
+    if(pofbench_table_type_parse(arg->table_type, types, &type_num) != POF_OK){
+        return POF_ERROR;
+    }
+
+    /* Packets enter the first table, which is always MM 0. The others
+     * take the types in turn. */
+    for(i=0; i<arg->table_num; i++){
+        c->type[i] = (i == 0) ? POF_MM_TABLE : types[(i - 1) % type_num];
+        c->table_id[i] = table_num[c->type[i]]++;
+    }
+
+    if(table_num[POF_MM_TABLE] > POFLR_MM_TBL_NUM){
+        poflr_set_MM_table_number(table_num[POF_MM_TABLE]);
+    }
+    if(table_num[POF_LPM_TABLE] > POFLR_LPM_TBL_NUM){
+        poflr_set_LPM_table_number(table_num[POF_LPM_TABLE]);
+    }
+    if(table_num[POF_EM_TABLE] > POFLR_EM_TBL_NUM){
+        poflr_set_EM_table_number(table_num[POF_EM_TABLE]);
+    }
+    if(table_num[POF_LINEAR_TABLE] > POFLR_DT_TBL_NUM){
+        poflr_set_DT_table_number(table_num[POF_LINEAR_TABLE]);
+    }
+    if(arg->entry_num > POFLR_FLOW_TABLE_SIZE){
+        poflr_set_flow_table_size(arg->entry_num);
+    }
+    return POF_OK;
+}
+
+static void forward_action_output(pof_action *act, uint32_t flow){
+    pof_action_output *p = (pof_action_output *)act->action_data;
+
+    act->type = POFAT_OUTPUT;
+    act->len = sizeof(pof_action);
+    p->outputPortId = flow % FORWARD_PORT_NUM + 1;
+    return;
+}
+
+/* Actions ending the pipeline. Return the action number. */
+static uint8_t forward_action_init(pof_action *act, uint32_t action, uint32_t flow){
+    pof_action_set_field *set;
+    pof_action_modify_field *modify;
+    pof_action_calculate_checksum *cs;
+
+    switch(action){
+        case FORWARD_ACTION_drop:
+            act[0].type = POFAT_DROP;
+            act[0].len = sizeof(pof_action);
+            return 1;
+        case FORWARD_ACTION_output:
+            forward_action_output(&act[0], flow);
+            return 1;
+        case FORWARD_ACTION_set:
+            act[0].type = POFAT_SET_FIELD;
+            act[0].len = sizeof(pof_action);
+            set = (pof_action_set_field *)act[0].action_data;
+            set->field_setting.offset = FORWARD_ETH_DST_B;
+            set->field_setting.len = 48;
+            set->field_setting.value[0] = 0x02;
+            forward_put32(&set->field_setting.value[2], flow);
+            memset(set->field_setting.mask, 0xff, 6);
+            forward_action_output(&act[1], flow);
+            return 2;
+        case FORWARD_ACTION_modify:
+        default:
+            act[0].type = POFAT_MODIFY_FIELD;
+            act[0].len = sizeof(pof_action);
+            modify = (pof_action_modify_field *)act[0].action_data;
+            modify->field.offset = FORWARD_IP_TTL_B;
+            modify->field.len = 8;
+            modify->increment = -1;
+            act[1].type = POFAT_CALCULATE_CHECKSUM;
+            act[1].len = sizeof(pof_action);
+            cs = (pof_action_calculate_checksum *)act[1].action_data;
+            cs->checksum_pos = FORWARD_IP_CHECKSUM_B;
+            cs->checksum_len = 16;
+            cs->cal_startpos = FORWARD_IP_HEADER_B;
+            cs->cal_len = 160;
+            forward_action_output(&act[2], flow);
+            return 3;
+    }
+}
+
+/* Entry j of table i matches the flow j, unless the table is DT, where
+ * the previous table sends the flow j to the entry j directly. */
+static void forward_entry_init(struct forward_ctx *c, pof_flow_entry *e, uint32_t i, uint32_t j){
+    pof_instruction_goto_direct_table *gdt;
+    pof_instruction_goto_table *gt;
+    pof_instruction_apply_actions *apply;
+    uint32_t k, len_B;
+
+    memset(e, 0, sizeof(*e));
+    e->command = POFFC_ADD;
+    e->table_id = c->table_id[i];
+    e->table_type = c->type[i];
+    e->priority = 1;
+    e->index = j;
+    e->instruction_num = 1;
+
+    if(c->type[i] != POF_LINEAR_TABLE){
+        e->match_field_num = FORWARD_MATCH_NUM;
+        for(k=0; k<FORWARD_MATCH_NUM; k++){
+            e->match[k].field_id = forward_match[k].field_id;
+            e->match[k].offset = forward_match[k].offset;
+            e->match[k].len = forward_match[k].len;
+            len_B = POF_BITNUM_TO_BYTENUM_CEIL(forward_match[k].len);
+            memset(e->match[k].mask, 0xff, len_B);
+        }
+        forward_put32(e->match[0].value, forward_ip_dst(j));
+        forward_put16(e->match[1].value, forward_udp_dst(j));
+    }
+
+    if(i + 1 == c->arg->table_num){
+        e->instruction[0].type = POFIT_APPLY_ACTIONS;
+        e->instruction[0].len = sizeof(pof_instruction);
+        apply = (pof_instruction_apply_actions *)e->instruction[0].instruction_data;
+        apply->action_num = forward_action_init(apply->action, c->action, j);
+    }else if(c->type[i + 1] == POF_LINEAR_TABLE){
+        e->instruction[0].type = POFIT_GOTO_DIRECT_TABLE;
+        e->instruction[0].len = sizeof(pof_instruction);
+        gdt = (pof_instruction_goto_direct_table *)e->instruction[0].instruction_data;
+        gdt->next_table_id = c->ID[i + 1];
+        gdt->table_entry_index = j;
+    }else{
+        e->instruction[0].type = POFIT_GOTO_TABLE;
+        e->instruction[0].len = sizeof(pof_instruction);
+        gt = (pof_instruction_goto_table *)e->instruction[0].instruction_data;
+        gt->next_table_id = c->ID[i + 1];
+        gt->match_field_num = FORWARD_MATCH_NUM;
+        memcpy(gt->match, forward_match, sizeof(forward_match));
+    }
+    return;
+}
+
+/* Create the tables and fill them, the last one first, so every entry
+ * goes to a table which is already there. */
+static uint32_t forward_pipeline_init(struct forward_ctx *c){
+    const struct pofbench_arg *arg = c->arg;
+    pof_flow_entry *e;
+    pof_match match[POF_MAX_MATCH_FIELD_NUM] = {{0}};
+    char name[POF_NAME_MAX_LENGTH];
+    uint32_t i, j, ret;
+    int32_t t;
+
+    memcpy(match, forward_match, sizeof(forward_match));
+    for(i=0; i<arg->table_num; i++){
+        ret = poflr_table_id_to_ID(c->type[i], c->table_id[i], &c->ID[i]);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+
+    e = malloc(sizeof(*e));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(e);
+
+    for(t=arg->table_num-1; t>=0; t--){
+        snprintf(name, sizeof(name), "bench%d", t);
+        if(c->type[t] == POF_LINEAR_TABLE){
+            ret = poflr_create_flow_table(c->table_id[t], c->type[t], 0, arg->entry_num, name, 0, match);
+        }else{
+            ret = poflr_create_flow_table(c->table_id[t], c->type[t], FORWARD_KEY_LEN, arg->entry_num, \
+                                          name, FORWARD_MATCH_NUM, match);
+        }
+        if(ret != POF_OK){
+            free(e);
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        }
+
+        for(j=0; j<arg->entry_num; j++){
+            forward_entry_init(c, e, t, j);
+            ret = poflr_add_flow_entry(e);
+            if(ret != POF_OK){
+                free(e);
+                POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+            }
+        }
+    }
+
+    free(e);
+    return POF_OK;
+}
+
+/* Forward the packets of the worker round by round, as the datapath
+ * task forwards the packets from the receive queue. */
+static uint32_t forward_worker_task(void *arg_ptr){
+    struct forward_worker *w = arg_ptr;
+    struct forward_ctx *c = w->ctx;
+    struct pofdp_packet dpp[1];
+    struct pof_instruction first_ins[1] = {0};
+    pofbf_rcu_reader *reader;
+    uint32_t len = c->arg->packet_len, r, i, index;
+    uint64_t ts = 0;
+    uint8_t *buf, *packet;
+
+    pofdp_set_goto_first_table(first_ins);
+    reader = pofbf_rcu_register();
+    buf = malloc(POFDP_PACKET_RAW_MAX_LEN);
+
+    for(r=0; r<c->round_num; r++){
+        pthread_barrier_wait(&c->start);
+        for(i=0; reader!=NULL && buf!=NULL && i<w->num; i++){
+            index = (w->first + i) % c->packet_num;
+            packet = c->packet + (size_t)index * len;
+            if(r > 0 && i % FORWARD_SAMPLE == 0){
+                ts = pofbench_now();
+            }
+
+            memcpy(buf, packet, len);
+            memset(dpp, 0, sizeof *dpp);
+            dpp->ori_port_id = index % FORWARD_PORT_NUM + 1;
+            dpp->buf = buf;
+            dpp->ori_len = len;
+            dpp->left_len = len;
+            dpp->buf_offset = buf;
+
+            POFBF_RCU_READ_LOCK(reader);
+            if(pofdp_forward(dpp, first_ins) != POF_OK){
+                w->error++;
+            }
+            POFBF_RCU_READ_UNLOCK(reader);
+
+            if(r > 0 && i % FORWARD_SAMPLE == 0){
+                pofdp_hist_record(&w->hist, pofbench_now() - ts);
+            }
+        }
+        pthread_barrier_wait(&c->done);
+    }
+
+    if(reader == NULL || buf == NULL){
+        w->error += (uint64_t)w->num * c->round_num;
+    }
+    w->sent = forward_sent;
+    if(reader != NULL){
+        pofbf_rcu_unregister(reader);
+    }
+    free(buf);
+    return POF_OK;
+}
+
+/* Time the pipeline with worker_num workers sharing the packets of each
+ * round. */
+static uint32_t forward_case(struct forward_ctx *c, uint32_t worker_num, uint32_t index){
+    const struct pofbench_arg *arg = c->arg;
+    struct forward_worker *w;
+    struct pofbench_result res;
+    struct pofdp_hist *hist;
+    uint64_t start, sent = 0, error = 0;
+    uint32_t i, b, first = 0, ret = POF_OK;
+
+    w = calloc(worker_num + 1, sizeof(*w));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(w);
+    hist = &w[worker_num].hist;
+
+    pthread_barrier_init(&c->start, NULL, worker_num + 1);
+    pthread_barrier_init(&c->done, NULL, worker_num + 1);
+    for(i=0; i<worker_num; i++){
+        w[i].ctx = c;
+        w[i].first = first;
+        w[i].num = arg->iteration / worker_num + (i < arg->iteration % worker_num);
+        first += w[i].num;
+        ret = pofbf_task_create(&w[i], (void *)forward_worker_task, &w[i].tid);
+        if(ret != POF_OK){
+            /* The workers created wait for the rounds forever. */
+            POF_CHECK_RETVALUE_TERMINATE(ret);
+        }
+    }
+
+    res.round = arg->round;
+    for(i=0; i<c->round_num; i++){
+        start = pofbench_now();
+        pthread_barrier_wait(&c->start);
+        pthread_barrier_wait(&c->done);
+        if(i > 0){
+            res.ns[i - 1] = (double)(pofbench_now() - start) / arg->iteration;
+        }
+    }
+    pofbench_result_stat(&res);
+
+    for(i=0; i<worker_num; i++){
+        pthread_join(w[i].tid, NULL);
+        sent += w[i].sent;
+        error += w[i].error;
+        for(b=0; b<POFDP_HIST_BUCKET_NUM; b++){
+            hist->bucket[b] += w[i].hist.bucket[b];
+        }
+        hist->count += w[i].hist.count;
+        if(w[i].hist.max > hist->max){
+            hist->max = w[i].hist.max;
+        }
+    }
+    pthread_barrier_destroy(&c->start);
+    pthread_barrier_destroy(&c->done);
+
+    fprintf(arg->out, "%s\n    {\"worker\":%u,\"mpps\":%.3f,\"mpps_max\":%.3f,\"ns_per_packet\":%.2f," \
+            "\"latency_ns\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}," \
+            "\"output_per_packet\":%.3f,\"error\":%llu}", \
+            index ? "," : "", worker_num, \
+            res.median > 0 ? 1000 / res.median : 0, res.min > 0 ? 1000 / res.min : 0, res.median, \
+            (unsigned long long)pofdp_hist_percentile(hist, 50), \
+            (unsigned long long)pofdp_hist_percentile(hist, 99), \
+            (unsigned long long)pofdp_hist_percentile(hist, 99.9), \
+            (unsigned long long)hist->max, \
+            (double)sent / ((double)arg->iteration * c->round_num), \
+            (unsigned long long)error);
+    fflush(arg->out);
+
+    free(w);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Run the benchmark of forwarding through a synthetic pipeline.
+ * Form:     uint32_t pofbench_forward(const struct pofbench_arg *arg)
+ * Input:    arguments
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function installs arg->table_num tables of
+ *           arg->entry_num entries each on in-memory ports, and forwards
+ *           arg->iteration pregenerated packets in each round with 1 to
+ *           arg->worker_num workers calling pofdp_forward(). The entries
+ *           of the last table apply arg->action. It writes the median and
+ *           the best packet rates and the percentiles of the sampled
+ *           per-packet latency in JSON. No raw socket is used, so it
+ *           needs no privilege.
+ ***********************************************************************/
+uint32_t pofbench_forward(const struct pofbench_arg *arg){
+    struct pofbench_arg forward_arg = *arg;
+    struct forward_ctx *c;
+    uint32_t i, ret;
+
+    if(forward_arg.entry_num == 0){
+        forward_arg.entry_num = POFBENCH_ENTRY_DEFAULT;
+    }
+    if(forward_arg.table_type == NULL){
+        forward_arg.table_type = POFBENCH_TABLE_TYPE_DEFAULT;
+    }
+    arg = &forward_arg;
+
+    c = calloc(1, sizeof(*c));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(c);
+    c->arg = arg;
+    c->round_num = arg->round + 1;
+
+    /* Only the errors are printed, so the result stays parsable. */
+    poflp_set_level(POFLP_CATEGORY_ALL, POFLP_OFF);
+    pofdp_set_latency_on(arg->stage_latency);
+    dp.send = forward_send;
+
+    ret = forward_parse(c);
+    if(ret == POF_OK){
+        ret = poflr_init_table_resource();
+    }
+    if(ret == POF_OK){
+        ret = poflr_init_port_memory(FORWARD_PORT_NUM);
+    }
+    if(ret == POF_OK){
+        ret = forward_pipeline_init(c);
+    }
+    if(ret == POF_OK){
+        ret = forward_packet_pool_init(c);
+    }
+    if(ret != POF_OK){
+        free(c);
+        return ret;
+    }
+
+    fprintf(arg->out, "{\"suite\":\"forward\",\"version\":\"%s\",\"iteration\":%u,\"round\":%u," \
+            "\"table\":%u,\"entry\":%u,\"table_type\":\"%s\",\"action\":\"%s\",\"packet_len\":%u," \
+            "\"port\":%u,\"stage_latency\":%s,\"results\":[", \
+            POFSWITCH_VERSION, arg->iteration, arg->round, arg->table_num, arg->entry_num, \
+            arg->table_type, arg->action, arg->packet_len, FORWARD_PORT_NUM, \
+            arg->stage_latency ? "true" : "false");
+
+    for(i=1; i<=arg->worker_num; i++){
+        forward_case(c, i, i - 1);
+    }
+    fprintf(arg->out, "\n]}\n");
+
+    free(c->packet);
+    free(c);
+    return POF_OK;
+}
+
+#endif // POF_DATAPATH_ON
@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_byte_transfer.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_bench.h"
+#include <string.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* Bit offsets and lengths of the bit operation cases. The unaligned offset
+ * makes every length cross a byte boundary. */
+static const uint16_t primitive_bit_offset[] = {0, 3};
+static const uint16_t primitive_bit_len[] = {1, 4, 8, 12, 16, 24, 32, 48, 64, 96, 128};
+
+/* Checksum cases: IPv4 header, IPv4 header with options, 128 bytes. */
+static const uint16_t primitive_cs_offset[] = {0, 4};
+static const uint16_t primitive_cs_len[] = {160, 480, 1024};
+#define PRIMITIVE_CS_LEN_B (16)
+
+/* Match cases. Every field of the entry is compared when the keys match. */
+static const uint8_t primitive_match_field_num[] = {1, 2, 4, 8};
+static const uint16_t primitive_match_len[] = {16, 48, 128};
+
+#define PRIMITIVE_NUM(array) (sizeof(array) / sizeof((array)[0]))
+
+/* The buffers are larger than any case touches, so reading a byte beyond
+ * the piece stays inside them. */
+struct primitive_ctx{
+    uint16_t offset_b;
+    uint16_t len_b;
+    uint8_t  field_num;
+    uint8_t  data[256];
+    uint8_t  value[64];
+    uint8_t  key_buf[POF_MAX_MATCH_FIELD_NUM][POF_MAX_FIELD_LENGTH_IN_BYTE];
+    uint8_t  *key[POF_MAX_MATCH_FIELD_NUM];
+    pof_match_x match[POF_MAX_MATCH_FIELD_NUM];
+    pof_header header;
+    pof_packet_in packet_in;
+    pof_flow_entry entry;
+};
+
+static struct primitive_ctx primitive_ctx;
+static uint32_t primitive_result_num = 0;
+
+static void primitive_fill(uint8_t *buf, uint32_t len, uint32_t seed){
+    uint32_t i;
+
+    for(i=0; i<len; i++){
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+    return;
+}
+
+static void loop_copy_bit(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pofdp_copy_bit(c->data, c->value, c->offset_b, c->len_b);
+    }
+    pofbench_sink += c->value[0];
+    return;
+}
+
+static void loop_cover_bit(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pofdp_cover_bit(c->data, c->value, c->offset_b, c->len_b);
+    }
+    pofbench_sink += c->data[0];
+    return;
+}
+
+static void loop_bzero_bit(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pofdp_bzero_bit(c->data, c->offset_b, c->len_b);
+    }
+    pofbench_sink += c->data[0];
+    return;
+}
+
+static void loop_checksum(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint64_t value;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        value = 0;
+        pofdp_checksum(c->data, &value, c->offset_b, c->len_b, PRIMITIVE_CS_LEN_B);
+        pofbench_sink += value;
+    }
+    return;
+}
+
+static void loop_match_per_entry(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i, match = 0;
+
+    for(i=0; i<num; i++){
+        match += pofdp_match_per_entry(c->key, c->field_num, c->match);
+    }
+    pofbench_sink += match;
+    return;
+}
+
+static void loop_header_transfer(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pof_HtoN_transfer_header(&c->header);
+        pof_NtoH_transfer_header(&c->header);
+    }
+    pofbench_sink += c->header.length;
+    return;
+}
+
+static void loop_packet_in_transfer(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pof_HtoN_transfer_packet_in(&c->packet_in);
+        pof_NtoH_transfer_packet_in(&c->packet_in);
+    }
+    pofbench_sink += c->packet_in.total_len;
+    return;
+}
+
+static void loop_flow_entry_transfer(void *arg, uint32_t num){
+    struct primitive_ctx *c = arg;
+    uint32_t i;
+
+    for(i=0; i<num; i++){
+        pof_HtoN_transfer_flow_entry(&c->entry);
+        pof_NtoH_transfer_flow_entry(&c->entry);
+    }
+    pofbench_sink += c->entry.priority;
+    return;
+}
+
+static void primitive_case(const struct pofbench_arg *arg, const char *name, \
+                           pofbench_loop loop, struct primitive_ctx *c)
+{
+    struct pofbench_result res;
+    uint32_t aligned;
+
+    pofbench_run(arg, loop, c, &res);
+
+    aligned = (c->offset_b % POF_BITNUM_IN_BYTE == 0) && (c->len_b % POF_BITNUM_IN_BYTE == 0);
+    fprintf(arg->out, "%s\n    {\"primitive\":\"%s\",\"offset_bit\":%u,\"len_bit\":%u," \
+            "\"field_num\":%u,\"aligned\":%s,\"ns_per_op\":%.2f,\"ns_per_op_min\":%.2f," \
+            "\"mops\":%.2f}", \
+            primitive_result_num++ ? "," : "", name, c->offset_b, c->len_b, \
+            c->field_num, aligned ? "true" : "false", res.median, res.min, \
+            res.median > 0 ? 1000 / res.median : 0);
+    fflush(arg->out);
+    return;
+}
+
+/* Fill an entry whose field i matches the key i. The mask of every
+ * field is full, so a missing key may differ in any bit. */
+static void primitive_match_init(struct primitive_ctx *c, uint16_t len_b){
+    uint32_t i, len_B = POF_BITNUM_TO_BYTENUM_CEIL(len_b);
+
+    memset(c->match, 0, sizeof(c->match));
+    for(i=0; i<POF_MAX_MATCH_FIELD_NUM; i++){
+        c->match[i].field_id = i;
+        c->match[i].offset = i * len_b;
+        c->match[i].len = len_b;
+        primitive_fill(c->match[i].value, len_B, i + 1);
+        memset(c->match[i].mask, 0xff, len_B);
+        memcpy(c->key_buf[i], c->match[i].value, POF_MAX_FIELD_LENGTH_IN_BYTE);
+        c->key[i] = c->key_buf[i];
+    }
+    c->offset_b = 0;
+    c->len_b = len_b;
+    return;
+}
+
+/* An entry with every match field and two instructions: one applying
+ * the most actions, the other going to the next table. */
+static void primitive_flow_entry_init(struct primitive_ctx *c){
+    pof_instruction_apply_actions *apply;
+    pof_instruction_goto_table *go;
+    uint32_t i;
+
+    memset(&c->entry, 0, sizeof(c->entry));
+    c->entry.command = POFFC_ADD;
+    c->entry.match_field_num = POF_MAX_MATCH_FIELD_NUM;
+    c->entry.instruction_num = 2;
+    c->entry.counter_id = 1;
+    c->entry.cookie = 0x0123456789abcdefULL;
+    c->entry.priority = 0x100;
+    c->entry.index = 7;
+    for(i=0; i<POF_MAX_MATCH_FIELD_NUM; i++){
+        c->entry.match[i].field_id = i;
+        c->entry.match[i].offset = i * 16;
+        c->entry.match[i].len = 16;
+    }
+
+    c->entry.instruction[0].type = POFIT_APPLY_ACTIONS;
+    c->entry.instruction[0].len = sizeof(pof_instruction);
+    apply = (pof_instruction_apply_actions *)c->entry.instruction[0].instruction_data;
+    apply->action_num = POF_MAX_ACTION_NUMBER_PER_INSTRUCTION;
+    for(i=0; i<POF_MAX_ACTION_NUMBER_PER_INSTRUCTION; i++){
+        apply->action[i].type = POFAT_OUTPUT;
+        apply->action[i].len = sizeof(pof_action);
+    }
+
+    c->entry.instruction[1].type = POFIT_GOTO_TABLE;
+    c->entry.instruction[1].len = sizeof(pof_instruction);
+    go = (pof_instruction_goto_table *)c->entry.instruction[1].instruction_data;
+    go->next_table_id = 1;
+    go->match_field_num = 1;
+    go->packet_offset = 14;
+
+    c->offset_b = 0;
+    c->len_b = sizeof(c->entry) * POF_BITNUM_IN_BYTE;
+    c->field_num = c->entry.match_field_num;
+    return;
+}
+
+/***********************************************************************
+ * Run the benchmark of the datapath primitives.
+ * Form:     uint32_t pofbench_primitive(const struct pofbench_arg *arg)
+ * Input:    arguments
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function times the bit copy, cover and zero operations
+ *           at byte aligned and unaligned offsets over 1 to 128 bits,
+ *           the checksum, the match of keys against one entry and the
+ *           byte order transfer of messages, and writes them in JSON.
+ *           A transfer case turns the message to the network order and
+ *           back, so one operation is two transfers.
+ ***********************************************************************/
+uint32_t pofbench_primitive(const struct pofbench_arg *arg){
+    struct primitive_ctx *c = &primitive_ctx;
+    uint32_t i, j;
+
+    memset(c, 0, sizeof(*c));
+    primitive_result_num = 0;
+
+    fprintf(arg->out, "{\"suite\":\"primitive\",\"version\":\"%s\",\"iteration\":%u," \
+            "\"round\":%u,\"results\":[", POFSWITCH_VERSION, arg->iteration, arg->round);
+
+    c->field_num = 1;
+    for(i=0; i<PRIMITIVE_NUM(primitive_bit_offset); i++){
+        for(j=0; j<PRIMITIVE_NUM(primitive_bit_len); j++){
+            c->offset_b = primitive_bit_offset[i];
+            c->len_b = primitive_bit_len[j];
+
+            primitive_fill(c->data, sizeof(c->data), j);
+            primitive_case(arg, "copy_bit", loop_copy_bit, c);
+            primitive_fill(c->value, sizeof(c->value), j);
+            primitive_case(arg, "cover_bit", loop_cover_bit, c);
+            primitive_case(arg, "bzero_bit", loop_bzero_bit, c);
+        }
+    }
+
+    for(i=0; i<PRIMITIVE_NUM(primitive_cs_offset); i++){
+        for(j=0; j<PRIMITIVE_NUM(primitive_cs_len); j++){
+            c->offset_b = primitive_cs_offset[i];
+            c->len_b = primitive_cs_len[j];
+            primitive_fill(c->data, sizeof(c->data), j);
+            primitive_case(arg, "checksum", loop_checksum, c);
+        }
+    }
+
+    for(i=0; i<PRIMITIVE_NUM(primitive_match_len); i++){
+        primitive_match_init(c, primitive_match_len[i]);
+        for(j=0; j<PRIMITIVE_NUM(primitive_match_field_num); j++){
+            c->field_num = primitive_match_field_num[j];
+            primitive_case(arg, "match_per_entry", loop_match_per_entry, c);
+        }
+
+        /* The first field misses, so one field is compared. */
+        c->key_buf[0][0] ^= 0x1;
+        c->field_num = POF_MAX_MATCH_FIELD_NUM;
+        primitive_case(arg, "match_per_entry_miss", loop_match_per_entry, c);
+    }
+
+    c->header.version = POF_VERSION;
+    c->header.type = POFT_HELLO;
+    c->header.length = sizeof(pof_header);
+    c->header.xid = 1;
+    c->offset_b = 0;
+    c->len_b = sizeof(pof_header) * POF_BITNUM_IN_BYTE;
+    c->field_num = 0;
+    primitive_case(arg, "header_transfer", loop_header_transfer, c);
+
+    c->packet_in.buffer_id = 0xffffffff;
+    c->packet_in.total_len = 64;
+    c->packet_in.device_id = 1;
+    c->len_b = sizeof(pof_packet_in) * POF_BITNUM_IN_BYTE;
+    primitive_case(arg, "packet_in_transfer", loop_packet_in_transfer, c);
+
+    primitive_flow_entry_init(c);
+    primitive_case(arg, "flow_entry_transfer", loop_flow_entry_transfer, c);
+
+    fprintf(arg->out, "\n]}\n");
+    return POF_OK;
+}
+
+#endif // POF_DATAPATH_ON
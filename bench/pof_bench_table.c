@@ -0,0 +1,497 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_bench.h"
+#include <malloc.h>
+#include <string.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* The match fields are 16 bits each, back to back from the start of the
+ * packet, so the eight fields make a key of 128 bits. */
+#define TABLE_FIELD_LEN         (16)
+#define TABLE_FIELD_LEN_B       POF_BITNUM_TO_BYTENUM_CEIL(TABLE_FIELD_LEN)
+#define TABLE_FIELD_NUM_DEFAULT (2)
+#define TABLE_PACKET_LEN        (POF_MAX_MATCH_FIELD_NUM * TABLE_FIELD_LEN_B)
+
+/* Keys looked up in turn. Each one is made from a random entry. */
+#define TABLE_KEY_NUM           (256)
+
+/* Entries of the sweeps other than the entries sweep, and the fewest
+ * lookups in one round. */
+#define TABLE_SWEEP_ENTRY_MAX   (1024)
+#define TABLE_LOOKUP_MIN        (1000)
+
+/* Tries to make an entry which is not the same as any one before. */
+#define TABLE_ENTRY_TRY_MAX     (64)
+
+static const uint8_t table_field_num[] = {1, 2, 4, 8};
+#define TABLE_NUM(array) (sizeof(array) / sizeof((array)[0]))
+
+/* Masks of the entries. The prefix masks cover the last field with 16, 12,
+ * 8 and 4 bits in turn, as the routes of LPM table.
+ * TABLE_MASK(NAME) */
+#define TABLE_MASKS         \
+    TABLE_MASK(exact)       \
+    TABLE_MASK(prefix)      \
+    TABLE_MASK(random)
+
+enum table_mask{
+#define TABLE_MASK(NAME) TABLE_MASK_##NAME,
+    TABLE_MASKS
+#undef TABLE_MASK
+    TABLE_MASK_NUM
+};
+
+static const char *table_mask_str[TABLE_MASK_NUM] = {
+#define TABLE_MASK(NAME) #NAME,
+    TABLE_MASKS
+#undef TABLE_MASK
+};
+
+/* Priorities of the entries, in the order of the indexes.
+ * TABLE_PRIORITY(NAME) */
+#define TABLE_PRIORITIES            \
+    TABLE_PRIORITY(same)            \
+    TABLE_PRIORITY(ascending)       \
+    TABLE_PRIORITY(descending)      \
+    TABLE_PRIORITY(random)
+
+enum table_priority{
+#define TABLE_PRIORITY(NAME) TABLE_PRIORITY_##NAME,
+    TABLE_PRIORITIES
+#undef TABLE_PRIORITY
+    TABLE_PRIORITY_NUM
+};
+
+static const char *table_priority_str[TABLE_PRIORITY_NUM] = {
+#define TABLE_PRIORITY(NAME) #NAME,
+    TABLE_PRIORITIES
+#undef TABLE_PRIORITY
+};
+
+/* One case of the sweeps. */
+struct table_case{
+    const char *sweep;
+    uint8_t  type;
+    uint32_t entry_num;
+    uint8_t  field_num;
+    uint32_t mask;
+    uint32_t priority;
+};
+
+struct table_ctx{
+    const struct pofbench_arg *arg;
+    uint32_t seed;
+    pofbf_rcu_reader *reader;
+
+    poflr_flow_table *table;
+    uint8_t  field_num;
+    pof_match match[POF_MAX_MATCH_FIELD_NUM];
+
+    uint8_t  packet[TABLE_KEY_NUM][TABLE_PACKET_LEN];
+    uint32_t index[TABLE_KEY_NUM];          /* Entry indexes of DT. */
+    uint8_t  key_buf[POF_MAX_MATCH_FIELD_NUM][POF_MAX_FIELD_LENGTH_IN_BYTE];
+    uint8_t  *key[POF_MAX_MATCH_FIELD_NUM];
+
+    /* Signatures of the entries added, hashed by priority and masked
+     * match as the table finds the same entry. Zero is empty. */
+    uint64_t *sig;
+    uint32_t sig_mask;
+};
+
+/* Xorshift, as the entries take every byte of it. */
+static uint32_t table_rand(struct table_ctx *c){
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 17;
+    c->seed ^= c->seed << 5;
+    return c->seed;
+}
+
+static uint64_t table_sig(const pof_flow_entry *e){
+    uint64_t h = 14695981039346656037ULL;
+    uint32_t i, j;
+
+    h = (h ^ e->priority) * 1099511628211ULL;
+    for(i=0; i<e->match_field_num; i++){
+        for(j=0; j<TABLE_FIELD_LEN_B; j++){
+            h = (h ^ (e->match[i].value[j] & e->match[i].mask[j])) * 1099511628211ULL;
+        }
+    }
+    return h ? h : 1;
+}
+
+/* Insert the signature of the entry. Return FALSE if it is there. */
+static uint32_t table_sig_insert(struct table_ctx *c, const pof_flow_entry *e){
+    uint64_t s = table_sig(e);
+    uint32_t i = (uint32_t)s & c->sig_mask;
+
+    for(; c->sig[i] != 0; i = (i + 1) & c->sig_mask){
+        if(c->sig[i] == s){
+            return FALSE;
+        }
+    }
+    c->sig[i] = s;
+    return TRUE;
+}
+
+static uint16_t table_priority(struct table_ctx *c, const struct table_case *tc, uint32_t j){
+    switch(tc->priority){
+        case TABLE_PRIORITY_ascending:
+            return (uint16_t)j;
+        case TABLE_PRIORITY_descending:
+            return (uint16_t)(tc->entry_num - j);
+        case TABLE_PRIORITY_random:
+            return (uint16_t)table_rand(c);
+        case TABLE_PRIORITY_same:
+        default:
+            return 1;
+    }
+}
+
+/* Fill the match of the entry j with random values under the mask of
+ * the case. */
+static void table_entry_init(struct table_ctx *c, const struct table_case *tc, \
+                             pof_flow_entry *e, uint32_t j)
+{
+    pof_match_x *m;
+    uint32_t k, b, prefix;
+
+    memset(e, 0, sizeof(*e));
+    e->command = POFFC_ADD;
+    e->table_id = 0;
+    e->table_type = tc->type;
+    e->priority = table_priority(c, tc, j);
+    e->index = j;
+    if(tc->type == POF_LINEAR_TABLE){
+        return;
+    }
+
+    e->match_field_num = tc->field_num;
+    for(k=0; k<tc->field_num; k++){
+        m = &e->match[k];
+        m->field_id = c->match[k].field_id;
+        m->offset = c->match[k].offset;
+        m->len = c->match[k].len;
+        for(b=0; b<TABLE_FIELD_LEN_B; b++){
+            m->value[b] = (uint8_t)table_rand(c);
+            m->mask[b] = 0xff;
+        }
+        if(tc->mask == TABLE_MASK_random){
+            for(b=0; b<TABLE_FIELD_LEN_B; b++){
+                m->mask[b] = (uint8_t)table_rand(c);
+            }
+        }else if(tc->mask == TABLE_MASK_prefix && k + 1 == tc->field_num){
+            prefix = TABLE_FIELD_LEN - (j % 4) * 4;
+            for(b=0; b<TABLE_FIELD_LEN_B; b++){
+                m->mask[b] = (prefix >= (b + 1) * 8) ? 0xff : \
+                             (prefix <= b * 8) ? 0 : (uint8_t)(0xff << ((b + 1) * 8 - prefix));
+            }
+        }
+        for(b=0; b<TABLE_FIELD_LEN_B; b++){
+            m->value[b] &= m->mask[b];
+        }
+    }
+    return;
+}
+
+/* Create the table of the case and fill it. */
+static uint32_t table_fill(struct table_ctx *c, const struct table_case *tc){
+    pof_flow_entry *e;
+    uint32_t j, t, ret;
+
+    if(tc->type == POF_LINEAR_TABLE){
+        ret = poflr_create_flow_table(0, tc->type, 0, tc->entry_num, "bench", 0, c->match);
+    }else{
+        ret = poflr_create_flow_table(0, tc->type, tc->field_num * TABLE_FIELD_LEN, tc->entry_num, \
+                                      "bench", tc->field_num, c->match);
+    }
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    for(c->sig_mask=1; c->sig_mask<tc->entry_num*2; c->sig_mask<<=1);
+    c->sig = calloc(c->sig_mask, sizeof(uint64_t));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(c->sig);
+    c->sig_mask--;
+
+    e = malloc(sizeof(*e));
+    if(e == NULL){
+        free(c->sig);
+        POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(e);
+    }
+
+    ret = POF_OK;
+    for(j=0; ret==POF_OK && j<tc->entry_num; j++){
+        for(t=0; t<TABLE_ENTRY_TRY_MAX; t++){
+            table_entry_init(c, tc, e, j);
+            if(tc->type == POF_LINEAR_TABLE || table_sig_insert(c, e) == TRUE){
+                break;
+            }
+        }
+        if(t == TABLE_ENTRY_TRY_MAX){
+            fprintf(stderr, "No more distinct entries of %u fields with %s masks.\n", \
+                    tc->field_num, table_mask_str[tc->mask]);
+            ret = POF_ERROR;
+            break;
+        }
+        ret = poflr_add_flow_entry(e);
+    }
+
+    free(e);
+    free(c->sig);
+    c->sig = NULL;
+    if(ret != POF_OK){
+        return POF_ERROR;
+    }
+    return poflr_get_flow_table(&c->table, tc->type, 0);
+}
+
+/* Make the keys from random entries, with random bits where the entries
+ * do not care. */
+static void table_key_init(struct table_ctx *c, const struct table_case *tc){
+    poflr_flow_entry *entry_ptr;
+    pof_match_x *m;
+    uint32_t i, k, b;
+
+    for(i=0; i<TABLE_KEY_NUM; i++){
+        c->index[i] = table_rand(c) % tc->entry_num;
+        entry_ptr = c->table->entry_ptr[c->index[i]];
+        for(k=0; tc->type!=POF_LINEAR_TABLE && k<tc->field_num; k++){
+            m = &entry_ptr->entry.match[k];
+            for(b=0; b<TABLE_FIELD_LEN_B; b++){
+                c->packet[i][k * TABLE_FIELD_LEN_B + b] = m->value[b] | \
+                        ((uint8_t)table_rand(c) & ~m->mask[b]);
+            }
+        }
+    }
+    return;
+}
+
+static void loop_lookup(void *arg, uint32_t num){
+    struct table_ctx *c = arg;
+    pof_flow_entry *entry;
+    uint32_t i, hit = 0;
+
+    for(i=0; i<num; i++){
+        pofdp_find_key(c->packet[i % TABLE_KEY_NUM], NULL, c->key, c->field_num, c->match);
+        POFBF_RCU_READ_LOCK(c->reader);
+        if(pofdp_lookup_in_table(c->key, c->field_num, c->table, &entry) == POF_OK){
+            hit++;
+        }
+        POFBF_RCU_READ_UNLOCK(c->reader);
+    }
+    pofbench_sink += hit;
+    return;
+}
+
+static void loop_lookup_direct(void *arg, uint32_t num){
+    struct table_ctx *c = arg;
+    pof_flow_entry *entry;
+    uint32_t i, hit = 0;
+
+    for(i=0; i<num; i++){
+        POFBF_RCU_READ_LOCK(c->reader);
+        if(pofdp_lookup_direct(c->table, c->index[i % TABLE_KEY_NUM], &entry) == POF_OK){
+            hit++;
+        }
+        POFBF_RCU_READ_UNLOCK(c->reader);
+    }
+    pofbench_sink += hit;
+    return;
+}
+
+/* Fill the table of the case, time the lookups and write one line. */
+static uint32_t table_case_run(struct table_ctx *c, const struct table_case *tc){
+    struct pofbench_arg case_arg = *c->arg;
+    struct pofbench_result res;
+    pofbench_loop loop;
+    size_t mem;
+    uint32_t ret, hit;
+
+    c->field_num = (tc->type == POF_LINEAR_TABLE) ? 0 : tc->field_num;
+    mem = mallinfo2().uordblks;
+    ret = table_fill(c, tc);
+    mem = mallinfo2().uordblks - mem;
+    if(ret != POF_OK){
+        poflr_empty_flow_table();
+        return ret;
+    }
+    table_key_init(c, tc);
+
+    /* Every lookup of the keyed tables scans the whole table, so the
+     * larger ones take fewer lookups a round. */
+    loop = (tc->type == POF_LINEAR_TABLE) ? loop_lookup_direct : loop_lookup;
+    case_arg.iteration = c->arg->iteration / tc->entry_num;
+    if(tc->type == POF_LINEAR_TABLE || case_arg.iteration < TABLE_LOOKUP_MIN){
+        case_arg.iteration = (tc->type == POF_LINEAR_TABLE) ? c->arg->iteration : TABLE_LOOKUP_MIN;
+    }
+
+    hit = (uint32_t)pofbench_sink;
+    loop(c, TABLE_KEY_NUM);
+    hit = (uint32_t)pofbench_sink - hit;
+    pofbench_run(&case_arg, loop, c, &res);
+
+    fprintf(c->arg->out, "%s,%s,%u,%u,%s,%s,%u,%.2f,%.2f,", \
+            pofbench_table_type_str[tc->type], tc->sweep, tc->entry_num, c->field_num, \
+            (tc->type == POF_LINEAR_TABLE) ? "" : table_mask_str[tc->mask], \
+            table_priority_str[tc->priority], case_arg.iteration, res.median, res.min);
+    if(tc->type == POF_LINEAR_TABLE){
+        fprintf(c->arg->out, ",");
+    }else{
+        fprintf(c->arg->out, "%.4f,", res.median / tc->entry_num);
+    }
+    fprintf(c->arg->out, "%.3f,%.1f\n", (double)hit / TABLE_KEY_NUM, (double)mem / tc->entry_num);
+    fflush(c->arg->out);
+
+    return poflr_empty_flow_table();
+}
+
+/* Sweep one dimension of the cases of the type, from the default case. */
+static uint32_t table_sweep(struct table_ctx *c, uint8_t type){
+    struct table_case tc, base = {NULL, type, 0, TABLE_FIELD_NUM_DEFAULT, \
+                                  TABLE_MASK_exact, TABLE_PRIORITY_same};
+    uint32_t entry_max = c->arg->entry_num, i, n, ret = POF_OK;
+
+    /* Table size. */
+    for(n=16; ret==POF_OK; n*=4){
+        tc = base;
+        tc.sweep = "entries";
+        tc.entry_num = (n < entry_max) ? n : entry_max;
+        ret = table_case_run(c, &tc);
+        if(n >= entry_max){
+            break;
+        }
+    }
+    if(type == POF_LINEAR_TABLE){
+        return ret;
+    }
+    base.entry_num = (entry_max < TABLE_SWEEP_ENTRY_MAX) ? entry_max : TABLE_SWEEP_ENTRY_MAX;
+
+    /* Match field number. */
+    for(i=0; ret==POF_OK && i<TABLE_NUM(table_field_num); i++){
+        tc = base;
+        tc.sweep = "fields";
+        tc.field_num = table_field_num[i];
+        ret = table_case_run(c, &tc);
+    }
+
+    /* Mask diversity. */
+    for(i=0; ret==POF_OK && i<TABLE_MASK_NUM; i++){
+        tc = base;
+        tc.sweep = "mask";
+        tc.mask = i;
+        ret = table_case_run(c, &tc);
+    }
+
+    /* Priority distribution, over the overlapping random masks. */
+    for(i=0; ret==POF_OK && i<TABLE_PRIORITY_NUM; i++){
+        tc = base;
+        tc.sweep = "priority";
+        tc.mask = TABLE_MASK_random;
+        tc.priority = i;
+        ret = table_case_run(c, &tc);
+    }
+    return ret;
+}
+
+/***********************************************************************
+ * Run the benchmark of the flow table lookup.
+ * Form:     uint32_t pofbench_table(const struct pofbench_arg *arg)
+ * Input:    arguments
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function fills one table of each type in
+ *           arg->table_type, and times the lookup of the keys made from
+ *           its entries. From the default case of 2 fields, exact masks
+ *           and the same priority, it sweeps the entry number up to
+ *           arg->entry_num, the match field number, the mask and the
+ *           priority distribution one at a time. The linear table is
+ *           only swept by size, as it is indexed directly. It writes one
+ *           CSV line each case with the nanoseconds per lookup, the hit
+ *           ratio of the keys, and the heap bytes per entry.
+ ***********************************************************************/
+uint32_t pofbench_table(const struct pofbench_arg *arg){
+    struct pofbench_arg table_arg = *arg;
+    struct table_ctx *c;
+    uint8_t types[POFBENCH_TABLE_MAX];
+    uint32_t i, type_num, ret;
+
+    if(table_arg.entry_num == 0){
+        table_arg.entry_num = POFBENCH_TABLE_ENTRY_DEFAULT;
+    }
+    if(table_arg.table_type == NULL){
+        table_arg.table_type = POFBENCH_TABLE_TABLE_TYPE_DEFAULT;
+    }
+    arg = &table_arg;
+
+    if(pofbench_table_type_parse(arg->table_type, types, &type_num) != POF_OK){
+        return POF_ERROR;
+    }
+
+    c = calloc(1, sizeof(*c));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(c);
+    c->arg = arg;
+    c->seed = 1;
+    for(i=0; i<POF_MAX_MATCH_FIELD_NUM; i++){
+        c->match[i].field_id = i;
+        c->match[i].offset = i * TABLE_FIELD_LEN;
+        c->match[i].len = TABLE_FIELD_LEN;
+        c->key[i] = c->key_buf[i];
+    }
+
+    /* Only the errors are printed, so the result stays parsable. */
+    poflp_set_level(POFLP_CATEGORY_ALL, POFLP_OFF);
+    if(arg->entry_num > POFLR_FLOW_TABLE_SIZE){
+        poflr_set_flow_table_size(arg->entry_num);
+    }
+    ret = poflr_init_table_resource();
+    if(ret == POF_OK){
+        c->reader = pofbf_rcu_register();
+        if(c->reader == NULL){
+            ret = POF_ERROR;
+        }
+    }
+    if(ret != POF_OK){
+        free(c);
+        return ret;
+    }
+
+    fprintf(arg->out, "type,sweep,entries,fields,mask,priority,lookups,ns_per_lookup," \
+            "ns_per_lookup_min,ns_per_entry,hit_ratio,mem_per_entry_B\n");
+    for(i=0; ret==POF_OK && i<type_num; i++){
+        ret = table_sweep(c, types[i]);
+    }
+
+    pofbf_rcu_unregister(c->reader);
+    free(c);
+    return ret;
+}
+
+#endif // POF_DATAPATH_ON
@@ -36,6 +36,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <sched.h>
 
 /* Define pofbf_key to build queue using ftok function. */
 static key_t pofbf_key = 0;
@@ -203,12 +205,13 @@ uint32_t pofbf_queue_read(uint32_t queue_id, void *buf, uint32_t max_len, int ti
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg_ptr);
 
     /* Receive the messsage from the message queue. */
-    if(-1 == (len = msgrcv(queue_id, msg_ptr, max_len + sizeof(struct msg), POF_MSGTYPE_ANY, timeout))){
+    /* The size of the message excludes mtype. */
+    if(-1 == (len = msgrcv(queue_id, msg_ptr, max_len, POF_MSGTYPE_ANY, timeout))){
         free(msg_ptr);
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_READ_MSG_QUEUE_FAILURE);
     }
 
-    memcpy(buf, msg_ptr->mdata, len - sizeof(struct msg));
+    memcpy(buf, msg_ptr->mdata, len);
 
     free(msg_ptr);
     return POF_OK;
@@ -251,7 +254,7 @@ uint32_t pofbf_queue_write(uint32_t queue_id, const void *message, uint32_t msg_
     msg_ptr->mtype = POF_MSGTYPE;
     memcpy(msg_ptr->mdata, message, msg_len);
 
-    if(-1 == msgsnd(queue_id, msg_ptr, msg_len+sizeof(struct msg), timeout)){
+    if(-1 == msgsnd(queue_id, msg_ptr, msg_len, timeout)){
         free(msg_ptr);
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
     }
@@ -261,6 +264,456 @@ uint32_t pofbf_queue_write(uint32_t queue_id, const void *message, uint32_t msg_
     return POF_OK;
 }
 
+/***********************************************************************
+ * Get the depth of the message queue.
+ * Form:     uint32_t pofbf_queue_depth(uint32_t queue_id, \
+ *                                      uint32_t *msg_num_ptr, \
+ *                                      uint32_t *byte_num_ptr)
+ * Input:    queue id
+ * Output:   number of messages and bytes waiting in the queue
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function reads the state of the message queue, which
+ *           does not disturb the tasks reading and writing it.
+ ***********************************************************************/
+uint32_t pofbf_queue_depth(uint32_t queue_id, uint32_t *msg_num_ptr, uint32_t *byte_num_ptr){
+    struct msqid_ds ds;
+
+    if(queue_id == POF_INVALID_QUEUEID || msgctl(queue_id, IPC_STAT, &ds) == -1){
+        *msg_num_ptr = 0;
+        *byte_num_ptr = 0;
+        return POF_ERROR;
+    }
+
+    *msg_num_ptr = ds.msg_qnum;
+    *byte_num_ptr = ds.msg_cbytes;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Allocate a message buffer.
+ * Form:     pofbf_msg *pofbf_msg_alloc(uint32_t len)
+ * Input:    data length
+ * Output:   NONE
+ * Return:   message buffer, or NULL if fail to malloc
+ * Discribe: This function allocates a message buffer holding len bytes
+ *           of data. The caller holds the only reference.
+ ***********************************************************************/
+pofbf_msg *pofbf_msg_alloc(uint32_t len){
+    pofbf_msg *msg;
+
+    msg = (pofbf_msg *)malloc(sizeof(pofbf_msg) + len);
+    if(msg == NULL){
+        return NULL;
+    }
+    msg->next = NULL;
+    msg->ref = 1;
+    msg->len = len;
+    return msg;
+}
+
+/* Take one more reference of the message buffer. */
+void pofbf_msg_hold(pofbf_msg *msg){
+    __sync_fetch_and_add(&msg->ref, 1);
+}
+
+/* Release one reference of the message buffer, and free it if it is
+ * the last one. */
+void pofbf_msg_release(pofbf_msg *msg){
+    if(__sync_sub_and_fetch(&msg->ref, 1) == 0){
+        free(msg);
+    }
+}
+
+/***********************************************************************
+ * Initialize a message buffer queue.
+ * Form:     uint32_t pofbf_msg_queue_init(pofbf_msg_queue *queue, \
+ *                                         uint32_t byte_max)
+ * Input:    queue, max bytes of the droppable messages
+ * Output:   queue
+ * Return:   POF_OK or Error code
+ * Discribe: This function initializes an empty queue. Its head and tail
+ *           both point to the stub.
+ ***********************************************************************/
+uint32_t pofbf_msg_queue_init(pofbf_msg_queue *queue, uint32_t byte_max){
+    memset(queue, 0, sizeof(pofbf_msg_queue));
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+    queue->byte_max = byte_max;
+
+    if(sem_init(&queue->sem, 0, 0) != 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_CREATE_FAIL);
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Destroy a message buffer queue.
+ * Form:     uint32_t pofbf_msg_queue_destroy(pofbf_msg_queue *queue)
+ * Input:    queue
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function releases the messages left in the queue. No
+ *           one should push or pop any more.
+ ***********************************************************************/
+uint32_t pofbf_msg_queue_destroy(pofbf_msg_queue *queue){
+    pofbf_msg *msg;
+
+    while((msg = pofbf_msg_queue_pop(queue, POF_NO_WAIT)) != NULL){
+        pofbf_msg_release(msg);
+    }
+    sem_destroy(&queue->sem);
+    return POF_OK;
+}
+
+/* Link the message at the head of the queue. The exchange orders the
+ * producers, and the previous head is linked to the message after it.
+ * The consumer does not see the message until the link is done. */
+static void pofbf_msg_queue_link(pofbf_msg_queue *queue, pofbf_msg *msg){
+    pofbf_msg *prev;
+
+    msg->next = NULL;
+    prev = __atomic_exchange_n(&queue->head, msg, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+/* Unlink the message at the tail of the queue. Return NULL if the queue
+ * is empty, or the next message is still being linked by a producer. */
+static pofbf_msg *pofbf_msg_queue_unlink(pofbf_msg_queue *queue){
+    pofbf_msg *tail = queue->tail;
+    pofbf_msg *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    /* Skip the stub. */
+    if(tail == &queue->stub){
+        if(next == NULL){
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if(next != NULL){
+        queue->tail = next;
+        return tail;
+    }
+
+    /* The tail is the last one if no producer has passed it. Then link
+     * the stub behind it, so the tail can be taken out. */
+    if(tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+    pofbf_msg_queue_link(queue, &queue->stub);
+
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(next != NULL){
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ * Push message into queue.
+ * Form:     uint32_t pofbf_msg_queue_push(pofbf_msg_queue *queue, \
+ *                                         pofbf_msg *msg, \
+ *                                         uint8_t droppable)
+ * Input:    queue, message, whether the message can be dropped
+ * Output:   NONE
+ * Return:   POF_OK, or POF_ERROR if the message is dropped
+ * Discribe: This function passes the reference of the message to the
+ *           queue. It never waits. If the bytes in queue exceed the
+ *           byte_max, the droppable message is dropped and counted
+ *           instead. The other messages are always queued, and the
+ *           producers of them should slow down by checking byte_num.
+ ***********************************************************************/
+uint32_t pofbf_msg_queue_push(pofbf_msg_queue *queue, pofbf_msg *msg, uint8_t droppable){
+    uint32_t byte_num;
+
+    byte_num = __sync_add_and_fetch(&queue->byte_num, msg->len);
+    if(droppable && byte_num > queue->byte_max){
+        __sync_sub_and_fetch(&queue->byte_num, msg->len);
+        __sync_fetch_and_add(&queue->drop_msg, 1);
+        __sync_fetch_and_add(&queue->drop_byte, msg->len);
+        pofbf_msg_release(msg);
+        return POF_ERROR;
+    }
+    __sync_fetch_and_add(&queue->msg_num, 1);
+
+    pofbf_msg_queue_link(queue, msg);
+    sem_post(&queue->sem);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Pop message from queue.
+ * Form:     pofbf_msg *pofbf_msg_queue_pop(pofbf_msg_queue *queue, \
+ *                                        int timeout)
+ * Input:    queue, timeout mode
+ * Output:   NONE
+ * Return:   message, or NULL if the queue is empty with POF_NO_WAIT
+ * Discribe: This function pops the oldest message. The caller takes the
+ *           reference of the message. Only one task can pop from one
+ *           queue.
+ ***********************************************************************/
+pofbf_msg *pofbf_msg_queue_pop(pofbf_msg_queue *queue, int timeout){
+    pofbf_msg *msg;
+
+    if(timeout == POF_NO_WAIT){
+        if(sem_trywait(&queue->sem) != 0){
+            return NULL;
+        }
+    }else{
+        while(sem_wait(&queue->sem) != 0){
+            if(errno != EINTR){
+                return NULL;
+            }
+        }
+    }
+
+    /* The message counted by the semaphore is linked, but the producer
+     * before it may be still linking its own one. */
+    while((msg = pofbf_msg_queue_unlink(queue)) == NULL){
+        sched_yield();
+    }
+    __sync_fetch_and_sub(&queue->msg_num, 1);
+    __sync_fetch_and_sub(&queue->byte_num, msg->len);
+
+    msg->next = NULL;
+    return msg;
+}
+
+/* Readers and the objects waiting to be freed, in the order of their
+ * retire epoch. The epoch starts from 1 since 0 marks the idle reader. */
+typedef struct pofbf_rcu_node{
+    struct pofbf_rcu_node *next;
+    uint64_t epoch;             /* Epoch when the object was retired. */
+    void *ptr;
+    void (*free_func)(void *);
+} pofbf_rcu_node;
+
+volatile uint64_t pofbf_rcu_epoch = 1;
+static pofbf_rcu_reader pofbf_rcu_readers[POFBF_RCU_READER_MAX];
+static pofbf_rcu_node *pofbf_rcu_head = NULL;
+static pofbf_rcu_node *pofbf_rcu_tail = NULL;
+
+/* The oldest epoch marked by the readers, or UINT64_MAX if no reader
+ * is in the read-side section. */
+static uint64_t pofbf_rcu_oldest(){
+    uint64_t oldest = UINT64_MAX, epoch;
+    uint32_t i;
+
+    __sync_synchronize();
+    for(i=0; i<POFBF_RCU_READER_MAX; i++){
+        epoch = pofbf_rcu_readers[i].epoch;
+        if(epoch != 0 && epoch < oldest){
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+/***********************************************************************
+ * Register a reader.
+ * Form:     pofbf_rcu_reader *pofbf_rcu_register()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   reader, or NULL if there are too many readers
+ * Discribe: Each task reading the shared objects without lock registers
+ *           its own reader, and marks it with POFBF_RCU_READ_LOCK and
+ *           POFBF_RCU_READ_UNLOCK around the reading.
+ ***********************************************************************/
+pofbf_rcu_reader *pofbf_rcu_register(){
+    uint32_t i;
+
+    for(i=0; i<POFBF_RCU_READER_MAX; i++){
+        if(__sync_bool_compare_and_swap(&pofbf_rcu_readers[i].used, 0, 1)){
+            pofbf_rcu_readers[i].epoch = 0;
+            return &pofbf_rcu_readers[i];
+        }
+    }
+    return NULL;
+}
+
+/* Unregister the reader, which must be out of the read-side section. */
+void pofbf_rcu_unregister(pofbf_rcu_reader *reader){
+    reader->epoch = 0;
+    __atomic_store_n(&reader->used, 0, __ATOMIC_RELEASE);
+}
+
+/***********************************************************************
+ * Free the retired objects no reader can hold.
+ * Form:     void pofbf_rcu_reclaim()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function frees the retired objects whose retire epoch
+ *           is older than the epoch of every reader in the read-side
+ *           section. The writer calls it with the same serialization as
+ *           pofbf_rcu_retire.
+ ***********************************************************************/
+void pofbf_rcu_reclaim(){
+    pofbf_rcu_node *node;
+    uint64_t oldest;
+
+    if(pofbf_rcu_head == NULL){
+        return;
+    }
+
+    oldest = pofbf_rcu_oldest();
+    while((node = pofbf_rcu_head) != NULL && node->epoch < oldest){
+        pofbf_rcu_head = node->next;
+        node->free_func(node->ptr);
+        free(node);
+    }
+    if(pofbf_rcu_head == NULL){
+        pofbf_rcu_tail = NULL;
+    }
+    return;
+}
+
+/* Wait until every reader has left the read-side section it was in. */
+void pofbf_rcu_synchronize(){
+    uint64_t epoch = __sync_fetch_and_add(&pofbf_rcu_epoch, 1);
+
+    while(pofbf_rcu_oldest() <= epoch){
+        sched_yield();
+    }
+    return;
+}
+
+/***********************************************************************
+ * Retire a shared object.
+ * Form:     uint32_t pofbf_rcu_retire(void *ptr, void (*free_func)(void *))
+ * Input:    object, function to free the object
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: The object must have been unpublished, so no reader can
+ *           find it any more. It is freed by free_func once the readers
+ *           which may still hold it have left the read-side section.
+ *           If no node can be allocated, this function waits for the
+ *           readers and frees the object at once.
+ ***********************************************************************/
+uint32_t pofbf_rcu_retire(void *ptr, void (*free_func)(void *)){
+    pofbf_rcu_node *node;
+
+    node = (pofbf_rcu_node *)malloc(sizeof(pofbf_rcu_node));
+    if(node == NULL){
+        pofbf_rcu_synchronize();
+        free_func(ptr);
+        return POF_OK;
+    }
+    node->next = NULL;
+    node->ptr = ptr;
+    node->free_func = free_func;
+    node->epoch = __sync_fetch_and_add(&pofbf_rcu_epoch, 1);
+
+    if(pofbf_rcu_tail == NULL){
+        pofbf_rcu_head = node;
+    }else{
+        pofbf_rcu_tail->next = node;
+    }
+    pofbf_rcu_tail = node;
+
+    pofbf_rcu_reclaim();
+    return POF_OK;
+}
+
+/* Value of the key of the thread which can not get a slot. */
+static char pofbf_thread_slot_none;
+
+/* Free the slot of the exiting thread. The data is kept for the next
+ * thread. */
+static void pofbf_thread_slot_free(void *value){
+    pofbf_thread_slot *slot = (pofbf_thread_slot *)value;
+
+    if(value != &pofbf_thread_slot_none){
+        __atomic_store_n(&slot->used, FALSE, __ATOMIC_RELEASE);
+    }
+    return;
+}
+
+/* Take a freed slot, or a new one with new data. It is called with the
+ * mutex of the slots. */
+static pofbf_thread_slot *pofbf_thread_slot_alloc(pofbf_thread_slots *slots){
+    pofbf_thread_slot *slot;
+    uint32_t i, num = slots->num;
+    void *data;
+
+    for(i=0; i<num; i++){
+        slot = &slots->slot[i];
+        if(__atomic_load_n(&slot->used, __ATOMIC_ACQUIRE) == FALSE){
+            slot->used = TRUE;
+            return slot;
+        }
+    }
+
+    if(num >= POFBF_THREAD_SLOT_MAX || (data = malloc(slots->size)) == NULL){
+        return NULL;
+    }
+    memset(data, 0, slots->size);
+    if(slots->init_func != NULL){
+        slots->init_func(data);
+    }
+
+    slot = &slots->slot[num];
+    slot->data = data;
+    slot->used = TRUE;
+    __atomic_store_n(&slots->num, num + 1, __ATOMIC_RELEASE);
+    return slot;
+}
+
+/***********************************************************************
+ * Get the slot of the calling thread.
+ * Form:     void *pofbf_thread_slot_get(pofbf_thread_slots *slots)
+ * Input:    slots
+ * Output:   NONE
+ * Return:   data of the slot, or NULL if the thread can not get a slot
+ * Discribe: The thread gets a slot the first time it calls this function,
+ *           and the slot is freed by the destructor of the key when the
+ *           thread exits. Only the thread writes the data of the slot.
+ *           A thread which failed to get a slot does not try again. The
+ *           caller may keep the data in a thread local variable.
+ ***********************************************************************/
+void *pofbf_thread_slot_get(pofbf_thread_slots *slots){
+    pofbf_thread_slot *slot;
+    void *value;
+
+    if(__atomic_load_n(&slots->key_created, __ATOMIC_ACQUIRE) == TRUE){
+        value = pthread_getspecific(slots->key);
+        if(value == &pofbf_thread_slot_none){
+            return NULL;
+        }else if(value != NULL){
+            return ((pofbf_thread_slot *)value)->data;
+        }
+    }
+
+    pthread_mutex_lock(&slots->mutex);
+    if(slots->key_created == FALSE){
+        if(pthread_key_create(&slots->key, pofbf_thread_slot_free) != 0){
+            pthread_mutex_unlock(&slots->mutex);
+            return NULL;
+        }
+        __atomic_store_n(&slots->key_created, TRUE, __ATOMIC_RELEASE);
+    }
+    slot = pofbf_thread_slot_alloc(slots);
+    pthread_mutex_unlock(&slots->mutex);
+
+    if(slot != NULL && pthread_setspecific(slots->key, slot) != 0){
+        pofbf_thread_slot_free(slot);
+        slot = NULL;
+    }
+    if(slot == NULL){
+        (void)pthread_setspecific(slots->key, &pofbf_thread_slot_none);
+        return NULL;
+    }
+    return slot->data;
+}
+
+/* Number of the slots with data. */
+uint32_t pofbf_thread_slot_num(pofbf_thread_slots *slots){
+    return __atomic_load_n(&slots->num, __ATOMIC_ACQUIRE);
+}
+
 /***********************************************************************
  * Create timer.
  * Form:     uint32_t pofbf_timer_create(uint32_t delay, \
@@ -150,6 +150,83 @@ uint32_t pof_NtoH_transfer_counter(void *ptr){
     return POF_OK;
 }
 
+uint32_t pof_NtoH_transfer_multipart(void *ptr){
+    pof_multipart *p = (pof_multipart *)ptr;
+
+    POF_NTOHS_FUNC(p->type);
+    POF_NTOHS_FUNC(p->flags);
+
+    return POF_OK;
+}
+
+uint32_t pof_NtoH_transfer_counter_multipart_request(void *ptr){
+    pof_counter_multipart_request *p = (pof_counter_multipart_request *)ptr;
+
+    POF_NTOHL_FUNC(p->counter_id);
+    POF_NTOHL_FUNC(p->counter_num);
+
+    return POF_OK;
+}
+
+uint32_t pof_NtoH_transfer_port_stats_multipart_request(void *ptr){
+    pof_port_stats_multipart_request *p = (pof_port_stats_multipart_request *)ptr;
+
+    POF_NTOHL_FUNC(p->port_id);
+
+    return POF_OK;
+}
+
+uint32_t pof_HtoN_transfer_port_stats(void *ptr){
+    pof_port_stats *p = (pof_port_stats *)ptr;
+
+    POF_HTONL_FUNC(p->port_id);
+    POF_HTON64_FUNC(p->rx_packets);
+    POF_HTON64_FUNC(p->tx_packets);
+    POF_HTON64_FUNC(p->rx_bytes);
+    POF_HTON64_FUNC(p->tx_bytes);
+    POF_HTON64_FUNC(p->rx_dropped);
+    POF_HTON64_FUNC(p->tx_dropped);
+    POF_HTON64_FUNC(p->rx_errors);
+    POF_HTON64_FUNC(p->tx_errors);
+    POF_HTON64_FUNC(p->rx_disabled_dropped);
+    POF_HTON64_FUNC(p->rx_mtu_dropped);
+    POF_HTON64_FUNC(p->rx_filter_dropped);
+    POF_HTON64_FUNC(p->rx_queue_dropped);
+    POF_HTON64_FUNC(p->tx_mtu_dropped);
+    POF_HTON64_FUNC(p->tx_queue_dropped);
+
+    return POF_OK;
+}
+
+uint32_t pof_HtoN_transfer_table_stats(void *ptr){
+    pof_table_stats *p = (pof_table_stats *)ptr;
+
+    POF_HTONL_FUNC(p->active_count);
+    POF_HTON64_FUNC(p->lookup_count);
+    POF_HTON64_FUNC(p->matched_count);
+    POF_HTON64_FUNC(p->missed_count);
+    POF_HTON64_FUNC(p->examined_count);
+
+    return POF_OK;
+}
+
+uint32_t pof_HtoN_transfer_flow_removed(void *ptr){
+    pof_flow_removed *p = (pof_flow_removed *)ptr;
+
+    POF_HTON64_FUNC(p->cookie);
+    POF_HTONS_FUNC(p->priority);
+    POF_HTONL_FUNC(p->index);
+    POF_HTONL_FUNC(p->counter_id);
+    POF_HTONL_FUNC(p->duration_sec);
+    POF_HTONL_FUNC(p->duration_nsec);
+    POF_HTONS_FUNC(p->idle_timeout);
+    POF_HTONS_FUNC(p->hard_timeout);
+    POF_HTON64_FUNC(p->packet_count);
+    POF_HTON64_FUNC(p->byte_count);
+
+    return POF_OK;
+}
+
 uint32_t pof_HtoN_transfer_packet_in(void *ptr){
     pof_packet_in *p = (pof_packet_in *)ptr;
 
@@ -521,3 +598,16 @@ uint32_t pof_NtoH_transfer_group(void *ptr){
 
     return POF_OK;
 }
+
+uint32_t pof_NtoH_transfer_packet_out(void *ptr){
+    pof_packet_out *p = (pof_packet_out *)ptr;
+    int i;
+
+    POF_NTOHL_FUNC(p->buffer_id);
+    POF_NTOHL_FUNC(p->in_port);
+    POF_NTOHL_FUNC(p->packet_len);
+    for(i=0;i<p->action_num && i<POF_MAX_ACTION_NUMBER_PER_INSTRUCTION;i++)
+        action((pof_action *)p->action+i);
+
+    return POF_OK;
+}
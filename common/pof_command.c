@@ -28,6 +28,7 @@
 #include "../include/pof_global.h"
 #include "../include/pof_command.h"
 #include "../include/pof_datapath.h"
+#include "../include/pof_conn.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -42,14 +43,23 @@
 	COMMAND(table_resource)		\
 	COMMAND(ports)				\
 	COMMAND(tables)				\
+	COMMAND(table_stats)		\
+	COMMAND(latency)			\
+	COMMAND(latency_dump)		\
+	COMMAND(enable_latency)		\
+	COMMAND(disable_latency)	\
 	COMMAND(groups)				\
 	COMMAND(meters)				\
 	COMMAND(counters)			\
+	COMMAND(channel)			\
+	COMMAND(packet_in)			\
 	COMMAND(version)			\
 	COMMAND(state)			\
 	COMMAND(clear_resource)		\
 	COMMAND(enable_debug)		\
 	COMMAND(disable_debug)		\
+	COMMAND(log_level)			\
+	COMMAND(trace_dump)			\
 	COMMAND(enable_color)		\
 	COMMAND(disable_color)		\
 	COMMAND(enable_promisc)		\
@@ -92,6 +102,7 @@ usr_cmd_enable_debug()
 {
 	POF_COMMAND_PRINT_HEAD("enable_debug");
 	poflp_debug_enable();
+	poflp_set_level(POFLP_CATEGORY_ALL, POFLP_DEBUG);
     strncpy(g_states.debug_on.cont, "ON", POF_STRING_PAIR_MAX_LEN-1);
 }
 
@@ -100,9 +111,46 @@ usr_cmd_disable_debug()
 {
 	POF_COMMAND_PRINT_HEAD("disable_debug");
 	poflp_debug_disable();
+	poflp_set_level(POFLP_CATEGORY_ALL, POFLP_OFF);
     strncpy(g_states.debug_on.cont, "OFF", POF_STRING_PAIR_MAX_LEN-1);
 }
 
+static void
+usr_cmd_log_level()
+{
+	static const char *category_str[POFLP_CATEGORY_NUM] = {"control", "datapath", "lookup"};
+	static const char *level_str[POFLP_LEVEL_NUM] = {"off", "error", "info", "debug"};
+	uint32_t i;
+
+	POF_COMMAND_PRINT_HEAD("log_level");
+	for(i=0; i<POFLP_CATEGORY_NUM; i++){
+		POF_COMMAND_PRINT(1,CYAN,"%s=", category_str[i]);
+		POF_COMMAND_PRINT(1,WHITE,"%s ", level_str[g_poflp_level[i]]);
+	}
+	POF_COMMAND_PRINT(1,CYAN,"dropped=");
+	POF_COMMAND_PRINT(1,WHITE,"%llu", (unsigned long long)poflp_dropped());
+	POF_COMMAND_PRINT(1,CYAN,"\n");
+}
+
+static void
+usr_cmd_trace_dump()
+{
+	POF_COMMAND_PRINT_HEAD("trace_dump");
+#ifdef POF_DATAPATH_ON
+	uint32_t event_num = 0;
+
+	POF_COMMAND_PRINT(1,CYAN,"sample=");
+	POF_COMMAND_PRINT(1,WHITE,"%u ", g_pofdp_trace_sample);
+	if(pofdp_trace_dump(POFDP_TRACE_FILE_NAME, &event_num) == POF_OK){
+		POF_COMMAND_PRINT(1,CYAN,"events=");
+		POF_COMMAND_PRINT(1,WHITE,"%u ", event_num);
+		POF_COMMAND_PRINT(1,CYAN,"file=");
+		POF_COMMAND_PRINT(1,WHITE,"%s", POFDP_TRACE_FILE_NAME);
+	}
+	POF_COMMAND_PRINT(1,CYAN,"\n");
+#endif // POF_DATAPATH_ON
+}
+
 static void
 usr_cmd_enable_color()
 {
@@ -250,12 +298,12 @@ static void flow_entry_baseinfo(pof_flow_entry *p){
 
 static void flow_entry(poflr_flow_table *poflrft_ptr){
     int entry_num = poflrft_ptr->entry_num;
-    poflr_flow_entry *tmp_vhal_entry_ptr = poflrft_ptr->entry_ptr;
+    poflr_flow_entry **tmp_vhal_entry_ptr = poflrft_ptr->entry_ptr;
     int entry_id, sum = 0;
     for(entry_id=0; sum<entry_num; entry_id++){
-        if(tmp_vhal_entry_ptr[entry_id].state == POFLR_STATE_INVALID)
+        if(tmp_vhal_entry_ptr[entry_id] == NULL)
             continue;
-        flow_entry_baseinfo(&tmp_vhal_entry_ptr[entry_id].entry);
+        flow_entry_baseinfo(&tmp_vhal_entry_ptr[entry_id]->entry);
         sum++;
     }
 }
@@ -313,6 +361,8 @@ static void flow_table(){
 
     poflr_get_table_number(&table_num);
 
+    /* The tables are not freed while the lock is held. */
+    POFLR_FLOW_LOCK_ON;
     for(type=0; type<POF_MAX_TABLE_TYPE; type++){
         for(table_id=0; table_id<table_num[type]; table_id++){
             poflr_get_flow_table(&p, type, table_id);
@@ -322,6 +372,7 @@ static void flow_table(){
             flow_table_single(*p);
         }
     }
+    POFLR_FLOW_LOCK_OFF;
 }
 
 static void usr_cmd_groups(){
@@ -367,6 +418,7 @@ static void usr_cmd_meters(){
     poflr_meters *meter_ptr = NULL;
     uint32_t i, j, count, num;
     pof_meter *p = NULL;
+    poflr_meter_bucket *b = NULL;
 
     poflr_get_meter(&meter_ptr);
     poflr_get_flow_table_resource(&flow_table_resource_ptr);
@@ -378,10 +430,17 @@ static void usr_cmd_meters(){
             continue;
         }
         p = &meter_ptr->meter[i];
+        b = &meter_ptr->bucket[i];
         POF_COMMAND_PRINT(1,CYAN,"rate=");
         POF_COMMAND_PRINT(1,WHITE,"%u ", p->rate);
         POF_COMMAND_PRINT(1,CYAN,"meter_id=");
         POF_COMMAND_PRINT(1,WHITE,"%u ", p->meter_id);
+        POF_COMMAND_PRINT(1,CYAN,"conform=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu/%lluB ", (unsigned long long)b->conform_packets, \
+                          (unsigned long long)b->conform_bytes);
+        POF_COMMAND_PRINT(1,CYAN,"exceed=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu/%lluB ", (unsigned long long)b->exceed_packets, \
+                          (unsigned long long)b->exceed_bytes);
         POF_COMMAND_PRINT(1,CYAN,"\n");
         count++;
     }
@@ -412,13 +471,167 @@ static void usr_cmd_counters(){
     }
 }
 
+static void usr_cmd_channel(){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc;
+
+    POF_COMMAND_PRINT_HEAD("channel");
+    POF_COMMAND_PRINT(1,CYAN,"state=");
+    POF_COMMAND_PRINT(1,WHITE,"%u ", conn_desc_ptr->conn_status.state);
+    POF_COMMAND_PRINT(1,CYAN,"send_queue=");
+    POF_COMMAND_PRINT(1,WHITE,"%u/%uB ", pofsc_send_q.msg_num, pofsc_send_q.byte_num);
+    POF_COMMAND_PRINT(1,CYAN,"dropped=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu/%lluB ", (unsigned long long)pofsc_send_q.drop_msg, \
+                      (unsigned long long)pofsc_send_q.drop_byte);
+    POF_COMMAND_PRINT(1,CYAN,"\n");
+}
+
+#ifdef POF_DATAPATH_ON
+static void usr_cmd_packet_in_bucket(const char *name, uint32_t id, \
+                                     struct pofdp_packet_in_bucket *b){
+    POF_COMMAND_PRINT(1,CYAN,"%s=", name);
+    POF_COMMAND_PRINT(1,WHITE,"%u ", id);
+    POF_COMMAND_PRINT(1,CYAN,"rate=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)(b->ns_per_packet ? 1000000000ULL / b->ns_per_packet : 0));
+    POF_COMMAND_PRINT(1,CYAN,"sent=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)b->sent);
+    POF_COMMAND_PRINT(1,CYAN,"dropped=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)b->dropped);
+    POF_COMMAND_PRINT(1,CYAN,"sampled=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)b->sampled);
+    POF_COMMAND_PRINT(1,CYAN,"\n");
+}
+#endif // POF_DATAPATH_ON
+
+static void usr_cmd_packet_in(){
+    POF_COMMAND_PRINT_HEAD("packet_in");
+#ifdef POF_DATAPATH_ON
+    struct pofdp_packet_in_limit *l = &g_pofdp_packet_in_limit;
+    uint32_t i;
+
+    POF_COMMAND_PRINT(1,CYAN,"sample=");
+    POF_COMMAND_PRINT(1,WHITE,"%u ", l->sample);
+    POF_COMMAND_PRINT(1,CYAN,"packet_out_dropped=");
+    POF_COMMAND_PRINT(1,WHITE,"%llu\n", (unsigned long long)g_pofdp_packet_out_dropped);
+    /* Only the limited or used buckets are shown. */
+    for(i=0; i<POFDP_PACKET_IN_REASON_NUM; i++){
+        if(l->reason[i].ns_per_packet != 0 || l->reason[i].sent != 0){
+            usr_cmd_packet_in_bucket("reason", i, &l->reason[i]);
+        }
+    }
+    for(i=0; i<POFDP_PACKET_IN_PORT_NUM; i++){
+        if(l->port[i].sent != 0 || l->port[i].dropped != 0){
+            usr_cmd_packet_in_bucket("port", i, &l->port[i]);
+        }
+    }
+#endif // POF_DATAPATH_ON
+}
+
 void usr_cmd_tables(){
 	POF_COMMAND_PRINT_HEAD("tables");
     flow_table();
 }
 
+static void usr_cmd_table_stats(){
+    char ctype[POF_MAX_TABLE_TYPE][5] = {"MM","LPM","EM","DT"};
+    pof_table_stats stats;
+    uint8_t *table_num = NULL;
+    uint32_t type, table_id;
+
+    POF_COMMAND_PRINT_HEAD("table_stats");
+    poflr_get_table_number(&table_num);
+
+    /* The tables are not freed while the lock is held. */
+    POFLR_FLOW_LOCK_ON;
+    for(type=0; type<POF_MAX_TABLE_TYPE; type++){
+        for(table_id=0; table_id<table_num[type]; table_id++){
+            if(poflr_get_table_stats(type, table_id, &stats) != POF_OK){
+                continue;
+            }
+            POF_COMMAND_PRINT(1,PINK,"[%s %u] ", ctype[type], table_id);
+            POF_COMMAND_PRINT(1,CYAN,"ID=");
+            POF_COMMAND_PRINT(1,WHITE,"%u ", stats.table_id);
+            POF_COMMAND_PRINT(1,CYAN,"entries=");
+            POF_COMMAND_PRINT(1,WHITE,"%u ", stats.active_count);
+            POF_COMMAND_PRINT(1,CYAN,"lookups=");
+            POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)stats.lookup_count);
+            POF_COMMAND_PRINT(1,CYAN,"matched=");
+            POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)stats.matched_count);
+            POF_COMMAND_PRINT(1,CYAN,"missed=");
+            POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)stats.missed_count);
+            POF_COMMAND_PRINT(1,CYAN,"avg_examined=");
+            POF_COMMAND_PRINT(1,WHITE,"%.1f\n", stats.lookup_count ? \
+                    (double)stats.examined_count / stats.lookup_count : 0.0);
+        }
+    }
+    POFLR_FLOW_LOCK_OFF;
+}
+
+static void usr_cmd_latency(){
+    POF_COMMAND_PRINT_HEAD("latency");
+#ifdef POF_DATAPATH_ON
+    struct pofdp_hist *hist, *h;
+    uint32_t i;
+
+    hist = malloc(POFDP_STAGE_NUM * sizeof *hist);
+    if(hist == NULL){
+        return;
+    }
+    pofdp_latency_snapshot(hist);
+
+    POF_COMMAND_PRINT(1,CYAN,"on=");
+    POF_COMMAND_PRINT(1,WHITE,"%s ", (g_pofdp_latency_on == TRUE) ? "yes" : "no");
+    POF_COMMAND_PRINT(1,CYAN,"unit=");
+    POF_COMMAND_PRINT(1,WHITE,"us\n");
+    for(i=0; i<POFDP_STAGE_NUM; i++){
+        h = &hist[i];
+        POF_COMMAND_PRINT(1,PINK,"[%-8s] ", g_pofdp_stage_str[i]);
+        POF_COMMAND_PRINT(1,CYAN,"count=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ", (unsigned long long)h->count);
+        if(h->count == 0){
+            POF_COMMAND_PRINT(1,CYAN,"\n");
+            continue;
+        }
+        POF_COMMAND_PRINT(1,CYAN,"min=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f ", h->min / 1000.0);
+        POF_COMMAND_PRINT(1,CYAN,"mean=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f ", (double)h->sum / h->count / 1000.0);
+        POF_COMMAND_PRINT(1,CYAN,"p50=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f ", pofdp_hist_percentile(h, 50) / 1000.0);
+        POF_COMMAND_PRINT(1,CYAN,"p99=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f ", pofdp_hist_percentile(h, 99) / 1000.0);
+        POF_COMMAND_PRINT(1,CYAN,"p999=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f ", pofdp_hist_percentile(h, 99.9) / 1000.0);
+        POF_COMMAND_PRINT(1,CYAN,"max=");
+        POF_COMMAND_PRINT(1,WHITE,"%.3f\n", h->max / 1000.0);
+    }
+    free(hist);
+#endif // POF_DATAPATH_ON
+}
+
+static void usr_cmd_latency_dump(){
+    POF_COMMAND_PRINT_HEAD("latency_dump");
+#ifdef POF_DATAPATH_ON
+    pofdp_latency_dump(stdout);
+#endif // POF_DATAPATH_ON
+}
+
+static void usr_cmd_enable_latency(){
+    POF_COMMAND_PRINT_HEAD("enable_latency");
+#ifdef POF_DATAPATH_ON
+    pofdp_set_latency_on(TRUE);
+#endif // POF_DATAPATH_ON
+}
+
+static void usr_cmd_disable_latency(){
+    POF_COMMAND_PRINT_HEAD("disable_latency");
+#ifdef POF_DATAPATH_ON
+    pofdp_set_latency_on(FALSE);
+#endif // POF_DATAPATH_ON
+}
+
 static void usr_cmd_ports(){
     pof_port *p = NULL;
+    pof_port_stats stats;
     uint16_t port_num = 0;
     int i;
 
@@ -454,9 +667,41 @@ static void usr_cmd_ports(){
         POF_COMMAND_PRINT(1,CYAN,"max_speed=");
         POF_COMMAND_PRINT(1,WHITE,"%u ",p->max_speed);
         POF_COMMAND_PRINT(1,CYAN,"of_enable=");
-        POF_COMMAND_PRINT(1,WHITE,"0x%.2x ",p->of_enable);
+        POF_COMMAND_PRINT(1,WHITE,"0x%.2x\n",p->of_enable);
+
+        poflr_get_port_stats(p->port_id, &stats);
+        POF_COMMAND_PRINT(1,CYAN,"  rx: packets=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_packets);
+        POF_COMMAND_PRINT(1,CYAN,"bytes=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_bytes);
+        POF_COMMAND_PRINT(1,CYAN,"errors=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_errors);
+        POF_COMMAND_PRINT(1,CYAN,"dropped=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"(disabled=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_disabled_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"mtu=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_mtu_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"filter=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.rx_filter_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"queue=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu",(unsigned long long)stats.rx_queue_dropped);
+        POF_COMMAND_PRINT(1,CYAN,")\n");
+
+        POF_COMMAND_PRINT(1,CYAN,"  tx: packets=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.tx_packets);
+        POF_COMMAND_PRINT(1,CYAN,"bytes=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.tx_bytes);
+        POF_COMMAND_PRINT(1,CYAN,"errors=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.tx_errors);
+        POF_COMMAND_PRINT(1,CYAN,"dropped=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.tx_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"(mtu=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu ",(unsigned long long)stats.tx_mtu_dropped);
+        POF_COMMAND_PRINT(1,CYAN,"queue=");
+        POF_COMMAND_PRINT(1,WHITE,"%llu",(unsigned long long)stats.tx_queue_dropped);
+        POF_COMMAND_PRINT(1,CYAN,")\n");
         p++;
-		POF_COMMAND_PRINT(1,WHITE,"\n");
     }
     return;
 }
@@ -28,6 +28,64 @@
 #include "../include/pof_global.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_byte_transfer.h"
+#include <stdarg.h>
+
+/* Level of each log category. The datapath and lookup categories log
+ * every packet, so they only log the errors even in the debug build, and
+ * are raised by Log_level or enable_debug. */
+volatile uint8_t g_poflp_level[POFLP_CATEGORY_NUM] = {
+#ifdef POF_DEBUG_ON
+    [POFLP_CONTROL]  = POFLP_DEBUG,
+    [POFLP_DATAPATH] = POFLP_ERROR,
+    [POFLP_LOOKUP]   = POFLP_ERROR,
+#else // POF_DEBUG_ON
+    [0 ... POFLP_CATEGORY_NUM-1] = POFLP_OFF
+#endif // POF_DEBUG_ON
+};
+
+static const char *poflp_level_str[POFLP_LEVEL_NUM] = {
+    "OFF", "ERROR", "INFO", "DEBUG"
+};
+
+/* One log line waiting in the ring. The text is formatted by the logging
+ * thread, while the head, the hex dump and the output are left to the
+ * writer task. */
+typedef struct poflp_record{
+    struct timespec ts;
+    const char *file;
+    char *col;
+    int line;
+    uint8_t level;
+    uint8_t pad[1];
+    uint16_t hex_len;           /* Bytes kept in hex. */
+    uint32_t hex_full_len;      /* Bytes asked to dump. */
+    char text[POFLP_RECORD_TEXT_LEN];
+    uint8_t hex[POFLP_RECORD_HEX_LEN];
+}poflp_record;
+
+/* Log ring of one thread. Only the thread moves the head, and only the
+ * writer moves the tail. */
+typedef struct poflp_ring{
+    volatile uint32_t head;
+    uint8_t pad[60];            /* Keep the head and tail apart. */
+    volatile uint32_t tail;
+    volatile uint64_t dropped;  /* Records dropped as the ring is full. */
+    uint64_t dropped_reported;
+    poflp_record record[POFLP_RING_SIZE];
+}poflp_ring;
+
+static pofbf_thread_slots poflp_ring_slots = \
+    POFBF_THREAD_SLOTS_INIT(sizeof(poflp_ring), NULL);
+static __thread poflp_ring *poflp_ring_self = NULL;
+
+/* Records lost by the threads without ring. */
+static volatile uint64_t poflp_ring_lost = 0;
+
+/* The writer task. The lock keeps the writer and pof_close_log_file from
+ * draining at the same time. */
+static task_t poflp_writer_task_id = POF_INVALID_TASKID;
+static pthread_once_t poflp_writer_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t poflp_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void
 log_(char *cont){fprintf(g_log.log_fp, "%s", cont);}
@@ -96,6 +154,200 @@ poflp_error_disable()
 	g_log._pErr = print_disable;
 }
 
+/* Set the level of the category, or of all the categories with
+ * POFLP_CATEGORY_ALL. Enabling a level also enables the debug print, as
+ * the lines go to the screen through it. */
+uint32_t poflp_set_level(uint32_t category, uint32_t level){
+    uint32_t i;
+
+    if(category > POFLP_CATEGORY_ALL || level >= POFLP_LEVEL_NUM){
+        return POF_ERROR;
+    }
+
+    for(i=0; i<POFLP_CATEGORY_NUM; i++){
+        if(category == POFLP_CATEGORY_ALL || category == i){
+            g_poflp_level[i] = level;
+        }
+    }
+    if(level != POFLP_OFF){
+        poflp_debug_enable();
+    }
+    return POF_OK;
+}
+
+/* Format the record and write it to the log file and the screen. */
+static void poflp_record_print(const poflp_record *rec, uint32_t ring_id, uint32_t seq){
+    char str[POFLP_LINE_MAX_LEN];
+    size_t n, max = sizeof(str) - 2;
+    struct tm tm;
+    uint32_t i;
+
+    localtime_r(&rec->ts.tv_sec, &tm);
+    n = strftime(str, max, "%H:%M:%S", &tm);
+    n += snprintf(str + n, max - n, ".%06ld|", rec->ts.tv_nsec / 1000);
+    n += strftime(str + n, max - n, "%b %d %Y", &tm);
+    n += snprintf(str + n, max - n, "|%02u:%05u|%s|%s|%d: %s", ring_id, seq, \
+            poflp_level_str[rec->level], rec->file, rec->line, rec->text);
+    if(rec->hex_full_len != 0 && n < max){
+        n += snprintf(str + n, max - n, "0x");
+        for(i=0; i<rec->hex_len && n + 3 < max; i++){
+            n += snprintf(str + n, max - n, "%.2x ", rec->hex[i]);
+        }
+        if(rec->hex_len < rec->hex_full_len && n < max){
+            n += snprintf(str + n, max - n, "...(%u bytes)", rec->hex_full_len);
+        }
+    }
+    if(n > max){
+        n = max;
+    }
+    str[n] = '\n';
+    str[n + 1] = '\0';
+
+    g_log._pLog(str);
+    g_log._pDbg(str, "1", rec->col);
+    return;
+}
+
+/* Print the records in all the rings, and return the number of them. */
+static uint32_t poflp_drain(){
+    char str[POF_LOG_STRING_MAX_LEN];
+    poflp_ring *ring;
+    uint32_t i, num, head, tail, count = 0;
+    uint64_t dropped;
+
+    pthread_mutex_lock(&poflp_writer_mutex);
+    num = pofbf_thread_slot_num(&poflp_ring_slots);
+    for(i=0; i<num; i++){
+        ring = POFBF_THREAD_SLOT_DATA(&poflp_ring_slots, i);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for(tail = ring->tail; tail != head; tail++, count++){
+            poflp_record_print(&ring->record[tail & (POFLP_RING_SIZE - 1)], i, tail);
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        dropped = ring->dropped;
+        if(dropped != ring->dropped_reported){
+            snprintf(str, sizeof(str), "Log ring %02u is full: %llu records dropped.\n", \
+                    i, (unsigned long long)(dropped - ring->dropped_reported));
+            ring->dropped_reported = dropped;
+            g_log._pLog(str);
+            g_log._pDbg(str, "1", RED);
+            count++;
+        }
+    }
+
+    if(count != 0){
+        if(g_log.log_fp != NULL){
+            fflush(g_log.log_fp);
+        }
+        fflush(stdout);
+    }
+    pthread_mutex_unlock(&poflp_writer_mutex);
+    return count;
+}
+
+/* The writer task prints the records in batches, and sleeps while the
+ * rings are empty. It is not cancelled in the middle of a batch. */
+static void poflp_writer_task(void *arg_ptr){
+    uint32_t count;
+
+    while(1){
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        count = poflp_drain();
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        if(count == 0){
+            pofbf_task_delay(POFLP_WRITER_INTERVAL);
+        }
+    }
+    return;
+}
+
+static void poflp_writer_start(){
+    (void)pofbf_task_create(NULL, (void *)poflp_writer_task, &poflp_writer_task_id);
+    return;
+}
+
+/* Get the ring of the calling thread, and start the writer task with
+ * the first ring. The ring of an exited thread is given to the next one
+ * with the records the writer has not printed. */
+static poflp_ring *poflp_ring_get(){
+    poflp_ring *ring = pofbf_thread_slot_get(&poflp_ring_slots);
+
+    if(ring != NULL){
+        pthread_once(&poflp_writer_once, poflp_writer_start);
+    }
+    poflp_ring_self = ring;
+    return ring;
+}
+
+/* Number of the log records dropped. */
+uint64_t poflp_dropped(){
+    uint64_t dropped = poflp_ring_lost;
+    const poflp_ring *ring;
+    uint32_t i, num = pofbf_thread_slot_num(&poflp_ring_slots);
+
+    for(i=0; i<num; i++){
+        ring = POFBF_THREAD_SLOT_DATA(&poflp_ring_slots, i);
+        dropped += ring->dropped;
+    }
+    return dropped;
+}
+
+/***********************************************************************
+ * Print one log line.
+ * Form:     void poflp_cprint_fl(uint32_t level, const char *file, int line, \
+ *                                char *col, const void *x, uint32_t len, \
+ *                                const char *cont, ...)
+ * Input:    level, source file and line, color, data to dump in hex and
+ *           its length, format and arguments
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function is called by POF_LOG_CPRINT_FL and
+ *           POF_LOG_CPRINT_FL_0X only if the level is enabled. The text
+ *           and the data to dump are copied into a record in the ring of
+ *           the calling thread, and the writer task prints the record
+ *           later. No lock is taken. If the ring is full, the record is
+ *           dropped and counted.
+ ***********************************************************************/
+void poflp_cprint_fl(uint32_t level, const char *file, int line, char *col, \
+                     const void *x, uint32_t len, const char *cont, ...){
+    poflp_ring *ring = poflp_ring_self;
+    poflp_record *rec;
+    uint32_t head;
+    va_list ap;
+
+    if(ring == NULL && (ring = poflp_ring_get()) == NULL){
+        __sync_fetch_and_add(&poflp_ring_lost, 1);
+        return;
+    }
+
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= POFLP_RING_SIZE){
+        ring->dropped++;
+        return;
+    }
+
+    rec = &ring->record[head & (POFLP_RING_SIZE - 1)];
+    clock_gettime(CLOCK_REALTIME, &rec->ts);
+    rec->file = file;
+    rec->line = line;
+    rec->col = col;
+    rec->level = level;
+
+    va_start(ap, cont);
+    vsnprintf(rec->text, sizeof(rec->text), cont, ap);
+    va_end(ap);
+
+    rec->hex_full_len = (x != NULL) ? len : 0;
+    rec->hex_len = (len < POFLP_RECORD_HEX_LEN) ? len : POFLP_RECORD_HEX_LEN;
+    if(x != NULL){
+        memcpy(rec->hex, x, rec->hex_len);
+    }
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return;
+}
+
 void pof_open_log_file(char *filename){
 	char *filename_ = NULL;
 	if(filename){
@@ -111,11 +363,21 @@ void pof_open_log_file(char *filename){
 		exit(0);
 	}
 	g_log._pLog = log_;
+	/* The log file records the control messages as before. */
+	if(g_poflp_level[POFLP_CONTROL] < POFLP_DEBUG){
+		g_poflp_level[POFLP_CONTROL] = POFLP_DEBUG;
+	}
 	POF_DEBUG_CPRINT_FL(1,GREEN,"Create log file: %s", filename_);
 	return;
 }
 
 void pof_close_log_file(){
+	/* Print the records left in the rings. */
+	if(poflp_writer_task_id != POF_INVALID_TASKID){
+		pofbf_task_delete(&poflp_writer_task_id);
+	}
+	(void)poflp_drain();
+
 	if(!g_log.log_fp){
 		return;
 	}
@@ -732,11 +994,17 @@ static void counter(const unsigned char *ph){
     free(p);
 }
 
-static void packet_in(const unsigned char *ph){
+static void packet_in(const unsigned char *ph, uint32_t len){
     pof_packet_in *p;
-    uint32_t len = sizeof(pof_packet_in);
+    uint32_t data_len;
 
-    p = malloc(len);
+    /* The data may be cut by miss_send_len. */
+    if(len > sizeof(pof_packet_in)){
+        len = sizeof(pof_packet_in);
+    }
+    data_len = len - (sizeof(pof_packet_in) - POF_PACKET_IN_MAX_LENGTH);
+
+    p = malloc(sizeof(pof_packet_in));
     memcpy(p,ph,len);
     pof_NtoH_transfer_packet_in(p);
 
@@ -753,7 +1021,7 @@ static void packet_in(const unsigned char *ph){
     POF_DEBUG_CPRINT(1,CYAN,"device_id=");
     POF_DEBUG_CPRINT(1,WHITE,"%u ",p->device_id);
 
-    POF_DEBUG_CPRINT_0X_NO_ENTER(p->data, p->total_len);
+    POF_DEBUG_CPRINT_0X_NO_ENTER(p->data, data_len);
 
     free(p);
 }
@@ -907,7 +1175,7 @@ void pof_debug_cprint_packet(const void * ph, uint32_t flag, int len){
             break;
         case POFT_PACKET_IN:
             POF_DEBUG_CPRINT(1,PINK,"[PACKET_IN:] ");
-            packet_in((unsigned char *)ph + sizeof(pof_header));
+            packet_in((unsigned char *)ph + sizeof(pof_header), header_ptr->length - sizeof(pof_header));
 			packet_raw(ph, header_ptr);
             break;
         case POFT_PACKET_OUT:
@@ -2,4 +2,8 @@ DATAPATH_FOLDER = datapath
 pofswitch_SOURCES += $(DATAPATH_FOLDER)/pof_action.c \
 					 $(DATAPATH_FOLDER)/pof_datapath.c \
 					 $(DATAPATH_FOLDER)/pof_instruction.c \
-					 $(DATAPATH_FOLDER)/pof_lookup.c
+					 $(DATAPATH_FOLDER)/pof_latency.c \
+					 $(DATAPATH_FOLDER)/pof_lookup.c \
+					 $(DATAPATH_FOLDER)/pof_port_stats.c \
+					 $(DATAPATH_FOLDER)/pof_table_stats.c \
+					 $(DATAPATH_FOLDER)/pof_trace.c
@@ -35,6 +35,8 @@
 
 #ifdef POF_DATAPATH_ON
 
+static uint32_t pofdp_action_run(POFDP_ARG);
+
 /* Update action pointer and number in dpp when one action
  * has been done. */
 static void action_update(struct pofdp_packet *dpp){
@@ -47,14 +49,14 @@ static void action_update(struct pofdp_packet *dpp){
 
 /**********************************************************************
  * Make the piece of packet to be zero.
- * Form:     pofdp_bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b)
+ * Form:     uint32_t pofdp_bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b)
  * Input:    packet, start position(bit), length(bit)
  * Output:   packet
  * Return:   POF_OK or Error code
  * Discribe: This function makes the piece of packet with pos_b and len_b
  *           to be zero. The units of pos_b and len_b both are BIT.
  *********************************************************************/
-static uint32_t bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b){
+uint32_t pofdp_bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b){
     uint32_t ret;
     uint16_t len_B;
     uint8_t  *zero;
@@ -97,11 +99,44 @@ static uint32_t execute_COUNTER(POFDP_ARG)
     ret = poflr_counter_increace(p->counter_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_counter has been done!");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_counter has been done!");
     action_update(dpp);
     return POF_OK;
 }
 
+/* Hash the configured fields of the packet/metadata to select the bucket of
+ * select group. The field out of the packet/metadata is skipped. */
+static uint32_t pofdp_group_hash(const struct pofdp_packet *dpp)
+{
+    pof_match *field;
+    uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE];
+    uint8_t *src;
+    uint32_t field_num, bound_b, hash = 2166136261U, i, j;
+
+    poflr_get_group_hash_field(&field, &field_num);
+
+    for(i=0; i<field_num; i++){
+        if(field[i].field_id != POFDP_METADATA_FIELD_ID){
+            src = dpp->buf_offset;
+            bound_b = dpp->left_len * POF_BITNUM_IN_BYTE;
+        }else{
+            src = (uint8_t *)dpp->metadata;
+            bound_b = dpp->metadata_len * POF_BITNUM_IN_BYTE;
+        }
+        if(field[i].offset + field[i].len > bound_b){
+            continue;
+        }
+
+        memset(value, 0, sizeof(value));
+        pofdp_copy_bit(src, value, field[i].offset, field[i].len);
+        for(j=0; j<POF_BITNUM_TO_BYTENUM_CEIL(field[i].len); j++){
+            hash = (hash ^ value[j]) * 16777619U;
+        }
+    }
+
+    return hash;
+}
+
 /***********************************************************************
  * Handle the action with POFAT_GROUP type.
  * Form:     uint32_t pofdp_action_handle_group(uint8_t *packet, \
@@ -115,37 +150,61 @@ static uint32_t execute_COUNTER(POFDP_ARG)
  *           packet will be forward to the group table. The group id is
  *           given in action_data. The instructions corresponding to the
  *           group will be all executed what ever packet_over is TRUE or
- *           not. In this version, we consider all group type is all.
+ *           not. For the select group, only the bucket chosen by the hash
+ *           of the packet fields is executed. For the fast failover group,
+ *           only the first bucket whose watch port is live is executed.
  * Note:     If there is an ERROR, The packet_over identifier will be TRUE
  ***********************************************************************/
 static uint32_t execute_GROUP(POFDP_ARG)
 {
     pof_action_group *p = (pof_action_group *)dpp->act->action_data;
-    poflr_groups *group_lr_ptr = NULL;
+    poflr_group_select *s = NULL;
+    const poflr_group_bucket *bucket = NULL;
     pof_group  *group_ptr;
     uint32_t   group_id, ret;
 
     group_id = p->group_id;
-    poflr_get_group(&group_lr_ptr);
 
-    if(group_lr_ptr->state[group_id] == POFLR_STATE_INVALID){
+    /* The group stays valid as long as the packet is in the read-side
+     * section, even if it is modified or deleted meanwhile. */
+    ret = poflr_get_group_select(group_id, &s);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    if(s == NULL){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_UNKNOWN_GROUP, g_upward_xid++);
     }
 
-    group_ptr = &group_lr_ptr->group[group_id];
+    group_ptr = &s->group;
 
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"Go to Group[%u]", group_id);
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,YELLOW,"Go to Group[%u]", group_id);
 
     ret = poflr_counter_increace(group_ptr->counter_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	dpp->act = group_ptr->action;
-	dpp->act_num = group_ptr->action_number;
+    if(group_ptr->type == POFGT_SELECT || group_ptr->type == POFGT_FF){
+        if(group_ptr->type == POFGT_SELECT){
+            /* Execute only one bucket chosen by the packet hash. */
+            poflr_group_select_bucket(s, pofdp_group_hash(dpp), &bucket);
+        }else{
+            /* Execute the first bucket whose watch port is live. */
+            poflr_group_ff_bucket(s, &bucket);
+        }
+        if(bucket == NULL){
+            dpp->packet_done = TRUE;
+            return POF_OK;
+        }
+        dpp->act = group_ptr->action + bucket->action_offset;
+        dpp->act_num = bucket->action_num;
+    }else{
+        dpp->act = group_ptr->action;
+        dpp->act_num = group_ptr->action_number;
+    }
 
-    ret = pofdp_action_execute(dpp);
+    /* The group's actions are timed by the outermost
+     * pofdp_action_execute. */
+    ret = pofdp_action_run(dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_group has been DONE!");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_group has been DONE!");
     return POF_OK;
 }
 
@@ -175,11 +234,11 @@ static uint32_t execute_PACKET_IN(POFDP_ARG)
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     ret = pofdp_send_packet_in_to_controller(dpp->offset + dpp->left_len, \
-            p->reason_code, table_ID, dpp->flow_entry, POF_FE_ID, dpp->buf);
+            p->reason_code, table_ID, dpp->flow_entry, POF_FE_ID, dpp->ori_port_id, dpp->buf);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"action_packet_in has been done! The packet in reason is %d.", p->reason_code);
-	POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf, dpp->offset + dpp->left_len, "The packet in data is ");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,YELLOW,"action_packet_in has been done! The packet in reason is %d.", p->reason_code);
+	POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf, dpp->offset + dpp->left_len, "The packet in data is ");
 
     action_update(dpp);
     return POF_OK;
@@ -203,7 +262,7 @@ static uint32_t execute_DROP(POFDP_ARG)
 {
     pof_action_drop *p = (pof_action_drop *)dpp->act->action_data;
 
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"action_drop has been done! The drop reason is %d\n.", p->reason_code);
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,YELLOW,"action_drop has been done! The drop reason is %d\n.", p->reason_code);
 
     dpp->packet_done = TRUE;
 
@@ -245,8 +304,8 @@ static uint32_t execute_SET_FIELD(POFDP_ARG)
 
     pofdp_cover_bit(dpp->buf_offset, value, offset_b, len_b);
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_set_field has been DONE");
-	POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The packet is ");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_set_field has been DONE");
+	POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_offset,dpp->left_len,"The packet is ");
 
     action_update(dpp);
     return POF_OK;
@@ -286,9 +345,9 @@ static uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_ARG)
 
     pofdp_cover_bit(dpp->buf_offset, value, offset_b, len_b);
 
-	POF_DEBUG_CPRINT_FL_0X(1,GREEN,value,POF_BITNUM_TO_BYTENUM_CEIL(len_b), \
+	POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,value,POF_BITNUM_TO_BYTENUM_CEIL(len_b), \
 			"Set_field_from_metadata has been done! The metadata is :");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The packet is :");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_offset,dpp->left_len,"The packet is :");
 
     action_update(dpp);
     return POF_OK;
@@ -320,8 +379,8 @@ static uint32_t execute_MODIFY_FIELD(POFDP_ARG)
 	ret = pofdp_write_32value_to_field(value, &p->field, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_modeify_field has been done! The increment is %d", p->increment);
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The packet is ");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_modeify_field has been done! The increment is %d", p->increment);
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_offset,dpp->left_len,"The packet is ");
 
     action_update(dpp);
     return POF_OK;
@@ -329,11 +388,11 @@ static uint32_t execute_MODIFY_FIELD(POFDP_ARG)
 
 /***********************************************************************
  * Calculate the checksum.
- * Form:     static uint32_t pofdp_checksum(uint8_t *data, \
- *                                          uint64_t *value, \
- *                                          uint16_t pos_b, \
- *                                          uint16_t len_b, \
- *                                          uint16_t cs_len_b)
+ * Form:     uint32_t pofdp_checksum(uint8_t *data, \
+ *                                   uint64_t *value, \
+ *                                   uint16_t pos_b, \
+ *                                   uint16_t len_b, \
+ *                                   uint16_t cs_len_b)
  * Input:    data, start position(bit), length(bit), checksum len(bit)
  * Output:   calculate result
  * Return:   POF_OK or Error code
@@ -343,11 +402,11 @@ static uint32_t execute_MODIFY_FIELD(POFDP_ARG)
  *           len_b, cs_len_b all are BIT.
  * NOTE:     The max of length of checksum is 64bits.
  ***********************************************************************/
-static uint32_t checksum(uint8_t *data, \
-                         uint64_t *value, \
-                         uint16_t pos_b, \
-                         uint16_t len_b, \
-                         uint16_t cs_len_b)
+uint32_t pofdp_checksum(uint8_t *data, \
+                        uint64_t *value, \
+                        uint16_t pos_b, \
+                        uint16_t len_b, \
+                        uint16_t cs_len_b)
 {
     uint64_t *value_temp, threshold = 1;
     uint32_t ret;
@@ -421,15 +480,15 @@ static uint32_t execute_CALCULATE_CHECKSUM(POFDP_ARG)
     }
 */
 
-    ret = bzero_bit(dpp->buf_offset, cs_pos_b, cs_len_b);
+    ret = pofdp_bzero_bit(dpp->buf_offset, cs_pos_b, cs_len_b);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    ret = checksum(dpp->buf_offset, &checksum_value, cal_pos_b, cal_len_b, cs_len_b);
+    ret = pofdp_checksum(dpp->buf_offset, &checksum_value, cal_pos_b, cal_len_b, cs_len_b);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     pofdp_cover_bit(dpp->buf_offset, (uint8_t *)&checksum_value, cs_pos_b, cs_len_b);
 
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,&checksum_value,8,"action_calculate_checksum has been done! The checksum_value = ");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,&checksum_value,8,"action_calculate_checksum has been done! The checksum_value = ");
 
     action_update(dpp);
     return POF_OK;
@@ -533,8 +592,8 @@ static uint32_t execute_ADD_FIELD(POFDP_ARG)
     dpp->left_len += POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b);
     dpp->metadata->len = POF_HTONS(POF_HTONS(dpp->metadata->len) + POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b));
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_add_field has been done!");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The new packet = ");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_add_field has been done!");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_offset,dpp->left_len,"The new packet = ");
 
     action_update(dpp);
     return POF_OK;
@@ -580,8 +639,8 @@ static uint32_t execute_DELETE_FIELD(POFDP_ARG)
         *(dpp->buf_offset + dpp->left_len - 1) &= POF_MOVE_BIT_LEFT(0xff, tag_len_b_x);
     }
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"action_delete_field has been done!");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The new packet = ");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"action_delete_field has been done!");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_offset,dpp->left_len,"The new packet = ");
 
     action_update(dpp);
     return POF_OK;
@@ -615,15 +674,25 @@ execute_EXPERIMENTER(POFDP_ARG)
  *           executed, and the packet_over parameter is useless.
  ***********************************************************************/
 uint32_t pofdp_action_execute(POFDP_ARG)
+{
+    uint64_t ts = pofdp_latency_start();
+    uint32_t ret;
+
+    ret = pofdp_action_run(dpp);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    pofdp_latency_end(POFDP_STAGE_ACTION, ts);
+    return POF_OK;
+}
+
+/* Execute the actions in dpp until they run out or the packet is done. */
+static uint32_t pofdp_action_run(POFDP_ARG)
 {
     uint32_t ret;
-    uint8_t *packet, action_num, execute_all;
-    pof_action *action_ptr;
-    struct pofdp_metadata *metadata;
-    uint32_t *packet_over;
-    pof_flow_entry *entry_ptr;
 
     while(dpp->packet_done == FALSE && dpp->act_num > 0){
+        POFDP_TRACE(dpp, POFDP_TRACE_ACTION, dpp->act->type, 0, 0);
+
 		/* Execute the actions. */
         switch(dpp->act->type){
 #define ACTION(NAME,VALUE) case POFAT_##NAME: ret = execute_##NAME(dpp); break;
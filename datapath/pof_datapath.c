@@ -32,10 +32,13 @@
 #include "../include/pof_datapath.h"
 #include "../include/pof_byte_transfer.h"
 #include <sys/socket.h>
+#include <sys/msg.h>
 #include <netinet/in.h>
 #include <string.h>
 #include <linux/if_packet.h>
 #include <net/ethernet.h>
+#include <pthread.h>
+#include <errno.h>
 
 #ifdef POF_DATAPATH_ON
 
@@ -49,15 +52,46 @@ task_t g_pofdp_detect_port_task_id = 0;
 uint32_t g_pofdp_recv_q_id = POF_INVALID_QUEUEID;
 uint32_t g_pofdp_send_q_id = POF_INVALID_QUEUEID;
 
+/* Packets buffered for the packet-in messages. The low bits of the
+ * buffer id index the slot, and the high bits distinguish the packets
+ * stored in the same slot one after another. */
+static struct pofdp_packet_in_buffer{
+    uint32_t buffer_id;         /* POF_NO_BUFFER means the slot is free. */
+    uint32_t port_id;           /* Input port of the packet. */
+    uint16_t len;
+    time_t   time;              /* Time when the packet was stored. */
+    uint8_t  data[POFDP_PACKET_RAW_MAX_LEN];
+} pofdp_packet_in_buffer[POFDP_PACKET_IN_BUFFER_NUM];
+static uint32_t pofdp_packet_in_buffer_next = 0;
+static uint32_t pofdp_packet_in_buffer_cookie = 0;
+static pthread_mutex_t pofdp_packet_in_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Packet-in rate limitation. Each ingress port is limited by default,
+ * and no reason is limited until it is configured. */
+#define POFDP_PACKET_IN_NS_PER_PACKET(rate) (1000000000ULL / (rate))
+#define POFDP_PACKET_IN_BURST_NS(rate, burst) \
+    (((burst) > 1) ? ((uint64_t)(burst) - 1) * POFDP_PACKET_IN_NS_PER_PACKET(rate) : 0)
+struct pofdp_packet_in_limit g_pofdp_packet_in_limit = {
+    .port = { [0 ... POFDP_PACKET_IN_PORT_NUM - 1] = {
+        .ns_per_packet = POFDP_PACKET_IN_NS_PER_PACKET(POFDP_PACKET_IN_PORT_RATE_DEFAULT),
+        .burst_ns = POFDP_PACKET_IN_BURST_NS(POFDP_PACKET_IN_PORT_RATE_DEFAULT, \
+                                             POFDP_PACKET_IN_PORT_BURST_DEFAULT),
+    } },
+};
+static uint32_t pofdp_packet_in_exceed_count = 0;
+
+/* Packet outs dropped since the datapath receive queue was full. */
+volatile uint64_t g_pofdp_packet_out_dropped = 0;
+
 static uint32_t pofdp_main_task(void *arg_ptr);
-static uint32_t pofdp_forward(struct pofdp_packet *dp_packet, struct pof_instruction *first_ins);
 static uint32_t pofdp_recv_raw_task(void *arg_ptr);
 static uint32_t pofdp_send_raw_task(void *arg_ptr);
 
-/* Malloc memery in struct pofdp_packet to store packet data. 
+/* Malloc memery in struct pofdp_packet to store packet data. The extra_len
+ * bytes behind the packet room are for the caller's own use.
  * The memery should be free by free_packet_data(). */
-static uint32_t malloc_packet_data(struct pofdp_packet *dpp, uint32_t len){
-	dpp->buf = malloc(POFDP_PACKET_RAW_MAX_LEN);
+static uint32_t malloc_packet_data(struct pofdp_packet *dpp, uint32_t len, uint32_t extra_len){
+	dpp->buf = malloc(POFDP_PACKET_RAW_MAX_LEN + extra_len);
     POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(dpp->buf, g_upward_xid++);
 
 	memset(dpp->buf, 0, len);
@@ -113,6 +147,11 @@ uint32_t pof_datapath_init(){
     uint32_t i, ret;
     uint16_t port_number = 0, port_number_max = 0;
 
+    /* No packet is buffered for packet-in. */
+    for(i=0; i<POFDP_PACKET_IN_BUFFER_NUM; i++){
+        pofdp_packet_in_buffer[i].buffer_id = POF_NO_BUFFER;
+    }
+
     /* Create message queues to store send or receive message. */
     ret = pofbf_queue_create(&g_pofdp_recv_q_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -123,12 +162,12 @@ uint32_t pof_datapath_init(){
     /* Create datapath task. */
     ret = pofbf_task_create(NULL, (void *)pofdp_main_task, &g_pofdp_main_task_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Start datapatch task!");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,BLUE,"Start datapatch task!");
 
     /* Create task to send raw packet. */
     ret = pofbf_task_create(NULL, (void *)pofdp_send_raw_task, &g_pofdp_send_raw_task_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Start send_raw task!");
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,BLUE,"Start send_raw task!");
 
     /* Create task to receive raw packet. */
     poflr_get_port_number(&port_number);
@@ -149,6 +188,10 @@ uint32_t pof_datapath_init(){
     ret = pofbf_task_create(NULL, (void *)poflr_port_detect_task, &g_pofdp_detect_port_task_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
+    /* Create task to listen to the link events of the ports. */
+    ret = pofbf_task_create(NULL, (void *)poflr_port_link_task, &g_poflr_port_link_task_id);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
     return POF_OK;
 }
 
@@ -157,7 +200,7 @@ uint32_t pofdp_create_port_listen_task(task_t *tid, pof_port *p){
 
 	ret = pofbf_task_create(p, (void *)pofdp_recv_raw_task, tid);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Start recv_raw task!", p->name);
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,BLUE,"Port %s: Start recv_raw task!", p->name);
 
 	ret = poflr_set_port_task_id(tid, p);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -165,7 +208,16 @@ uint32_t pofdp_create_port_listen_task(task_t *tid, pof_port *p){
 	return POF_OK;
 }
 
-static void set_goto_first_table_instruction(struct pof_instruction *p)
+/***********************************************************************
+ * Set the instruction going to the first flow table
+ * Form:     void pofdp_set_goto_first_table(struct pof_instruction *p)
+ * Input:    instruction
+ * Output:   instruction
+ * Return:   VOID
+ * Discribe: This function sets the GOTO_TABLE instruction to the first
+ *           flow table, with which a new packet starts to be forwarded.
+ ***********************************************************************/
+void pofdp_set_goto_first_table(struct pof_instruction *p)
 {
 	struct pof_instruction_goto_table *pigt = \
 			(struct pof_instruction_goto_table *)p->instruction_data;
@@ -205,19 +257,30 @@ static uint32_t pofdp_recv_raw(struct pofdp_packet *dpp){
  * Discribe: This is the main function of the datapath task, which is
  *           infinite loop running. It receive the RAW packet, and forward.
  *           The next RAW packet will be not proceeded until the forward
- *           process of the last packet is over.
+ *           process of the last packet is over. The packet out from the
+ *           Controller comes in the same queue, carrying its own
+ *           instruction if it is not sent to the first flow table.
  * NOTE:     The datapath task will be terminated if some ERROR occurs
  *           during the receive process and the datapath process.
  ***********************************************************************/
 static uint32_t pofdp_main_task(void *arg_ptr){
     uint8_t recv_buf[POFDP_PACKET_RAW_MAX_LEN] = {0};
 	struct pofdp_packet dpp[1] = {0};
-	struct pof_instruction first_ins[1] = {0};
+	struct pof_instruction first_ins[1] = {0}, *ins;
+    pofbf_rcu_reader *reader;
     uint32_t len_B = 0, port_id = 0;
+    uint64_t ts;
     uint32_t ret;
 
 	/* Set GOTO_TABLE instruction to go to the first flow table. */
-	set_goto_first_table_instruction(first_ins);
+	pofdp_set_goto_first_table(first_ins);
+
+    /* The flow tables are read without lock. */
+    reader = pofbf_rcu_register();
+    if(reader == NULL){
+        POF_ERROR_CPRINT_FL(1,RED,"Too many readers of the flow tables.");
+        terminate_handler();
+    }
 
     while(1){
         /* Receive raw packet through local physical OpenFlow-enabled ports. */
@@ -228,6 +291,7 @@ static uint32_t pofdp_main_task(void *arg_ptr){
             pofbf_task_delay(100);
             terminate_handler();
         }
+        pofdp_latency_end(POFDP_STAGE_RX_QUEUE, dpp->ts);
 
         /* Check the packet length. */
         if(dpp->ori_len > POFDP_PACKET_RAW_MAX_LEN){
@@ -236,29 +300,40 @@ static uint32_t pofdp_main_task(void *arg_ptr){
             continue;
         }
 
+        /* The flow tables and entries met by the packet are not freed
+         * until the packet is forwarded. */
+        POFBF_RCU_READ_LOCK(reader);
+
 		/* Check whether the first flow table exist. */
-		if(POF_OK != poflr_check_flow_table_exist(POFDP_FIRST_TABLE_ID)){
-			POF_DEBUG_CPRINT_FL(1,RED,"Received a packet, but the first flow table does NOT exist.");
-			free_packet_data(dpp);
-			continue;
+		ins = dpp->ins;
+		if(ins == NULL){
+			if(POF_OK != poflr_check_flow_table_exist(POFDP_FIRST_TABLE_ID)){
+				POFBF_RCU_READ_UNLOCK(reader);
+				POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,RED,"Received a packet, but the first flow table does NOT exist.");
+				free_packet_data(dpp);
+				continue;
+			}
+			ins = first_ins;
 		}
 
         /* Forward the packet. */
-        ret = pofdp_forward(dpp, first_ins);
+        ts = pofdp_latency_start();
+        ret = pofdp_forward(dpp, ins);
+        pofdp_latency_end(POFDP_STAGE_FORWARD, ts);
+        POFBF_RCU_READ_UNLOCK(reader);
         POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
 
 		free_packet_data(dpp);
-        POF_DEBUG_CPRINT_FL(1,GREEN,"one packet_raw has been processed!\n");
+        POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,GREEN,"one packet_raw has been processed!\n");
     }
     return POF_OK;
 }
 
 /***********************************************************************
  * Forward function
- * Form:     static uint32_t pofdp_forward(uint8_t *packet, \
- *                                         uint32_t len, \
- *                                         uint32_t port_id)
- * Input:    packet, length of packet
+ * Form:     uint32_t pofdp_forward(struct pofdp_packet *dpp, \
+ *                                  struct pof_instruction *first_ins)
+ * Input:    packet, first instruction
  * Output:   NONE
  * Return:   POF_OK or Error code
  * Discribe: This function forwards the packet between the flow tables.
@@ -273,15 +348,14 @@ static uint32_t pofdp_main_task(void *arg_ptr){
  *           the specified local physical port. 3, Any ERROR has occurred
  *           during the process.
  ***********************************************************************/
-static uint32_t pofdp_forward(struct pofdp_packet *dpp, struct pof_instruction *first_ins)
+uint32_t pofdp_forward(struct pofdp_packet *dpp, struct pof_instruction *first_ins)
 {
 	uint8_t metadata[POFDP_METADATA_MAX_LEN] = {0};
 	uint32_t ret;
 
-	POF_DEBUG_CPRINT(1,BLUE,"\n");
-	POF_DEBUG_CPRINT_FL(1,BLUE,"Receive a raw packet! len_B = %d, port id = %u", \
+	POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,BLUE,"Receive a raw packet! len_B = %d, port id = %u", \
 			dpp->ori_len, dpp->ori_port_id);
-	POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf,dpp->left_len,"Input packet data is ");
+	POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf,dpp->left_len,"Input packet data is ");
 
 	/* Initialize the metadata. */
 	ret = init_packet_metadata(dpp, (struct pofdp_metadata *)metadata, sizeof(metadata));
@@ -291,7 +365,9 @@ static uint32_t pofdp_forward(struct pofdp_packet *dpp, struct pof_instruction *
 	dpp->ins = first_ins;
 	dpp->ins_todo_num = 1;
 
+	POFDP_TRACE_START(dpp);
 	ret = pofdp_instruction_execute(dpp);
+	POFDP_TRACE(dpp, POFDP_TRACE_DONE, 0, ret, 0);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     return POF_OK;
 }
@@ -317,9 +393,11 @@ static uint32_t pofdp_forward(struct pofdp_packet *dpp, struct pof_instruction *
 static uint32_t pofdp_recv_raw_task(void *arg_ptr){
     pof_port *port_ptr = (pof_port *)arg_ptr;
     struct pofdp_packet *dpp = malloc(sizeof *dpp);
+    struct pofdp_port_stats *ps = pofdp_port_stats_self(port_ptr->port_id);
     struct   sockaddr_ll sockadr, from;
     uint32_t from_len, len_B;
     uint8_t  buf[POFDP_PACKET_RAW_MAX_LEN];
+    uint64_t ts;
     int      sock;
 
     from_len = sizeof(struct sockaddr_ll);
@@ -350,38 +428,52 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
         /* Receive the raw packet. */
         if((len_B = recvfrom(sock, buf, POFDP_PACKET_RAW_MAX_LEN, 0, (struct sockaddr *)&from, &from_len)) <=0){
             POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_RECEIVE_MSG_FAILURE, g_upward_xid++);
+            ps->rx_errors++;
+            continue;
+        }
+        ts = pofdp_latency_start();
+
+        /* The packets sent by this switch are seen by the socket too. */
+        if(from.sll_pkttype == PACKET_OUTGOING){
             continue;
         }
 
         /* Check whether the OpenFlow-enabled of the port is on or not. */
-        if(port_ptr->of_enable == POFLR_PORT_DISABLE || from.sll_pkttype == PACKET_OUTGOING){
+        if(port_ptr->of_enable == POFLR_PORT_DISABLE){
+            ps->rx_disabled_dropped++;
             continue;
         }
 
         /* Check the packet length. */
         if(len_B > POF_MTU_LENGTH){
-            POF_DEBUG_CPRINT_FL(1,RED,"The packet received is longer than MTU. DROP!");
+            POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,RED,"The packet received is longer than MTU. DROP!");
+            ps->rx_mtu_dropped++;
             continue;
         }
 
         /* Filter the received raw packet by some rules. */
         if(dp.filter(buf, port_ptr, from) != POF_OK){
+            ps->rx_filter_dropped++;
             continue;
         }
 		
         /* Store packet data, length, received port infomation into the message queue. */
 		memset(dpp, 0, sizeof *dpp);
         dpp->ori_port_id = port_ptr->port_id;
-		malloc_packet_data(dpp, len_B);
+		malloc_packet_data(dpp, len_B, 0);
         memcpy(dpp->buf, buf, len_B);
+        dpp->ts = pofdp_latency_end(POFDP_STAGE_RX, ts);
 
         if(pofbf_queue_write(g_pofdp_recv_q_id, dpp, sizeof *dpp, POF_WAIT_FOREVER) != POF_OK){
             POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_upward_xid++);
 			free_packet_data(dpp);
+            ps->rx_queue_dropped++;
 
             pofbf_task_delay(100);
             terminate_handler();
         }
+        ps->rx_packets++;
+        ps->rx_bytes += len_B;
     }
 
     close(sock);
@@ -403,7 +495,9 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
  ***********************************************************************/
 static uint32_t pofdp_send_raw_task(void *arg){
     struct pofdp_packet *dpp = malloc(sizeof *dpp);
+    struct pofdp_port_stats *ps;
     struct   sockaddr_ll sll;
+    uint64_t ts;
     int      sock;
 
     /* Create socket. */
@@ -426,6 +520,7 @@ static uint32_t pofdp_send_raw_task(void *arg){
             pofbf_task_delay(100);
             terminate_handler();
         }
+        ts = pofdp_latency_end(POFDP_STAGE_TX_QUEUE, dpp->ts);
 
         /* Send the packet data out through the port. */
         memset(&sll, 0, sizeof sll);
@@ -433,15 +528,19 @@ static uint32_t pofdp_send_raw_task(void *arg){
         sll.sll_ifindex = dpp->output_port_id;
         sll.sll_protocol = POF_HTONS(ETH_P_ALL);
 
+        /* A failed packet is counted and dropped. The port may be going
+         * down, which is not an error of the switch. */
+        ps = pofdp_port_stats_self(dpp->output_port_id);
         if(sendto(sock, dpp->buf_out, dpp->output_whole_len, 0, (struct sockaddr *)&sll, sizeof(sll)) == -1){
-			free(dpp->buf_out);
-            POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE, g_upward_xid++);
-
-            /* Delay 0.1s to send error message upward to the Controller. */
-            pofbf_task_delay(100);
-            terminate_handler();
+            POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,RED,"Send packet to port %u failed: %s. DROP!", \
+                    dpp->output_port_id, strerror(errno));
+            ps->tx_errors++;
+        }else{
+            ps->tx_packets++;
+            ps->tx_bytes += dpp->output_whole_len;
         }
 		free(dpp->buf_out);
+        pofdp_latency_end(POFDP_STAGE_TX, ts);
     }
 
     close(sock);
@@ -462,12 +561,12 @@ static uint32_t pofdp_send_raw_task(void *arg){
  *           output_packet_offset plus output_packet_len is less than the
  *           whole packet_len, and that output_metadata_offset plus 
  *           output_metadata_len is less than the whole metadata_len.
+ *           The assembled packet is handed to dp.send.
  ***********************************************************************/
 uint32_t pofdp_send_raw(struct pofdp_packet *dpp){
-	uint8_t *data = malloc(dpp->output_whole_len);
+	uint8_t *data;
 
-	/* Malloc the output data memery which will be freed in 
-	 * pofdp_send_raw_task. */
+	/* Malloc the output data memery which will be freed by dp.send. */
 	data = malloc(dpp->output_whole_len);
     POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(data, g_upward_xid++);
     memset(data, 0, dpp->output_whole_len);
@@ -479,37 +578,398 @@ uint32_t pofdp_send_raw(struct pofdp_packet *dpp){
     memcpy(data + dpp->output_metadata_len, dpp->buf + dpp->output_packet_offset, dpp->output_packet_len);
 	dpp->buf_out = data;
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"One packet is about to be sent out! port_id = %d, packet_len = %u, metadata_len = %u, total_len = %u", \
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,GREEN,"One packet is about to be sent out! port_id = %d, packet_len = %u, metadata_len = %u, total_len = %u", \
 			            dpp->output_port_id, dpp->output_packet_len, dpp->output_metadata_len, dpp->output_whole_len);
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf + dpp->output_packet_offset, dpp->output_packet_len, \
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf + dpp->output_packet_offset, dpp->output_packet_len, \
 			"The packet is ");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_out,dpp->output_metadata_len,"The metatada is ");
-    POF_DEBUG_CPRINT_FL_0X(1,YELLOW,dpp->buf_out, dpp->output_whole_len,"The whole output packet is ");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->buf_out,dpp->output_metadata_len,"The metatada is ");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,YELLOW,dpp->buf_out, dpp->output_whole_len,"The whole output packet is ");
+
+    POFDP_TRACE(dpp, POFDP_TRACE_OUTPUT, 0, dpp->output_port_id, dpp->output_whole_len);
 
     /* Check the packet lenght. */
     if(dpp->output_whole_len > POF_MTU_LENGTH){
+        pofdp_port_stats_self(dpp->output_port_id)->tx_mtu_dropped++;
+        free(data);
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
     }
 
-    /* Write the packet to the send queue. */
+    return dp.send(dpp);
+}
+
+/***********************************************************************
+ * Send packet to the send queue
+ * Form:     static uint32_t pofdp_send_queue(struct pofdp_packet *dpp)
+ * Input:    packet assembled in buf_out
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function writes the packet to the send queue, from
+ *           which pofdp_send_raw_task sends it out through the local
+ *           physical port and frees buf_out.
+ ***********************************************************************/
+static uint32_t pofdp_send_queue(struct pofdp_packet *dpp){
+    dpp->ts = pofdp_latency_start();
     if(pofbf_queue_write(g_pofdp_send_q_id, dpp, sizeof *dpp, POF_WAIT_FOREVER) != POF_OK){
-		free(data);
+		free(dpp->buf_out);
+        pofdp_port_stats_self(dpp->output_port_id)->tx_queue_dropped++;
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_upward_xid++);
     }
 
     return POF_OK;
 }
 
+/***********************************************************************
+ * Store the packet in the packet-in buffer.
+ * Form:     static uint32_t pofdp_packet_in_buffer_store(uint8_t *packet, \
+ *                                                    uint16_t len, \
+ *                                                    uint32_t port_id, \
+ *                                                    uint32_t *buffer_id_ptr)
+ * Input:    packet data, packet length, input port id
+ * Output:   buffer id
+ * Return:   POF_OK, or POF_ERROR if there is no free slot
+ * Discribe: This function copies the packet into the next slot of the
+ *           buffer. The slot still holding a packet younger than
+ *           POFDP_PACKET_IN_BUFFER_TIMEOUT is not overwritten, so the
+ *           packet is not buffered when the Controller falls behind.
+ ***********************************************************************/
+static uint32_t pofdp_packet_in_buffer_store(uint8_t *packet, \
+                                             uint16_t len, \
+                                             uint32_t port_id, \
+                                             uint32_t *buffer_id_ptr)
+{
+    struct pofdp_packet_in_buffer *b;
+    time_t now = time(NULL);
+    uint32_t slot, buffer_id;
+
+    if(len > POFDP_PACKET_RAW_MAX_LEN){
+        return POF_ERROR;
+    }
+
+    pthread_mutex_lock(&pofdp_packet_in_buffer_mutex);
+    slot = pofdp_packet_in_buffer_next;
+    b = &pofdp_packet_in_buffer[slot];
+    if(b->buffer_id != POF_NO_BUFFER && now - b->time < POFDP_PACKET_IN_BUFFER_TIMEOUT){
+        pthread_mutex_unlock(&pofdp_packet_in_buffer_mutex);
+        return POF_ERROR;
+    }
+
+    do{
+        buffer_id = (++pofdp_packet_in_buffer_cookie * POFDP_PACKET_IN_BUFFER_NUM) | slot;
+    }while(buffer_id == POF_NO_BUFFER);
+
+    b->buffer_id = buffer_id;
+    b->port_id = port_id;
+    b->len = len;
+    b->time = now;
+    memcpy(b->data, packet, len);
+    pofdp_packet_in_buffer_next = (slot + 1) % POFDP_PACKET_IN_BUFFER_NUM;
+    pthread_mutex_unlock(&pofdp_packet_in_buffer_mutex);
+
+    *buffer_id_ptr = buffer_id;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Take the packet out of the packet-in buffer.
+ * Form:     uint32_t pofdp_packet_in_buffer_take(uint32_t buffer_id, \
+ *                                                uint8_t *packet, \
+ *                                                uint16_t *len_ptr, \
+ *                                                uint32_t *port_id_ptr)
+ * Input:    buffer id
+ * Output:   packet data, packet length, input port id
+ * Return:   POF_OK or Error code
+ * Discribe: This function copies the buffered packet into the packet
+ *           memery of POFDP_PACKET_RAW_MAX_LEN bytes, and frees the slot.
+ *           If packet is NULL, the slot is only freed. Each buffered
+ *           packet can be taken once.
+ ***********************************************************************/
+uint32_t pofdp_packet_in_buffer_take(uint32_t buffer_id, \
+                                     uint8_t *packet, \
+                                     uint16_t *len_ptr, \
+                                     uint32_t *port_id_ptr)
+{
+    struct pofdp_packet_in_buffer *b;
+
+    b = &pofdp_packet_in_buffer[buffer_id % POFDP_PACKET_IN_BUFFER_NUM];
+
+    pthread_mutex_lock(&pofdp_packet_in_buffer_mutex);
+    if(buffer_id == POF_NO_BUFFER || b->buffer_id != buffer_id){
+        pthread_mutex_unlock(&pofdp_packet_in_buffer_mutex);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BUFFER_UNKNOWN, g_recv_xid);
+    }
+
+    if(packet != NULL){
+        memcpy(packet, b->data, b->len);
+        *len_ptr = b->len;
+        *port_id_ptr = b->port_id;
+    }
+    b->buffer_id = POF_NO_BUFFER;
+    pthread_mutex_unlock(&pofdp_packet_in_buffer_mutex);
+
+    return POF_OK;
+}
+
+/* Check the in_port of the packet out with data. It is a local port, or
+ * POFP_CONTROLLER for the packet made by the Controller. */
+static uint32_t pofdp_packet_out_check_in_port(uint32_t port_id){
+    pof_port *port_ptr = NULL;
+    uint16_t port_num = 0, i;
+
+    if(port_id == POFP_CONTROLLER){
+        return POF_OK;
+    }
+    poflr_get_port(&port_ptr);
+    poflr_get_port_number(&port_num);
+    for(i=0; i<port_num; i++){
+        if(port_ptr[i].port_id == port_id){
+            return POF_OK;
+        }
+    }
+    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_PORT, g_recv_xid);
+}
+
+/***********************************************************************
+ * Inject the packet out from the Controller into the datapath.
+ * Form:     uint32_t pofdp_packet_out(pof_packet_out *packet_out_ptr, \
+ *                                     uint32_t data_len)
+ * Input:    packet out message body, length of data behind the body
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function puts the packet into the datapath receive
+ *           queue, where the datapath task handles it like a received
+ *           one. The packet is the buffered one if buffer_id is valid,
+ *           with the port it was received on, or the data behind the
+ *           body with in_port. It is copied once, straight
+ *           into the packet memery owned by the datapath, since the
+ *           receive buffer of the channel is reused at once and the
+ *           actions may grow the packet in place.
+ *           If the only action is OUTPUT to POFP_TABLE, the packet goes
+ *           through the flow tables from the first one. Otherwise the
+ *           actions are applied to it directly.
+ *           The channel task never waits for the datapath. If the queue
+ *           is full, the packet is dropped, counted, and reported.
+ ***********************************************************************/
+uint32_t pofdp_packet_out(pof_packet_out *packet_out_ptr, uint32_t data_len){
+    struct pofdp_packet dpp[1] = {0};
+    struct pof_instruction *ins;
+    pof_instruction_apply_actions *apply;
+    pof_action_output *output;
+    uint32_t port_id, ret;
+    uint16_t len;
+
+    if(packet_out_ptr->action_num > POF_MAX_ACTION_NUMBER_PER_INSTRUCTION){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBAC_TOO_MANY, g_recv_xid);
+    }
+    if(packet_out_ptr->buffer_id == POF_NO_BUFFER && \
+            (packet_out_ptr->packet_len == 0 || \
+             packet_out_ptr->packet_len > POFDP_PACKET_RAW_MAX_LEN || \
+             packet_out_ptr->packet_len > data_len)){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_PACKET, g_recv_xid);
+    }
+    if(packet_out_ptr->buffer_id == POF_NO_BUFFER){
+        ret = pofdp_packet_out_check_in_port(packet_out_ptr->in_port);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+
+    /* The instruction is stored behind the packet room, and freed with
+     * the packet. */
+    ret = malloc_packet_data(dpp, 0, sizeof(struct pof_instruction));
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    if(packet_out_ptr->buffer_id != POF_NO_BUFFER){
+        ret = pofdp_packet_in_buffer_take(packet_out_ptr->buffer_id, dpp->buf, &len, &port_id);
+        if(ret != POF_OK){
+            free_packet_data(dpp);
+            return ret;
+        }
+    }else{
+        len = packet_out_ptr->packet_len;
+        port_id = packet_out_ptr->in_port;
+        memcpy(dpp->buf, packet_out_ptr->data, len);
+    }
+    dpp->ori_port_id = port_id;
+    dpp->ori_len = len;
+    dpp->left_len = len;
+
+    /* Go to the first flow table, or apply the actions. */
+    output = (pof_action_output *)packet_out_ptr->action[0].action_data;
+    if(!(packet_out_ptr->action_num == 1 && \
+            packet_out_ptr->action[0].type == POFAT_OUTPUT && \
+            output->outputPortId == POFP_TABLE)){
+        ins = (struct pof_instruction *)(dpp->buf + POFDP_PACKET_RAW_MAX_LEN);
+        memset(ins, 0, sizeof(struct pof_instruction));
+        ins->type = POFIT_APPLY_ACTIONS;
+        ins->len = sizeof(pof_instruction_apply_actions);
+        apply = (pof_instruction_apply_actions *)ins->instruction_data;
+        apply->action_num = packet_out_ptr->action_num;
+        memcpy(apply->action, packet_out_ptr->action, \
+                packet_out_ptr->action_num * sizeof(pof_action));
+        dpp->ins = ins;
+    }
+
+    dpp->ts = pofdp_latency_start();
+    if(pofbf_queue_write(g_pofdp_recv_q_id, dpp, sizeof *dpp, POF_NO_WAIT) != POF_OK){
+        free_packet_data(dpp);
+        __sync_fetch_and_add(&g_pofdp_packet_out_dropped, 1);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid);
+    }
+
+    return POF_OK;
+}
+
+/* Reset the packet-in bucket to be full with the new rate. The unit of
+ * rate is packet per second, and zero means no limitation. */
+static void pofdp_packet_in_reset_bucket(struct pofdp_packet_in_bucket *b, \
+                                         uint32_t rate, uint32_t burst)
+{
+    memset(b, 0, sizeof(struct pofdp_packet_in_bucket));
+    if(rate != 0){
+        b->ns_per_packet = POFDP_PACKET_IN_NS_PER_PACKET(rate);
+        b->burst_ns = POFDP_PACKET_IN_BURST_NS(rate, burst);
+    }
+    return;
+}
+
+/***********************************************************************
+ * Set the packet-in rate limitation of one reason.
+ * Form:     uint32_t pofdp_set_packet_in_rate(uint32_t reason, \
+ *                                             uint32_t rate, \
+ *                                             uint32_t burst)
+ * Input:    packet-in reason, rate in packet per second, burst in packet
+ * Output:   NONE
+ * Return:   POF_OK or POF_ERROR
+ * Discribe: This function limits the packet-in messages with the reason.
+ *           Rate 0 means no limitation. The counters of the reason are
+ *           reset.
+ ***********************************************************************/
+uint32_t pofdp_set_packet_in_rate(uint32_t reason, uint32_t rate, uint32_t burst){
+    if(reason >= POFDP_PACKET_IN_REASON_NUM){
+        POF_ERROR_CPRINT_FL(1,RED,"The packet-in reason %u is invalid.", reason);
+        return POF_ERROR;
+    }
+
+    pofdp_packet_in_reset_bucket(&g_pofdp_packet_in_limit.reason[reason], rate, burst);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Set the packet-in rate limitation of each ingress port.
+ * Form:     uint32_t pofdp_set_packet_in_port_rate(uint32_t rate, uint32_t burst)
+ * Input:    rate in packet per second, burst in packet
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: This function limits the packet-in messages from each ingress
+ *           port. Rate 0 means no limitation. The counters of the ports
+ *           are reset.
+ ***********************************************************************/
+uint32_t pofdp_set_packet_in_port_rate(uint32_t rate, uint32_t burst){
+    uint32_t i;
+
+    for(i=0; i<POFDP_PACKET_IN_PORT_NUM; i++){
+        pofdp_packet_in_reset_bucket(&g_pofdp_packet_in_limit.port[i], rate, burst);
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Set the sampling of the packet-in over the rate.
+ * Form:     uint32_t pofdp_set_packet_in_sample(uint32_t sample)
+ * Input:    sample
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: One of every sample packet-in messages over the rate is still
+ *           sent to the Controller. Sample 0 drops all of them.
+ ***********************************************************************/
+uint32_t pofdp_set_packet_in_sample(uint32_t sample){
+    g_pofdp_packet_in_limit.sample = sample;
+    return POF_OK;
+}
+
+/* Charge one packet-in to the bucket. Returns FALSE if the bucket is
+ * over the rate. The bucket is updated with compare-and-swap in the same
+ * way as the meter, so the datapath tasks share it without lock. */
+static uint8_t pofdp_packet_in_bucket_charge(struct pofdp_packet_in_bucket *b, uint64_t now){
+    uint64_t old_tat, tat;
+
+    if(b->ns_per_packet == 0){
+        return TRUE;
+    }
+    do{
+        old_tat = b->tat;
+        tat = (old_tat > now) ? old_tat : now;
+        if(tat - now > b->burst_ns){
+            return FALSE;
+        }
+    }while(!__sync_bool_compare_and_swap(&b->tat, old_tat, tat + b->ns_per_packet));
+
+    return TRUE;
+}
+
+/* Give back one packet-in charged to the bucket. */
+static void pofdp_packet_in_bucket_refund(struct pofdp_packet_in_bucket *b){
+    uint64_t old_tat;
+
+    if(b->ns_per_packet == 0){
+        return;
+    }
+    do{
+        old_tat = b->tat;
+    }while(!__sync_bool_compare_and_swap(&b->tat, old_tat, old_tat - b->ns_per_packet));
+    return;
+}
+
+/* Decide whether the packet-in with the reason from the port is sent.
+ * Both of the port bucket and the reason bucket must allow it, unless
+ * it is picked by the sampling. A packet-in the reason bucket rejects is
+ * given back to the port bucket, so a flooding reason does not use up
+ * the rate of the other reasons from the same port. */
+static uint8_t pofdp_packet_in_admit(uint8_t reason, uint32_t port_id){
+    struct pofdp_packet_in_bucket *rb, *pb, *b = NULL;
+    struct timespec ts;
+    uint64_t now;
+    uint32_t sample;
+
+    rb = &g_pofdp_packet_in_limit.reason[reason];
+    pb = &g_pofdp_packet_in_limit.port[port_id % POFDP_PACKET_IN_PORT_NUM];
+    if(rb->ns_per_packet == 0 && pb->ns_per_packet == 0){
+        return TRUE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if(!pofdp_packet_in_bucket_charge(pb, now)){
+        b = pb;
+    }else if(!pofdp_packet_in_bucket_charge(rb, now)){
+        pofdp_packet_in_bucket_refund(pb);
+        b = rb;
+    }
+
+    if(b == NULL){
+        __sync_fetch_and_add(&rb->sent, 1);
+        __sync_fetch_and_add(&pb->sent, 1);
+        return TRUE;
+    }
+
+    sample = g_pofdp_packet_in_limit.sample;
+    if(sample != 0 && __sync_fetch_and_add(&pofdp_packet_in_exceed_count, 1) % sample == 0){
+        __sync_fetch_and_add(&b->sampled, 1);
+        return TRUE;
+    }
+    __sync_fetch_and_add(&b->dropped, 1);
+    return FALSE;
+}
+
 /***********************************************************************
  * Send packet upward to the Controller
  * Form:     uint32_t pofdp_send_packet_in_to_controller(uint16_t len, \
  *                                                       uint8_t reason, \
  *                                                       uint8_t table_id, \
- *                                                       uint64_t cookie, \
+ *                                                       struct pof_flow_entry *pfe, \
  *                                                       uint32_t device_id, \
+ *                                                       uint32_t port_id, \
  *                                                       uint8_t *packet)
- * Input:    packet length, upward reason, current table id, cookie,
- *           device id, packet data
+ * Input:    packet length, upward reason, current table id, flow entry,
+ *           device id, input port id, packet data
  * Output:   NONE
  * Return:   POF_OK or Error code
  * Discribe: This function send the packet data upward to the controller.
@@ -518,40 +978,75 @@ uint32_t pofdp_send_raw(struct pofdp_packet *dpp){
  *           and encapsulate to a new openflow packet. Then the new packet
  *           will be send to the mpu module in order to send upward to the
  *           Controller.
+ *           Unless miss_send_len is POFCML_NO_BUFFER, the packet is kept
+ *           in the packet-in buffer, and only the first miss_send_len
+ *           bytes are sent with the buffer id. The whole packet is sent
+ *           if the buffer is full.
+ *           The packet-in over the rate of its reason or of its ingress
+ *           port is dropped silently before it is buffered.
  ***********************************************************************/
 uint32_t pofdp_send_packet_in_to_controller(uint16_t len, \
                                             uint8_t reason, \
                                             uint8_t table_id, \
 											struct pof_flow_entry *pfe, \
                                             uint32_t device_id, \
+                                            uint32_t port_id, \
                                             uint8_t *packet)
 {
-    pof_packet_in packetin = {0};
-    uint32_t      packet_in_len;
-
-    /* The length of the packet in data upward to the Controller is the real length
-     * instead of the max length of the packet_in. */
-    packet_in_len = sizeof(pof_packet_in) - POF_PACKET_IN_MAX_LENGTH + len;
+    pof_switch_config *config_ptr;
+    pof_packet_in *packetin_ptr;
+    pofbf_msg     *msg;
+    uint32_t      packet_in_len, buffer_id = POF_NO_BUFFER;
+    uint16_t      data_len = len;
 
     /* Check the packet length. */
     if(len > POF_PACKET_IN_MAX_LENGTH){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
     }
 
-    packetin.buffer_id = 0xffffffff;
-    packetin.total_len = len;
-    packetin.reason = reason;
-    packetin.table_id = table_id;
+    /* Protect the Controller and the channel from packet-in flooding. */
+    if(!pofdp_packet_in_admit(reason, port_id)){
+        return POF_OK;
+    }
+
+    /* Buffer the packet and send only the head of it. */
+    poflr_get_switch_config(&config_ptr);
+    if(config_ptr->miss_send_len != POFCML_NO_BUFFER && \
+            POF_OK == pofdp_packet_in_buffer_store(packet, len, port_id, &buffer_id)){
+        if(data_len > config_ptr->miss_send_len){
+            data_len = config_ptr->miss_send_len;
+        }
+    }
+
+    /* The length of the packet in data upward to the Controller is the real length
+     * instead of the max length of the packet_in. */
+    packet_in_len = sizeof(pof_packet_in) - POF_PACKET_IN_MAX_LENGTH + data_len;
+
+    /* Build the packet-in in the message buffer directly. */
+    msg = pofec_new_msg(POFT_PACKET_IN, g_upward_xid++, packet_in_len);
+    if(msg == NULL){
+        if(buffer_id != POF_NO_BUFFER){
+            (void)pofdp_packet_in_buffer_take(buffer_id, NULL, NULL, NULL);
+        }
+        POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg);
+    }
+    packetin_ptr = (pof_packet_in *)(msg->data + sizeof(pof_header));
+    memset(packetin_ptr, 0, sizeof(pof_packet_in) - POF_PACKET_IN_MAX_LENGTH);
+
+    packetin_ptr->buffer_id = buffer_id;
+    packetin_ptr->total_len = len;
+    packetin_ptr->reason = reason;
+    packetin_ptr->table_id = table_id;
 	if(NULL != pfe){
-		packetin.cookie = pfe->cookie & pfe->cookie_mask;
+		packetin_ptr->cookie = pfe->cookie & pfe->cookie_mask;
 	}else{
-		packetin.cookie = 0;
+		packetin_ptr->cookie = 0;
 	}
-    packetin.device_id = device_id;
-    memcpy(packetin.data, packet, len);
-    pof_HtoN_transfer_packet_in(&packetin);
+    packetin_ptr->device_id = device_id;
+    memcpy(packetin_ptr->data, packet, data_len);
+    pof_HtoN_transfer_packet_in(packetin_ptr);
 
-    if(POF_OK != pofec_reply_msg(POFT_PACKET_IN, g_upward_xid++, packet_in_len, (uint8_t *)&packetin)){
+    if(POF_OK != pofec_send_msg(msg)){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid);
     }
 
@@ -642,6 +1137,7 @@ struct pof_datapath dp = {
 #else // POF_PROMISC_ON
     pofdp_no_promisc,
 #endif // POF_PROMISC_ON
+    pofdp_send_queue,
 };
 
 
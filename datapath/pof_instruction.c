@@ -35,7 +35,6 @@
 
 #ifdef POF_DATAPATH_ON
 
-static void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr, uint8_t match_field_num, const pof_match *match);
 static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp);
 
 /* Update instruction pointer and number in dpp when one instruction
@@ -78,20 +77,20 @@ move_packet_offset_backward(struct pofdp_packet *dpp, uint32_t offset)
 
 /***********************************************************************
  * Find the packet key before forwarding to the table.
- * Form:     uint32_t pofdp_find_key(uint8_t *packet, \
- *                                   uint8_t *metadata, \
- *                                   uint8_t **key_ptr, \
- *                                   uint8_t match_field_num, \
- *                                   const pof_match *match)
+ * Form:     void pofdp_find_key(uint8_t *packet, \
+ *                               uint8_t *metadata, \
+ *                               uint8_t **key_ptr, \
+ *                               uint8_t match_field_num, \
+ *                               const pof_match *match)
  * Input:    packet, metadata, match field number, match data
  * Output:   key
- * Return:   POF_OK or Error code
+ * Return:   VOID
  * Discribe: This function get the key of packet, according to the match
  *           data. This function will be called when the POFIT_GOTO_TABLE
  *           instruction is processing. We lookup the packet into flow
  *           table using the packet key builded in this function.
  ***********************************************************************/
-static void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr, uint8_t match_field_num, const pof_match *match){
+void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr, uint8_t match_field_num, const pof_match *match){
     pof_match tmp_match;
     uint32_t  ret;
     uint8_t   i;
@@ -125,7 +124,7 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp){
     uint8_t  table_ID;
 
 #if (POF_NOMATCH == POF_NOMATCH_PACKET_IN)
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"Send the packet which does NOT match " \
+    POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_INFO,YELLOW,"Send the packet which does NOT match " \
             "any entry in the table[%d][%d] to the controller", dpp->table_type, dpp->table_id);
 
     /* Current table ID. */
@@ -134,11 +133,11 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp){
 
     /* Send the no match packet upward to the Controller. */
     ret = pofdp_send_packet_in_to_controller(dpp->offset + dpp->left_len, \
-			POFR_NO_MATCH, table_ID, 0, POF_FE_ID, dpp->buf);
+			POFR_NO_MATCH, table_ID, 0, POF_FE_ID, dpp->ori_port_id, dpp->buf);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 #elif (POF_NOMATCH == POF_NOMATCH_DROP)
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"Drop the packet which does NOT match " \
+    POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_INFO,YELLOW,"Drop the packet which does NOT match " \
             "any entry in the table[%d][%d].", dpp->table_type, dpp->table_id);
 #endif
 
@@ -155,28 +154,40 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp){
  * Input:    packet, length of packet, instruction data
  * Output:   packet over identifier, meter
  * Return:   POF_OK or Error code
- * Discribe: This function load the meter table, and copy the meter value,
- *           according to the meter_id given in the ins_data, to the meter.
- *           Rate-limiting is not supported yet.
+ * Discribe: This function polices the packet with the meter whose
+ *           meter_id is given in the ins_data. The packet exceeding the
+ *           meter rate is droped, or marked red in the metadata when
+ *           POF_METER_EXCEED is POF_METER_EXCEED_MARK.
  * NOTE:     If there is an ERROR, The packet_over identifier will be TRUE.
  ***********************************************************************/
 static uint32_t execute_METER(POFDP_ARG)
 {
     pof_instruction_meter *p = (pof_instruction_meter *)dpp->ins->instruction_data;
     poflr_meters *meter_ptr = NULL;
-    uint32_t index;
+    uint32_t index, ret;
+    uint8_t conform = TRUE;
 
     index = p->meter_id;
     poflr_get_meter(&meter_ptr);
 
-    /* Check the meter id. */
-    if(meter_ptr->state[index] == POFLR_STATE_INVALID){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER, g_upward_xid++);
-    }
+    ret = poflr_meter_police(index, dpp->offset + dpp->left_len, &conform);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	dpp->rate = meter_ptr->meter[index].rate;
-    POF_DEBUG_CPRINT_FL(1,GREEN,"instruction_meter has been DONE! meter_id = %u, rate = %u", \
-			meter_ptr->meter[index].meter_id, meter_ptr->meter[index].rate);
+
+    if(conform == FALSE){
+#if (POF_METER_EXCEED == POF_METER_EXCEED_DROP)
+        POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,YELLOW,"Drop the packet which exceeds the meter. meter_id = %u, rate = %u", \
+                index, dpp->rate);
+        dpp->packet_done = TRUE;
+        return POF_OK;
+#elif (POF_METER_EXCEED == POF_METER_EXCEED_MARK)
+        dpp->metadata->reserve = POFDP_METER_COLOR_RED;
+#endif // POF_METER_EXCEED
+    }
+
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"instruction_meter has been DONE! meter_id = %u, rate = %u, conform = %u", \
+			index, dpp->rate, conform);
 
 	instruction_update(dpp);
     return POF_OK;
@@ -206,7 +217,7 @@ static uint32_t execute_WRITE_METADATA(POFDP_ARG)
 	ret = pofdp_write_32value_to_field(value, &pm, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->metadata, POF_BITNUM_TO_BYTENUM_CEIL(p->metadata_offset+p->len),"instruction_write_metadata has been DONE! The metadata = ");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,dpp->metadata, POF_BITNUM_TO_BYTENUM_CEIL(p->metadata_offset+p->len),"instruction_write_metadata has been DONE! The metadata = ");
 
 	instruction_update(dpp);
     return POF_OK;
@@ -242,7 +253,7 @@ static uint32_t execute_WRITE_METADATA_FROM_PACKET(POFDP_ARG)
     pofdp_copy_bit(dpp->buf_offset, value, p->packet_offset, p->len);
     pofdp_cover_bit((uint8_t *)metadata, value, p->metadata_offset, p->len);
 
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,metadata, POF_BITNUM_TO_BYTENUM_CEIL(p->metadata_offset+p->len),"instruction_write_metadata_from_packet has been DONE! The metadata = ");
+    POF_LOG_CPRINT_FL_0X(POFLP_DATAPATH,POFLP_DEBUG,GREEN,metadata, POF_BITNUM_TO_BYTENUM_CEIL(p->metadata_offset+p->len),"instruction_write_metadata_from_packet has been DONE! The metadata = ");
 
 	instruction_update(dpp);
     return POF_OK;
@@ -269,7 +280,6 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
     pof_instruction_goto_direct_table *p = \
 			(pof_instruction_goto_direct_table *)dpp->ins->instruction_data;
     poflr_flow_table *tmp_table;
-    poflr_flow_entry *tmp_entry;
     uint8_t *table_type = &dpp->table_type;
     uint8_t *table_id = &dpp->table_id;
     uint32_t i, ret, entry_index;
@@ -287,7 +297,7 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
 	entry_index = p->table_entry_index;
 
     poflr_get_flow_table(&tmp_table, *table_type, *table_id);
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"Go to DT table[%d][%d][%d]!", *table_type, *table_id, entry_index);
+    POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_DEBUG,YELLOW,"Go to DT table[%d][%d][%d]!", *table_type, *table_id, entry_index);
 
     /* Check the table type. */
     if(*table_type != POF_LINEAR_TABLE){
@@ -299,14 +309,11 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_TABLE_UNEXIST, g_upward_xid++);
     }
 
-    tmp_entry = &(tmp_table->entry_ptr[entry_index]);
-    /* Check the flow entry. */
-    if(tmp_entry->state == POFLR_STATE_INVALID){
+    /* Load the flow entry data. */
+    if(pofdp_lookup_direct(tmp_table, entry_index, &dpp->flow_entry) != POF_OK){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_ENTRY_UNEXIST, g_upward_xid++);
     }
-
-    /* Load the flow entry data. */
-    dpp->flow_entry = &tmp_entry->entry;
+    POFDP_TRACE(dpp, POFDP_TRACE_LOOKUP, TRUE, entry_index, 0);
 
     /* Increase the counter value. */
     ret = poflr_counter_increace(dpp->flow_entry->counter_id);
@@ -318,7 +325,7 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
     dpp->ins_todo_num = dpp->flow_entry->instruction_num;
 	dpp->ins_done_num = 0;
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"Match entry! ");
+    POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_DEBUG,GREEN,"Match entry! ");
 
     return POF_OK;
 }
@@ -357,6 +364,7 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
     uint8_t *table_type = &dpp->table_type;
     uint8_t *table_id = &dpp->table_id;
     uint8_t  **key_ptr;
+    uint64_t ts;
 
     p = (pof_instruction_goto_table *)dpp->ins->instruction_data;
 
@@ -368,11 +376,12 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
     ret = poflr_table_ID_to_id(p->next_table_id, table_type, table_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    POF_DEBUG_CPRINT_FL(1,YELLOW,"Go to table[%d][%d]!", *table_type, *table_id);
+    POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_DEBUG,YELLOW,"Go to table[%d][%d]!", *table_type, *table_id);
 
     poflr_get_flow_table(&table_vhal_ptr, *table_type, *table_id);
 
     /* Find the key corresponding to the next table infomation. */
+    ts = pofdp_latency_start();
     key_ptr = (uint8_t **)malloc(POF_MAX_MATCH_FIELD_NUM * sizeof(ptr_t));
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(key_ptr);
     for(i=0; i<POF_MAX_MATCH_FIELD_NUM;  i++){
@@ -387,24 +396,32 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
     }
     pofdp_find_key(dpp->buf_offset, (uint8_t *)dpp->metadata, (uint8_t **)(key_ptr), 
 			table_vhal_ptr->tbl_base_info.match_field_num, table_vhal_ptr->tbl_base_info.match);
+    ts = pofdp_latency_end(POFDP_STAGE_KEY, ts);
 
     /* Lookup the flow entry which matches the packet in the next table. */
-    if(pofdp_lookup_in_table((uint8_t **)key_ptr, table_vhal_ptr->tbl_base_info.match_field_num, \
-             *table_vhal_ptr, &dpp->flow_entry) != POF_OK){
+    ret = pofdp_lookup_in_table((uint8_t **)key_ptr, table_vhal_ptr->tbl_base_info.match_field_num, \
+             table_vhal_ptr, &dpp->flow_entry);
+    pofdp_latency_end(POFDP_STAGE_LOOKUP, ts);
+    if(ret != POF_OK){
 
         /* No match. */
-        POF_DEBUG_CPRINT_FL(1,RED,"Cannot find the right entry in table[%d][%d]!",*table_type,*table_id);
+        POF_LOG_CPRINT_FL(POFLP_LOOKUP,POFLP_INFO,RED,"Cannot find the right entry in table[%d][%d]!",*table_type,*table_id);
+        POFDP_TRACE(dpp, POFDP_TRACE_LOOKUP, FALSE, 0, 0);
 
         ret = pofdp_entry_nomatch(dpp);
         POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
 
         dpp->packet_done = TRUE;
     }else{
+        POFDP_TRACE(dpp, POFDP_TRACE_LOOKUP, TRUE, dpp->flow_entry->index, 0);
 
         /* Match. Increace the counter value. */
         ret = poflr_counter_increace(dpp->flow_entry->counter_id);
         POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
 
+        /* Record the hit for the idle timeout. */
+        POFLR_FLOW_ENTRY_HIT(dpp->flow_entry);
+
         /* Update the instruction number and the instruction data corresponding to the
          * matched flow entry in the current flow table. */
         dpp->ins = dpp->flow_entry->instruction;
@@ -592,6 +609,8 @@ uint32_t pofdp_instruction_execute(POFDP_ARG)
     /* Forward the packet via executing the instructions until packet_over is TRUE or all
      * instructions have been done. */
     while(dpp->packet_done == FALSE){
+        POFDP_TRACE(dpp, POFDP_TRACE_INSTRUCTION, dpp->ins->type, 0, 0);
+
         /* Execute the instructions. */
         switch(dpp->ins->type){
 #define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: ret = execute_##NAME(dpp); break;
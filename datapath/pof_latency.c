@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+#include <time.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* Off by default, since it reads the clock several times per packet.
+ * Latency_stat or the command turns it on. */
+volatile uint32_t g_pofdp_latency_on = FALSE;
+
+const char *g_pofdp_stage_str[POFDP_STAGE_NUM] = {
+#define POFDP_STAGE(NAME,STR) STR,
+    POFDP_STAGES
+#undef POFDP_STAGE
+};
+
+/* Latency histograms of one thread. Only the thread writes them, so the
+ * recording needs no atomic operation. The readers may see a count which
+ * is a little ahead of the buckets. */
+typedef struct pofdp_latency_thread{
+    struct pofdp_hist hist[POFDP_STAGE_NUM];
+}pofdp_latency_thread;
+
+static void pofdp_latency_thread_init(void *data);
+static pofbf_thread_slots pofdp_latency_slots = \
+    POFBF_THREAD_SLOTS_INIT(sizeof(pofdp_latency_thread), pofdp_latency_thread_init);
+static __thread pofdp_latency_thread *pofdp_latency_self = NULL;
+
+static uint64_t pofdp_latency_now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void pofdp_latency_thread_init(void *data){
+    pofdp_latency_thread *lt = (pofdp_latency_thread *)data;
+    uint32_t i;
+
+    for(i=0; i<POFDP_STAGE_NUM; i++){
+        lt->hist[i].min = UINT64_MAX;
+    }
+    return;
+}
+
+/* Get the histograms of the calling thread. */
+static pofdp_latency_thread *pofdp_latency_thread_get(){
+    pofdp_latency_self = pofbf_thread_slot_get(&pofdp_latency_slots);
+    return pofdp_latency_self;
+}
+
+static uint32_t pofdp_hist_index(uint64_t value){
+    uint32_t e;
+
+    if(value < POFDP_HIST_SUB_NUM){
+        return (uint32_t)value;
+    }
+    e = 63 - __builtin_clzll(value);
+    return ((e - POFDP_HIST_SUB_BITS + 1) << POFDP_HIST_SUB_BITS) | \
+           ((value >> (e - POFDP_HIST_SUB_BITS)) & (POFDP_HIST_SUB_NUM - 1));
+}
+
+/* The highest value counted in the bucket. */
+static uint64_t pofdp_hist_value(uint32_t index){
+    uint32_t shift;
+
+    if(index < POFDP_HIST_SUB_NUM){
+        return index;
+    }
+    shift = (index >> POFDP_HIST_SUB_BITS) - 1;
+    return (((uint64_t)(POFDP_HIST_SUB_NUM | (index & (POFDP_HIST_SUB_NUM - 1))) + 1) << shift) - 1;
+}
+
+/***********************************************************************
+ * Set the latency measurement on or off
+ * Form:     uint32_t pofdp_set_latency_on(uint32_t on)
+ * Input:    on
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: This function turns on the latency measurement if on is not
+ *           zero, otherwise turns it off. The histograms are kept.
+ ***********************************************************************/
+uint32_t pofdp_set_latency_on(uint32_t on){
+    g_pofdp_latency_on = (on != 0) ? TRUE : FALSE;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Start a latency measurement
+ * Form:     uint64_t pofdp_latency_start()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   current time in ns, or 0 if the measurement is off
+ * Discribe: The time returned is passed to pofdp_latency_end() when the
+ *           stage is over, or stored in the packet for the task which
+ *           the packet is handed to.
+ ***********************************************************************/
+uint64_t pofdp_latency_start(){
+    if(g_pofdp_latency_on == FALSE){
+        return 0;
+    }
+    return pofdp_latency_now();
+}
+
+/***********************************************************************
+ * End a latency measurement
+ * Form:     uint64_t pofdp_latency_end(uint32_t stage, uint64_t start)
+ * Input:    stage, start time in ns
+ * Output:   NONE
+ * Return:   current time in ns, or 0 if the measurement is off
+ * Discribe: This function adds the time since start to the histogram of
+ *           the stage of the calling thread. Nothing is done if start is
+ *           0. The time returned can start the next stage.
+ ***********************************************************************/
+uint64_t pofdp_latency_end(uint32_t stage, uint64_t start){
+    pofdp_latency_thread *lt = pofdp_latency_self;
+    uint64_t now, value;
+
+    if(start == 0 || g_pofdp_latency_on == FALSE){
+        return 0;
+    }
+    if(lt == NULL && (lt = pofdp_latency_thread_get()) == NULL){
+        return 0;
+    }
+
+    now = pofdp_latency_now();
+    value = (now > start) ? now - start : 0;
+
+    pofdp_hist_record(&lt->hist[stage], value);
+    return now;
+}
+
+/***********************************************************************
+ * Record a value in the histogram
+ * Form:     void pofdp_hist_record(struct pofdp_hist *hist, uint64_t value)
+ * Input:    histogram, value in ns
+ * Output:   histogram
+ * Return:   VOID
+ * Discribe: This function counts the value in its bucket and updates the
+ *           sum, min and max. The histogram is not locked, so it should
+ *           be written by one thread only.
+ ***********************************************************************/
+void pofdp_hist_record(struct pofdp_hist *hist, uint64_t value){
+    hist->bucket[pofdp_hist_index(value)]++;
+    hist->sum += value;
+    if(hist->count == 0 || value < hist->min){
+        hist->min = value;
+    }
+    if(value > hist->max){
+        hist->max = value;
+    }
+    hist->count++;
+    return;
+}
+
+/***********************************************************************
+ * Get the latency histograms
+ * Form:     void pofdp_latency_snapshot(struct pofdp_hist *hist)
+ * Input:    NONE
+ * Output:   histograms of all the stages
+ * Return:   VOID
+ * Discribe: This function sums the histograms of all the threads into
+ *           hist, which has POFDP_STAGE_NUM elements. The count is
+ *           taken from the buckets, so that it agrees with them.
+ ***********************************************************************/
+void pofdp_latency_snapshot(struct pofdp_hist *hist){
+    const pofdp_latency_thread *lt;
+    const struct pofdp_hist *h;
+    uint32_t i, s, b, num;
+
+    memset(hist, 0, POFDP_STAGE_NUM * sizeof *hist);
+    for(s=0; s<POFDP_STAGE_NUM; s++){
+        hist[s].min = UINT64_MAX;
+    }
+
+    num = pofbf_thread_slot_num(&pofdp_latency_slots);
+    for(i=0; i<num; i++){
+        lt = POFBF_THREAD_SLOT_DATA(&pofdp_latency_slots, i);
+        for(s=0; s<POFDP_STAGE_NUM; s++){
+            h = &lt->hist[s];
+            if(h->count == 0){
+                continue;
+            }
+            for(b=0; b<POFDP_HIST_BUCKET_NUM; b++){
+                hist[s].bucket[b] += h->bucket[b];
+                hist[s].count += h->bucket[b];
+            }
+            hist[s].sum += h->sum;
+            if(h->min < hist[s].min){
+                hist[s].min = h->min;
+            }
+            if(h->max > hist[s].max){
+                hist[s].max = h->max;
+            }
+        }
+    }
+
+    for(s=0; s<POFDP_STAGE_NUM; s++){
+        if(hist[s].count == 0){
+            hist[s].min = 0;
+        }
+    }
+    return;
+}
+
+/***********************************************************************
+ * Get the percentile of the histogram
+ * Form:     uint64_t pofdp_hist_percentile(const struct pofdp_hist *hist, \
+ *                                          double percent)
+ * Input:    histogram, percent such as 99.9
+ * Output:   NONE
+ * Return:   latency in ns
+ * Discribe: This function returns the highest value of the bucket where
+ *           the percentile falls, but not more than the max.
+ ***********************************************************************/
+uint64_t pofdp_hist_percentile(const struct pofdp_hist *hist, double percent){
+    uint64_t rank, sum = 0, value;
+    uint32_t b;
+
+    if(hist->count == 0){
+        return 0;
+    }
+    rank = (uint64_t)(hist->count * percent / 100.0 + 0.5);
+    if(rank == 0){
+        rank = 1;
+    }
+    for(b=0; b<POFDP_HIST_BUCKET_NUM; b++){
+        sum += hist->bucket[b];
+        if(sum >= rank){
+            break;
+        }
+    }
+    value = pofdp_hist_value(b);
+    return (value < hist->max) ? value : hist->max;
+}
+
+/***********************************************************************
+ * Dump the latency histograms
+ * Form:     void pofdp_latency_dump(FILE *fp)
+ * Input:    output stream
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function writes the histograms of all the stages to fp
+ *           in one line of JSON. Each stage has its count, sum, min, max,
+ *           p50, p99 and p999 in ns, and the non-empty buckets as pairs
+ *           of the highest value and the count.
+ ***********************************************************************/
+void pofdp_latency_dump(FILE *fp){
+    struct pofdp_hist *hist, *h;
+    uint32_t s, b, first;
+
+    hist = malloc(POFDP_STAGE_NUM * sizeof *hist);
+    if(hist == NULL){
+        fprintf(fp, "{}\n");
+        return;
+    }
+    pofdp_latency_snapshot(hist);
+
+    fprintf(fp, "{\"unit\":\"ns\",\"stages\":{");
+    for(s=0; s<POFDP_STAGE_NUM; s++){
+        h = &hist[s];
+        fprintf(fp, "%s\"%s\":{\"count\":%llu,\"sum\":%llu,\"min\":%llu,\"max\":%llu," \
+                "\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"buckets\":[", \
+                (s == 0) ? "" : ",", g_pofdp_stage_str[s], \
+                (unsigned long long)h->count, (unsigned long long)h->sum, \
+                (unsigned long long)h->min, (unsigned long long)h->max, \
+                (unsigned long long)pofdp_hist_percentile(h, 50), \
+                (unsigned long long)pofdp_hist_percentile(h, 99), \
+                (unsigned long long)pofdp_hist_percentile(h, 99.9));
+        first = TRUE;
+        for(b=0; b<POFDP_HIST_BUCKET_NUM; b++){
+            if(h->bucket[b] == 0){
+                continue;
+            }
+            fprintf(fp, "%s[%llu,%llu]", (first == TRUE) ? "" : ",", \
+                    (unsigned long long)pofdp_hist_value(b), (unsigned long long)h->bucket[b]);
+            first = FALSE;
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "}}\n");
+    fflush(fp);
+
+    free(hist);
+    return;
+}
+
+#endif // POF_DATAPATH_ON
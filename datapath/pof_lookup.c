@@ -32,13 +32,11 @@
 
 #ifdef POF_DATAPATH_ON
 
-static uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num, const pof_match_x *match);
-
 /***********************************************************************
  * Lookup the matched flow entry in the table using the keys.
  * Form:     uint32_t pofdp_lookup_in_table(uint8_t **key_ptr,
  *                                          uint8_t match_field_num,
- *                                          poflr_flow_table table_vhal,
+ *                                          poflr_flow_table *table_ptr,
  *                                          pof_flow_entry **entry_ptrptr)
  * Input:    keys, match field number, flow table
  * Output:   matched flow entry
@@ -46,29 +44,34 @@ static uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num
  * Discribe: This function lookup the flow entry matched the packet in
  *           the flow table using the match keys. If there is no matched
  *           flow entry, return POF_ERROR.
+ *           The caller must be in the read-side section of the flow
+ *           tables. The entries may be replaced during the lookup, but
+ *           each one read is whole. The lookup is counted in the table
+ *           statistics.
  ***********************************************************************/
 uint32_t pofdp_lookup_in_table(uint8_t **key_ptr, \
                                uint8_t match_field_num, \
-                               poflr_flow_table table_vhal, \
+                               poflr_flow_table *table_ptr, \
                                pof_flow_entry **entry_ptrptr)
 {
-    poflr_flow_entry *entry_ptr = table_vhal.entry_ptr;
-    pof_instruction  *ins_ptr;
-    uint32_t i, entry_num = table_vhal.entry_num;
+    poflr_flow_entry *entry_ptr;
+    uint32_t i, count, entry_num = table_ptr->entry_num;
+    uint32_t size = table_ptr->tbl_base_info.size;
     uint16_t *priority = NULL;
 
     *entry_ptrptr = NULL;
 
     /* Check the flow table state. */
-    if( table_vhal.state == POFLR_STATE_INVALID ){
+    if( table_ptr->state == POFLR_STATE_INVALID ){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_TABLE_UNEXIST, g_upward_xid++);
     }
 
     /* Match the key against every flow entry in the flow table. */
-    for(i=0; i<entry_num; entry_ptr++){
+    for(i=0, count=0; count<entry_num && i<size; i++){
 
-        /* Check the flow entry state. If the flow entry is invalid, go to next flow entry. */
-        if(entry_ptr->state == POFLR_STATE_INVALID)
+        /* If there is no flow entry of the index, go to next flow entry. */
+        entry_ptr = POFBF_RCU_DEREF(table_ptr->entry_ptr[i]);
+        if(entry_ptr == NULL)
             continue;
 
         /* Match the key against the flow entry. */
@@ -83,8 +86,10 @@ uint32_t pofdp_lookup_in_table(uint8_t **key_ptr, \
                 }
             }
         }
-        i++;
+        count++;
     }
+    pofdp_table_stats_count(table_ptr->tbl_base_info.type, table_ptr->tbl_base_info.tid, \
+                            (*entry_ptrptr != NULL), count);
 
     /* Check whether the key matches any flow entry or not. */
     if(*entry_ptrptr == NULL){
@@ -94,18 +99,51 @@ uint32_t pofdp_lookup_in_table(uint8_t **key_ptr, \
     return POF_OK;
 }
 
+/***********************************************************************
+ * Get the flow entry of the index in the linear table.
+ * Form:     uint32_t pofdp_lookup_direct(poflr_flow_table *table_ptr, \
+ *                                        uint32_t index, \
+ *                                        pof_flow_entry **entry_ptrptr)
+ * Input:    flow table, entry index
+ * Output:   flow entry
+ * Return:   POF_OK, or POF_ERROR if there is no entry of the index
+ * Discribe: This function gets the flow entry without matching, as the
+ *           GOTO_DIRECT_TABLE instruction does. The caller must be in
+ *           the read-side section of the flow tables. The lookup is
+ *           counted in the table statistics.
+ ***********************************************************************/
+uint32_t pofdp_lookup_direct(poflr_flow_table *table_ptr, \
+                             uint32_t index, \
+                             pof_flow_entry **entry_ptrptr)
+{
+    poflr_flow_entry *entry_ptr = NULL;
+
+    *entry_ptrptr = NULL;
+    if(index < table_ptr->tbl_base_info.size){
+        entry_ptr = POFBF_RCU_DEREF(table_ptr->entry_ptr[index]);
+    }
+    pofdp_table_stats_count(table_ptr->tbl_base_info.type, table_ptr->tbl_base_info.tid, \
+                            (entry_ptr != NULL), (index < table_ptr->tbl_base_info.size));
+    if(entry_ptr == NULL){
+        return POF_ERROR;
+    }
+
+    *entry_ptrptr = &entry_ptr->entry;
+    return POF_OK;
+}
+
 /***********************************************************************
  * Match the keys against the specified flow entry.
- * Form:     static uint32_t pofdp_match_per_entry(uint8_t **key_ptr, \
- *                                                 uint8_t match_field_num, \
- *                                                 const pof_match_x *match)
+ * Form:     uint32_t pofdp_match_per_entry(uint8_t **key_ptr, \
+ *                                          uint8_t match_field_num, \
+ *                                          const pof_match_x *match)
  * Input:    keys, match field number, match data
  * Output:   NONE
  * Return:   TRUE: match, FALSE: do not match
  * Discribe: This function matches the keys against the specified flow
  *           entry. If match successfully, return TRUE.
  ***********************************************************************/
-static uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num, const pof_match_x *match){
+uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num, const pof_match_x *match){
     pof_match_x tmp_match;
     uint16_t    j, len_B;
     uint8_t     i, *value, *mask;
@@ -138,9 +176,9 @@ static uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num
  *           should make sure that data_ori and value are not NULL.
  ***********************************************************************/
 void pofdp_cover_bit(uint8_t *data_ori, uint8_t *value, uint16_t pos_b, uint16_t len_b){
-    uint32_t process_len_b = 0;
+    uint32_t process_len_b = 0, rest_b;
     uint16_t pos_b_x, len_B, after_len_b_x;
-    uint8_t *ptr;
+    uint8_t *ptr, next;
 
     pos_b_x = pos_b % 8;
     len_B = (uint16_t)((len_b - 1) / 8 + 1);
@@ -158,14 +196,19 @@ void pofdp_cover_bit(uint8_t *data_ori, uint8_t *value, uint16_t pos_b, uint16_t
         | POF_MOVE_BIT_RIGHT(*value, pos_b_x);
 
     process_len_b = 8 - pos_b_x;
-    while(process_len_b < (len_b-8)){
-        *(++ptr) = POF_MOVE_BIT_LEFT(*value, 8-pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x);
+    while(process_len_b + 8 < len_b){
+        *(++ptr) = POF_MOVE_BIT_LEFT(value[0], 8-pos_b_x) | POF_MOVE_BIT_RIGHT(value[1], pos_b_x);
+        value++;
         process_len_b += 8;
     }
 
-    *(ptr+1) = (POF_MOVE_BIT_LEFT(*value, 8-pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x) \
-        & POF_MOVE_BIT_LEFT(0xff, 8 - (len_b - process_len_b))) \
-        | (*(ptr+1) & POF_MOVE_BIT_RIGHT(0xff, len_b - process_len_b));
+    /* The next byte of the value is read only if the last bits are in
+     * it, as the value buffer may end right here. */
+    rest_b = len_b - process_len_b;
+    next = (rest_b > pos_b_x) ? value[1] : 0;
+    *(ptr+1) = ((POF_MOVE_BIT_LEFT(value[0], 8-pos_b_x) | POF_MOVE_BIT_RIGHT(next, pos_b_x)) \
+        & POF_MOVE_BIT_LEFT(0xff, 8 - rest_b)) \
+        | (*(ptr+1) & POF_MOVE_BIT_RIGHT(0xff, rest_b));
 
     return;
 }
@@ -185,9 +228,9 @@ void pofdp_cover_bit(uint8_t *data_ori, uint8_t *value, uint16_t pos_b, uint16_t
 void pofdp_copy_bit(uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b){
     uint32_t process_len_b = 0, offset_b_x;
     uint16_t offset_B;
-    uint8_t  *ptr;
+    uint8_t  *ptr, next;
 
-	if(NULL==data_ori || NULL==data_res){
+	if(NULL==data_ori || NULL==data_res || len_b==0){
 		return;
 	}
 
@@ -195,9 +238,13 @@ void pofdp_copy_bit(uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uin
     offset_b_x = offset_b % 8;
     ptr = data_ori + offset_B;
 
+    /* The next byte of the original data is read only if the piece
+     * goes on in it, so nothing behind the piece is touched. */
     while(process_len_b < len_b){
-        *(data_res++) = POF_MOVE_BIT_LEFT(*ptr, offset_b_x) \
-            | POF_MOVE_BIT_RIGHT(*(++ptr), 8 - offset_b_x);
+        next = (offset_b_x + len_b - process_len_b > 8) ? ptr[1] : 0;
+        *(data_res++) = POF_MOVE_BIT_LEFT(ptr[0], offset_b_x) \
+            | POF_MOVE_BIT_RIGHT(next, 8 - offset_b_x);
+        ptr++;
         process_len_b += 8;
     }
 
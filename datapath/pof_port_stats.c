@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* Port counters of one thread. Only the thread writes them, so the
+ * counting needs no atomic operation. The readers sum the counters of
+ * all the slots. Each port has its own receive task, so the receive
+ * counters of a thread are also the ones of the receive queue. */
+typedef struct pofdp_port_stats_thread{
+    struct pofdp_port_stats port[POFDP_PORT_STATS_ID_MAX];
+}pofdp_port_stats_thread;
+
+static pofbf_thread_slots pofdp_port_stats_slots = \
+    POFBF_THREAD_SLOTS_INIT(sizeof(pofdp_port_stats_thread), NULL);
+static __thread pofdp_port_stats_thread *pofdp_port_stats_thread_self = NULL;
+
+/* Counters of the threads which failed to get their own ones, and of
+ * the port ids out of range. They are never read. */
+static __thread struct pofdp_port_stats pofdp_port_stats_discard;
+
+/* Get the counters of the calling thread. */
+static pofdp_port_stats_thread *pofdp_port_stats_thread_get(){
+    pofdp_port_stats_thread_self = pofbf_thread_slot_get(&pofdp_port_stats_slots);
+    return pofdp_port_stats_thread_self;
+}
+
+/***********************************************************************
+ * Get the port counters of the calling thread
+ * Form:     struct pofdp_port_stats *pofdp_port_stats_self(uint32_t port_id)
+ * Input:    port id
+ * Output:   NONE
+ * Return:   counters of the port
+ * Discribe: This function returns the counters of the port which only
+ *           the calling thread writes. The task which always counts for
+ *           the same port may keep the pointer. It never returns NULL:
+ *           if the counters can not be created, or the port id is too
+ *           large, the counting is discarded.
+ ***********************************************************************/
+struct pofdp_port_stats *pofdp_port_stats_self(uint32_t port_id){
+    pofdp_port_stats_thread *pt = pofdp_port_stats_thread_self;
+
+    if(port_id >= POFDP_PORT_STATS_ID_MAX){
+        return &pofdp_port_stats_discard;
+    }
+    if(pt == NULL && (pt = pofdp_port_stats_thread_get()) == NULL){
+        return &pofdp_port_stats_discard;
+    }
+    return &pt->port[port_id];
+}
+
+/***********************************************************************
+ * Get the counters of the port
+ * Form:     void pofdp_port_stats_get(uint32_t port_id, \
+ *                                     struct pofdp_port_stats *stats)
+ * Input:    port id
+ * Output:   counters of the port
+ * Return:   VOID
+ * Discribe: This function sums the counters of the port of all the
+ *           threads into stats.
+ ***********************************************************************/
+void pofdp_port_stats_get(uint32_t port_id, struct pofdp_port_stats *stats){
+    const pofdp_port_stats_thread *pt;
+    const struct pofdp_port_stats *ps;
+    uint32_t num, i;
+
+    memset(stats, 0, sizeof *stats);
+    if(port_id >= POFDP_PORT_STATS_ID_MAX){
+        return;
+    }
+
+    num = pofbf_thread_slot_num(&pofdp_port_stats_slots);
+    for(i=0; i<num; i++){
+        pt = POFBF_THREAD_SLOT_DATA(&pofdp_port_stats_slots, i);
+        ps = &pt->port[port_id];
+#define POFDP_PORT_COUNTER(NAME) stats->NAME += *(volatile const uint64_t *)&ps->NAME;
+        POFDP_PORT_COUNTERS
+#undef POFDP_PORT_COUNTER
+    }
+    return;
+}
+
+#endif // POF_DATAPATH_ON
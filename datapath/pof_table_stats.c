@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+
+#ifdef POF_DATAPATH_ON
+
+/* Table counters of one worker thread. Only the thread writes them, so
+ * the counting needs no atomic operation. The readers sum the counters
+ * of all the threads. */
+typedef struct pofdp_table_stats_thread{
+    struct pofdp_table_stats table[POF_MAX_TABLE_TYPE][POFDP_TABLE_STATS_ID_MAX];
+}pofdp_table_stats_thread;
+
+static pofbf_thread_slots pofdp_table_stats_slots = \
+    POFBF_THREAD_SLOTS_INIT(sizeof(pofdp_table_stats_thread), NULL);
+static __thread pofdp_table_stats_thread *pofdp_table_stats_thread_self = NULL;
+
+/* Sums of the counters when the table was created. The counters are
+ * reported from them, so a new table starts from zero although the
+ * threads never clear their counters. Only the control path writes. */
+static struct pofdp_table_stats pofdp_table_stats_base[POF_MAX_TABLE_TYPE][POFDP_TABLE_STATS_ID_MAX];
+
+/* Get the counters of the calling thread. */
+static pofdp_table_stats_thread *pofdp_table_stats_thread_get(){
+    pofdp_table_stats_thread_self = pofbf_thread_slot_get(&pofdp_table_stats_slots);
+    return pofdp_table_stats_thread_self;
+}
+
+/* Sum the counters of the table of all the threads. */
+static void pofdp_table_stats_sum(uint8_t table_type, uint8_t table_id, struct pofdp_table_stats *stats){
+    const pofdp_table_stats_thread *tt;
+    const volatile struct pofdp_table_stats *ts;
+    uint32_t num, i;
+
+    memset(stats, 0, sizeof *stats);
+    num = pofbf_thread_slot_num(&pofdp_table_stats_slots);
+    for(i=0; i<num; i++){
+        tt = POFBF_THREAD_SLOT_DATA(&pofdp_table_stats_slots, i);
+        ts = &tt->table[table_type][table_id];
+        stats->lookup += ts->lookup;
+        stats->match += ts->match;
+        stats->examined += ts->examined;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Count one lookup in the flow table
+ * Form:     void pofdp_table_stats_count(uint8_t table_type, uint8_t table_id, \
+ *                                        uint32_t match, uint32_t examined)
+ * Input:    table type, table id, whether matched, entries examined
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function counts the lookup in the counters of the
+ *           calling thread.
+ ***********************************************************************/
+void pofdp_table_stats_count(uint8_t table_type, uint8_t table_id, \
+                             uint32_t match, uint32_t examined){
+    pofdp_table_stats_thread *tt = pofdp_table_stats_thread_self;
+    struct pofdp_table_stats *ts;
+
+    if(table_type >= POF_MAX_TABLE_TYPE){
+        return;
+    }
+    if(tt == NULL && (tt = pofdp_table_stats_thread_get()) == NULL){
+        return;
+    }
+
+    ts = &tt->table[table_type][table_id];
+    ts->lookup++;
+    ts->match += (match != FALSE);
+    ts->examined += examined;
+    return;
+}
+
+/***********************************************************************
+ * Get the counters of the flow table
+ * Form:     void pofdp_table_stats_get(uint8_t table_type, uint8_t table_id, \
+ *                                      struct pofdp_table_stats *stats)
+ * Input:    table type, table id
+ * Output:   counters of the table
+ * Return:   VOID
+ * Discribe: This function sums the counters of the table of all the
+ *           threads since the table was created.
+ ***********************************************************************/
+void pofdp_table_stats_get(uint8_t table_type, uint8_t table_id, struct pofdp_table_stats *stats){
+    const struct pofdp_table_stats *base;
+
+    if(table_type >= POF_MAX_TABLE_TYPE){
+        memset(stats, 0, sizeof *stats);
+        return;
+    }
+
+    pofdp_table_stats_sum(table_type, table_id, stats);
+    base = &pofdp_table_stats_base[table_type][table_id];
+    stats->lookup -= base->lookup;
+    stats->match -= base->match;
+    stats->examined -= base->examined;
+    return;
+}
+
+/***********************************************************************
+ * Reset the counters of the flow table
+ * Form:     void pofdp_table_stats_reset(uint8_t table_type, uint8_t table_id)
+ * Input:    table type, table id
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function makes the counters of the table start from
+ *           zero. It is called when the table is created.
+ ***********************************************************************/
+void pofdp_table_stats_reset(uint8_t table_type, uint8_t table_id){
+    if(table_type >= POF_MAX_TABLE_TYPE){
+        return;
+    }
+    pofdp_table_stats_sum(table_type, table_id, &pofdp_table_stats_base[table_type][table_id]);
+    return;
+}
+
+#endif // POF_DATAPATH_ON
@@ -0,0 +1,374 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+#include <time.h>
+
+#ifdef POF_DATAPATH_ON
+
+volatile uint32_t g_pofdp_trace_sample = 0;
+
+/* Trace ring of one datapath thread. Only the thread writes the events
+ * and moves the head, so recording takes no lock. */
+typedef struct pofdp_trace_ring{
+    volatile uint64_t head;     /* Number of events ever recorded. */
+    uint32_t packet_count;      /* Packets since the last sampled one. */
+    uint32_t packet;            /* Sequence of the last sampled packet. */
+    struct pofdp_trace_event event[POFDP_TRACE_RING_SIZE];
+}pofdp_trace_ring;
+
+static pofbf_thread_slots pofdp_trace_ring_slots = \
+    POFBF_THREAD_SLOTS_INIT(sizeof(pofdp_trace_ring), NULL);
+static __thread pofdp_trace_ring *pofdp_trace_ring_self = NULL;
+
+static uint64_t pofdp_trace_now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Get the ring of the calling thread. */
+static pofdp_trace_ring *pofdp_trace_ring_get(){
+    pofdp_trace_ring_self = pofbf_thread_slot_get(&pofdp_trace_ring_slots);
+    return pofdp_trace_ring_self;
+}
+
+/***********************************************************************
+ * Set the trace sample
+ * Form:     uint32_t pofdp_set_trace_sample(uint32_t sample)
+ * Input:    sample
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: One of every sample packets forwarded by each datapath thread
+ *           is traced. Sample 0 turns the trace off.
+ ***********************************************************************/
+uint32_t pofdp_set_trace_sample(uint32_t sample){
+    g_pofdp_trace_sample = sample;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Start to trace a packet
+ * Form:     void pofdp_trace_start(struct pofdp_packet *dpp)
+ * Input:    packet
+ * Output:   trace flag of the packet
+ * Return:   VOID
+ * Discribe: This function decides whether the packet is sampled. If so,
+ *           it sets the trace flag of the packet, and records the receive
+ *           event. It is called by POFDP_TRACE_START only when the trace
+ *           is on.
+ ***********************************************************************/
+void pofdp_trace_start(struct pofdp_packet *dpp){
+    pofdp_trace_ring *ring = pofdp_trace_ring_self;
+    uint32_t sample = g_pofdp_trace_sample;
+
+    dpp->trace = FALSE;
+    if(ring == NULL && (ring = pofdp_trace_ring_get()) == NULL){
+        return;
+    }
+    if(sample == 0 || ++ring->packet_count < sample){
+        return;
+    }
+    ring->packet_count = 0;
+    ring->packet++;
+
+    dpp->trace = TRUE;
+    pofdp_trace_record(dpp, POFDP_TRACE_RECV, 0, dpp->ori_port_id, dpp->ori_len);
+    return;
+}
+
+/***********************************************************************
+ * Record a trace event
+ * Form:     void pofdp_trace_record(const struct pofdp_packet *dpp, \
+ *                                   uint8_t type, uint16_t code, \
+ *                                   uint32_t arg, uint16_t len)
+ * Input:    packet, event type, code, argument, length
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function writes one event of the sampled packet into
+ *           the ring of the calling thread, overwriting the oldest one.
+ *           It is called by POFDP_TRACE only for the sampled packets.
+ ***********************************************************************/
+void pofdp_trace_record(const struct pofdp_packet *dpp, uint8_t type, \
+                        uint16_t code, uint32_t arg, uint16_t len){
+    pofdp_trace_ring *ring = pofdp_trace_ring_self;
+    struct pofdp_trace_event *e;
+    uint64_t head;
+
+    if(ring == NULL){
+        return;
+    }
+
+    head = ring->head;
+    e = &ring->event[head & (POFDP_TRACE_RING_SIZE - 1)];
+    e->ts = pofdp_trace_now();
+    e->packet = ring->packet;
+    e->arg = arg;
+    e->len = len;
+    e->code = code;
+    e->type = type;
+    e->table_type = dpp->table_type;
+    e->table_id = dpp->table_id;
+    e->reserve = 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return;
+}
+
+/* Copy the valid events of the ring to buf from the oldest one, and
+ * return the number of them. The events overwritten during the copy are
+ * left out. */
+static uint32_t pofdp_trace_ring_copy(const pofdp_trace_ring *ring, struct pofdp_trace_event *buf){
+    uint64_t head, head_after, start, i;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    memcpy(buf, ring->event, sizeof(ring->event));
+    head_after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    /* The event being written when the copy is over may be torn, so it
+     * is counted as overwritten too. */
+    start = (head > POFDP_TRACE_RING_SIZE) ? head - POFDP_TRACE_RING_SIZE : 0;
+    if(head_after + 1 > POFDP_TRACE_RING_SIZE && start < head_after + 1 - POFDP_TRACE_RING_SIZE){
+        start = head_after + 1 - POFDP_TRACE_RING_SIZE;
+    }
+    if(start >= head){
+        return 0;
+    }
+
+    /* Rotate the events in place so that the oldest one comes first. */
+    if((start & (POFDP_TRACE_RING_SIZE - 1)) != 0){
+        struct pofdp_trace_event *tmp = malloc(sizeof(ring->event));
+        if(tmp == NULL){
+            return 0;
+        }
+        for(i=start; i<head; i++){
+            tmp[i - start] = buf[i & (POFDP_TRACE_RING_SIZE - 1)];
+        }
+        memcpy(buf, tmp, (head - start) * sizeof *buf);
+        free(tmp);
+    }
+    return (uint32_t)(head - start);
+}
+
+/***********************************************************************
+ * Dump the trace rings
+ * Form:     uint32_t pofdp_trace_dump(const char *file_name, \
+ *                                     uint32_t *event_num_ptr)
+ * Input:    file name
+ * Output:   number of the dumped events
+ * Return:   POF_OK or Error code
+ * Discribe: This function writes the events in the rings of all the
+ *           datapath threads into the file in the binary format of
+ *           struct pofdp_trace_file_header. The datapath threads keep
+ *           recording during the dump. The file can be decoded by
+ *           pofdp_trace_decode().
+ ***********************************************************************/
+uint32_t pofdp_trace_dump(const char *file_name, uint32_t *event_num_ptr){
+    struct pofdp_trace_file_header header = {0};
+    struct pofdp_trace_file_ring ring_header;
+    struct pofdp_trace_event *buf;
+    pofdp_trace_ring *ring;
+    uint32_t i, ring_num, event_num = 0;
+    FILE *fp;
+
+    ring_num = pofbf_thread_slot_num(&pofdp_trace_ring_slots);
+
+    buf = malloc(POFDP_TRACE_RING_SIZE * sizeof *buf);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(buf);
+
+    if((fp = fopen(file_name, "wb")) == NULL){
+        free(buf);
+        POF_ERROR_CPRINT_FL(1,RED,"Can't open the trace file %s.", file_name);
+        return POF_ERROR;
+    }
+
+    memcpy(header.magic, POFDP_TRACE_FILE_MAGIC, sizeof header.magic);
+    header.version = POFDP_TRACE_FILE_VERSION;
+    header.event_size = sizeof(struct pofdp_trace_event);
+    header.ring_num = ring_num;
+    fwrite(&header, sizeof header, 1, fp);
+
+    for(i=0; i<ring_num; i++){
+        ring = POFBF_THREAD_SLOT_DATA(&pofdp_trace_ring_slots, i);
+        ring_header.id = i;
+        ring_header.event_num = pofdp_trace_ring_copy(ring, buf);
+        fwrite(&ring_header, sizeof ring_header, 1, fp);
+        fwrite(buf, sizeof *buf, ring_header.event_num, fp);
+        event_num += ring_header.event_num;
+    }
+    free(buf);
+
+    if(fclose(fp) != 0){
+        POF_ERROR_CPRINT_FL(1,RED,"Can't write the trace file %s.", file_name);
+        return POF_ERROR;
+    }
+
+    if(event_num_ptr != NULL){
+        *event_num_ptr = event_num;
+    }
+    return POF_OK;
+}
+
+static const char *pofdp_trace_instruction_str(uint16_t type){
+    switch(type){
+#define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: return #NAME;
+        INSTRUCTIONS
+#undef INSTRUCTION
+        default:
+            return "UNKNOWN";
+    }
+}
+
+static const char *pofdp_trace_action_str(uint16_t type){
+    switch(type){
+#define ACTION(NAME,VALUE) case POFAT_##NAME: return #NAME;
+        ACTIONS
+#undef ACTION
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/* Print one event with the time since the start of its packet. */
+static void pofdp_trace_event_print(const struct pofdp_trace_event *e, uint64_t start){
+    uint64_t ns = e->ts - start;
+
+    printf("  +%6llu.%03llu us  table[%u][%u]  ", (unsigned long long)(ns / 1000), \
+            (unsigned long long)(ns % 1000), e->table_type, e->table_id);
+    switch(e->type){
+        case POFDP_TRACE_RECV:
+            printf("RECV port=%u len=%u\n", e->arg, e->len);
+            break;
+        case POFDP_TRACE_INSTRUCTION:
+            printf("INSTRUCTION %s\n", pofdp_trace_instruction_str(e->code));
+            break;
+        case POFDP_TRACE_LOOKUP:
+            if(e->code == TRUE){
+                printf("LOOKUP match entry=%u\n", e->arg);
+            }else{
+                printf("LOOKUP miss\n");
+            }
+            break;
+        case POFDP_TRACE_ACTION:
+            printf("ACTION %s\n", pofdp_trace_action_str(e->code));
+            break;
+        case POFDP_TRACE_OUTPUT:
+            printf("OUTPUT port=%u len=%u\n", e->arg, e->len);
+            break;
+        case POFDP_TRACE_DONE:
+            if(e->arg == POF_OK){
+                printf("DONE\n");
+            }else{
+                printf("DONE error=0x%x\n", e->arg);
+            }
+            break;
+        default:
+            printf("UNKNOWN type=%u\n", e->type);
+            break;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Decode the trace file
+ * Form:     uint32_t pofdp_trace_decode(const char *file_name)
+ * Input:    file name
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function reads the file written by pofdp_trace_dump(),
+ *           and prints the events as per-packet timelines. The time of
+ *           each event is relative to the first event of its packet. The
+ *           packet whose first events have been overwritten in the ring
+ *           is marked as truncated.
+ ***********************************************************************/
+uint32_t pofdp_trace_decode(const char *file_name){
+    struct pofdp_trace_file_header header;
+    struct pofdp_trace_file_ring ring_header;
+    struct pofdp_trace_event e;
+    uint64_t start = 0, last = 0;
+    uint32_t i, j, packet = 0, packet_num = 0;
+    uint8_t first;
+    FILE *fp;
+
+    if((fp = fopen(file_name, "rb")) == NULL){
+        POF_ERROR_CPRINT_FL(1,RED,"Can't open the trace file %s.", file_name);
+        return POF_ERROR;
+    }
+
+    if(fread(&header, sizeof header, 1, fp) != 1 || \
+            memcmp(header.magic, POFDP_TRACE_FILE_MAGIC, sizeof header.magic) != 0 || \
+            header.version != POFDP_TRACE_FILE_VERSION || \
+            header.event_size != sizeof(struct pofdp_trace_event)){
+        fclose(fp);
+        POF_ERROR_CPRINT_FL(1,RED,"%s is not a trace file of this version.", file_name);
+        return POF_ERROR;
+    }
+
+    for(i=0; i<header.ring_num; i++){
+        if(fread(&ring_header, sizeof ring_header, 1, fp) != 1){
+            break;
+        }
+        printf("Ring %u: %u events\n", ring_header.id, ring_header.event_num);
+
+        first = TRUE;
+        for(j=0; j<ring_header.event_num; j++){
+            if(fread(&e, sizeof e, 1, fp) != 1){
+                break;
+            }
+            /* The events of one packet are recorded one after another by
+             * the same thread. */
+            if(first == TRUE || e.packet != packet){
+                if(first == FALSE){
+                    printf("  total %llu.%03llu us\n", (unsigned long long)((last - start) / 1000), \
+                            (unsigned long long)((last - start) % 1000));
+                }
+                packet = e.packet;
+                start = e.ts;
+                packet_num++;
+                printf("Packet %u:%u%s\n", ring_header.id, packet, \
+                        (e.type == POFDP_TRACE_RECV) ? "" : " (truncated)");
+                first = FALSE;
+            }
+            last = e.ts;
+            pofdp_trace_event_print(&e, start);
+        }
+        if(first == FALSE){
+            printf("  total %llu.%03llu us\n", (unsigned long long)((last - start) / 1000), \
+                    (unsigned long long)((last - start) % 1000));
+        }
+    }
+    fclose(fp);
+
+    printf("%u packets decoded.\n", packet_num);
+    return POF_OK;
+}
+
+#endif // POF_DATAPATH_ON
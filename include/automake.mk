@@ -1,4 +1,5 @@
 EXTRA_DIST += \
+	include/pof_bench.h \
 	include/pof_byte_transfer.h \
 	include/pof_command.h \
 	include/pof_common.h \
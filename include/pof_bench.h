@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _POF_BENCH_H_
+#define _POF_BENCH_H_
+
+#include "pof_common.h"
+
+/* Default operation number timed in one round, and round number of one
+ * benchmark case. */
+#define POFBENCH_ITERATION_DEFAULT  (1000000)
+#define POFBENCH_ROUND_DEFAULT      (5)
+#define POFBENCH_ROUND_MAX          (64)
+
+/* Defaults of the pipeline driven by the forward suite. */
+#define POFBENCH_TABLE_DEFAULT      (2)
+#define POFBENCH_TABLE_MAX          (32)
+#define POFBENCH_ENTRY_DEFAULT      (100)
+#define POFBENCH_WORKER_DEFAULT     (4)
+#define POFBENCH_WORKER_MAX         (16)    /* One flow table reader each. */
+#define POFBENCH_PACKET_LEN_DEFAULT (64)
+#define POFBENCH_PACKET_LEN_MIN     (42)    /* Ethernet, IPv4 and UDP headers. */
+#define POFBENCH_TABLE_TYPE_DEFAULT "mm"
+#define POFBENCH_ACTION_DEFAULT     "output"
+
+/* Defaults of the sweep of the table suite. */
+#define POFBENCH_TABLE_ENTRY_DEFAULT        (4096)
+#define POFBENCH_TABLE_TABLE_TYPE_DEFAULT   "mm,lpm,em,dt"
+
+/* The benchmark suites. All of them time the datapath code, so there is
+ * none without the datapath module.
+ * POFBENCH_SUITE(NAME,HELP) */
+#ifdef POF_DATAPATH_ON
+#define POFBENCH_SUITES \
+    POFBENCH_SUITE(primitive,"Bit copy, checksum, match and byte order primitives, in JSON.") \
+    POFBENCH_SUITE(forward,"Packets through a synthetic pipeline on 1..N workers, in JSON.") \
+    POFBENCH_SUITE(table,"Lookup cost and memory of the table types by size, fields, masks and priorities, in CSV.")
+#else // POF_DATAPATH_ON
+#define POFBENCH_SUITES
+#endif // POF_DATAPATH_ON
+
+/* Arguments shared by all suites. */
+struct pofbench_arg{
+    uint32_t iteration;     /* Operations timed in one round. */
+    uint32_t round;         /* Rounds of one case. */
+    FILE *out;              /* Where the suite writes its result. */
+
+    uint32_t table_num;     /* Flow tables in the pipeline. */
+    uint32_t entry_num;     /* Flow entries in each table. 0 means the
+                             * default of the suite. */
+    uint32_t worker_num;    /* Most workers forwarding the packets. */
+    uint32_t packet_len;    /* Length of the packets in byte. */
+    uint32_t stage_latency; /* Keep the stage latency measurement on. */
+    char *table_type;       /* Types of the tables, such as "mm,em,dt".
+                             * NULL means the default of the suite. */
+    char *action;           /* Actions of the last table. */
+};
+
+/* Timing result of one case. */
+struct pofbench_result{
+    uint32_t round;
+    double ns[POFBENCH_ROUND_MAX];  /* Nanoseconds per operation of each round. */
+    double median;
+    double min;
+};
+
+/* Run num operations of one case. */
+typedef void (*pofbench_loop)(void *ctx, uint32_t num);
+
+/* The loops add their results here so the compiler keeps the work. */
+extern volatile uint64_t pofbench_sink;
+extern const char *pofbench_table_type_str[];
+
+extern uint64_t pofbench_now();
+extern void pofbench_result_stat(struct pofbench_result *res);
+extern uint32_t pofbench_table_type_parse(const char *str, uint8_t *type, uint32_t *num);
+extern void pofbench_run(const struct pofbench_arg *arg, pofbench_loop loop, \
+                         void *ctx, struct pofbench_result *res);
+
+#define POFBENCH_SUITE(NAME,HELP) extern uint32_t pofbench_##NAME(const struct pofbench_arg *arg);
+    POFBENCH_SUITES
+#undef POFBENCH_SUITE
+
+#endif // _POF_BENCH_H_
@@ -91,12 +91,19 @@ extern uint32_t pof_HtoN_transfer_flow_entry(void *ptr);
 extern uint32_t pof_NtoH_transfer_meter(void *ptr);
 extern uint32_t pof_NtoH_transfer_group(void *ptr);
 extern uint32_t pof_NtoH_transfer_counter(void *ptr);
+extern uint32_t pof_NtoH_transfer_multipart(void *ptr);
+extern uint32_t pof_NtoH_transfer_counter_multipart_request(void *ptr);
+extern uint32_t pof_NtoH_transfer_port_stats_multipart_request(void *ptr);
+extern uint32_t pof_HtoN_transfer_port_stats(void *ptr);
+extern uint32_t pof_HtoN_transfer_table_stats(void *ptr);
+extern uint32_t pof_HtoN_transfer_flow_removed(void *ptr);
 extern uint32_t pof_HtoN_transfer_packet_in(void *ptr);
 extern uint32_t pof_HtoN_transfer_switch_features(void *ptr);
 extern uint32_t pof_HtoN_transfer_flow_table_resource(void *ptr);
 extern uint32_t pof_HtoN_transfer_port_status(void *ptr);
 extern uint32_t pof_HtoN_transfer_switch_config(void * ptr);
 extern uint32_t pof_NtoH_transfer_packet_in(void *ptr);
+extern uint32_t pof_NtoH_transfer_packet_out(void *ptr);
 extern uint32_t pof_NtoH_transfer_error(void *ptr);
 
 #endif // _POF_BYTETRANSFER_H_
@@ -87,8 +87,10 @@
 /* Output ERROR log. */
 #define POF_ERROR_PRINT_ON
 
-/* Check if the flow entry have already existed when add flow entry. */
-//#define POF_ADD_ENTRY_CHECK_ON
+/* Check if the flow entry have already existed when add flow entry. It
+ * looks up the hash index of the table, so it costs nothing like the
+ * table size. */
+#define POF_ADD_ENTRY_CHECK_ON
 
 /* Modes for setting initial config of connection: from "config" file, from command arg. */
 #define POF_CONN_CONFIG_FILE
@@ -112,6 +114,15 @@
 //#define POF_NOMATCH POF_NOMATCH_PACKET_IN
 #define POF_NOMATCH POF_NOMATCH_DROP
 
+/* Soft Switch performance when a packet exceeds the rate of its meter. */
+/* The exceeding packet will be droped. */
+#define POF_METER_EXCEED_DROP (1)
+/* The exceeding packet will be forwarded, with the color red marked in the
+ * reserve byte of the metadata. */
+#define POF_METER_EXCEED_MARK (2)
+#define POF_METER_EXCEED POF_METER_EXCEED_DROP
+//#define POF_METER_EXCEED POF_METER_EXCEED_MARK
+
 /* Soft Switch's filter of received raw packet in datapath module. If the raw packet
  * received by local physical port fit the filter condition, it will be forwarded.
  * On the contrary, the packet will be droped. If you want to set a complex filter, 
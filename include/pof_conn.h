@@ -41,8 +41,15 @@
 /* Define max size of sending buffer. */
 #define POF_SEND_BUF_MAX_SIZE (POF_MESSAGE_SIZE)
 
-/* Define max size of receiving buffer. */
-#define POF_RECV_BUF_MAX_SIZE (POF_MESSAGE_SIZE)
+/* Define size of receiving ring. It must be a power of 2, and hold the
+ * longest message whose length is 16 bits. */
+#define POF_RECV_BUF_MAX_SIZE (65536)
+
+/* Define the timeout of waiting for the channel events. */
+#define POF_CHANNEL_POLL_TIMEOUT (1000)  /* Unit is millisecond. */
+
+/* Define the timeout of waiting for the channel to be writable. */
+#define POF_CHANNEL_SEND_TIMEOUT (5000)  /* Unit is millisecond. */
 
 /* Define echo interval .*/
 #define POF_ECHO_INTERVAL (2000)  /* Unit is millisecond. */
@@ -50,6 +57,20 @@
 /* Message queue attributes. */
 #define POF_QUEUE_MESSAGE_LEN (POF_MESSAGE_SIZE)
 
+/* Define max bytes waiting in the sending queue. Over it, the packet-in
+ * messages are dropped, and the messages from the Controller are not
+ * read until the queue drains. */
+#define POF_SEND_QUEUE_MAX_SIZE (4 * 1024 * 1024)
+
+/* Define max number of the flow mods applied in one batch, and max time
+ * a flow mod waits in the batch. */
+#define POF_FLOW_MOD_BATCH_NUM     (256)
+#define POF_FLOW_MOD_BATCH_TIMEOUT (10)  /* Unit is millisecond. */
+
+/* Define max size and max number of the messages sent by one write. */
+#define POF_SEND_BATCH_SIZE (65536)
+#define POF_SEND_BATCH_NUM  (64)
+
 extern char pofsc_controller_ip_addr[POF_IP_ADDRESS_STRING_LEN];
 extern uint16_t pofsc_controller_port;
 
@@ -62,8 +83,13 @@ typedef struct pofsc_dev_conn_desc{
     /* Connection socket id and socket buffers. */
     int sfd; /* Scket id. */
     char send_buf[POF_SEND_BUF_MAX_SIZE];
-    char recv_buf[POF_RECV_BUF_MAX_SIZE];
-    char msg_buf[POF_QUEUE_MESSAGE_LEN];
+    char recv_buf[POF_RECV_BUF_MAX_SIZE];   /* Receiving ring. */
+    uint32_t recv_head;         /* Ring offset of the first byte not handled. */
+    uint32_t recv_tail;         /* Ring offset of the next byte to receive.
+                                 * Both offsets run freely and are masked
+                                 * on access. */
+    char frame_buf[POF_RECV_BUF_MAX_SIZE];
+                                /* Message wrapping around the ring. */
 
     /* Connection retry count and connection state. */
     uint32_t conn_retry_interval; /* Unit is second. */
@@ -91,20 +117,54 @@ typedef enum{
 /* Description of device connection. */
 extern volatile pofsc_dev_conn_desc pofsc_conn_desc;
 
+/* Counters of the control channel, which run across the connections. */
+typedef struct pofsc_channel_stats{
+    volatile uint64_t rx_msg;
+    volatile uint64_t rx_byte;
+    volatile uint64_t tx_msg;
+    volatile uint64_t tx_byte;
+    volatile uint64_t connect;  /* Times of reaching POFCS_CHANNEL_RUN. */
+} pofsc_channel_stats;
+
+extern pofsc_channel_stats g_pofsc_channel_stats;
+
+/* Define max length of the path of the statistics socket, which is the
+ * size of sun_path. */
+#define POF_STATS_SOCKET_PATH_MAX_LEN (108)
+
+/* Define the timeout of waiting for the request on the statistics socket. */
+#define POF_STATS_REQUEST_TIMEOUT (100)  /* Unit is millisecond. */
+
+extern char pofsc_stats_socket_path[POF_STATS_SOCKET_PATH_MAX_LEN];
+extern task_t pofsc_stats_task_id;
+
+/* Queue of the messages to send to the Controller. */
+extern pofbf_msg_queue pofsc_send_q;
+
 extern uint32_t pof_set_init_config(int argc, char *argv[]);
 extern uint32_t pof_auto_clear();
 extern uint32_t pofsc_set_controller_ip(char *ip_str);
 extern uint32_t pofsc_set_controller_port(uint16_t port);
 extern void pof_states_print();
 
+/* statistics. */
+extern uint32_t pofsc_set_stats_socket(const char *path);
+extern uint32_t pofsc_stats_task(void *arg_ptr);
+extern void pofsc_stats_close();
+
 /* parse and encap. */
 extern uint32_t pof_parse_msg_from_controller(char* msg_ptr);
+extern uint32_t pof_flow_mod_batch_flush();
+extern uint32_t pof_flow_mod_batch_timeout();
+extern void pof_flow_mod_batch_discard();
 extern uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid);
 extern uint32_t pofec_set_error(uint16_t type, char *type_str, uint16_t code, char *error_str);
 extern uint32_t pofec_reply_msg(uint8_t  type, \
                                 uint32_t xid, \
                                 uint32_t msg_len, \
                                 uint8_t  *msg_body);
+extern pofbf_msg *pofec_new_msg(uint8_t type, uint32_t xid, uint32_t msg_len);
+extern uint32_t pofec_send_msg(pofbf_msg *msg);
 
 extern uint32_t pofsc_check_root();
 
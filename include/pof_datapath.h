@@ -48,6 +48,17 @@
 
 /* Max length of the raw packet received by local physical port. */
 #define POFDP_PACKET_RAW_MAX_LEN (2048)
+/* Number of the packets buffered for packet-in. */
+#define POFDP_PACKET_IN_BUFFER_NUM (256)
+/* Seconds before a buffered packet can be overwritten. */
+#define POFDP_PACKET_IN_BUFFER_TIMEOUT (5)
+/* Number of the packet-in rate limiters by reason and by ingress port.
+ * The ports share the limiters by port id modulo the number. */
+#define POFDP_PACKET_IN_REASON_NUM (256)
+#define POFDP_PACKET_IN_PORT_NUM (256)
+/* Default packet-in rate limitation of each ingress port. */
+#define POFDP_PACKET_IN_PORT_RATE_DEFAULT (1000)   /* Packets per second. */
+#define POFDP_PACKET_IN_PORT_BURST_DEFAULT (100)   /* Packets. */
 /* Max length of the metadata. */
 #define POFDP_METADATA_MAX_LEN (128)
 /* The field offset of packet received port's ID infomation in metadata. */
@@ -58,6 +69,9 @@
 #define POFDP_FIRST_TABLE_ID (0)
 /* Define the metadata field id. */
 #define POFDP_METADATA_FIELD_ID (0xFFFF)
+/* Meter colors written in the reserve byte of the metadata. */
+#define POFDP_METER_COLOR_GREEN (0)
+#define POFDP_METER_COLOR_RED   (1)
 
 /* Packet infomation including data, length, received port. */
 struct pofdp_packet{
@@ -115,7 +129,16 @@ struct pofdp_packet{
                                  * already done. 1 means done, 0 means not. */
 
 	/* Meter. */
-	uint16_t rate;				/* Rate. 0 means no limitation. */
+	uint16_t rate;				/* Rate of the last meter which polices the
+								 * packet. 0 means no limitation. */
+
+	/* Trace. */
+	uint8_t trace;				/* TRUE if the packet is sampled into the
+								 * trace ring of the datapath thread. */
+
+	/* Latency. */
+	uint64_t ts;				/* Time in ns when the packet is handed to
+								 * the next task. 0 means not stamped. */
 };
 
 /* Define Metadata structure. */
@@ -136,12 +159,192 @@ struct pof_datapath{
 
     /* Set RAW packet filter function. */
     uint32_t (*filter)(uint8_t *packet, pof_port *port_ptr, struct sockaddr_ll sll);
+
+    /* Packet send function. It owns buf_out of the packet, which must
+     * be freed once the packet is sent or dropped. */
+    uint32_t (*send)(struct pofdp_packet *dpp);
 };
 
 extern struct pof_datapath dp;
 
+/* Token bucket limiting the packet-in messages, in the same GCRA form as
+ * the meter. Zero ns_per_packet means no limitation. */
+struct pofdp_packet_in_bucket{
+    volatile uint64_t tat;      /* Theoretical arrival time in ns. */
+    uint64_t ns_per_packet;
+    uint64_t burst_ns;
+
+    volatile uint64_t sent;     /* Packet-in sent within the rate. */
+    volatile uint64_t dropped;  /* Packet-in dropped over the rate. */
+    volatile uint64_t sampled;  /* Packet-in sent over the rate by sampling. */
+};
+
+/* Packet-in rate limitation. A packet-in is sent only if both of the
+ * bucket of its reason and the bucket of its ingress port allow. Over
+ * the rate, one of every sample packets is still sent if sample is not
+ * zero, so the Controller keeps seeing the flooding flow. */
+struct pofdp_packet_in_limit{
+    struct pofdp_packet_in_bucket reason[POFDP_PACKET_IN_REASON_NUM];
+    struct pofdp_packet_in_bucket port[POFDP_PACKET_IN_PORT_NUM];
+    uint32_t sample;
+};
+
+extern struct pofdp_packet_in_limit g_pofdp_packet_in_limit;
+extern volatile uint64_t g_pofdp_packet_out_dropped;
+
 #define POFDP_ARG	struct pofdp_packet *dpp
 
+/* Events in the trace ring of each datapath thread. The ring keeps the
+ * latest POFDP_TRACE_RING_SIZE events, overwriting the oldest. */
+#define POFDP_TRACE_RING_SIZE (4096)
+#define POFDP_TRACE_FILE_MAGIC "POFTRACE"
+#define POFDP_TRACE_FILE_VERSION (1)
+#define POFDP_TRACE_FILE_NAME "pofswitch.trace"
+
+enum pofdp_trace_type{
+	POFDP_TRACE_RECV = 0,		/* arg: input port, len: packet length. */
+	POFDP_TRACE_INSTRUCTION,	/* code: instruction type. */
+	POFDP_TRACE_LOOKUP,			/* code: TRUE if matched, arg: entry index. */
+	POFDP_TRACE_ACTION,			/* code: action type. */
+	POFDP_TRACE_OUTPUT,			/* arg: output port, len: output length. */
+	POFDP_TRACE_DONE,			/* arg: return value of the forwarding. */
+
+	POFDP_TRACE_TYPE_NUM,
+};
+
+/* One trace event. The table is where the packet is when the event
+ * occurs. The size is kept at 24 bytes. */
+struct pofdp_trace_event{
+	uint64_t ts;				/* CLOCK_MONOTONIC in ns. */
+	uint32_t packet;			/* Packet sequence in the ring. */
+	uint32_t arg;
+	uint16_t len;
+	uint16_t code;
+	uint8_t  type;
+	uint8_t  table_type;
+	uint8_t  table_id;
+	uint8_t  reserve;
+};
+
+/* Dump file: the header, followed by each ring with its events from the
+ * oldest to the latest. All of the values are in host byte order. */
+struct pofdp_trace_file_header{
+	char     magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t ring_num;
+	uint32_t reserve;
+};
+
+struct pofdp_trace_file_ring{
+	uint32_t id;
+	uint32_t event_num;
+};
+
+/* Stages of the datapath whose latency is measured. */
+#define POFDP_STAGES \
+	/* Receive task: from recvfrom() to the receive queue. */	\
+	POFDP_STAGE(RX, "rx")										\
+	/* Waiting in the receive queue. */							\
+	POFDP_STAGE(RX_QUEUE, "rx_queue")							\
+	/* Whole forwarding of one packet in the datapath task. */	\
+	POFDP_STAGE(FORWARD, "forward")								\
+	/* Key extraction of the GOTO_TABLE instruction. */			\
+	POFDP_STAGE(KEY, "key")										\
+	/* Flow table lookup of the GOTO_TABLE instruction. */		\
+	POFDP_STAGE(LOOKUP, "lookup")								\
+	/* Execution of an action list. */							\
+	POFDP_STAGE(ACTION, "action")								\
+	/* Waiting in the send queue. */							\
+	POFDP_STAGE(TX_QUEUE, "tx_queue")							\
+	/* Send task: sendto(). */									\
+	POFDP_STAGE(TX, "tx")
+
+enum pofdp_stage{
+#define POFDP_STAGE(NAME,STR) POFDP_STAGE_##NAME,
+	POFDP_STAGES
+#undef POFDP_STAGE
+	POFDP_STAGE_NUM,
+};
+
+/* Latency histogram in ns. The values below 2^POFDP_HIST_SUB_BITS have
+ * their own buckets. Above, each power of two is split into
+ * 2^POFDP_HIST_SUB_BITS buckets, so the error is less than 1/16. */
+#define POFDP_HIST_SUB_BITS (4)
+#define POFDP_HIST_SUB_NUM (1 << POFDP_HIST_SUB_BITS)
+#define POFDP_HIST_BUCKET_NUM ((64 - POFDP_HIST_SUB_BITS + 1) << POFDP_HIST_SUB_BITS)
+
+struct pofdp_hist{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[POFDP_HIST_BUCKET_NUM];
+};
+
+/* Latency is measured only if g_pofdp_latency_on is TRUE. */
+extern volatile uint32_t g_pofdp_latency_on;
+extern const char *g_pofdp_stage_str[POFDP_STAGE_NUM];
+
+/* Traffic counters of one port.
+ * POFDP_PORT_COUNTER(NAME) */
+#define POFDP_PORT_COUNTERS										\
+	/* Packets put into the receive queue. */					\
+	POFDP_PORT_COUNTER(rx_packets)								\
+	POFDP_PORT_COUNTER(rx_bytes)								\
+	/* recvfrom() failures. */									\
+	POFDP_PORT_COUNTER(rx_errors)								\
+	/* Received while OpenFlow is disabled on the port. */		\
+	POFDP_PORT_COUNTER(rx_disabled_dropped)						\
+	POFDP_PORT_COUNTER(rx_mtu_dropped)							\
+	POFDP_PORT_COUNTER(rx_filter_dropped)						\
+	POFDP_PORT_COUNTER(rx_queue_dropped)						\
+	/* Packets sent out by sendto(). */							\
+	POFDP_PORT_COUNTER(tx_packets)								\
+	POFDP_PORT_COUNTER(tx_bytes)								\
+	/* sendto() failures. */									\
+	POFDP_PORT_COUNTER(tx_errors)								\
+	POFDP_PORT_COUNTER(tx_mtu_dropped)							\
+	POFDP_PORT_COUNTER(tx_queue_dropped)
+
+struct pofdp_port_stats{
+#define POFDP_PORT_COUNTER(NAME) uint64_t NAME;
+	POFDP_PORT_COUNTERS
+#undef POFDP_PORT_COUNTER
+};
+
+/* The port counters are kept for the port ids below it. */
+#define POFDP_PORT_STATS_ID_MAX (POFLR_PORT_LIVE_ID_MAX)
+
+/* Lookup counters of one flow table. The misses are the lookups which
+ * do not match. The examined entries are the ones compared in the scan
+ * of the table, so examined / lookup is the average cost of the scan. */
+struct pofdp_table_stats{
+	uint64_t lookup;
+	uint64_t match;
+	uint64_t examined;
+};
+
+/* The lookup counters are kept for the table ids below it. */
+#define POFDP_TABLE_STATS_ID_MAX (256)
+
+/* Sample one of every g_pofdp_trace_sample packets. 0 means off. */
+extern volatile uint32_t g_pofdp_trace_sample;
+
+#define POFDP_TRACE_START(dpp) \
+	do{ \
+		(dpp)->trace = FALSE; \
+		if(__builtin_expect(g_pofdp_trace_sample != 0, 0)){ \
+			pofdp_trace_start(dpp); \
+		} \
+	}while(0)
+#define POFDP_TRACE(dpp,type,code,arg,len) \
+	do{ \
+		if(__builtin_expect((dpp)->trace, 0)){ \
+			pofdp_trace_record(dpp,type,code,arg,len); \
+		} \
+	}while(0)
+
 /* Task id in datapath module. */
 extern task_t g_pofdp_main_task_id;
 extern task_t *g_pofdp_recv_raw_task_id_ptr;
@@ -154,21 +357,61 @@ extern uint32_t g_pofdp_send_q_id;
 extern uint32_t pof_datapath_init();
 extern uint32_t pofdp_create_port_listen_task(task_t *tid, pof_port *p);
 extern uint32_t pofdp_send_raw(struct pofdp_packet *dpp);
+extern uint32_t pofdp_forward(struct pofdp_packet *dpp, struct pof_instruction *first_ins);
+extern void pofdp_set_goto_first_table(struct pof_instruction *p);
 extern uint32_t pofdp_send_packet_in_to_controller(uint16_t len, \
                                                    uint8_t reason, \
                                                    uint8_t table_id, \
 												   struct pof_flow_entry *pfe, \
                                                    uint32_t device_id, \
+                                                   uint32_t port_id, \
                                                    uint8_t *packet);
+extern uint32_t pofdp_set_packet_in_rate(uint32_t reason, uint32_t rate, uint32_t burst);
+extern uint32_t pofdp_set_packet_in_port_rate(uint32_t rate, uint32_t burst);
+extern uint32_t pofdp_set_packet_in_sample(uint32_t sample);
+extern uint32_t pofdp_packet_out(pof_packet_out *packet_out_ptr, uint32_t data_len);
+extern uint32_t pofdp_packet_in_buffer_take(uint32_t buffer_id, \
+                                            uint8_t *packet, \
+                                            uint16_t *len_ptr, \
+                                            uint32_t *port_id_ptr);
 extern uint32_t pofdp_instruction_execute(POFDP_ARG);
+extern void pofdp_trace_start(POFDP_ARG);
+extern void pofdp_trace_record(const struct pofdp_packet *dpp, uint8_t type, \
+                               uint16_t code, uint32_t arg, uint16_t len);
+extern uint32_t pofdp_set_trace_sample(uint32_t sample);
+extern uint64_t pofdp_latency_start();
+extern uint64_t pofdp_latency_end(uint32_t stage, uint64_t start);
+extern void pofdp_hist_record(struct pofdp_hist *hist, uint64_t value);
+extern uint32_t pofdp_set_latency_on(uint32_t on);
+extern void pofdp_latency_snapshot(struct pofdp_hist *hist);
+extern uint64_t pofdp_hist_percentile(const struct pofdp_hist *hist, double percent);
+extern void pofdp_latency_dump(FILE *fp);
+extern struct pofdp_port_stats *pofdp_port_stats_self(uint32_t port_id);
+extern void pofdp_port_stats_get(uint32_t port_id, struct pofdp_port_stats *stats);
+extern void pofdp_table_stats_count(uint8_t table_type, uint8_t table_id, \
+                                    uint32_t match, uint32_t examined);
+extern void pofdp_table_stats_get(uint8_t table_type, uint8_t table_id, struct pofdp_table_stats *stats);
+extern void pofdp_table_stats_reset(uint8_t table_type, uint8_t table_id);
+extern uint32_t pofdp_trace_dump(const char *file_name, uint32_t *event_num_ptr);
+extern uint32_t pofdp_trace_decode(const char *file_name);
 extern uint32_t pofdp_action_execute(POFDP_ARG);
 
 extern void pofdp_cover_bit(uint8_t *data_ori, uint8_t *value, uint16_t pos_b, uint16_t len_b);
 extern void pofdp_copy_bit(uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b);
+extern uint32_t pofdp_bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b);
+extern uint32_t pofdp_checksum(uint8_t *data, uint64_t *value, uint16_t pos_b, \
+                               uint16_t len_b, uint16_t cs_len_b);
+extern uint32_t pofdp_match_per_entry(uint8_t **key_ptr, uint8_t match_field_num, \
+                                      const pof_match_x *match);
 extern uint32_t pofdp_lookup_in_table(uint8_t **key_ptr, \
                                       uint8_t match_field_num, \
-                                      poflr_flow_table table_vhal, \
+                                      poflr_flow_table *table_ptr, \
                                       pof_flow_entry **entry_ptrptr);
+extern uint32_t pofdp_lookup_direct(poflr_flow_table *table_ptr, \
+                                    uint32_t index, \
+                                    pof_flow_entry **entry_ptrptr);
+extern void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr, \
+                           uint8_t match_field_num, const pof_match *match);
 extern uint32_t pofdp_write_32value_to_field(uint32_t value, const struct pof_match *pm, \
 											 struct pofdp_packet *dpp);
 extern uint32_t pofdp_get_32value(uint32_t *value, uint8_t type, void *u_, const struct pofdp_packet *dpp);
@@ -27,6 +27,8 @@
 #define _POF_GLOBAL_H_
 
 #include "pof_type.h"
+#include <semaphore.h>
+#include <pthread.h>
 
 /*openflow version.*/
 #define POF_VERSION (0x04)
@@ -171,6 +173,14 @@ typedef enum pof_group_mod_command {
     POFGC_DELETE = 2 /* Delete all matching groups. */
 }pof_group_mod_command;
 
+/* Group types. */
+typedef enum pof_group_type {
+    POFGT_ALL = 0, /* All actions are executed. */
+    POFGT_SELECT = 1, /* One bucket of actions is selected by packet hash. */
+    POFGT_INDIRECT = 2, /* The single bucket of actions is executed. */
+    POFGT_FF = 3 /* Fast failover. */
+}pof_group_type;
+
 /* Counter commands */
 typedef enum pof_counter_mod_command {
     POFCC_ADD = 0, /* New counter. */
@@ -189,6 +199,10 @@ typedef enum pof_flow_mod_command {
     POFFC_DELETE_STRICT = 4 /* Delete entry strictly matching wildcards and priority. */
 }pof_flow_mod_command;
 
+/* Flow index of MODIFY and DELETE which selects the flow entries by match
+ * instead of by index. The strict commands always select by match. */
+#define POF_FLOW_INDEX_ANY (0xffffffff)
+
 #define INSTRUCTIONS \
 	/* Setup the next table in the lookup pipeline */		\
 	INSTRUCTION(GOTO_TABLE, 1)								\
@@ -293,6 +307,18 @@ typedef struct pof_switch_config{
                                pof_controller_max_len for valid values.*/
 }pof_switch_config;  // sizeof() = 4
 
+/* Values of miss_send_len in pof_switch_config. */
+enum pof_controller_max_len{
+    POFCML_MAX       = 0xffe5, /* Maximum max_len value which can be used
+                                  to request a specific byte length. */
+    POFCML_NO_BUFFER = 0xffff  /* Indicates that no buffering should be
+                                  applied and the whole packet is to be
+                                  sent to the controller. */
+};
+
+/* Default miss_send_len before the Controller sets it. */
+#define POF_MISS_SEND_LEN_DEFAULT (128)
+
 enum pof_config_flags{
     POFC_FRAG_NORMAL = 0,      /* No special handling for fragments. */
     POFC_FRAG_DROP   = 1 << 0, /* Drop fragments. */
@@ -467,6 +493,9 @@ typedef struct pof_packet_in {
     char    data[POF_PACKET_IN_MAX_LENGTH];
 } pof_packet_in;    //sizeof=24 + 2048 = 2072
 
+/* Buffer ID which means the packet is not buffered. */
+#define POF_NO_BUFFER (0xffffffff)
+
 /* Describe the match struct, including the location, the length and the value. */
 typedef struct pof_match{
     uint16_t field_id;  /*0xffff means metadata*/
@@ -532,6 +561,38 @@ typedef struct pof_flow_entry{
     pof_instruction instruction[POF_MAX_INSTRUCTION_NUM]; /*The instructions*/
 }pof_flow_entry;        //sizeof=40+8*40+6*304=2184
 
+/* Why was this flow removed? */
+enum pof_flow_removed_reason {
+    POFRR_IDLE_TIMEOUT = 0,     /* Flow idle time exceeded idle_timeout. */
+    POFRR_HARD_TIMEOUT = 1,     /* Time exceeded hard_timeout. */
+    POFRR_DELETE = 2,           /* Evicted by a DELETE flow mod. */
+};
+
+/* Flow removed (datapath -> controller). */
+typedef struct pof_flow_removed{
+    uint64_t cookie;            /* Opaque controller-issued identifier. */
+
+    uint16_t priority;          /* Priority level of flow entry. */
+    uint8_t  reason;            /* One of POFRR_*. */
+    uint8_t  table_id;          /* ID of the table. */
+    uint8_t  table_type;        /* Type of the table. */
+    uint8_t  pad[3];            /*8 bytes aligned*/
+
+    uint32_t index;             /* Index of the flow entry in the table. */
+    uint32_t counter_id;
+
+    uint32_t duration_sec;      /* Time flow was alive in seconds. */
+    uint32_t duration_nsec;     /* Time flow was alive in nanoseconds beyond
+                                   duration_sec. */
+
+    uint16_t idle_timeout;      /* Idle timeout from original flow mod. */
+    uint16_t hard_timeout;      /* Hard timeout from original flow mod. */
+    uint8_t  pad2[4];           /*8 bytes aligned*/
+
+    uint64_t packet_count;
+    uint64_t byte_count;
+}pof_flow_removed;      //sizeof=56
+
 
 /* Discribe a particular instruction struct with each type. */
 typedef struct pof_instruction_goto_table{
@@ -575,6 +636,20 @@ typedef struct pof_action{
     uint8_t  action_data[POF_MAX_ACTION_LENGTH];
 }pof_action;    //sizof=4+44=48, NOTES: POFAction header size is 4
 
+/* Describe the packet struct sent by the Controller. If buffer_id is
+ * valid, the packet is the buffered one of a packet-in, otherwise the
+ * packet_len bytes of data follow the struct. */
+typedef struct pof_packet_out {
+    uint32_t buffer_id; /*Buffer ID assigned by datapath, or POF_NO_BUFFER*/
+    uint32_t in_port;   /*Input port of the packet*/
+    uint8_t  action_num;
+    uint8_t  pad[3];    /*8 bytes aligned*/
+    uint32_t packet_len;/*Length of the data*/
+
+    pof_action action[POF_MAX_ACTION_NUMBER_PER_INSTRUCTION];
+    uint8_t  data[0];
+} pof_packet_out;   //sizeof=16 + 4*48 = 208
+
 /* Discribe a particular action struct with each type. */
 typedef struct pof_instruction_apply_actions{
     uint8_t action_num;
@@ -664,7 +739,7 @@ typedef struct pof_group{
     uint32_t   group_id;  /*Group ID*/
 
     uint32_t   counter_id;  /*packet counter, driver need add a ActionCount in action[]*/
-    uint8_t    pad2[4];
+    uint8_t    weight[4];   /*Weights of the first 4 buckets of select group. 0 means 1.*/
     pof_action  action[POF_MAX_ACTION_NUMBER_PER_GROUP];
 }pof_group;     //sizeof=16+4*48=208
 
@@ -677,6 +752,93 @@ typedef struct pof_counter{
     uint64_t  value;
 }pof_counter;   //sizeof=24
 
+/* Types of multipart request and reply. */
+typedef enum pof_multipart_type{
+    POFMP_COUNTER = 0,  /* Counter statistics. The request body is
+                         * pof_counter_multipart_request. The reply
+                         * body is an array of pof_counter. */
+    POFMP_PORT_STATS = 1,   /* Port statistics. The request body is
+                             * pof_port_stats_multipart_request. The
+                             * reply body is an array of pof_port_stats. */
+    POFMP_TABLE_STATS = 2,  /* Flow table statistics. The request body is
+                             * pof_table_stats_multipart_request. The
+                             * reply body is an array of pof_table_stats. */
+} pof_multipart_type;
+
+/* Flags of multipart reply. */
+typedef enum pof_multipart_reply_flags{
+    POFMPF_REPLY_MORE = 1 << 0,  /* More replies to follow. */
+} pof_multipart_reply_flags;
+
+/* Header of multipart request and reply. */
+typedef struct pof_multipart{
+    uint16_t type;      /* One of the POFMP_* constants. */
+    uint16_t flags;     /* POFMPF_REPLY_* flags. */
+    uint8_t  pad[4];
+}pof_multipart;     //sizeof=8
+
+/* Body of POFMP_COUNTER request. */
+typedef struct pof_counter_multipart_request{
+    uint32_t counter_id;    /* The first counter to report. */
+    uint32_t counter_num;   /* Number of counter ids to scan from
+                             * counter_id. Zero means all. */
+}pof_counter_multipart_request;     //sizeof=8
+
+/* Body of POFMP_PORT_STATS request. */
+typedef struct pof_port_stats_multipart_request{
+    uint32_t port_id;   /* The port to report. POFP_ANY means all. */
+    uint8_t  pad[4];
+}pof_port_stats_multipart_request;  //sizeof=8
+
+/* Body of POFMP_PORT_STATS reply. The dropped and errors counters are
+ * the sums of the detailed ones. */
+typedef struct pof_port_stats{
+    uint32_t port_id;
+    uint8_t  pad[4];
+
+    uint64_t rx_packets;    /* Packets received and forwarded. */
+    uint64_t tx_packets;    /* Packets sent out. */
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+
+    uint64_t rx_disabled_dropped;   /* OpenFlow is disabled on the port. */
+    uint64_t rx_mtu_dropped;        /* Longer than the MTU. */
+    uint64_t rx_filter_dropped;     /* Dropped by the packet filter. */
+    uint64_t rx_queue_dropped;      /* Receive queue failure. */
+    uint64_t tx_mtu_dropped;        /* Longer than the MTU. */
+    uint64_t tx_queue_dropped;      /* Send queue failure. */
+}pof_port_stats;    //sizeof=120
+
+/* Table ID for all of the flow tables in pof_table_stats_multipart_request. */
+#define POF_ALL_TABLE_ID (0xff)
+
+/* Body of POFMP_TABLE_STATS request. */
+typedef struct pof_table_stats_multipart_request{
+    uint8_t  table_id;  /* Global table ID. POF_ALL_TABLE_ID means all
+                         * of the valid tables. */
+    uint8_t  pad[7];
+}pof_table_stats_multipart_request; //sizeof=8
+
+/* Body of POFMP_TABLE_STATS reply. */
+typedef struct pof_table_stats{
+    uint8_t  table_id;      /* Global table ID. */
+    uint8_t  type;          /* Table type, one of pof_table_type. */
+    uint8_t  tid;           /* Table id in the type. */
+    uint8_t  pad[1];
+    uint32_t active_count;  /* Flow entries in the table. */
+
+    uint64_t lookup_count;  /* Packets looked up in the table. */
+    uint64_t matched_count; /* Packets which hit an entry. */
+    uint64_t missed_count;  /* Packets which hit no entry. */
+    uint64_t examined_count;    /* Entries compared in the lookups. The
+                                 * average cost of a lookup is
+                                 * examined_count / lookup_count. */
+}pof_table_stats;   //sizeof=40
+
 /* Values for 'type' in pof_error_message. These values are immutable: they
 * will not change in future versions of the protocol (although new values may
 * be added). */
@@ -1008,6 +1170,90 @@ typedef void (*POF_TASK_FUNC)(void *arg_ptr);
 /* Timer routine. */
 typedef void (*POF_TIMER_FUNC)(uint32_t timerid, int arg);
 
+/* Message buffer with reference count. It is freed when the last
+ * reference is released. */
+typedef struct pofbf_msg{
+    struct pofbf_msg *next;     /* Link in the message queue. */
+    volatile uint32_t ref;
+    uint32_t len;
+    uint8_t data[0];
+} pofbf_msg;
+
+/* Multi-producer single-consumer queue of message buffers. Producers
+ * link the buffers in without lock and never wait. Only the consumer
+ * pops. */
+typedef struct pofbf_msg_queue{
+    pofbf_msg * volatile head;  /* Last pushed message. */
+    pofbf_msg *tail;            /* Next message to pop. */
+    pofbf_msg stub;             /* Placeholder when the queue is empty. */
+    sem_t sem;                  /* Count of the messages to pop. */
+
+    uint32_t byte_max;          /* Droppable messages over it are dropped. */
+    volatile uint32_t msg_num;
+    volatile uint32_t byte_num;
+    volatile uint64_t drop_msg;
+    volatile uint64_t drop_byte;
+} pofbf_msg_queue;
+
+/* Epoch based reclamation of the objects shared with the readers which
+ * take no lock. A reader is marked with the global epoch while it may
+ * hold pointers to the shared objects. The writer unpublishes an object
+ * and retires it, and the object is freed when every reader in the
+ * read-side section is marked with a newer epoch. Only one writer
+ * retires at a time. */
+#define POFBF_RCU_READER_MAX (16)
+
+typedef struct pofbf_rcu_reader{
+    volatile uint64_t epoch;    /* 0 means the reader holds nothing. */
+    volatile uint32_t used;
+} pofbf_rcu_reader;
+
+extern volatile uint64_t pofbf_rcu_epoch;
+
+/* Load and store the pointer to the shared object. */
+#define POFBF_RCU_DEREF(p)      __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define POFBF_RCU_ASSIGN(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* Enter and leave the read-side section. The fence orders the mark
+ * before the loads of the shared pointers. */
+#define POFBF_RCU_READ_LOCK(reader)                                         \
+    do{                                                                     \
+        (reader)->epoch = pofbf_rcu_epoch;                                  \
+        __sync_synchronize();                                               \
+    }while(0)
+#define POFBF_RCU_READ_UNLOCK(reader) \
+    __atomic_store_n(&(reader)->epoch, 0, __ATOMIC_RELEASE)
+
+/* Slots of the data which each thread writes alone, such as its counters
+ * and its rings. A thread gets a slot the first time it asks, and frees
+ * it when it exits. The data of a freed slot is kept and given to the
+ * next thread, so the counts of the exited thread stay in the sums, and
+ * the readers never see the data freed. The readers sum the data of the
+ * first num slots. */
+#define POFBF_THREAD_SLOT_MAX (64)
+
+typedef struct pofbf_thread_slot{
+    void *data;
+    volatile uint32_t used;
+} pofbf_thread_slot;
+
+typedef struct pofbf_thread_slots{
+    uint32_t size;                  /* Size of the data of one slot. */
+    void (*init_func)(void *data);  /* Initialize new data, or NULL. */
+    pthread_mutex_t mutex;          /* Taken to get a slot. */
+    pthread_key_t key;              /* Slot of each thread. */
+    volatile uint32_t key_created;
+    volatile uint32_t num;          /* Slots with data. */
+    pofbf_thread_slot slot[POFBF_THREAD_SLOT_MAX];
+} pofbf_thread_slots;
+
+#define POFBF_THREAD_SLOTS_INIT(size, init_func) \
+    { (size), (init_func), PTHREAD_MUTEX_INITIALIZER }
+
+/* Data of the slot i, which must be less than the num read by
+ * pofbf_thread_slot_num. */
+#define POFBF_THREAD_SLOT_DATA(slots, i) ((slots)->slot[i].data)
+
 /* Basic function interface. */
 extern uint32_t pofbf_task_create(void *arg, POF_TASK_FUNC task_func, task_t *task_id_ptr0);
 extern uint32_t pofbf_task_delay(uint32_t delay);
@@ -1016,12 +1262,28 @@ extern uint32_t pofbf_queue_create(uint32_t *queue_id_ptr);
 extern uint32_t pofbf_queue_delete( uint32_t *queue_id_ptr );
 extern uint32_t pofbf_queue_read( uint32_t queue_id, void *buf, uint32_t max_len, int timeout);
 extern uint32_t pofbf_queue_write( uint32_t queue_id, const void *message, uint32_t msg_len, int timeout);
+extern uint32_t pofbf_queue_depth(uint32_t queue_id, uint32_t *msg_num_ptr, uint32_t *byte_num_ptr);
+extern pofbf_msg *pofbf_msg_alloc(uint32_t len);
+extern void pofbf_msg_hold(pofbf_msg *msg);
+extern void pofbf_msg_release(pofbf_msg *msg);
+extern uint32_t pofbf_msg_queue_init(pofbf_msg_queue *queue, uint32_t byte_max);
+extern uint32_t pofbf_msg_queue_destroy(pofbf_msg_queue *queue);
+extern uint32_t pofbf_msg_queue_push(pofbf_msg_queue *queue, pofbf_msg *msg, uint8_t droppable);
+extern pofbf_msg *pofbf_msg_queue_pop(pofbf_msg_queue *queue, int timeout);
+extern pofbf_rcu_reader *pofbf_rcu_register();
+extern void pofbf_rcu_unregister(pofbf_rcu_reader *reader);
+extern uint32_t pofbf_rcu_retire(void *ptr, void (*free_func)(void *));
+extern void pofbf_rcu_reclaim();
+extern void pofbf_rcu_synchronize();
+extern void *pofbf_thread_slot_get(pofbf_thread_slots *slots);
+extern uint32_t pofbf_thread_slot_num(pofbf_thread_slots *slots);
 extern uint32_t pofbf_timer_create(uint32_t delay, \
                               uint32_t interval, \
                               POF_TIMER_FUNC timer_handler, \
                               uint32_t *timer_id_ptr);
 extern uint32_t pofbf_timer_delete(uint32_t *task_id_ptr);
 extern uint32_t pofsc_send_packet_upward(uint8_t *packet, uint32_t len);
+extern uint32_t pofsc_send_msg_upward(pofbf_msg *msg, uint8_t droppable);
 extern void terminate_handler();
 
 #endif
@@ -27,6 +27,7 @@
 #define _POF_LOCALRESOURCE_H_
 
 #include "pof_common.h"
+#include <pthread.h>
 
 /* The table numbers of each type. */
 #define POFLR_MM_TBL_NUM   (6)
@@ -42,9 +43,35 @@
 #define POFLR_COUNTER_NUMBER (512)
 #define POFLR_GROUP_NUMBER (128)
 
+/* Burst tolerance of the meter, in milli-second of traffic at the meter
+ * rate. */
+#define POFLR_METER_BURST_MS (100)
+#define POFLR_METER_FRAC_BITS (16)  /* Fraction bits of the byte cost. */
+
+/* Max number of packet/metadata fields hashed to select the bucket of
+ * select group. */
+#define POFLR_GROUP_HASH_FIELD_MAX (8)
+
+/* Number of bucket weights the group message carries. A select group
+ * with more buckets than this is rejected. */
+#define POFLR_GROUP_WEIGHT_NUM (sizeof(((pof_group *)0)->weight))
+
+/* Number of points on the hash ring of one select group. */
+#define POFLR_GROUP_RING_SIZE (256)
+
 /* Max number of local physical port. */
 #define POFLR_DEVICE_PORT_NUM_MAX (16)
 
+/* Number of port ids tracked by the port liveness bitmap. Ports with larger
+ * id are never live. */
+#define POFLR_PORT_LIVE_ID_MAX (4096)
+
+/* Number of slots in each level of the flow timeout wheel. The wheel ticks
+ * every second, and two levels cover the longest 16-bit timeout. */
+#define POFLR_FLOW_WHEEL_BITS (8)
+#define POFLR_FLOW_WHEEL_SIZE (1 << POFLR_FLOW_WHEEL_BITS)
+#define POFLR_FLOW_WHEEL_MASK (POFLR_FLOW_WHEEL_SIZE - 1)
+
 /* Max key length. */
 #define POFLR_KEY_LEN (160)
 
@@ -59,18 +86,99 @@
 typedef struct poflr_flow_entry{
     pof_flow_entry entry;
     uint32_t state;   // POFLR_STATE_VALID or POFLR_STATE_INVALID
+
+    /* Timeout. The times are in second of poflr_flow_clock. */
+    uint32_t install_time;
+    uint64_t install_ns;        /* Install time in CLOCK_MONOTONIC nanosecond,
+                                 * for the duration reported to the Controller. */
+    volatile uint32_t last_hit;         /* Updated by the datapath on match. */
+    struct poflr_flow_entry *timer_next;
+    struct poflr_flow_entry **timer_pprev;
+                                /* Links in the timeout wheel slot. NULL if
+                                 * the entry has no timeout. */
 }poflr_flow_entry;
 
+/* Coarse clock of the flow timeout in second, updated by the timeout task. */
+extern volatile uint32_t poflr_flow_clock;
+
+/* Record the hit of the flow entry for the idle timeout. The store is
+ * skipped if the entry was already hit in this second. */
+#define POFLR_FLOW_ENTRY_HIT(flow_ptr)                                      \
+    do{                                                                     \
+        poflr_flow_entry *hit_ptr_ = (poflr_flow_entry *)(flow_ptr);        \
+        if(hit_ptr_->last_hit != poflr_flow_clock){                         \
+            hit_ptr_->last_hit = poflr_flow_clock;                          \
+        }                                                                   \
+    }while(0)
+
+/* Lock of the flow tables, shared by the flow mod handler, the flow
+ * timeout task and the command line. The datapath reads the tables
+ * without lock. A published entry is never changed: it is replaced by
+ * a new copy, and the old one is retired. A table is published whole
+ * when it is created, and retired when it is deleted. The retired
+ * objects are freed only while this lock is held. */
+extern pthread_mutex_t poflr_flow_mutex;
+#define POFLR_FLOW_LOCK_ON      pthread_mutex_lock(&poflr_flow_mutex)
+#define POFLR_FLOW_LOCK_OFF     pthread_mutex_unlock(&poflr_flow_mutex)
+
 typedef struct poflr_flow_table{
     pof_flow_table tbl_base_info;
-    poflr_flow_entry *entry_ptr;
+    poflr_flow_entry **entry_ptr;   /* Entry of each index, or NULL. Load
+                                     * it with POFBF_RCU_DEREF. */
     uint32_t entry_num;
     uint32_t state;   // POFLR_STATE_VALID or POFLR_STATE_INVALID
+
+    /* Index of the entries by priority and masked match, chaining the
+     * entry indexes. Only the control path uses it, under the flow lock.
+     * Linear table has no index. */
+    uint32_t *hash_head;    /* hash_mask + 1 buckets. */
+    uint32_t *hash_next;    /* Next entry index of each entry. */
+    uint32_t hash_mask;
 }poflr_flow_table;
 
+/* End of the hash chain of flow entries. */
+#define POFLR_FLOW_HASH_NONE (0xffffffff)
+
+/* Watch port of the bucket without OUTPUT action, which is always live. */
+#define POFLR_GROUP_WATCH_ANY (0xffffffff)
+
+/* One bucket of select or fast failover group. A bucket is a run of actions
+ * in pof_group.action ending with OUTPUT, DROP, GROUP or PACKET_IN action. */
+typedef struct poflr_group_bucket{
+    uint8_t action_offset;      /* Index of the first action of the bucket. */
+    uint8_t action_num;         /* Number of actions in the bucket. */
+    uint8_t pad[2];
+    uint32_t watch_port;        /* Output port of the bucket. Fast failover
+                                 * group uses the bucket only if it is live. */
+}poflr_group_bucket;
+
+/* One point on the consistent hash ring of select group. */
+typedef struct poflr_group_point{
+    uint32_t hash;
+    uint32_t bucket;            /* Index of the bucket owning the point. */
+}poflr_group_point;
+
+/* Group as the datapath executes it. It is built anew on group add/modify
+ * and published with POFBF_RCU_ASSIGN, so the datapath never sees the
+ * buckets of one version with the actions of another. The buckets are
+ * used by select and fast failover group, and the hash ring by select
+ * group only. Each bucket owns ring points in proportion to its weight.
+ * The points are derived from the bucket's actions, so that adding or
+ * removing a bucket only remaps the flows hashed to the points which
+ * change. */
+typedef struct poflr_group_select{
+    pof_group group;            /* Copy of the group the buckets index. */
+    uint32_t bucket_num;
+    poflr_group_bucket bucket[POF_MAX_ACTION_NUMBER_PER_GROUP];
+    uint32_t point_num;
+    poflr_group_point point[POFLR_GROUP_RING_SIZE];   /* Sorted by hash. */
+}poflr_group_select;
+
 typedef struct poflr_groups{
     uint32_t group_num;
     pof_group *group;
+    poflr_group_select **select;    /* Group of each id, or NULL. Load it
+                                     * with POFBF_RCU_DEREF. */
     uint32_t *state;   // POFLR_STATE_VALID or POFLR_STATE_INVALID
 }poflr_groups;
 
@@ -80,9 +188,26 @@ typedef struct poflr_counters{
     uint32_t *state; // POFLR_STATE_VALID or POFLR_STATE_INVALID
 }poflr_counters;
 
+/* Token bucket of one meter. The bucket is kept as the theoretical arrival
+ * time of the next conforming byte, so that one compare-and-swap updates it
+ * without lock. */
+typedef struct poflr_meter_bucket{
+    volatile uint64_t tat;          /* Theoretical arrival time. Unit is nano-second. */
+    uint64_t ns_per_byte;           /* Time cost of one byte at the meter rate,
+                                     * in nano-second fixed point with
+                                     * POFLR_METER_FRAC_BITS fraction bits.
+                                     * 0 means no limitation. */
+    uint64_t burst_ns;              /* Burst tolerance. Unit is nano-second. */
+    volatile uint64_t conform_packets;
+    volatile uint64_t conform_bytes;
+    volatile uint64_t exceed_packets;
+    volatile uint64_t exceed_bytes;
+}poflr_meter_bucket;
+
 typedef struct poflr_meters{
     uint32_t meter_num;
     pof_meter *meter;
+    poflr_meter_bucket *bucket;
     uint32_t *state;   // POFLR_STATE_VALID or POFLR_STATE_INVALID
 }poflr_meters;
 
@@ -110,6 +235,7 @@ extern uint32_t poflr_get_switch_feature(pof_switch_features **feature_ptrptr);
 
 /* Port. */
 extern uint32_t poflr_init_port();
+extern uint32_t poflr_init_port_memory(uint16_t num);
 extern uint32_t poflr_port_detect_task();
 extern uint32_t poflr_reply_port_resource();
 extern uint32_t poflr_get_hwaddr_by_ipaddr(uint8_t *hwaddr, char *ipaddr_stri, uint8_t *port_id_ptr);
@@ -121,6 +247,12 @@ extern uint32_t poflr_get_port_number(uint16_t *port_number_ptr);
 extern uint32_t poflr_get_port_number_max(uint16_t *port_number_ptr);
 extern uint32_t poflr_set_port_task_id(task_t *tid, pof_port *p);
 extern uint32_t poflr_del_port_task_id(task_t **tid, pof_port *p);
+extern uint32_t poflr_port_link_task();
+extern void poflr_set_port_live(uint32_t port_id, uint32_t live);
+extern uint32_t poflr_port_is_live(uint32_t port_id);
+extern void poflr_get_port_stats(uint32_t port_id, pof_port_stats *stats);
+extern uint32_t poflr_reply_port_stats_multipart(uint32_t port_id);
+extern task_t g_poflr_port_link_task_id;
 
 /* Flow table. */
 extern uint32_t poflr_init_table_resource();
@@ -142,6 +274,8 @@ extern uint32_t poflr_table_id_to_ID (uint8_t type, uint8_t id, uint8_t *ID_ptr)
 extern uint32_t poflr_get_flow_table_resource(pof_flow_table_resource **flow_table_resource_ptrptr);
 extern uint32_t poflr_get_flow_table(poflr_flow_table **flow_table_ptrptr, uint8_t table_type, uint8_t table_id);
 extern uint32_t poflr_get_table_number(uint8_t **table_number_ptrptr);
+extern uint32_t poflr_get_table_stats(uint8_t table_type, uint8_t table_id, pof_table_stats *stats);
+extern uint32_t poflr_reply_table_stats_multipart(uint8_t table_ID);
 extern uint32_t poflr_get_table_id_base(uint8_t **table_id_base_ptrptr);
 extern uint32_t poflr_get_table_size(uint32_t *tabel_size_ptr);
 extern uint32_t poflr_get_key_len(uint16_t **key_len_ptrptr);
@@ -150,6 +284,9 @@ extern uint32_t poflr_check_flow_table_exist(uint8_t ID);
 extern uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr);
 extern uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr);
 extern uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr);
+extern uint32_t poflr_flow_mod_by_match(pof_flow_entry *flow_ptr);
+extern uint32_t poflr_flow_timeout_task();
+extern task_t g_poflr_flow_timeout_task_id;
 
 /* Meter. */
 extern uint32_t poflr_add_meter_entry(uint32_t meter_id, uint32_t rate);
@@ -160,6 +297,7 @@ extern uint32_t poflr_free_meter();
 extern uint32_t poflr_empty_meter();
 extern uint32_t poflr_get_meter(poflr_meters **meter_ptrptr);
 extern uint32_t poflr_get_meter_number(uint32_t *meter_number_ptr);
+extern uint32_t poflr_meter_police(uint32_t meter_id, uint32_t byte_len, uint8_t *conform_ptr);
 
 /* Group. */
 extern uint32_t poflr_modify_group_entry(pof_group *group_ptr);
@@ -170,6 +308,12 @@ extern uint32_t poflr_free_group();
 extern uint32_t poflr_empty_group();
 extern uint32_t poflr_get_group(poflr_groups **group_ptrptr);
 extern uint32_t poflr_get_group_number(uint32_t *group_number_ptr);
+extern uint32_t poflr_get_group_select(uint32_t group_id, poflr_group_select **select_ptrptr);
+extern uint32_t poflr_group_select_bucket(const poflr_group_select *s, uint32_t hash, \
+                                          const poflr_group_bucket **bucket_ptrptr);
+extern uint32_t poflr_group_ff_bucket(const poflr_group_select *s, const poflr_group_bucket **bucket_ptrptr);
+extern uint32_t poflr_add_group_hash_field(uint16_t field_id, uint16_t offset, uint16_t len);
+extern uint32_t poflr_get_group_hash_field(pof_match **field_ptrptr, uint32_t *field_num_ptr);
 
 /* Counter. */
 extern uint32_t poflr_counter_init(uint32_t counter_id);
@@ -186,6 +330,11 @@ extern uint32_t poflr_free_counter();
 extern uint32_t poflr_empty_counter();
 extern uint32_t poflr_get_counter(poflr_counters **counter_ptrptr);
 extern uint32_t poflr_get_counter_number(uint32_t *counter_number_ptr);
+extern uint32_t poflr_reply_counter_multipart(uint32_t counter_id, uint32_t counter_num);
+extern uint32_t poflr_counter_push_task();
+extern uint32_t poflr_get_counter_push_interval(uint32_t *interval_ptr);
+extern uint32_t poflr_set_counter_push_interval(uint32_t interval);
+extern task_t g_poflr_counter_push_task_id;
 
 /* Set MM table number. */
 extern uint32_t poflr_set_MM_table_number(uint8_t MMTableNum);
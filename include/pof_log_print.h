@@ -41,6 +41,41 @@
 
 #define POF_LOG_STRING_MAX_LEN (512)
 
+/* Max length of one line printed by POF_LOG_CPRINT_FL. Longer hex dump is
+ * cut. */
+#define POFLP_LINE_MAX_LEN (4096)
+
+/* Log ring of each thread. The lines are kept as records of fixed size,
+ * with the text and the data to dump cut to the lengths. The size of the
+ * ring must be power of 2. */
+#define POFLP_RING_SIZE         (512)
+#define POFLP_RECORD_TEXT_LEN   (256)
+#define POFLP_RECORD_HEX_LEN    (256)
+
+/* Interval in milli-second of the writer task when the rings are empty. */
+#define POFLP_WRITER_INTERVAL   (10)
+
+/* Log categories. */
+enum poflp_category{
+    POFLP_CONTROL   = 0,    /* Channel, config and local resource. */
+    POFLP_DATAPATH  = 1,    /* Packet receiving, actions and sending. */
+    POFLP_LOOKUP    = 2,    /* Flow table lookup. */
+
+    POFLP_CATEGORY_NUM,
+    POFLP_CATEGORY_ALL = POFLP_CATEGORY_NUM
+};
+
+/* Log levels. A statement is printed if its level is not above the level
+ * of its category. */
+enum poflp_level{
+    POFLP_OFF       = 0,
+    POFLP_ERROR     = 1,
+    POFLP_INFO      = 2,    /* One line per packet or per message. */
+    POFLP_DEBUG     = 3,    /* Per action lines and hex dumps. */
+
+    POFLP_LEVEL_NUM
+};
+
 struct log_util{
 	FILE *log_fp;
 	pthread_mutex_t mutex;
@@ -70,6 +105,7 @@ struct log_util{
 };
 
 extern struct log_util g_log;
+extern volatile uint8_t g_poflp_level[POFLP_CATEGORY_NUM];
 
 /* flag = 0: receive, flag = 1: send */
 extern void pof_debug_cprint_packet(const void *ph, uint32_t flag, int len);
@@ -78,6 +114,11 @@ extern void poflp_action(const void *ph);
 extern void pof_open_log_file(char *filename);
 extern void pof_close_log_file();
 extern void poflp_debug_enable();
+extern uint32_t poflp_set_level(uint32_t category, uint32_t level);
+extern uint64_t poflp_dropped();
+extern void poflp_cprint_fl(uint32_t level, const char *file, int line, char *col, \
+                            const void *x, uint32_t len, const char *cont, ...) \
+                            __attribute__((format(printf, 7, 8)));
 
 #define POF_LOG_LOCK_ON			pthread_mutex_lock(&g_log.mutex)
 #define POF_LOG_LOCK_OFF		pthread_mutex_unlock(&g_log.mutex)
@@ -107,11 +148,29 @@ extern void poflp_debug_enable();
 #define POF_DEBUG_CPRINT(i,col,cont,...)        POF_CPRINT(i,col,pDbg,cont, ##__VA_ARGS__)
 
 #define POF_DEBUG_CPRINT_HEAD(i,col)            POF_DEBUG_CPRINT(i,col,"%s|%s|%05u|INFO|%s|%d: ", __TIME__, __DATE__, g_log.counter++, __FILE__, __LINE__)
-#define POF_DEBUG_CPRINT_FL(i,col,cont,...) \
-			POF_LOG_LOCK_ON;								\
-            POF_DEBUG_CPRINT_HEAD(i,col);					\
-            POF_DEBUG_CPRINT(i,col,cont"\n",##__VA_ARGS__); \
-			POF_LOG_LOCK_OFF
+
+/* Check the level of the category. A disabled statement costs only this
+ * branch, and its arguments are not evaluated. */
+#define POFLP_ENABLED(cat,level)                __builtin_expect(g_poflp_level[cat] >= (level), 0)
+
+/* Print one line of the category and level. The line is queued in the log
+ * ring of the calling thread, without the log lock. */
+#define POF_LOG_CPRINT_FL(cat,level,col,cont,...) \
+            do{ \
+                if(POFLP_ENABLED(cat,level)){ \
+                    poflp_cprint_fl(level,__FILE__,__LINE__,col,NULL,0,cont,##__VA_ARGS__); \
+                } \
+            }while(0)
+
+/* Print one line followed by len bytes of x in hex. */
+#define POF_LOG_CPRINT_FL_0X(cat,level,col,x,len,cont,...) \
+            do{ \
+                if(POFLP_ENABLED(cat,level)){ \
+                    poflp_cprint_fl(level,__FILE__,__LINE__,col,x,len,cont,##__VA_ARGS__); \
+                } \
+            }while(0)
+
+#define POF_DEBUG_CPRINT_FL(i,col,cont,...)     POF_LOG_CPRINT_FL(POFLP_CONTROL,POFLP_INFO,col,cont,##__VA_ARGS__)
 
 #define POF_DEBUG_CPRINT_FL_NO_ENTER(i,col,cont,...) \
             POF_DEBUG_CPRINT_HEAD(i,col); \
@@ -119,10 +178,14 @@ extern void poflp_debug_enable();
 
 /* flag = 0: receive, flag = 1: send */
 #define POF_DEBUG_CPRINT_PACKET(pheader,flag,len) \
-			POF_LOG_LOCK_ON;							\
-            POF_DEBUG_CPRINT_HEAD(1,GREEN);				\
-            pof_debug_cprint_packet(pheader,flag,len);	\
-			POF_LOG_LOCK_OFF
+            do{ \
+                if(POFLP_ENABLED(POFLP_CONTROL,POFLP_DEBUG)){ \
+                    POF_LOG_LOCK_ON; \
+                    POF_DEBUG_CPRINT_HEAD(1,GREEN); \
+                    pof_debug_cprint_packet(pheader,flag,len); \
+                    POF_LOG_LOCK_OFF; \
+                } \
+            }while(0)
 
 #define POF_DEBUG_CPRINT_0X_NO_ENTER(x, len) \
             { \
@@ -138,10 +201,7 @@ extern void poflp_debug_enable();
             POF_DEBUG_CPRINT(1,WHITE,"\n")
 
 #define POF_DEBUG_CPRINT_FL_0X(i,col,x,len,cont,...) \
-			POF_LOG_LOCK_ON;										\
-            POF_DEBUG_CPRINT_FL_NO_ENTER(i,col,cont,##__VA_ARGS__); \
-            POF_DEBUG_CPRINT_0X(x,len);								\
-			POF_LOG_LOCK_OFF
+            POF_LOG_CPRINT_FL_0X(POFLP_CONTROL,POFLP_DEBUG,col,x,len,cont,##__VA_ARGS__)
 
 #define POF_DEBUG_SLEEP(i) \
             POF_DEBUG_CPRINT_FL(1,WHITE,"sleep start! [%ds]\n", i); \
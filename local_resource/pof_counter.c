@@ -44,6 +44,20 @@ uint32_t poflr_counter_number = POFLR_COUNTER_NUMBER;
 /* Counter table. */
 poflr_counters *poflr_counter;
 
+/* Interval of pushing counters to the Controller. The unit is
+ * milli-second. Zero means counters are only reported on request. */
+uint32_t poflr_counter_push_interval = 0;
+
+/* Task id of the counter push task. */
+task_t g_poflr_counter_push_task_id = POF_INVALID_TASKID;
+
+/* Lock of the counter table. The counters are added, deleted and
+ * cleared under it, and the counter push task takes its snapshot under
+ * it. The datapath increases the values without it. */
+static pthread_mutex_t poflr_counter_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define POFLR_COUNTER_LOCK_ON   pthread_mutex_lock(&poflr_counter_mutex)
+#define POFLR_COUNTER_LOCK_OFF  pthread_mutex_unlock(&poflr_counter_mutex)
+
 /***********************************************************************
  * Initialize the counter corresponding the counter_id.
  * Form:     uint32_t poflr_counter_init(uint32_t counter_id)
@@ -65,13 +79,15 @@ uint32_t poflr_counter_init(uint32_t counter_id){
     if(counter_id >= poflr_counter_number){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID, g_recv_xid);
     }
+    POFLR_COUNTER_LOCK_ON;
     if(poflr_counter->state[counter_id] == POFLR_STATE_INVALID){
-        poflr_counter->state[counter_id] = POFLR_STATE_VALID;
-        poflr_counter->counter_num++;
         p = &poflr_counter->counter[counter_id];
         p->counter_id = counter_id;
         p->value = 0;
+        poflr_counter->state[counter_id] = POFLR_STATE_VALID;
+        poflr_counter->counter_num++;
     }
+    POFLR_COUNTER_LOCK_OFF;
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"The counter[%u] has been initialized!", counter_id);
     return POF_OK;
@@ -100,11 +116,13 @@ uint32_t poflr_counter_delete(uint32_t counter_id){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_COUNTER_UNEXIST, g_recv_xid);
     }
 
+    POFLR_COUNTER_LOCK_ON;
     poflr_counter->state[counter_id] = POFLR_STATE_INVALID;
     poflr_counter->counter_num--;
     p = &poflr_counter->counter[counter_id];
     p->counter_id = 0;
     p->value = 0;
+    POFLR_COUNTER_LOCK_OFF;
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"The counter[%u] has been deleted!", counter_id);
     return POF_OK;
@@ -134,7 +152,9 @@ uint32_t poflr_counter_clear(uint32_t counter_id){
 
     /* Initialize the counter value. */
     pof_counter * tmp_counter_ptr = & (poflr_counter->counter[counter_id]);
+    POFLR_COUNTER_LOCK_ON;
     tmp_counter_ptr->value = 0;
+    POFLR_COUNTER_LOCK_OFF;
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Clear counter value SUC!");
     return POF_OK;
@@ -166,9 +186,6 @@ uint32_t poflr_get_counter_value(uint32_t counter_id){
     counter.value = (poflr_counter->counter[counter_id]).value;
     pof_NtoH_transfer_counter(&counter);
 
-	/* Delay 0.1s. */
-	pofbf_task_delay(100);
-
     if(POF_OK != pofec_reply_msg(POFT_COUNTER_REPLY, g_recv_xid, sizeof(pof_counter), (uint8_t *)&counter)){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid);
     }
@@ -178,6 +195,142 @@ uint32_t poflr_get_counter_value(uint32_t counter_id){
     return POF_OK;
 }
 
+/* Copy the valid counters in [counter_id, counter_id + counter_num) into
+ * snap in one pass under the counter lock, so that no counter is added,
+ * deleted or cleared in the middle, and every reply chunk reflects the
+ * same instant. */
+static uint32_t poflr_counter_snapshot(uint32_t counter_id, uint32_t counter_num, \
+                                       pof_counter *snap, uint32_t *snap_num_ptr)
+{
+    uint32_t id, end, num = 0;
+
+    if(counter_num == 0 || counter_num > poflr_counter_number - counter_id){
+        end = poflr_counter_number;
+    }else{
+        end = counter_id + counter_num;
+    }
+
+    /* The counter_id 0 means no counter. */
+    POFLR_COUNTER_LOCK_ON;
+    for(id = (counter_id ? counter_id : 1); id < end; id++){
+        if(poflr_counter->state[id] != POFLR_STATE_VALID){
+            continue;
+        }
+        snap[num] = poflr_counter->counter[id];
+        snap[num].counter_id = id;
+        num++;
+    }
+    POFLR_COUNTER_LOCK_OFF;
+
+    *snap_num_ptr = num;
+    return POF_OK;
+}
+
+/* Send the counter snapshot as one or more POFT_MULTIPART_REPLY messages
+ * which share the xid. All but the last one carry POFMPF_REPLY_MORE. */
+static uint32_t poflr_counter_send_multipart(pof_counter *snap, uint32_t snap_num, uint32_t xid){
+    char msg[POF_QUEUE_MESSAGE_LEN];
+    pof_header *head_ptr = (pof_header *)msg;
+    pof_multipart *mp_ptr = (pof_multipart *)(msg + sizeof(pof_header));
+    pof_counter *counter_ptr = (pof_counter *)(msg + sizeof(pof_header) + sizeof(pof_multipart));
+    uint32_t num_per_msg, num, sent = 0, i;
+    uint16_t len;
+
+    num_per_msg = (POF_QUEUE_MESSAGE_LEN - sizeof(pof_header) - sizeof(pof_multipart)) / sizeof(pof_counter);
+
+    do{
+        num = (snap_num - sent > num_per_msg) ? num_per_msg : (snap_num - sent);
+        len = sizeof(pof_header) + sizeof(pof_multipart) + num * sizeof(pof_counter);
+
+        head_ptr->version = POF_VERSION;
+        head_ptr->type = POFT_MULTIPART_REPLY;
+        head_ptr->length = len;
+        head_ptr->xid = xid;
+        pof_HtoN_transfer_header(head_ptr);
+
+        memset(mp_ptr, 0, sizeof(pof_multipart));
+        mp_ptr->type = POFMP_COUNTER;
+        mp_ptr->flags = (sent + num < snap_num) ? POFMPF_REPLY_MORE : 0;
+        pof_NtoH_transfer_multipart(mp_ptr);
+
+        for(i=0; i<num; i++){
+            counter_ptr[i] = snap[sent + i];
+            counter_ptr[i].command = POFCC_REPLY;
+            pof_NtoH_transfer_counter(counter_ptr + i);
+        }
+
+        if(POF_OK != pofsc_send_packet_upward((uint8_t *)msg, len)){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+        }
+        sent += num;
+    }while(sent < snap_num);
+
+    return POF_OK;
+}
+
+static uint32_t poflr_counter_report(uint32_t counter_id, uint32_t counter_num, uint32_t xid){
+    pof_counter *snap;
+    uint32_t snap_num = 0, ret;
+
+    snap = (pof_counter *)malloc(sizeof(pof_counter) * poflr_counter_number);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(snap);
+
+    poflr_counter_snapshot(counter_id, counter_num, snap, &snap_num);
+    ret = poflr_counter_send_multipart(snap, snap_num, xid);
+
+    free(snap);
+    return ret;
+}
+
+/***********************************************************************
+ * Reply the values of a range of counters.
+ * Form:     uint32_t poflr_reply_counter_multipart(uint32_t counter_id, \
+ *                                                  uint32_t counter_num)
+ * Input:    first counter id, number of counter ids to scan
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function takes a snapshot of the valid counters in the
+ *           range and sends them to the Controller in POFT_MULTIPART_REPLY
+ *           messages. The counter_num 0 means all of the counters from
+ *           counter_id.
+ ***********************************************************************/
+uint32_t poflr_reply_counter_multipart(uint32_t counter_id, uint32_t counter_num){
+    uint32_t ret;
+
+    /* Check counter_id. */
+    if(counter_id >= poflr_counter_number){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID, g_recv_xid);
+    }
+
+    ret = poflr_counter_report(counter_id, counter_num, g_recv_xid);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"Reply counter multipart SUC! counter id = %u, counter num = %u", \
+                        counter_id, counter_num);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * The task function of the counter push task.
+ * Form:     uint32_t poflr_counter_push_task()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This task pushes all of the valid counters to the Controller
+ *           every poflr_counter_push_interval milli-seconds, while the
+ *           OpenFlow channel is running.
+ ***********************************************************************/
+uint32_t poflr_counter_push_task(){
+    while(1){
+        pofbf_task_delay(poflr_counter_push_interval);
+        if(pofsc_conn_desc.conn_status.state != POFCS_CHANNEL_RUN){
+            continue;
+        }
+        (void)poflr_counter_report(0, 0, __sync_fetch_and_add(&g_upward_xid, 1));
+    }
+    return POF_OK;
+}
+
 /***********************************************************************
  * Increace the counter
  * Form:     uint32_t poflr_counter_increace(uint32_t counter_id)
@@ -196,7 +349,8 @@ uint32_t poflr_counter_increace(uint32_t counter_id){
 
     /* Check the counter id. */
     if(counter_id >= poflr_counter_number){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID, g_upward_xid++);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID, \
+                                       __sync_fetch_and_add(&g_upward_xid, 1));
     }
     if(poflr_counter->state[counter_id] == POFLR_STATE_INVALID){
 		poflr_counter_init(counter_id);
@@ -205,7 +359,7 @@ uint32_t poflr_counter_increace(uint32_t counter_id){
     p = &poflr_counter->counter[counter_id];
     p->value++;
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased, value = %llu", counter_id, p->value);
+    POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_DEBUG,GREEN,"The counter %d has increased, value = %llu", counter_id, p->value);
     return POF_OK;
 }
 
@@ -250,9 +404,11 @@ uint32_t poflr_free_counter(){
 
 /* Empty counter. */
 uint32_t poflr_empty_counter(){
+    POFLR_COUNTER_LOCK_ON;
     memset(poflr_counter->counter, 0, sizeof(pof_counter) * poflr_counter_number);
     memset(poflr_counter->state, 0, sizeof(uint32_t) * poflr_counter_number);
     poflr_counter->counter_num = 0;
+    POFLR_COUNTER_LOCK_OFF;
 	
 	return POF_OK;
 }
@@ -274,3 +430,15 @@ uint32_t poflr_set_counter_number(uint32_t counter_num){
 	poflr_counter_number = counter_num;
 	return POF_OK;
 }
+
+/* Get counter push interval. */
+uint32_t poflr_get_counter_push_interval(uint32_t *interval_ptr){
+	*interval_ptr = poflr_counter_push_interval;
+	return POF_OK;
+}
+
+/* Set counter push interval. */
+uint32_t poflr_set_counter_push_interval(uint32_t interval){
+	poflr_counter_push_interval = interval;
+	return POF_OK;
+}
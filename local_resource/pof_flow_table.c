@@ -38,6 +38,8 @@
 #include "net/if.h"
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
+#include "time.h"
+#include "pthread.h"
 
 /* The table number of each type. */
 uint8_t poflr_mm_tbl_num = POFLR_MM_TBL_NUM;
@@ -48,8 +50,9 @@ uint8_t poflr_dt_tbl_num = POFLR_DT_TBL_NUM;
 /* Flow table size. */
 uint32_t poflr_flow_table_size = POFLR_FLOW_TABLE_SIZE;
 
-/* Flow tables. */
-poflr_flow_table *poflr_table_ptr[POF_MAX_TABLE_TYPE];
+/* Published flow tables. The table not created is poflr_flow_table_none. */
+poflr_flow_table **poflr_table_ptr[POF_MAX_TABLE_TYPE];
+static poflr_flow_table poflr_flow_table_none;
 
 /* Key length of each type flow table. */
 uint16_t poflr_key_len_each_type[POF_MAX_TABLE_TYPE];
@@ -63,8 +66,50 @@ uint8_t poflr_key_tid_base_each_type[POF_MAX_TABLE_TYPE];
 /* Key length. */
 uint32_t poflr_key_len = POFLR_KEY_LEN;
 
+/* Lock of the flow entries. */
+pthread_mutex_t poflr_flow_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Flow timeout clock in second, and its start time in CLOCK_MONOTONIC. */
+volatile uint32_t poflr_flow_clock = 0;
+static time_t poflr_flow_clock_base = 0;
+
+/* Flow timeout wheel. Level 0 has one slot per second, level 1 has one slot
+ * per POFLR_FLOW_WHEEL_SIZE seconds and cascades into level 0. */
+static poflr_flow_entry *poflr_flow_wheel[2][POFLR_FLOW_WHEEL_SIZE];
+static uint32_t poflr_flow_wheel_tick = 0;
+
+/* Nanoseconds of CLOCK_MONOTONIC. */
+static uint64_t poflr_flow_clock_ns(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Task id of the flow timeout task. */
+task_t g_poflr_flow_timeout_task_id = POF_INVALID_TASKID;
+
 static uint32_t poflr_compare_two_flow(pof_flow_entry *p1, pof_flow_entry *p2);
 static uint32_t poflr_check_flow_in_table(pof_flow_entry *flow_ptr, poflr_flow_table *table_ptr);
+static void poflr_flow_hash_insert(poflr_flow_table *table_ptr, poflr_flow_entry *entry_ptr);
+static void poflr_flow_hash_remove(poflr_flow_table *table_ptr, poflr_flow_entry *entry_ptr);
+static void poflr_flow_timer_insert(poflr_flow_entry *entry_ptr);
+static void poflr_flow_timer_remove(poflr_flow_entry *entry_ptr);
+
+/* Free the table and the entries left in it. */
+static void poflr_flow_table_free(void *ptr){
+    poflr_flow_table *tbl_ptr = (poflr_flow_table *)ptr;
+    uint32_t i;
+
+    for(i=0; i<tbl_ptr->tbl_base_info.size; i++){
+        free(tbl_ptr->entry_ptr[i]);
+    }
+    free(tbl_ptr->entry_ptr);
+    free(tbl_ptr->hash_head);
+    free(tbl_ptr->hash_next);
+    free(tbl_ptr);
+    return;
+}
 
 /***********************************************************************
  * Compare the two flow entry in the same table.
@@ -103,6 +148,78 @@ static uint32_t poflr_compare_two_flow(pof_flow_entry *p1, pof_flow_entry *p2){
     return POF_ERROR;
 }
 
+/* Hash the priority and the masked match of the flow entry. The same
+ * flow entries, as poflr_compare_two_flow decides, have the same hash. */
+static uint32_t poflr_flow_hash(const pof_flow_entry *p){
+    const uint8_t *head;
+    uint32_t h = 2166136261U, i, j;
+
+    h = (h ^ p->priority) * 16777619U;
+    h = (h ^ p->match_field_num) * 16777619U;
+    for(i=0; i<p->match_field_num && i<POF_MAX_MATCH_FIELD_NUM; i++){
+        head = (const uint8_t *)&p->match[i];
+        for(j=0; j<sizeof(pof_match_x) - 2*POF_MAX_FIELD_LENGTH_IN_BYTE; j++){
+            h = (h ^ head[j]) * 16777619U;
+        }
+        for(j=0; j<POF_MAX_FIELD_LENGTH_IN_BYTE; j++){
+            h = (h ^ (p->match[i].value[j] & p->match[i].mask[j])) * 16777619U;
+        }
+    }
+    return h ^ (h >> 16);
+}
+
+/* Link the entry into the hash chain of its bucket. */
+static void poflr_flow_hash_insert(poflr_flow_table *table_ptr, poflr_flow_entry *entry_ptr){
+    uint32_t bucket, index = entry_ptr->entry.index;
+
+    if(table_ptr->hash_head == NULL){
+        return;
+    }
+
+    bucket = poflr_flow_hash(&entry_ptr->entry) & table_ptr->hash_mask;
+    table_ptr->hash_next[index] = table_ptr->hash_head[bucket];
+    table_ptr->hash_head[bucket] = index;
+    return;
+}
+
+/* Unlink the entry from the hash chain of its bucket. */
+static void poflr_flow_hash_remove(poflr_flow_table *table_ptr, poflr_flow_entry *entry_ptr){
+    uint32_t *link, index = entry_ptr->entry.index;
+
+    if(table_ptr->hash_head == NULL){
+        return;
+    }
+
+    link = &table_ptr->hash_head[poflr_flow_hash(&entry_ptr->entry) & table_ptr->hash_mask];
+    while(*link != POFLR_FLOW_HASH_NONE){
+        if(*link == index){
+            *link = table_ptr->hash_next[index];
+            return;
+        }
+        link = &table_ptr->hash_next[*link];
+    }
+    return;
+}
+
+/* Find the entry with the same priority and masked match as the flow
+ * entry, other than the entry with index skip. Return its index or
+ * POFLR_FLOW_HASH_NONE. */
+static uint32_t poflr_flow_hash_find(poflr_flow_table *table_ptr, pof_flow_entry *flow_ptr, uint32_t skip){
+    uint32_t i;
+
+    if(table_ptr->hash_head == NULL){
+        return POFLR_FLOW_HASH_NONE;
+    }
+
+    i = table_ptr->hash_head[poflr_flow_hash(flow_ptr) & table_ptr->hash_mask];
+    for(; i != POFLR_FLOW_HASH_NONE; i = table_ptr->hash_next[i]){
+        if(i != skip && poflr_compare_two_flow(flow_ptr, &table_ptr->entry_ptr[i]->entry) != POF_OK){
+            break;
+        }
+    }
+    return i;
+}
+
 /***********************************************************************
  * Check flow entry in the table.
  * Form:     static uint32_t poflr_check_flow_in_table(pof_flow_entry *flow_ptr, \
@@ -113,28 +230,13 @@ static uint32_t poflr_compare_two_flow(pof_flow_entry *p1, pof_flow_entry *p2){
  * Discribe: This function will check if an exactly flow entry is already
  *           exist in the table when a new flow entry need to be added.
  *           If there is a same flow entry already, the task will be
- *           terminated.
+ *           terminated. Only the entries in the hash chain of the new
+ *           flow entry are compared. The entry with the same index is
+ *           skipped.
  ***********************************************************************/
 static uint32_t poflr_check_flow_in_table(pof_flow_entry *flow_ptr, poflr_flow_table *table_ptr){
-    poflr_flow_entry *entry_ptr;
-    uint32_t num=0, count=0;
-
-    num = table_ptr->entry_num;
-    entry_ptr = table_ptr->entry_ptr;
-
-    for(count=0; count<num; entry_ptr++){
-        if(entry_ptr->state == POFLR_STATE_INVALID){
-            continue;
-        }
-
-        count++;
-		if(entry_ptr->entry.index == flow_ptr->index){
-			continue;
-		}
-
-        if(poflr_compare_two_flow(flow_ptr, &entry_ptr->entry) != POF_OK){
-            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_EXIST, g_recv_xid);
-        }
+    if(poflr_flow_hash_find(table_ptr, flow_ptr, flow_ptr->index) != POFLR_FLOW_HASH_NONE){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_EXIST, g_recv_xid);
     }
 
     return POF_OK;
@@ -154,7 +256,7 @@ static uint32_t poflr_check_flow_in_table(pof_flow_entry *flow_ptr, poflr_flow_t
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will create a flow table in local resource.
- *           The new table is empty.
+ *           The new table is empty. It is published after it is filled.
  ***********************************************************************/
 uint32_t poflr_create_flow_table(uint8_t table_id, \
                                  uint8_t type, \
@@ -165,6 +267,7 @@ uint32_t poflr_create_flow_table(uint8_t table_id, \
 								 pof_match *match)
 {
     poflr_flow_table *tmp_tbl_ptr;
+    uint32_t i, bucket_num = 1;
 
     /* Check type. */
     if(type >= POF_MAX_TABLE_TYPE){
@@ -177,7 +280,7 @@ uint32_t poflr_create_flow_table(uint8_t table_id, \
     }
 
     /* Check whether the table have already existed. */
-    if(poflr_table_ptr[type][table_id].state != POFLR_STATE_INVALID){
+    if(poflr_table_ptr[type][table_id]->state != POFLR_STATE_INVALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_TABLE_EXIST, g_recv_xid);
     }
 
@@ -192,11 +295,33 @@ uint32_t poflr_create_flow_table(uint8_t table_id, \
     }
 
     /* Initialize the table. */
-    tmp_tbl_ptr = &poflr_table_ptr[type][table_id];
+    tmp_tbl_ptr = (poflr_flow_table *)malloc(sizeof(poflr_flow_table));
+    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(tmp_tbl_ptr, g_recv_xid);
+    memset(tmp_tbl_ptr, 0, sizeof(poflr_flow_table));
+
+    tmp_tbl_ptr->entry_ptr = (poflr_flow_entry **)malloc(size * sizeof(poflr_flow_entry *));
+    if(tmp_tbl_ptr->entry_ptr == NULL){
+        free(tmp_tbl_ptr);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_recv_xid);
+    }
+    memset(tmp_tbl_ptr->entry_ptr, 0, size * sizeof(poflr_flow_entry *));
 
-    tmp_tbl_ptr->entry_ptr = (poflr_flow_entry *)malloc(size * sizeof(poflr_flow_entry));
-    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(tmp_tbl_ptr->entry_ptr, g_recv_xid);
-    memset(tmp_tbl_ptr->entry_ptr, 0, size * sizeof(poflr_flow_entry));
+    /* The hash index has one bucket or more for each entry. */
+    if(type != POF_LINEAR_TABLE){
+        while(bucket_num < size){
+            bucket_num <<= 1;
+        }
+        tmp_tbl_ptr->hash_head = (uint32_t *)malloc(bucket_num * sizeof(uint32_t));
+        tmp_tbl_ptr->hash_next = (uint32_t *)malloc((size ? size : 1) * sizeof(uint32_t));
+        if(tmp_tbl_ptr->hash_head == NULL || tmp_tbl_ptr->hash_next == NULL){
+            poflr_flow_table_free(tmp_tbl_ptr);
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_recv_xid);
+        }
+        for(i=0; i<bucket_num; i++){
+            tmp_tbl_ptr->hash_head[i] = POFLR_FLOW_HASH_NONE;
+        }
+        tmp_tbl_ptr->hash_mask = bucket_num - 1;
+    }
 
     tmp_tbl_ptr->entry_num = 0;
     tmp_tbl_ptr->state = POFLR_STATE_VALID;
@@ -207,6 +332,10 @@ uint32_t poflr_create_flow_table(uint8_t table_id, \
     tmp_tbl_ptr->tbl_base_info.type = type;
 	tmp_tbl_ptr->tbl_base_info.match_field_num = match_field_num;
 	memcpy(tmp_tbl_ptr->tbl_base_info.match, match, match_field_num * sizeof(pof_match));
+#ifdef POF_DATAPATH_ON
+    pofdp_table_stats_reset(type, table_id);
+#endif // POF_DATAPATH_ON
+    POFBF_RCU_ASSIGN(poflr_table_ptr[type][table_id], tmp_tbl_ptr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Create flow table SUC!");
     return POF_OK;
@@ -220,7 +349,8 @@ uint32_t poflr_create_flow_table(uint8_t table_id, \
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will delete the flow table corresponding to the
- *           table id and the table type.
+ *           table id and the table type. The table is unpublished, and
+ *           freed when the datapath has left it.
  ***********************************************************************/
 uint32_t poflr_delete_flow_table(uint8_t table_id, uint8_t type){
     poflr_flow_table *tmp_tbl_ptr;
@@ -235,7 +365,7 @@ uint32_t poflr_delete_flow_table(uint8_t table_id, uint8_t type){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_BAD_TABLE_ID, g_recv_xid);
     }
 
-    tmp_tbl_ptr = & poflr_table_ptr[type][table_id];
+    tmp_tbl_ptr = poflr_table_ptr[type][table_id];
     /* Check whether the table have already existed. */
     if(tmp_tbl_ptr->state != POFLR_STATE_VALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_TABLE_UNEXIST, g_recv_xid);
@@ -246,11 +376,9 @@ uint32_t poflr_delete_flow_table(uint8_t table_id, uint8_t type){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_TABLE_UNEMPTY, g_recv_xid);
     }
 
-    /* Free the memory of the entry in the table. */
-    free(tmp_tbl_ptr->entry_ptr);
-
-    /* Initialize the table. */
-    memset(tmp_tbl_ptr,0,sizeof(poflr_flow_table));
+    /* Unpublish the table, and free it later. */
+    POFBF_RCU_ASSIGN(poflr_table_ptr[type][table_id], &poflr_flow_table_none);
+    pofbf_rcu_retire(tmp_tbl_ptr, poflr_flow_table_free);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Delete flow table SUC!");
     return POF_OK;
@@ -263,7 +391,8 @@ uint32_t poflr_delete_flow_table(uint8_t table_id, uint8_t type){
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will add a new flow entry in the table. If a
- *           same flow entry is already exist in this table, ERROR.
+ *           same flow entry is already exist in this table, ERROR. The
+ *           entry is published after it is filled.
  ***********************************************************************/
 uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr){
     poflr_flow_entry *tmp_vhal_entry_ptr;
@@ -282,7 +411,7 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
     }
 
-    tmp_tbl_ptr = & poflr_table_ptr[table_type][table_id];
+    tmp_tbl_ptr = poflr_table_ptr[table_type][table_id];
     /* Check whether the table have already existed. */
     if(tmp_tbl_ptr->state != POFLR_STATE_VALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
@@ -293,9 +422,8 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_ENTRY_ID, g_recv_xid);
     }
 
-    tmp_vhal_entry_ptr = &tmp_tbl_ptr->entry_ptr[index];
     /* Check whether the index have already existed. */
-    if(tmp_vhal_entry_ptr->state != POFLR_STATE_INVALID){
+    if(tmp_tbl_ptr->entry_ptr[index] != NULL){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_EXIST, g_recv_xid);
     }
 
@@ -307,21 +435,36 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr){
 	}
 #endif // POF_ADD_ENTRY_CHECK_ON
 
+    tmp_vhal_entry_ptr = (poflr_flow_entry *)malloc(sizeof(poflr_flow_entry));
+    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(tmp_vhal_entry_ptr, g_recv_xid);
+
     /* Initialize the counter_id. */
 	ret = poflr_counter_init(flow_ptr->counter_id);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    if(ret != POF_OK){
+        free(tmp_vhal_entry_ptr);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
 
     /* Create entry. */
+    memset(tmp_vhal_entry_ptr, 0, sizeof(poflr_flow_entry));
     memcpy(&tmp_vhal_entry_ptr->entry, flow_ptr, sizeof(pof_flow_entry));
     tmp_vhal_entry_ptr->state = POFLR_STATE_VALID;
+    tmp_vhal_entry_ptr->install_time = poflr_flow_clock;
+    tmp_vhal_entry_ptr->install_ns = poflr_flow_clock_ns();
+    tmp_vhal_entry_ptr->last_hit = poflr_flow_clock;
+    poflr_flow_timer_insert(tmp_vhal_entry_ptr);
+    POFBF_RCU_ASSIGN(tmp_tbl_ptr->entry_ptr[index], tmp_vhal_entry_ptr);
+    poflr_flow_hash_insert(tmp_tbl_ptr, tmp_vhal_entry_ptr);
     tmp_tbl_ptr->entry_num++;
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Add flow entry SUC! Totally %d entries in this table.",
             tmp_tbl_ptr->entry_num);
-	POF_LOG_LOCK_ON;
-    poflp_flow_entry(flow_ptr);
-    POF_DEBUG_CPRINT(1,WHITE,"\n");
-	POF_LOG_LOCK_OFF;
+    if(POFLP_ENABLED(POFLP_CONTROL,POFLP_DEBUG)){
+        POF_LOG_LOCK_ON;
+        poflp_flow_entry(flow_ptr);
+        POF_DEBUG_CPRINT(1,WHITE,"\n");
+        POF_LOG_LOCK_OFF;
+    }
     return POF_OK;
 }
 
@@ -331,10 +474,12 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr){
  * Input:    flow entry
  * Output:   NONE
  * Return:   POF_OK or ERROR code
- * Discribe: This function will modify a flow entry.
+ * Discribe: This function will modify a flow entry. The modified copy
+ *           replaces the entry, so the datapath sees either of them
+ *           whole.
  ***********************************************************************/
 uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr){
-    poflr_flow_entry *tmp_vhal_entry_ptr;
+    poflr_flow_entry *tmp_vhal_entry_ptr, *new_entry_ptr;
     poflr_flow_table *tmp_tbl_ptr;
     uint32_t index = flow_ptr->index, ret;
     uint8_t  table_id = flow_ptr->table_id;
@@ -350,7 +495,7 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
     }
 
-    tmp_tbl_ptr = & poflr_table_ptr[table_type][table_id];
+    tmp_tbl_ptr = poflr_table_ptr[table_type][table_id];
     /* Check whether the table have already existed. */
     if(tmp_tbl_ptr->state != POFLR_STATE_VALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
@@ -361,9 +506,9 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_ENTRY_ID, g_recv_xid);
     }
 
-    tmp_vhal_entry_ptr = &tmp_tbl_ptr->entry_ptr[index];
+    tmp_vhal_entry_ptr = tmp_tbl_ptr->entry_ptr[index];
     /* Check whether the index have already existed. */
-    if( tmp_vhal_entry_ptr->state != POFLR_STATE_VALID ){
+    if( tmp_vhal_entry_ptr == NULL ){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_UNEXIST, g_recv_xid);
     }
 
@@ -373,15 +518,33 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr){
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #endif // POF_ADD_ENTRY_CHECK_ON
 
+    new_entry_ptr = (poflr_flow_entry *)malloc(sizeof(poflr_flow_entry));
+    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(new_entry_ptr, g_recv_xid);
+
     /* Check the counter id in the flow entry. */
     if(tmp_vhal_entry_ptr->entry.counter_id != flow_ptr->counter_id){
         /* Initialize the counter_id. */
         ret = poflr_counter_init(flow_ptr->counter_id);
-        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        if(ret != POF_OK){
+            free(new_entry_ptr);
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        }
     }
 
-    /* Modify entry. */
-    memcpy(&tmp_vhal_entry_ptr->entry, flow_ptr, sizeof(pof_flow_entry));
+    /* Modify entry. The timeouts count from the original install time. */
+    memset(new_entry_ptr, 0, sizeof(poflr_flow_entry));
+    memcpy(&new_entry_ptr->entry, flow_ptr, sizeof(pof_flow_entry));
+    new_entry_ptr->state = POFLR_STATE_VALID;
+    new_entry_ptr->install_time = tmp_vhal_entry_ptr->install_time;
+    new_entry_ptr->install_ns = tmp_vhal_entry_ptr->install_ns;
+    new_entry_ptr->last_hit = tmp_vhal_entry_ptr->last_hit;
+
+    poflr_flow_timer_remove(tmp_vhal_entry_ptr);
+    poflr_flow_timer_insert(new_entry_ptr);
+    POFBF_RCU_ASSIGN(tmp_tbl_ptr->entry_ptr[index], new_entry_ptr);
+    poflr_flow_hash_remove(tmp_tbl_ptr, tmp_vhal_entry_ptr);
+    poflr_flow_hash_insert(tmp_tbl_ptr, new_entry_ptr);
+    pofbf_rcu_retire(tmp_vhal_entry_ptr, free);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify flow entry SUC!");
     return POF_OK;
@@ -394,6 +557,8 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr){
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will delete a flow entry in the flow table.
+ *           The entry is unpublished, and freed when the datapath has
+ *           left it.
  ***********************************************************************/
 uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr){
     poflr_flow_entry *tmp_vhal_entry_ptr;
@@ -412,7 +577,7 @@ uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
     }
 
-    tmp_tbl_ptr = & poflr_table_ptr[table_type][table_id];
+    tmp_tbl_ptr = poflr_table_ptr[table_type][table_id];
     /* Check whether the table have already existed. */
     if(tmp_tbl_ptr->state != POFLR_STATE_VALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
@@ -423,9 +588,9 @@ uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_ENTRY_ID, g_recv_xid);
     }
 
-    tmp_vhal_entry_ptr = &tmp_tbl_ptr->entry_ptr[index];
+    tmp_vhal_entry_ptr = tmp_tbl_ptr->entry_ptr[index];
     /* Check whether the index have already existed. */
-    if( tmp_vhal_entry_ptr->state != POFLR_STATE_VALID ){
+    if( tmp_vhal_entry_ptr == NULL ){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_UNEXIST, g_recv_xid);
     }
 
@@ -433,17 +598,346 @@ uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr){
     ret = poflr_counter_delete(tmp_vhal_entry_ptr->entry.counter_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    /* Delete and initialize the flow entry. */
-    memset(tmp_vhal_entry_ptr, 0, sizeof(poflr_flow_entry));
+    /* Delete the flow entry. */
+    poflr_flow_timer_remove(tmp_vhal_entry_ptr);
+    POFBF_RCU_ASSIGN(tmp_tbl_ptr->entry_ptr[index], NULL);
+    poflr_flow_hash_remove(tmp_tbl_ptr, tmp_vhal_entry_ptr);
     tmp_tbl_ptr->entry_num--;
+    pofbf_rcu_retire(tmp_vhal_entry_ptr, free);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Delete flow entry SUC!");
     return POF_OK;
 }
 
+/* Check whether the entry is selected by the match fields of the flow
+ * mod. Every field of the flow mod with nonzero mask must be in the entry,
+ * matched no less specifically and with the same masked value. */
+static uint32_t poflr_flow_match_cover(const pof_flow_entry *entry, const pof_flow_entry *fm){
+    const pof_match_x *f, *e;
+    uint32_t i, j, k, wild;
+
+    for(i=0; i<fm->match_field_num && i<POF_MAX_MATCH_FIELD_NUM; i++){
+        f = &fm->match[i];
+        for(j=0, wild=TRUE; j<POF_MAX_FIELD_LENGTH_IN_BYTE; j++){
+            if(f->mask[j] != 0){
+                wild = FALSE;
+                break;
+            }
+        }
+        if(wild == TRUE){
+            continue;
+        }
+
+        for(k=0; k<entry->match_field_num && k<POF_MAX_MATCH_FIELD_NUM; k++){
+            e = &entry->match[k];
+            if(e->field_id == f->field_id && e->offset == f->offset && e->len == f->len){
+                break;
+            }
+        }
+        if(k == entry->match_field_num || k == POF_MAX_MATCH_FIELD_NUM){
+            return FALSE;
+        }
+
+        for(j=0; j<POF_MAX_FIELD_LENGTH_IN_BYTE; j++){
+            if((f->mask[j] & ~e->mask[j]) != 0 \
+                    || ((f->value[j] ^ e->value[j]) & f->mask[j]) != 0){
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* Apply the modify or delete to the entry of the index. Modify replaces
+ * the instructions of the entry only. */
+static uint32_t poflr_flow_mod_at(poflr_flow_table *tbl_ptr, pof_flow_entry *flow_ptr, uint32_t index){
+    pof_flow_entry tmp = tbl_ptr->entry_ptr[index]->entry;
+
+    if(flow_ptr->command == POFFC_DELETE || flow_ptr->command == POFFC_DELETE_STRICT){
+        return poflr_delete_flow_entry(&tmp);
+    }
+
+    tmp.command = flow_ptr->command;
+    tmp.instruction_num = flow_ptr->instruction_num;
+    memcpy(tmp.instruction, flow_ptr->instruction, sizeof tmp.instruction);
+    return poflr_modify_flow_entry(&tmp);
+}
+
+/***********************************************************************
+ * Modify or delete the flow entries selected by match.
+ * Form:     uint32_t poflr_flow_mod_by_match(pof_flow_entry *flow_ptr)
+ * Input:    flow entry of MODIFY, MODIFY_STRICT, DELETE or DELETE_STRICT
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: The strict commands select the entry with the same priority
+ *           and match through the hash index of the table, and it is an
+ *           error if there is none. The non-strict commands select all
+ *           the entries covered by the match fields, whatever priority,
+ *           in one pass of the table. Both of them select only the
+ *           entries whose cookie equals the cookie under cookie_mask.
+ ***********************************************************************/
+uint32_t poflr_flow_mod_by_match(pof_flow_entry *flow_ptr){
+    poflr_flow_table *tmp_tbl_ptr;
+    poflr_flow_entry *entry_ptr;
+    uint32_t i, num, count, ret;
+    uint8_t  table_id = flow_ptr->table_id;
+    uint8_t  table_type = flow_ptr->table_type;
+    uint64_t cookie = flow_ptr->cookie & flow_ptr->cookie_mask;
+
+    /* Check type. */
+    if(table_type >= POF_MAX_TABLE_TYPE){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_TYPE, g_recv_xid);
+    }
+
+    /* Check table_id. */
+    if(table_id >= poflr_table_num_each_type[table_type]){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
+    }
+
+    tmp_tbl_ptr = poflr_table_ptr[table_type][table_id];
+    /* Check whether the table have already existed. */
+    if(tmp_tbl_ptr->state != POFLR_STATE_VALID){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid);
+    }
+
+    if(flow_ptr->command == POFFC_MODIFY_STRICT || flow_ptr->command == POFFC_DELETE_STRICT){
+        i = poflr_flow_hash_find(tmp_tbl_ptr, flow_ptr, POFLR_FLOW_HASH_NONE);
+        if(i == POFLR_FLOW_HASH_NONE \
+                || (tmp_tbl_ptr->entry_ptr[i]->entry.cookie & flow_ptr->cookie_mask) != cookie){
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_UNEXIST, g_recv_xid);
+        }
+        return poflr_flow_mod_at(tmp_tbl_ptr, flow_ptr, i);
+    }
+
+    /* Deleting an entry does not move the others, so one pass is enough. */
+    num = tmp_tbl_ptr->entry_num;
+    for(i=0, count=0; count<num && i<tmp_tbl_ptr->tbl_base_info.size; i++){
+        entry_ptr = tmp_tbl_ptr->entry_ptr[i];
+        if(entry_ptr == NULL){
+            continue;
+        }
+
+        count++;
+        if((entry_ptr->entry.cookie & flow_ptr->cookie_mask) != cookie \
+                || poflr_flow_match_cover(&entry_ptr->entry, flow_ptr) != TRUE){
+            continue;
+        }
+
+        ret = poflr_flow_mod_at(tmp_tbl_ptr, flow_ptr, i);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"Flow mod by match SUC! Totally %d entries in this table.",
+            tmp_tbl_ptr->entry_num);
+    return POF_OK;
+}
+
+/* Time of the first expiry of the flow entry. */
+static uint32_t poflr_flow_deadline(const poflr_flow_entry *entry_ptr){
+    const pof_flow_entry *p = &entry_ptr->entry;
+    uint32_t deadline = 0xffffffff;
+
+    if(p->hard_timeout != 0){
+        deadline = entry_ptr->install_time + p->hard_timeout;
+    }
+    if(p->idle_timeout != 0 && entry_ptr->last_hit + p->idle_timeout < deadline){
+        deadline = entry_ptr->last_hit + p->idle_timeout;
+    }
+    return deadline;
+}
+
+/* Link the flow entry into the wheel slot of its deadline. The deadline
+ * too far for level 1 is put in the last slot of level 1, and placed again
+ * when the slot cascades. */
+static void poflr_flow_timer_insert(poflr_flow_entry *entry_ptr){
+    poflr_flow_entry **slot;
+    uint32_t tick = poflr_flow_wheel_tick, deadline;
+
+    if(entry_ptr->entry.idle_timeout == 0 && entry_ptr->entry.hard_timeout == 0){
+        return;
+    }
+
+    deadline = poflr_flow_deadline(entry_ptr);
+    if((int32_t)(deadline - tick) <= 0){
+        slot = &poflr_flow_wheel[0][(tick + 1) & POFLR_FLOW_WHEEL_MASK];
+    }else if(deadline - tick < POFLR_FLOW_WHEEL_SIZE){
+        slot = &poflr_flow_wheel[0][deadline & POFLR_FLOW_WHEEL_MASK];
+    }else if((deadline >> POFLR_FLOW_WHEEL_BITS) - (tick >> POFLR_FLOW_WHEEL_BITS) < POFLR_FLOW_WHEEL_SIZE){
+        slot = &poflr_flow_wheel[1][(deadline >> POFLR_FLOW_WHEEL_BITS) & POFLR_FLOW_WHEEL_MASK];
+    }else{
+        slot = &poflr_flow_wheel[1][((tick >> POFLR_FLOW_WHEEL_BITS) + POFLR_FLOW_WHEEL_MASK) & POFLR_FLOW_WHEEL_MASK];
+    }
+
+    entry_ptr->timer_next = *slot;
+    if(*slot != NULL){
+        (*slot)->timer_pprev = &entry_ptr->timer_next;
+    }
+    entry_ptr->timer_pprev = slot;
+    *slot = entry_ptr;
+    return;
+}
+
+/* Unlink the flow entry from the wheel. */
+static void poflr_flow_timer_remove(poflr_flow_entry *entry_ptr){
+    if(entry_ptr->timer_pprev == NULL){
+        return;
+    }
+
+    *entry_ptr->timer_pprev = entry_ptr->timer_next;
+    if(entry_ptr->timer_next != NULL){
+        entry_ptr->timer_next->timer_pprev = entry_ptr->timer_pprev;
+    }
+    entry_ptr->timer_next = NULL;
+    entry_ptr->timer_pprev = NULL;
+    return;
+}
+
+/* Remove the expired flow entry, and report it to the Controller. The
+ * counters count packets only, so byte_count is reported as 0. */
+static uint32_t poflr_flow_expire(poflr_flow_entry *entry_ptr, uint8_t reason){
+    char msg[sizeof(pof_header) + sizeof(pof_flow_removed)];
+    pof_header *head_ptr = (pof_header *)msg;
+    pof_flow_removed *removed_ptr = (pof_flow_removed *)(msg + sizeof(pof_header));
+    pof_flow_entry *p = &entry_ptr->entry;
+    poflr_counters *counter_ptr = NULL;
+    poflr_flow_table *tbl_ptr;
+    uint32_t counter_number = 0, ret;
+    uint64_t duration = poflr_flow_clock_ns() - entry_ptr->install_ns;
+
+    memset(msg, 0, sizeof(msg));
+    head_ptr->version = POF_VERSION;
+    head_ptr->type = POFT_FLOW_REMOVED;
+    head_ptr->length = sizeof(msg);
+    head_ptr->xid = g_upward_xid++;
+    pof_HtoN_transfer_header(head_ptr);
+
+    removed_ptr->cookie = p->cookie;
+    removed_ptr->priority = p->priority;
+    removed_ptr->reason = reason;
+    removed_ptr->table_id = p->table_id;
+    removed_ptr->table_type = p->table_type;
+    removed_ptr->index = p->index;
+    removed_ptr->counter_id = p->counter_id;
+    removed_ptr->duration_sec = duration / 1000000000ULL;
+    removed_ptr->duration_nsec = duration % 1000000000ULL;
+    removed_ptr->idle_timeout = p->idle_timeout;
+    removed_ptr->hard_timeout = p->hard_timeout;
+    poflr_get_counter(&counter_ptr);
+    poflr_get_counter_number(&counter_number);
+    if(p->counter_id != 0 && p->counter_id < counter_number \
+            && counter_ptr->state[p->counter_id] == POFLR_STATE_VALID){
+        removed_ptr->packet_count = counter_ptr->counter[p->counter_id].value;
+    }
+    pof_HtoN_transfer_flow_removed(removed_ptr);
+
+    ret = poflr_counter_delete(p->counter_id);
+    POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+
+    tbl_ptr = poflr_table_ptr[p->table_type][p->table_id];
+    POFBF_RCU_ASSIGN(tbl_ptr->entry_ptr[p->index], NULL);
+    poflr_flow_hash_remove(tbl_ptr, entry_ptr);
+    tbl_ptr->entry_num--;
+    pofbf_rcu_retire(entry_ptr, free);
+
+    if(POF_OK != pofsc_send_packet_upward((uint8_t *)msg, sizeof(msg))){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+    }
+    return POF_OK;
+}
+
+/* Advance the wheel by one second. The entries in the current slot are
+ * expired, or placed again if they have been hit since. */
+static void poflr_flow_wheel_advance(){
+    poflr_flow_entry *entry_ptr, *next;
+    pof_flow_entry *p;
+    uint32_t tick;
+
+    tick = ++poflr_flow_wheel_tick;
+
+    /* Cascade level 1 into level 0. */
+    if((tick & POFLR_FLOW_WHEEL_MASK) == 0){
+        entry_ptr = poflr_flow_wheel[1][(tick >> POFLR_FLOW_WHEEL_BITS) & POFLR_FLOW_WHEEL_MASK];
+        poflr_flow_wheel[1][(tick >> POFLR_FLOW_WHEEL_BITS) & POFLR_FLOW_WHEEL_MASK] = NULL;
+        for(; entry_ptr != NULL; entry_ptr = next){
+            next = entry_ptr->timer_next;
+            entry_ptr->timer_next = NULL;
+            entry_ptr->timer_pprev = NULL;
+            poflr_flow_timer_insert(entry_ptr);
+        }
+    }
+
+    entry_ptr = poflr_flow_wheel[0][tick & POFLR_FLOW_WHEEL_MASK];
+    poflr_flow_wheel[0][tick & POFLR_FLOW_WHEEL_MASK] = NULL;
+    for(; entry_ptr != NULL; entry_ptr = next){
+        next = entry_ptr->timer_next;
+        entry_ptr->timer_next = NULL;
+        entry_ptr->timer_pprev = NULL;
+
+        p = &entry_ptr->entry;
+        if(p->hard_timeout != 0 && tick - entry_ptr->install_time >= p->hard_timeout){
+            poflr_flow_expire(entry_ptr, POFRR_HARD_TIMEOUT);
+        }else if(p->idle_timeout != 0 && tick - entry_ptr->last_hit >= p->idle_timeout){
+            poflr_flow_expire(entry_ptr, POFRR_IDLE_TIMEOUT);
+        }else{
+            poflr_flow_timer_insert(entry_ptr);
+        }
+    }
+    return;
+}
+
+/* Seconds since the flow timeout clock started. */
+static uint32_t poflr_flow_clock_now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec - poflr_flow_clock_base);
+}
+
+/***********************************************************************
+ * The task function of the flow timeout task.
+ * Form:     uint32_t poflr_flow_timeout_task()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This task advances the flow timeout wheel every second. The
+ *           flow entry whose hard_timeout or idle_timeout has expired is
+ *           deleted, and a POFT_FLOW_REMOVED message is sent to the
+ *           Controller. Only the entries in the current wheel slot are
+ *           visited, and the datapath only stores the hit time, so the
+ *           tables are never scanned.
+ ***********************************************************************/
+uint32_t poflr_flow_timeout_task(){
+    uint32_t now;
+
+    while(1){
+        pofbf_task_delay(1000);
+
+        now = poflr_flow_clock_now();
+        POFLR_FLOW_LOCK_ON;
+        while((int32_t)(now - poflr_flow_wheel_tick) > 0){
+            poflr_flow_wheel_advance();
+        }
+        poflr_flow_clock = now;
+
+        /* Free the entries retired while the datapath was busy. */
+        pofbf_rcu_reclaim();
+        POFLR_FLOW_LOCK_OFF;
+    }
+
+    return POF_OK;
+}
+
 /* Initialize flow table resource. */
 uint32_t poflr_init_flow_table(){
-    uint32_t i;
+    struct timespec ts;
+    uint32_t i, j;
+
+    /* Start the flow timeout clock. */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    poflr_flow_clock_base = ts.tv_sec;
+    poflr_flow_clock = 0;
+    poflr_flow_wheel_tick = 0;
+    memset(poflr_flow_wheel, 0, sizeof(poflr_flow_wheel));
 
     /* Initialize the key length of each table type. */
     for(i=0; i<POF_MAX_TABLE_TYPE; i++){
@@ -462,14 +956,16 @@ uint32_t poflr_init_flow_table(){
     poflr_key_tid_base_each_type[2] = poflr_mm_tbl_num + poflr_lpm_tbl_num;
     poflr_key_tid_base_each_type[3] = poflr_mm_tbl_num + poflr_lpm_tbl_num + poflr_em_tbl_num;
 
-    /* Initialize the flow table resource. */
+    /* Initialize the flow table resource. No table is created. */
     for(i = 0; i < POF_MAX_TABLE_TYPE; i++){
-        poflr_table_ptr[i] = (poflr_flow_table*)malloc(poflr_table_num_each_type[i] * sizeof(poflr_flow_table));
+        poflr_table_ptr[i] = (poflr_flow_table**)malloc(poflr_table_num_each_type[i] * sizeof(poflr_flow_table *));
 		if(poflr_table_ptr[i] == NULL){
 			poflr_free_table_resource();
 			POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
 		}
-        memset((poflr_table_ptr[i]), 0, poflr_table_num_each_type[i] * sizeof(poflr_flow_table));
+        for(j = 0; j < poflr_table_num_each_type[i]; j++){
+            poflr_table_ptr[i][j] = &poflr_flow_table_none;
+        }
     }
 
 	return POF_OK;
@@ -482,10 +978,13 @@ uint32_t poflr_free_flow_table(){
 	for(i=0; i<POF_MAX_TABLE_TYPE; i++){
 		if(NULL != poflr_table_ptr[i]){
 			for(j=0; j<poflr_table_num_each_type[i]; j++){
-				free(poflr_table_ptr[j][i].entry_ptr);
+				if(poflr_table_ptr[i][j] != &poflr_flow_table_none){
+					poflr_flow_table_free(poflr_table_ptr[i][j]);
+				}
 			}
 		}
 		free(poflr_table_ptr[i]);
+		poflr_table_ptr[i] = NULL;
 	}
 	return POF_OK;
 }
@@ -495,16 +994,25 @@ uint32_t poflr_empty_flow_table(){
     poflr_flow_table *tmp_tbl_ptr;
     uint32_t type, table_id;
 
-    /* Empty the flow entry, and flow tabel. */
+    POFLR_FLOW_LOCK_ON;
+
+    /* The entries in the timeout wheel are all freed with their tables. */
+    memset(poflr_flow_wheel, 0, sizeof(poflr_flow_wheel));
+
+    /* Unpublish the flow tables, and free them with their entries when
+     * the datapath has left them. */
     for(type=0; type<POF_MAX_TABLE_TYPE; type++){
         for(table_id=0; table_id<poflr_table_num_each_type[type]; table_id++){
-            tmp_tbl_ptr = &poflr_table_ptr[type][table_id];
-            memset(tmp_tbl_ptr->entry_ptr, 0, sizeof(poflr_flow_entry)*tmp_tbl_ptr->tbl_base_info.size);
-            free(tmp_tbl_ptr->entry_ptr);
-            memset(tmp_tbl_ptr, 0, sizeof(poflr_flow_table));
+            tmp_tbl_ptr = poflr_table_ptr[type][table_id];
+            if(tmp_tbl_ptr == &poflr_flow_table_none){
+                continue;
+            }
+            POFBF_RCU_ASSIGN(poflr_table_ptr[type][table_id], &poflr_flow_table_none);
+            pofbf_rcu_retire(tmp_tbl_ptr, poflr_flow_table_free);
         }
     }
 
+    POFLR_FLOW_LOCK_OFF;
 	return POF_OK;
 }
 
@@ -579,7 +1087,7 @@ uint32_t poflr_get_flow_table(poflr_flow_table **flow_table_ptrptr, uint8_t tabl
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_TABLE_ID, g_upward_xid++);
     }
 
-	*flow_table_ptrptr = &(poflr_table_ptr[table_type][table_id]);
+	*flow_table_ptrptr = POFBF_RCU_DEREF(poflr_table_ptr[table_type][table_id]);
 	return POF_OK;
 }
 
@@ -591,7 +1099,7 @@ uint32_t poflr_check_flow_table_exist(uint8_t ID){
 
     poflr_table_ID_to_id(ID, &table_type, &table_id);
 
-	if(poflr_table_ptr[table_type][table_id].state == POFLR_STATE_INVALID){
+	if(POFBF_RCU_DEREF(poflr_table_ptr[table_type][table_id])->state == POFLR_STATE_INVALID){
 		return POF_ERROR;
 	}
 	
@@ -604,6 +1112,132 @@ uint32_t poflr_get_table_number(uint8_t **table_number_ptrptr){
 	return POF_OK;
 }
 
+/***********************************************************************
+ * Get the statistics of the flow table.
+ * Form:     uint32_t poflr_get_table_stats(uint8_t table_type, \
+ *                                        uint8_t table_id, \
+ *                                        pof_table_stats *stats)
+ * Input:    table type, table id
+ * Output:   statistics of the table, in host byte order
+ * Return:   POF_OK, or POF_ERROR if the table does not exist
+ * Discribe: This function sums the lookup counters the datapath keeps
+ *           for the table since it was created. All of the counters
+ *           are zero if the datapath is off. The caller should hold the
+ *           flow table lock if it is not the control path.
+ ***********************************************************************/
+uint32_t poflr_get_table_stats(uint8_t table_type, uint8_t table_id, pof_table_stats *stats){
+    poflr_flow_table *t;
+#ifdef POF_DATAPATH_ON
+    struct pofdp_table_stats ts;
+#endif // POF_DATAPATH_ON
+
+    memset(stats, 0, sizeof *stats);
+    if(table_type >= POF_MAX_TABLE_TYPE || table_id >= poflr_table_num_each_type[table_type]){
+        return POF_ERROR;
+    }
+    t = poflr_table_ptr[table_type][table_id];
+    if(t->state != POFLR_STATE_VALID){
+        return POF_ERROR;
+    }
+
+    stats->table_id = poflr_key_tid_base_each_type[table_type] + table_id;
+    stats->type = table_type;
+    stats->tid = table_id;
+    stats->active_count = t->entry_num;
+#ifdef POF_DATAPATH_ON
+    pofdp_table_stats_get(table_type, table_id, &ts);
+    stats->lookup_count = ts.lookup;
+    stats->matched_count = ts.match;
+    stats->missed_count = ts.lookup - ts.match;
+    stats->examined_count = ts.examined;
+#endif // POF_DATAPATH_ON
+    return POF_OK;
+}
+
+/* Send the table statistics as one or more POFT_MULTIPART_REPLY messages
+ * which share the xid. All but the last one carry POFMPF_REPLY_MORE. */
+static uint32_t poflr_table_stats_send_multipart(pof_table_stats *snap, uint32_t snap_num, uint32_t xid){
+    char msg[POF_QUEUE_MESSAGE_LEN];
+    pof_header *head_ptr = (pof_header *)msg;
+    pof_multipart *mp_ptr = (pof_multipart *)(msg + sizeof(pof_header));
+    pof_table_stats *stats_ptr = (pof_table_stats *)(msg + sizeof(pof_header) + sizeof(pof_multipart));
+    uint32_t num_per_msg, num, sent = 0, i;
+    uint16_t len;
+
+    num_per_msg = (POF_QUEUE_MESSAGE_LEN - sizeof(pof_header) - sizeof(pof_multipart)) / sizeof(pof_table_stats);
+
+    do{
+        num = (snap_num - sent > num_per_msg) ? num_per_msg : (snap_num - sent);
+        len = sizeof(pof_header) + sizeof(pof_multipart) + num * sizeof(pof_table_stats);
+
+        head_ptr->version = POF_VERSION;
+        head_ptr->type = POFT_MULTIPART_REPLY;
+        head_ptr->length = len;
+        head_ptr->xid = xid;
+        pof_HtoN_transfer_header(head_ptr);
+
+        memset(mp_ptr, 0, sizeof(pof_multipart));
+        mp_ptr->type = POFMP_TABLE_STATS;
+        mp_ptr->flags = (sent + num < snap_num) ? POFMPF_REPLY_MORE : 0;
+        pof_NtoH_transfer_multipart(mp_ptr);
+
+        for(i=0; i<num; i++){
+            stats_ptr[i] = snap[sent + i];
+            pof_HtoN_transfer_table_stats(stats_ptr + i);
+        }
+
+        if(POF_OK != pofsc_send_packet_upward((uint8_t *)msg, len)){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+        }
+        sent += num;
+    }while(sent < snap_num);
+
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Reply the statistics of the flow tables.
+ * Form:     uint32_t poflr_reply_table_stats_multipart(uint8_t table_ID)
+ * Input:    global table ID
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function sends the statistics of the flow table, or of
+ *           all the valid flow tables if table_ID is POF_ALL_TABLE_ID,
+ *           to the Controller in POFT_MULTIPART_REPLY messages.
+ ***********************************************************************/
+uint32_t poflr_reply_table_stats_multipart(uint8_t table_ID){
+    pof_table_stats *snap;
+    uint32_t snap_num = 0, type, id, ret;
+
+    snap = (pof_table_stats *)malloc(sizeof(pof_table_stats) * POF_ALL_TABLE_ID);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(snap);
+
+    for(type=0; type<POF_MAX_TABLE_TYPE; type++){
+        for(id=0; id<poflr_table_num_each_type[type]; id++){
+            if(table_ID != POF_ALL_TABLE_ID && \
+                    table_ID != (uint8_t)(poflr_key_tid_base_each_type[type] + id)){
+                continue;
+            }
+            if(snap_num < POF_ALL_TABLE_ID && \
+                    poflr_get_table_stats(type, id, &snap[snap_num]) == POF_OK){
+                snap_num++;
+            }
+        }
+    }
+    if(snap_num == 0 && table_ID != POF_ALL_TABLE_ID){
+        free(snap);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_TABLE_ID, g_recv_xid);
+    }
+
+    ret = poflr_table_stats_send_multipart(snap, snap_num, g_recv_xid);
+    free(snap);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"Reply table stats multipart SUC! table ID = %u, table num = %u", \
+                        table_ID, snap_num);
+    return POF_OK;
+}
+
 /* Get table ID's base value. */
 uint32_t poflr_get_table_id_base(uint8_t **table_id_base_ptrptr){
 	*table_id_base_ptrptr = poflr_key_tid_base_each_type;
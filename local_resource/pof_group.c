@@ -37,6 +37,7 @@
 #include "net/if.h"
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
+#include "stdlib.h"
 
 /* The number of group. */
 uint32_t poflr_group_number = POFLR_GROUP_NUMBER;
@@ -44,6 +45,166 @@ uint32_t poflr_group_number = POFLR_GROUP_NUMBER;
 /* Group table. */
 poflr_groups *poflr_group;
 
+/* Fields hashed to select the bucket of select group. The default is the
+ * IPv4 protocol, source and destination address, and the transport ports
+ * of the untagged Ethernet packet. */
+static pof_match poflr_group_hash_field[POFLR_GROUP_HASH_FIELD_MAX] = {
+    {0, 184, 8}, {0, 208, 32}, {0, 240, 32}, {0, 272, 32},
+};
+static uint32_t poflr_group_hash_field_num = 4;
+static uint32_t poflr_group_hash_field_set = FALSE;
+
+/* Mix the bits of the 32-bit hash value. */
+static uint32_t poflr_group_hash_mix(uint32_t h){
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Identify the bucket by the content of its actions, which does not change
+ * when other buckets are added or removed. */
+static uint32_t poflr_group_bucket_id(const pof_group *group_ptr, const poflr_group_bucket *b){
+    const pof_action *act;
+    uint32_t h = 2166136261U, i, j, len;
+
+    for(i=0; i<b->action_num; i++){
+        act = &group_ptr->action[b->action_offset + i];
+        h = (h ^ act->type) * 16777619U;
+        len = (act->len < POF_MAX_ACTION_LENGTH) ? act->len : POF_MAX_ACTION_LENGTH;
+        for(j=0; j<len; j++){
+            h = (h ^ act->action_data[j]) * 16777619U;
+        }
+    }
+    return h;
+}
+
+static int poflr_group_point_compare(const void *a, const void *b){
+    uint32_t ha = ((const poflr_group_point *)a)->hash;
+    uint32_t hb = ((const poflr_group_point *)b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+/* Whether the ith action of the group ends a bucket. A bucket ends with
+ * the action which sends the packet away, or with the last action. */
+static uint8_t poflr_group_bucket_end(const pof_group *group_ptr, uint32_t i){
+    uint16_t type = group_ptr->action[i].type;
+
+    return (type == POFAT_OUTPUT || type == POFAT_DROP || type == POFAT_GROUP \
+            || type == POFAT_PACKET_IN || i == group_ptr->action_number - 1);
+}
+
+/* Split the actions of the group into buckets. The watch port of the
+ * bucket is the port of its OUTPUT action. */
+static void poflr_group_build_bucket(const pof_group *group_ptr, poflr_group_select *s){
+    poflr_group_bucket *b;
+    uint32_t i, start = 0;
+    uint16_t type;
+
+    for(i=0; i<group_ptr->action_number && i<POF_MAX_ACTION_NUMBER_PER_GROUP; i++){
+        type = group_ptr->action[i].type;
+        if(poflr_group_bucket_end(group_ptr, i)){
+            b = &s->bucket[s->bucket_num++];
+            b->action_offset = start;
+            b->action_num = i - start + 1;
+            if(type == POFAT_OUTPUT){
+                b->watch_port = ((pof_action_output *)group_ptr->action[i].action_data)->outputPortId;
+            }else{
+                b->watch_port = POFLR_GROUP_WATCH_ANY;
+            }
+            start = i + 1;
+        }
+    }
+    return;
+}
+
+/* Split the actions of select group into buckets and build the hash ring. */
+static void poflr_group_build_select(const pof_group *group_ptr, poflr_group_select *s){
+    uint32_t i, j, weight_sum = 0, weight, point_num, id;
+
+    poflr_group_build_bucket(group_ptr, s);
+
+    for(i=0; i<s->bucket_num; i++){
+        weight_sum += group_ptr->weight[i] ? group_ptr->weight[i] : 1;
+    }
+
+    for(i=0; i<s->bucket_num; i++){
+        weight = group_ptr->weight[i] ? group_ptr->weight[i] : 1;
+        point_num = POFLR_GROUP_RING_SIZE * weight / weight_sum;
+        if(point_num == 0){
+            point_num = 1;
+        }
+
+        id = poflr_group_bucket_id(group_ptr, &s->bucket[i]);
+        for(j=0; j<point_num && s->point_num<POFLR_GROUP_RING_SIZE; j++){
+            s->point[s->point_num].hash = poflr_group_hash_mix(id + j * 0x9e3779b9U);
+            s->point[s->point_num].bucket = i;
+            s->point_num++;
+        }
+    }
+
+    qsort(s->point, s->point_num, sizeof(poflr_group_point), poflr_group_point_compare);
+    return;
+}
+
+/* Build the group for the datapath and publish it in place of the old
+ * one, which is freed once the datapath has left it. A NULL group_ptr
+ * unpublishes the group. The flow lock serializes the retire with the
+ * flow tables. */
+static uint32_t poflr_group_publish(uint32_t group_id, const pof_group *group_ptr){
+    poflr_group_select *s = NULL, *old;
+
+    if(group_ptr != NULL){
+        s = (poflr_group_select *)malloc(sizeof(poflr_group_select));
+        POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(s, g_recv_xid);
+        memset(s, 0, sizeof(poflr_group_select));
+        memcpy(&s->group, group_ptr, sizeof(pof_group));
+
+        if(group_ptr->type == POFGT_SELECT){
+            poflr_group_build_select(&s->group, s);
+        }else if(group_ptr->type == POFGT_FF){
+            poflr_group_build_bucket(&s->group, s);
+        }
+    }
+
+    POFLR_FLOW_LOCK_ON;
+    old = poflr_group->select[group_id];
+    POFBF_RCU_ASSIGN(poflr_group->select[group_id], s);
+    if(old != NULL){
+        pofbf_rcu_retire(old, free);
+    }
+    POFLR_FLOW_LOCK_OFF;
+    return POF_OK;
+}
+
+/* Check the group type. */
+static uint32_t poflr_group_check_type(uint8_t type){
+    if(type > POFGT_FF){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_TYPE, g_recv_xid);
+    }
+    return POF_OK;
+}
+
+/* Check the bucket number. Every bucket of select group needs a weight. */
+static uint32_t poflr_group_check_bucket(const pof_group *group_ptr){
+    uint32_t i, bucket_num = 0;
+
+    if(group_ptr->type != POFGT_SELECT){
+        return POF_OK;
+    }
+    for(i=0; i<group_ptr->action_number && i<POF_MAX_ACTION_NUMBER_PER_GROUP; i++){
+        if(poflr_group_bucket_end(group_ptr, i)){
+            bucket_num++;
+        }
+    }
+    if(bucket_num > POFLR_GROUP_WEIGHT_NUM){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_OUT_OF_BUCKETS, g_recv_xid);
+    }
+    return POF_OK;
+}
+
 /***********************************************************************
  * Add the group entry.
  * Form:     uint32_t poflr_modify_group_entry(pof_group *group_ptr)
@@ -63,11 +224,20 @@ uint32_t poflr_add_group_entry(pof_group *group_ptr){
     if(poflr_group->state[group_ptr->group_id] == POFLR_STATE_VALID){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_GROUP_EXISTS, g_recv_xid);
     }
+    ret = poflr_group_check_type(group_ptr->type);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    ret = poflr_group_check_bucket(group_ptr);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Initialize the counter_id. */
     ret = poflr_counter_init(group_ptr->counter_id);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
+    ret = poflr_group_publish(group_ptr->group_id, group_ptr);
+    if(ret != POF_OK){
+        poflr_counter_delete(group_ptr->counter_id);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
     memcpy(&poflr_group->group[group_ptr->group_id], group_ptr,  sizeof(pof_group));
     poflr_group->group_num ++;
     poflr_group->state[group_ptr->group_id] = POFLR_STATE_VALID;
@@ -86,6 +256,7 @@ uint32_t poflr_add_group_entry(pof_group *group_ptr){
  * Discribe: This function will modify the group entry in the group table.
  ***********************************************************************/
 uint32_t poflr_modify_group_entry(pof_group *group_ptr){
+    uint32_t ret;
 
     /* Check group_id. */
     if(group_ptr->group_id >= poflr_group_number){
@@ -99,7 +270,13 @@ uint32_t poflr_modify_group_entry(pof_group *group_ptr){
     if(group_ptr->counter_id != poflr_group->group[group_ptr->group_id].counter_id){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_COUNTER_ID, g_recv_xid);
     }
+    ret = poflr_group_check_type(group_ptr->type);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    ret = poflr_group_check_bucket(group_ptr);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
+    ret = poflr_group_publish(group_ptr->group_id, group_ptr);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     memcpy(&poflr_group->group[group_ptr->group_id], group_ptr,  sizeof(pof_group));
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify group entry SUC!");
@@ -133,11 +310,125 @@ uint32_t poflr_delete_group_entry(pof_group *group_ptr){
     poflr_group->group_num --;
     poflr_group->state[group_ptr->group_id] = POFLR_STATE_INVALID;
     memset(&poflr_group->group[group_ptr->group_id], 0, sizeof(pof_group));
+    poflr_group_publish(group_ptr->group_id, NULL);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Delete group entry SUC!");
     return POF_OK;
 }
 
+/***********************************************************************
+ * Get the group as the datapath executes it.
+ * Form:     uint32_t poflr_get_group_select(uint32_t group_id, \
+ *                                           poflr_group_select **select_ptrptr)
+ * Input:    group id
+ * Output:   group, or NULL if there is no such group
+ * Return:   POF_OK or ERROR code
+ * Discribe: The caller must be in the read-side section, and may use the
+ *           group and its actions until it leaves the section.
+ ***********************************************************************/
+uint32_t poflr_get_group_select(uint32_t group_id, poflr_group_select **select_ptrptr){
+    if(group_id >= poflr_group_number){
+        *select_ptrptr = NULL;
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_INVALID_GROUP, g_upward_xid++);
+    }
+    *select_ptrptr = POFBF_RCU_DEREF(poflr_group->select[group_id]);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Select the bucket of select group.
+ * Form:     uint32_t poflr_group_select_bucket(const poflr_group_select *s, \
+ *                                              uint32_t hash, \
+ *                                              const poflr_group_bucket **bucket_ptrptr)
+ * Input:    group, hash value of the packet fields
+ * Output:   bucket, or NULL if the group has no bucket
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function finds the first point on the hash ring of the
+ *           group which is not less than the hash value, and returns the
+ *           bucket owning the point.
+ ***********************************************************************/
+uint32_t poflr_group_select_bucket(const poflr_group_select *s, uint32_t hash, \
+                                   const poflr_group_bucket **bucket_ptrptr)
+{
+    uint32_t low = 0, high = s->point_num;
+
+    if(s->point_num == 0){
+        *bucket_ptrptr = NULL;
+        return POF_OK;
+    }
+
+    hash = poflr_group_hash_mix(hash);
+    while(low < high){
+        uint32_t mid = (low + high) / 2;
+        if(s->point[mid].hash < hash){
+            low = mid + 1;
+        }else{
+            high = mid;
+        }
+    }
+    if(low == s->point_num){
+        low = 0;
+    }
+
+    *bucket_ptrptr = &s->bucket[s->point[low].bucket];
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Select the bucket of fast failover group.
+ * Form:     uint32_t poflr_group_ff_bucket(const poflr_group_select *s, \
+ *                                          const poflr_group_bucket **bucket_ptrptr)
+ * Input:    group
+ * Output:   bucket, or NULL if no bucket is live
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function returns the first bucket whose watch port is
+ *           live. The liveness is read from the port liveness bitmap, so
+ *           the failover takes effect as soon as the port goes down.
+ ***********************************************************************/
+uint32_t poflr_group_ff_bucket(const poflr_group_select *s, const poflr_group_bucket **bucket_ptrptr){
+    const poflr_group_bucket *b;
+    uint32_t i;
+
+    for(i=0; i<s->bucket_num; i++){
+        b = &s->bucket[i];
+        if(b->watch_port == POFLR_GROUP_WATCH_ANY || poflr_port_is_live(b->watch_port)){
+            *bucket_ptrptr = b;
+            return POF_OK;
+        }
+    }
+
+    *bucket_ptrptr = NULL;
+    return POF_OK;
+}
+
+/* Add one field to hash for select group. The first field added replaces
+ * the default fields. */
+uint32_t poflr_add_group_hash_field(uint16_t field_id, uint16_t offset, uint16_t len){
+    pof_match *p;
+
+    if(poflr_group_hash_field_set == FALSE){
+        poflr_group_hash_field_num = 0;
+        poflr_group_hash_field_set = TRUE;
+    }
+    if(poflr_group_hash_field_num >= POFLR_GROUP_HASH_FIELD_MAX \
+            || len == 0 || len > POF_MAX_FIELD_LENGTH_IN_BYTE * 8){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ERROR);
+    }
+
+    p = &poflr_group_hash_field[poflr_group_hash_field_num++];
+    p->field_id = field_id;
+    p->offset = offset;
+    p->len = len;
+    return POF_OK;
+}
+
+/* Get the fields to hash for select group. */
+uint32_t poflr_get_group_hash_field(pof_match **field_ptrptr, uint32_t *field_num_ptr){
+    *field_ptrptr = poflr_group_hash_field;
+    *field_num_ptr = poflr_group_hash_field_num;
+    return POF_OK;
+}
+
 /* Initialize group resource. */
 uint32_t poflr_init_group(){
 
@@ -156,6 +447,13 @@ uint32_t poflr_init_group(){
 	}
     memset(poflr_group->group, 0, sizeof(pof_group)*poflr_group_number);
 
+    poflr_group->select = (poflr_group_select **)malloc(sizeof(poflr_group_select *) * poflr_group_number);
+	if(poflr_group->select == NULL){
+		poflr_free_table_resource();
+		POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+	}
+    memset(poflr_group->select, 0, sizeof(poflr_group_select *)*poflr_group_number);
+
     poflr_group->state = (uint32_t *)malloc(sizeof(uint32_t) * poflr_group_number);
 	if(poflr_group->state == NULL){
 		poflr_free_table_resource();
@@ -168,8 +466,16 @@ uint32_t poflr_init_group(){
 
 /* Free group resource. */
 uint32_t poflr_free_group(){
+	uint32_t i;
+
 	if(NULL != poflr_group){
 		free(poflr_group->group);
+		if(poflr_group->select != NULL){
+			for(i=0; i<poflr_group_number; i++){
+				free(poflr_group->select[i]);
+			}
+		}
+		free(poflr_group->select);
 		free(poflr_group->state);
 		free(poflr_group);
 	}
@@ -179,7 +485,14 @@ uint32_t poflr_free_group(){
 
 /* Empty group. */
 uint32_t poflr_empty_group(){
+    uint32_t i;
+
     memset(poflr_group->group, 0, sizeof(pof_group) * poflr_group_number);
+    for(i=0; i<poflr_group_number; i++){
+        if(poflr_group->select[i] != NULL){
+            poflr_group_publish(i, NULL);
+        }
+    }
     memset(poflr_group->state, 0, sizeof(uint32_t) * poflr_group_number);
     poflr_group->group_num = 0;
 
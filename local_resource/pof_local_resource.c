@@ -39,7 +39,7 @@
 #include "arpa/inet.h"
 
 /* Description of switch config. */
-pof_switch_config poflr_switch_config;
+pof_switch_config poflr_switch_config = {0, POF_MISS_SEND_LEN_DEFAULT};
 
 /* Description of switch feature. */
 pof_switch_features poflr_switch_feature;
@@ -304,7 +304,7 @@ uint32_t poflr_clear_resource(){
  ***********************************************************************/
 /* Start openflow task. */
 uint32_t pof_localresource_init(){
-    uint32_t ret = POF_OK;
+    uint32_t ret = POF_OK, push_interval = 0;
 
     /* Initialize the local physical port infomation. */
     ret = poflr_init_port();
@@ -317,6 +317,17 @@ uint32_t pof_localresource_init(){
     ret = poflr_init_table_resource();
     POF_CHECK_RETVALUE_TERMINATE(ret);
 
+    /* Start the task expiring the flow entries. */
+    ret = pofbf_task_create(NULL, (void *)poflr_flow_timeout_task, &g_poflr_flow_timeout_task_id);
+    POF_CHECK_RETVALUE_TERMINATE(ret);
+
+    /* Start the task pushing counters to the Controller if configured. */
+    poflr_get_counter_push_interval(&push_interval);
+    if(push_interval != 0){
+        ret = pofbf_task_create(NULL, (void *)poflr_counter_push_task, &g_poflr_counter_push_task_id);
+        POF_CHECK_RETVALUE_TERMINATE(ret);
+    }
+
     return POF_OK;
 }
 
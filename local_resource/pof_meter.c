@@ -37,6 +37,7 @@
 #include "net/if.h"
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
+#include "time.h"
 
 /* The number of meter. */
 uint32_t poflr_meter_number = POFLR_METER_NUMBER;
@@ -44,6 +45,45 @@ uint32_t poflr_meter_number = POFLR_METER_NUMBER;
 /* Meter table. */
 poflr_meters *poflr_meter;
 
+/* Monotonic time in nano-second. The coarse clock is cheap enough to be
+ * read per packet, and its resolution is far below POFLR_METER_BURST_MS. */
+static inline uint64_t poflr_meter_now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Reset the token bucket of the meter to be full with the new rate. The
+ * unit of rate is kbps, and zero means no limitation. The cost of one byte
+ * is kept in fixed point, so it is never 0 and stays within 1% of the rate
+ * for any rate in 32 bits. The datapath tasks may be policing with the
+ * bucket, so each field is stored atomically and the counters are kept. A
+ * tat of 0 is in the past, which makes the bucket full. */
+static void poflr_meter_reset_bucket(uint32_t meter_id, uint32_t rate){
+    poflr_meter_bucket *b = &poflr_meter->bucket[meter_id];
+    uint64_t ns_per_byte = 0, burst_ns = 0;
+
+    if(rate != 0){
+        ns_per_byte = (8000000ULL << POFLR_METER_FRAC_BITS) / rate;
+        burst_ns = (uint64_t)POFLR_METER_BURST_MS * 1000000ULL;
+    }
+    __atomic_store_n(&b->burst_ns, burst_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->ns_per_byte, ns_per_byte, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->tat, 0, __ATOMIC_RELEASE);
+    return;
+}
+
+/* Clear the counters of the new meter. */
+static void poflr_meter_clear_counters(uint32_t meter_id){
+    poflr_meter_bucket *b = &poflr_meter->bucket[meter_id];
+
+    __atomic_store_n(&b->conform_packets, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->conform_bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->exceed_packets, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->exceed_bytes, 0, __ATOMIC_RELAXED);
+    return;
+}
+
 /***********************************************************************
  * Add the meter.
  * Form:     uint32_t poflr_mod_meter_entry(uint32_t meter_id, uint32_t rate)
@@ -66,6 +106,8 @@ uint32_t poflr_add_meter_entry(uint32_t meter_id, uint32_t rate){
     meter = &(poflr_meter->meter[meter_id]);
     meter->meter_id = meter_id;
     meter->rate = rate;
+    poflr_meter_reset_bucket(meter_id, rate);
+    poflr_meter_clear_counters(meter_id);
 
     poflr_meter->meter_num++;
     poflr_meter->state[meter_id] = POFLR_STATE_VALID;
@@ -96,6 +138,7 @@ uint32_t poflr_modify_meter_entry(uint32_t meter_id, uint32_t rate){
     meter = &(poflr_meter->meter[meter_id]);
     meter->meter_id = meter_id;
     meter->rate = rate;
+    poflr_meter_reset_bucket(meter_id, rate);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify meter SUC!");
     return POF_OK;
@@ -123,6 +166,7 @@ uint32_t poflr_delete_meter_entry(uint32_t meter_id, uint32_t rate){
     meter = &(poflr_meter->meter[meter_id]);
     meter->meter_id = 0;
     meter->rate = 0;
+    poflr_meter_reset_bucket(meter_id, 0);
 
     poflr_meter->meter_num--;
     poflr_meter->state[meter_id] = POFLR_STATE_INVALID;
@@ -131,6 +175,64 @@ uint32_t poflr_delete_meter_entry(uint32_t meter_id, uint32_t rate){
     return POF_OK;
 }
 
+/***********************************************************************
+ * Police the packet with the meter.
+ * Form:     uint32_t poflr_meter_police(uint32_t meter_id, \
+ *                                       uint32_t byte_len, \
+ *                                       uint8_t *conform_ptr)
+ * Input:    meter id, packet length in byte
+ * Output:   TRUE if the packet conforms to the meter rate, or FALSE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function charges the packet to the token bucket of the
+ *           meter and counts it as conforming or exceeding. The bucket is
+ *           updated with compare-and-swap, so several datapath tasks can
+ *           share one meter without lock.
+ ***********************************************************************/
+uint32_t poflr_meter_police(uint32_t meter_id, uint32_t byte_len, uint8_t *conform_ptr){
+    poflr_meter_bucket *b;
+    uint64_t now, old_tat, tat, cost, ns_per_byte, burst_ns;
+
+    /* Check meter_id. */
+    if(meter_id >= poflr_meter_number){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_INVALID_METER, \
+                                       __sync_fetch_and_add(&g_upward_xid, 1));
+    }
+    if(poflr_meter->state[meter_id] == POFLR_STATE_INVALID){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER, \
+                                       __sync_fetch_and_add(&g_upward_xid, 1));
+    }
+
+    b = &poflr_meter->bucket[meter_id];
+    *conform_ptr = TRUE;
+
+    /* Rate 0 means no limitation. */
+    ns_per_byte = __atomic_load_n(&b->ns_per_byte, __ATOMIC_RELAXED);
+    if(ns_per_byte != 0){
+        burst_ns = __atomic_load_n(&b->burst_ns, __ATOMIC_RELAXED);
+        now = poflr_meter_now_ns();
+        cost = (ns_per_byte * byte_len + (1ULL << (POFLR_METER_FRAC_BITS - 1))) \
+               >> POFLR_METER_FRAC_BITS;
+        do{
+            old_tat = b->tat;
+            tat = (old_tat > now) ? old_tat : now;
+            if(tat - now > burst_ns){
+                *conform_ptr = FALSE;
+                break;
+            }
+        }while(!__sync_bool_compare_and_swap(&b->tat, old_tat, tat + cost));
+    }
+
+    if(*conform_ptr){
+        __sync_fetch_and_add(&b->conform_packets, 1);
+        __sync_fetch_and_add(&b->conform_bytes, byte_len);
+    }else{
+        __sync_fetch_and_add(&b->exceed_packets, 1);
+        __sync_fetch_and_add(&b->exceed_bytes, byte_len);
+    }
+
+    return POF_OK;
+}
+
 /* Initialize meter resource. */
 uint32_t poflr_init_meter(){
 
@@ -149,6 +251,13 @@ uint32_t poflr_init_meter(){
 	}
     memset(poflr_meter->meter, 0, sizeof(pof_meter) * poflr_meter_number);
 
+    poflr_meter->bucket = (poflr_meter_bucket *)malloc(sizeof(poflr_meter_bucket) * poflr_meter_number);
+	if(poflr_meter->bucket == NULL){
+		poflr_free_table_resource();
+		POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+	}
+    memset(poflr_meter->bucket, 0, sizeof(poflr_meter_bucket) * poflr_meter_number);
+
     poflr_meter->state = (uint32_t *)malloc(sizeof(uint32_t) * poflr_meter_number);
 	if(poflr_meter->state == NULL){
 		poflr_free_table_resource();
@@ -163,6 +272,7 @@ uint32_t poflr_init_meter(){
 uint32_t poflr_free_meter(){
 	if(NULL != poflr_meter){
 		free(poflr_meter->meter);
+		free(poflr_meter->bucket);
 		free(poflr_meter->state);
 		free(poflr_meter);
 	}
@@ -173,6 +283,7 @@ uint32_t poflr_free_meter(){
 /* Empty meter. */
 uint32_t poflr_empty_meter(){
     memset(poflr_meter->meter, 0, sizeof(pof_meter) * poflr_meter_number);
+    memset(poflr_meter->bucket, 0, sizeof(poflr_meter_bucket) * poflr_meter_number);
     memset(poflr_meter->state, 0, sizeof(uint32_t) * poflr_meter_number);
     poflr_meter->meter_num = 0;
 
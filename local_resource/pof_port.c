@@ -39,6 +39,9 @@
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
 #include "ifaddrs.h"
+#include "errno.h"
+#include "linux/netlink.h"
+#include "linux/rtnetlink.h"
 
 /* The max number of local physical ports. */
 uint32_t poflr_device_port_num_max = POFLR_DEVICE_PORT_NUM_MAX;
@@ -55,6 +58,13 @@ char **poflr_port_ipaddr_str;
 /* Port number. */
 uint16_t poflr_port_num = 0;
 
+/* Liveness bitmap indexed by port id. It is written by the port tasks with
+ * atomic operations and read without lock by the datapath. */
+static volatile uint32_t poflr_port_live_bitmap[POFLR_PORT_LIVE_ID_MAX / 32];
+
+/* Task id of the link event listener. */
+task_t g_poflr_port_link_task_id = POF_INVALID_TASKID;
+
 static uint32_t poflr_get_port_num_name_by_systemfile(char **name, uint16_t *num);
 static uint32_t poflr_get_port_num_name_by_getifaddrs(char **name, uint16_t *num);
 static uint32_t poflr_get_hwaddr_index_by_name(const char *name, \
@@ -65,6 +75,86 @@ static uint32_t poflr_check_port_link(const char *name);
 static uint32_t poflr_check_port_up(const char *name);
 static uint32_t poflr_set_port(const char *name, pof_port *p);
 
+/* Set the port liveness in the liveness bitmap. */
+void poflr_set_port_live(uint32_t port_id, uint32_t live){
+	uint32_t mask;
+
+	if(port_id >= POFLR_PORT_LIVE_ID_MAX){
+		return;
+	}
+
+	mask = (uint32_t)1 << (port_id % 32);
+	if(live){
+		__sync_fetch_and_or(&poflr_port_live_bitmap[port_id / 32], mask);
+	}else{
+		__sync_fetch_and_and(&poflr_port_live_bitmap[port_id / 32], ~mask);
+	}
+	return;
+}
+
+/* Check whether the port is live. */
+uint32_t poflr_port_is_live(uint32_t port_id){
+	if(port_id >= POFLR_PORT_LIVE_ID_MAX){
+		return FALSE;
+	}
+	return (poflr_port_live_bitmap[port_id / 32] >> (port_id % 32)) & 1;
+}
+
+/***********************************************************************
+ * Listen to the link events of the ports.
+ * Form:     uint32_t poflr_port_link_task()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This task receives the RTM_NEWLINK and RTM_DELLINK messages of
+ *           the kernel, and updates the port liveness bitmap as soon as
+ *           a link goes up or down. The port is live if it is up and
+ *           running. The ports are still reported to the Controller by
+ *           poflr_port_detect_task.
+ ***********************************************************************/
+uint32_t poflr_port_link_task(){
+	struct sockaddr_nl addr;
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	char buf[8192];
+	int sock, len;
+
+	if((sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) < 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK;
+	if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+		close(sock);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BIND_SOCKET_FAILURE);
+	}
+
+	while(1){
+		len = recv(sock, buf, sizeof(buf), 0);
+		if(len <= 0){
+			/* Interrupted by the echo timer, or events lost on overflow
+			 * which the detect task will make up. */
+			if(len < 0 && errno != EINTR && errno != ENOBUFS){
+				pofbf_task_delay(1000);
+			}
+			continue;
+		}
+
+		for(nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)){
+			if(nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK){
+				continue;
+			}
+			ifi = (struct ifinfomsg *)NLMSG_DATA(nh);
+			poflr_set_port_live(ifi->ifi_index, (nh->nlmsg_type == RTM_NEWLINK) \
+					&& (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING));
+		}
+	}
+
+	return POF_OK;
+}
+
 /* Detect all of ports, and report to Controller if any change. */
 static uint32_t poflr_port_detect_main(char **name_old, \
 		                               uint16_t *num_old, \
@@ -404,6 +494,57 @@ uint32_t poflr_init_port(){
     return POF_OK;
 }
 
+/***********************************************************************
+ * Initialize the in-memory ports.
+ * Form:     uint32_t poflr_init_port_memory(uint16_t num)
+ * Input:    port number
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function initializes num ports which are not bound to
+ *           any local physical net port, in place of poflr_init_port().
+ *           The ports are named "mem<id>" with the port id from 1, and
+ *           are live and OpenFlow-enabled. The packets output to them
+ *           are handled by dp.send, so the datapath can be driven without
+ *           raw sockets.
+ ***********************************************************************/
+uint32_t poflr_init_port_memory(uint16_t num){
+    pof_port *p;
+    uint32_t i;
+
+    if(num == 0 || num > poflr_device_port_num_max){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+	port_task_id = (poflr_port_task_id *)malloc(poflr_device_port_num_max * sizeof(poflr_port_task_id));
+	POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(port_task_id);
+	memset(port_task_id, 0, poflr_device_port_num_max * sizeof(poflr_port_task_id));
+
+    poflr_port = (pof_port *)malloc(num * sizeof(pof_port));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(poflr_port);
+    memset(poflr_port, 0, num * sizeof(pof_port));
+
+    for(i=0; i<num; i++){
+        p = &poflr_port[i];
+        p->port_id = i + 1;
+        p->hw_addr[0] = 0x02;
+        p->hw_addr[5] = (uint8_t)p->port_id;
+        snprintf(p->name, POF_NAME_MAX_LENGTH, "mem%u", p->port_id);
+        p->state = POFPS_LIVE;
+        poflr_set_port_live(p->port_id, TRUE);
+
+        p->config = 0;
+        p->curr = POFPF_10MB_HD | POFPF_10MB_FD;
+        p->of_enable = POFLR_PORT_ENABLE;
+        p->device_id = g_poflr_dev_id;
+        p->supported = 0xffffffff;
+        p->advertised = POFPF_10MB_FD | POFPF_100MB_FD;
+        p->peer = POFPF_10MB_FD | POFPF_100MB_FD;
+    }
+    poflr_port_num = num;
+
+    return POF_OK;
+}
+
 static uint32_t poflr_set_port(const char *name, pof_port *p){
 	uint32_t ret = POF_OK;
 
@@ -417,6 +558,7 @@ static uint32_t poflr_set_port(const char *name, pof_port *p){
 	else{
 		p->state = POFPS_LINK_DOWN;
 	}
+	poflr_set_port_live(p->port_id, p->state == POFPS_LIVE);
 
 
 	/* Fill the port's other infomation. */
@@ -498,6 +640,121 @@ uint32_t poflr_disable_all_port(){
 	return POF_OK;
 }
 
+/***********************************************************************
+ * Get the statistics of the port.
+ * Form:     void poflr_get_port_stats(uint32_t port_id, pof_port_stats *stats)
+ * Input:    port id
+ * Output:   statistics of the port, in host byte order
+ * Return:   VOID
+ * Discribe: This function sums the traffic counters the datapath keeps
+ *           for the port. All of the counters are zero if the datapath
+ *           is off.
+ ***********************************************************************/
+void poflr_get_port_stats(uint32_t port_id, pof_port_stats *stats){
+#ifdef POF_DATAPATH_ON
+    struct pofdp_port_stats ps;
+#endif // POF_DATAPATH_ON
+
+    memset(stats, 0, sizeof *stats);
+    stats->port_id = port_id;
+#ifdef POF_DATAPATH_ON
+    pofdp_port_stats_get(port_id, &ps);
+    stats->rx_packets = ps.rx_packets;
+    stats->tx_packets = ps.tx_packets;
+    stats->rx_bytes = ps.rx_bytes;
+    stats->tx_bytes = ps.tx_bytes;
+    stats->rx_errors = ps.rx_errors;
+    stats->tx_errors = ps.tx_errors;
+    stats->rx_disabled_dropped = ps.rx_disabled_dropped;
+    stats->rx_mtu_dropped = ps.rx_mtu_dropped;
+    stats->rx_filter_dropped = ps.rx_filter_dropped;
+    stats->rx_queue_dropped = ps.rx_queue_dropped;
+    stats->tx_mtu_dropped = ps.tx_mtu_dropped;
+    stats->tx_queue_dropped = ps.tx_queue_dropped;
+    stats->rx_dropped = ps.rx_disabled_dropped + ps.rx_mtu_dropped + \
+                        ps.rx_filter_dropped + ps.rx_queue_dropped;
+    stats->tx_dropped = ps.tx_mtu_dropped + ps.tx_queue_dropped;
+#endif // POF_DATAPATH_ON
+    return;
+}
+
+/* Send the port statistics as one or more POFT_MULTIPART_REPLY messages
+ * which share the xid. All but the last one carry POFMPF_REPLY_MORE. */
+static uint32_t poflr_port_stats_send_multipart(pof_port_stats *snap, uint32_t snap_num, uint32_t xid){
+    char msg[POF_QUEUE_MESSAGE_LEN];
+    pof_header *head_ptr = (pof_header *)msg;
+    pof_multipart *mp_ptr = (pof_multipart *)(msg + sizeof(pof_header));
+    pof_port_stats *stats_ptr = (pof_port_stats *)(msg + sizeof(pof_header) + sizeof(pof_multipart));
+    uint32_t num_per_msg, num, sent = 0, i;
+    uint16_t len;
+
+    num_per_msg = (POF_QUEUE_MESSAGE_LEN - sizeof(pof_header) - sizeof(pof_multipart)) / sizeof(pof_port_stats);
+
+    do{
+        num = (snap_num - sent > num_per_msg) ? num_per_msg : (snap_num - sent);
+        len = sizeof(pof_header) + sizeof(pof_multipart) + num * sizeof(pof_port_stats);
+
+        head_ptr->version = POF_VERSION;
+        head_ptr->type = POFT_MULTIPART_REPLY;
+        head_ptr->length = len;
+        head_ptr->xid = xid;
+        pof_HtoN_transfer_header(head_ptr);
+
+        memset(mp_ptr, 0, sizeof(pof_multipart));
+        mp_ptr->type = POFMP_PORT_STATS;
+        mp_ptr->flags = (sent + num < snap_num) ? POFMPF_REPLY_MORE : 0;
+        pof_NtoH_transfer_multipart(mp_ptr);
+
+        for(i=0; i<num; i++){
+            stats_ptr[i] = snap[sent + i];
+            pof_HtoN_transfer_port_stats(stats_ptr + i);
+        }
+
+        if(POF_OK != pofsc_send_packet_upward((uint8_t *)msg, len)){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+        }
+        sent += num;
+    }while(sent < snap_num);
+
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Reply the statistics of the ports.
+ * Form:     uint32_t poflr_reply_port_stats_multipart(uint32_t port_id)
+ * Input:    port id
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function sends the statistics of the port, or of all
+ *           the ports if port_id is POFP_ANY, to the Controller in
+ *           POFT_MULTIPART_REPLY messages.
+ ***********************************************************************/
+uint32_t poflr_reply_port_stats_multipart(uint32_t port_id){
+    pof_port_stats *snap;
+    uint32_t snap_num = 0, ret, i;
+
+    snap = (pof_port_stats *)malloc(sizeof(pof_port_stats) * (poflr_port_num + 1));
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(snap);
+
+    for(i=0; i<poflr_port_num; i++){
+        if(port_id == POFP_ANY || port_id == poflr_port[i].port_id){
+            poflr_get_port_stats(poflr_port[i].port_id, &snap[snap_num++]);
+        }
+    }
+    if(snap_num == 0){
+        free(snap);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_PORT, g_recv_xid);
+    }
+
+    ret = poflr_port_stats_send_multipart(snap, snap_num, g_recv_xid);
+    free(snap);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"Reply port stats multipart SUC! port id = 0x%x, port num = %u", \
+                        port_id, snap_num);
+    return POF_OK;
+}
+
 static uint32_t poflr_check_port_link(const char *name){
 	struct ifreq ifr;
 	int sock_fd;
@@ -849,6 +1106,6 @@ poflr_check_port_index(uint32_t id)
 		}
 	}
 
-	POF_DEBUG_CPRINT_FL(1,RED,"Output port with index %u is invalid.", id);
+	POF_LOG_CPRINT_FL(POFLP_DATAPATH,POFLP_INFO,RED,"Output port with index %u is invalid.", id);
 	POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_OUT_PORT, g_upward_xid++);
 }
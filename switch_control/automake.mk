@@ -2,4 +2,5 @@ SWITCH_CONTROL_FOLDER = switch_control
 pofswitch_SOURCES += $(SWITCH_CONTROL_FOLDER)/pof_config.c \
 					 $(SWITCH_CONTROL_FOLDER)/pof_encap.c \
 					 $(SWITCH_CONTROL_FOLDER)/pof_parse.c \
+					 $(SWITCH_CONTROL_FOLDER)/pof_stats.c \
 					 $(SWITCH_CONTROL_FOLDER)/pof_switch_control.c
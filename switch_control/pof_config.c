@@ -30,6 +30,7 @@
 #include "../include/pof_log_print.h"
 #include "../include/pof_local_resource.h"
 #include "../include/pof_byte_transfer.h"
+#include "../include/pof_datapath.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -59,6 +60,7 @@ uint32_t pofc_cmd_auto_clear = TRUE;
     CONFIG_CMD('l',"l","log-file",log_file,"Create log file: /usr/local/var/log/pofswitch.log.") \
     CONFIG_CMD('s',"s","state",state,"Print software state information.")                     \
     CONFIG_CMD('t',"t","test",test,"Test.")                     \
+    CONFIG_CMD('d',"d:","trace-decode",trace_decode,"Decode a packet trace file.")          \
     CONFIG_CMD('h',"h","help",help,"Print help message.")                                    \
     CONFIG_CMD('v',"v","version",version,"Print the version number of POFSwitch.")
 
@@ -112,6 +114,15 @@ start_cmd_test(char *optarg)
     exit(0);
 }
 
+static uint32_t
+start_cmd_trace_decode(char *optarg)
+{
+#ifdef POF_DATAPATH_ON
+    pofdp_trace_decode(optarg);
+#endif // POF_DATAPATH_ON
+    exit(0);
+}
+
 static uint32_t
 start_cmd_help(char *optarg)
 {
@@ -202,6 +213,15 @@ enum pof_init_config_type{
 	POFICT_COUNTER_NUMBER   = 9,
 	POFICT_GROUP_NUMBER     = 10,
 	POFICT_DEVICE_PORT_NUMBER_MAX = 11,
+	POFICT_COUNTER_PUSH_INTERVAL = 12,
+	POFICT_GROUP_HASH_FIELD = 13,
+	POFICT_PACKET_IN_RATE   = 14,
+	POFICT_PACKET_IN_PORT_RATE = 15,
+	POFICT_PACKET_IN_SAMPLE = 16,
+	POFICT_LOG_LEVEL        = 17,
+	POFICT_TRACE_SAMPLE     = 18,
+	POFICT_LATENCY_STAT     = 19,
+	POFICT_STATS_SOCKET     = 20,
 
 	POFICT_CONFIG_TYPE_MAX,
 };
@@ -211,7 +231,10 @@ char *config_type_str[POFICT_CONFIG_TYPE_MAX] = {
 	"MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
 	"Flow_table_size", "Flow_table_key_length", 
 	"Meter_number", "Counter_number", "Group_number", 
-	"Device_port_number_max"
+	"Device_port_number_max", "Counter_push_interval", "Group_hash_field",
+	"Packet_in_rate", "Packet_in_port_rate", "Packet_in_sample",
+	"Log_level", "Trace_sample", "Latency_stat",
+	"Stats_socket"
 };
 
 static uint8_t pofsic_get_config_type(char *str){
@@ -249,7 +272,14 @@ static uint32_t pofsic_get_config_data(FILE *fp, uint32_t *ret_p){
  *			 "MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
  *			 "Flow_table_size", "Flow_table_key_length", 
  *			 "Meter_number", "Counter_number", "Group_number", 
- *			 "Device_port_number_max"
+ *			 "Device_port_number_max", "Counter_push_interval",
+ *			 "Group_hash_field" followed by field_id, offset and length,
+ *			 "Packet_in_rate" followed by reason, rate and burst,
+ *			 "Packet_in_port_rate" followed by rate and burst,
+ *			 "Packet_in_sample",
+ *			 "Log_level" followed by category and level,
+ *			 "Trace_sample", "Latency_stat",
+ *			 "Stats_socket" followed by the path of the socket
  ***********************************************************************/
 static uint32_t pof_set_init_config_by_file(){
 	uint32_t ret = POF_OK, data = 0;
@@ -293,6 +323,12 @@ static uint32_t pof_set_init_config_by_file(){
 					pofsc_set_controller_ip(ip_str);
 				}
 			}
+		}else if(config_type == POFICT_STATS_SOCKET){
+			if(fscanf(fp, "%s", str) != 1){
+				ret = POF_ERROR;
+			}else{
+				ret = pofsc_set_stats_socket(str);
+			}
 		}else{
 			data = pofsic_get_config_data(fp, &ret);
 			switch(config_type){
@@ -331,6 +367,54 @@ static uint32_t pof_set_init_config_by_file(){
 				case POFICT_DEVICE_PORT_NUMBER_MAX:
 					poflr_set_port_number_max(data);
 					break;
+				case POFICT_COUNTER_PUSH_INTERVAL:
+					poflr_set_counter_push_interval(data);
+					break;
+				case POFICT_GROUP_HASH_FIELD:
+					{
+						uint32_t offset = pofsic_get_config_data(fp, &ret);
+						uint32_t len = pofsic_get_config_data(fp, &ret);
+						if(ret == POF_OK){
+							ret = poflr_add_group_hash_field(data, offset, len);
+						}
+					}
+					break;
+#ifdef POF_DATAPATH_ON
+				case POFICT_PACKET_IN_RATE:
+					{
+						uint32_t rate = pofsic_get_config_data(fp, &ret);
+						uint32_t burst = pofsic_get_config_data(fp, &ret);
+						if(ret == POF_OK){
+							ret = pofdp_set_packet_in_rate(data, rate, burst);
+						}
+					}
+					break;
+				case POFICT_PACKET_IN_PORT_RATE:
+					{
+						uint32_t burst = pofsic_get_config_data(fp, &ret);
+						if(ret == POF_OK){
+							ret = pofdp_set_packet_in_port_rate(data, burst);
+						}
+					}
+					break;
+				case POFICT_PACKET_IN_SAMPLE:
+					pofdp_set_packet_in_sample(data);
+					break;
+				case POFICT_TRACE_SAMPLE:
+					pofdp_set_trace_sample(data);
+					break;
+				case POFICT_LATENCY_STAT:
+					pofdp_set_latency_on(data);
+					break;
+#endif // POF_DATAPATH_ON
+				case POFICT_LOG_LEVEL:
+					{
+						uint32_t level = pofsic_get_config_data(fp, &ret);
+						if(ret == POF_OK){
+							ret = poflp_set_level(data, level);
+						}
+					}
+					break;
 				default:
 					ret = POF_ERROR;
 					break;
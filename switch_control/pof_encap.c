@@ -31,9 +31,6 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 
-/* Data buffer. */
-char pofec_queue_msg_buf[POF_QUEUE_MESSAGE_LEN] = {0};
-
 /* Error messages. */
 pofec_error g_pofec_error = {0};
 
@@ -66,18 +63,17 @@ uint32_t pofec_set_error(uint16_t type, char *type_str, uint16_t code, char *err
  *           Controller through the OpenFlow channel.
 *******************************************************************************/
 uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid){
-    pof_error *error_ptr;
+    pof_error error = {0};
 
     /* Build the pof body. */
-    error_ptr = (pof_error *)(pofec_queue_msg_buf + sizeof(pof_header));
-    error_ptr->code = code;
-    error_ptr->device_id = POF_FE_ID;
-    error_ptr->type = type;
-    memcpy(error_ptr->err_str, s, strlen(s)+1);
+    error.code = code;
+    error.device_id = POF_FE_ID;
+    error.type = type;
+    strncpy((char *)error.err_str, s, sizeof(error.err_str) - 1);
 
-    pof_NtoH_transfer_error(pofec_queue_msg_buf + sizeof(pof_header));
+    pof_NtoH_transfer_error(&error);
 
-    if(POF_OK != pofec_reply_msg(POFT_ERROR, xid, sizeof(pof_error), NULL)){
+    if(POF_OK != pofec_reply_msg(POFT_ERROR, xid, sizeof(pof_error), (uint8_t *)&error)){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_upward_xid++);
     }
 
@@ -85,6 +81,69 @@ uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid){
     return POF_OK;
 }
 
+/*******************************************************************************
+ * Allocate a message to the Controller.
+ * Form:     pofbf_msg *pofec_new_msg(uint8_t type, uint32_t xid, uint32_t msg_len)
+ * Input:    message type, xid, length of message body
+ * Output:   NONE
+ * Return:   message buffer, or NULL if fail to malloc
+ * Discribe: This function allocates the message buffer and fills the
+ *           header. The caller writes the body of msg_len bytes behind
+ *           the header in network order, then sends it by pofec_send_msg.
+*******************************************************************************/
+pofbf_msg *pofec_new_msg(uint8_t type, uint32_t xid, uint32_t msg_len){
+    pof_header* header_ptr;
+    pofbf_msg *msg;
+    uint32_t total_len = msg_len + sizeof(pof_header);
+
+    msg = pofbf_msg_alloc(total_len);
+    if(msg == NULL){
+        return NULL;
+    }
+
+    header_ptr = (pof_header*)msg->data;
+    header_ptr->version = POF_VERSION;
+    header_ptr->type = type;
+    header_ptr->xid = xid;
+    header_ptr->length = total_len;
+
+    pof_HtoN_transfer_header(header_ptr);
+    return msg;
+}
+
+/*******************************************************************************
+ * Send the message built by pofec_new_msg to Controller.
+ * Form:     uint32_t pofec_send_msg(pofbf_msg *msg)
+ * Input:    message buffer
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function passes the message buffer to the sending queue
+ *           without copy, or releases it if the channel is not ready.
+ *           The packet-in messages are dropped if the Controller is too
+ *           slow to receive them.
+*******************************************************************************/
+uint32_t pofec_send_msg(pofbf_msg *msg){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc;
+    pof_header* header_ptr = (pof_header*)msg->data;
+
+    /* If valid, fetch one message and send it to controller. */
+    switch(conn_desc_ptr->conn_status.state){
+        case POFCS_REQUEST_FEATURE:
+		case POFCS_SET_CONFIG:
+		case POFCS_REQUEST_GET_CONFIG:
+        case POFCS_CHANNEL_RUN:
+			if(POF_OK != pofsc_send_msg_upward(msg, header_ptr->type == POFT_PACKET_IN)){
+				POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+			}
+            break;
+        default:
+            pofbf_msg_release(msg);
+            break;
+    }
+
+    return POF_OK;
+}
+
 /*******************************************************************************
  * Send the message to Controller.
  * Form:     uint32_t  pofec_reply_msg(uint8_t type,
@@ -96,49 +155,21 @@ uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid){
  * Return:   POF_OK or Error code
  * Discribe: This function encapsulats the message, which the soft switch want
  *           to send to the Controller, to OpenFlow format. If msg_body is NULL,
- *           it means the message data has already written into the pofec_queue_msg_buf
- *           start on sizeof(pof_header).
+ *           the message has no body.
 *******************************************************************************/
 uint32_t  pofec_reply_msg(uint8_t  type, \
                           uint32_t xid, \
                           uint32_t msg_len, \
                           uint8_t  *msg_body)
 {
-    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc;
-    pof_header* header_ptr;
-    uint32_t total_len = msg_len + sizeof(pof_header);
+    pofbf_msg *msg;
 
-    /* If valid, fetch one message and send it to controller. */
-    switch(conn_desc_ptr->conn_status.state){
-        case POFCS_CHANNEL_INVALID:
-        case POFCS_CHANNEL_CONNECTING:
-        case POFCS_CHANNEL_CONNECTED:
-        case POFCS_HELLO:
-            break;
-        case POFCS_REQUEST_FEATURE:
-		case POFCS_SET_CONFIG:
-		case POFCS_REQUEST_GET_CONFIG:
-        case POFCS_CHANNEL_RUN:
-
-			header_ptr = (pof_header*)pofec_queue_msg_buf;
-			header_ptr->version = POF_VERSION;
-			header_ptr->type = type;
-			header_ptr->xid = xid;
-			header_ptr->length = total_len;
-
-			pof_HtoN_transfer_header(header_ptr);
-
-			if(msg_body != NULL){
-				memcpy(pofec_queue_msg_buf + sizeof(pof_header), (uint8_t*)msg_body, msg_len);
-			}
+    msg = pofec_new_msg(type, xid, msg_len);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg);
 
-			if(POF_OK != pofsc_send_packet_upward(pofec_queue_msg_buf, total_len)){
-				POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
-			}
-            break;
-        default:
-            break;
+    if(msg_body != NULL){
+        memcpy(msg->data + sizeof(pof_header), (uint8_t*)msg_body, msg_len);
     }
 
-    return POF_OK;
+    return pofec_send_msg(msg);
 }
@@ -30,10 +30,117 @@
 #include "../include/pof_local_resource.h"
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
 
 /* Xid in OpenFlow header received from Controller. */
 uint32_t g_recv_xid = POF_INITIAL_XID;
 
+/* Flow mods waiting to be applied together. Each keeps the xid of its
+ * message for the error reply. */
+static struct pof_flow_mod_batch_entry{
+    pof_flow_entry flow;
+    uint32_t xid;
+} pof_flow_mod_batch[POF_FLOW_MOD_BATCH_NUM];
+static uint32_t pof_flow_mod_batch_num = 0;
+static uint64_t pof_flow_mod_batch_time = 0;   /* Time of the first flow mod in ms. */
+
+/* Monotonic time in millisecond. */
+static uint64_t pof_flow_mod_batch_now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/***********************************************************************
+ * Apply the flow mods in the batch.
+ * Form:     uint32_t pof_flow_mod_batch_flush()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: This function applies the flow mods waiting in the batch in
+ *           the order of arrival, holding the flow lock only once for
+ *           the whole batch. A failed flow mod is replied with the error
+ *           carrying its own xid, and does not stop the others.
+ ***********************************************************************/
+uint32_t pof_flow_mod_batch_flush(){
+    pof_flow_entry *flow_ptr;
+    uint32_t i, ret, xid = g_recv_xid;
+
+    if(pof_flow_mod_batch_num == 0){
+        return POF_OK;
+    }
+
+    POFLR_FLOW_LOCK_ON;
+    for(i=0; i<pof_flow_mod_batch_num; i++){
+        flow_ptr = &pof_flow_mod_batch[i].flow;
+        g_recv_xid = pof_flow_mod_batch[i].xid;
+        if(flow_ptr->command == POFFC_ADD){
+            ret = poflr_add_flow_entry(flow_ptr);
+        }else if(flow_ptr->command == POFFC_DELETE && flow_ptr->index != POF_FLOW_INDEX_ANY){
+            ret = poflr_delete_flow_entry(flow_ptr);
+        }else if(flow_ptr->command == POFFC_MODIFY && flow_ptr->index != POF_FLOW_INDEX_ANY){
+            ret = poflr_modify_flow_entry(flow_ptr);
+        }else if(flow_ptr->command <= POFFC_DELETE_STRICT){
+            ret = poflr_flow_mod_by_match(flow_ptr);
+        }else{
+            POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_COMMAND, g_recv_xid);
+            continue;
+        }
+        POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+    }
+    POFLR_FLOW_LOCK_OFF;
+
+    pof_flow_mod_batch_num = 0;
+    g_recv_xid = xid;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Apply the flow mods in the batch if they have waited long enough.
+ * Form:     uint32_t pof_flow_mod_batch_timeout()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   Time in millisecond before the batch should be applied, or
+ *           POF_CHANNEL_POLL_TIMEOUT if the batch is empty.
+ * Discribe: The channel task calls this function after every wait, and
+ *           waits no longer than the returned time.
+ ***********************************************************************/
+uint32_t pof_flow_mod_batch_timeout(){
+    uint64_t age;
+
+    if(pof_flow_mod_batch_num == 0){
+        return POF_CHANNEL_POLL_TIMEOUT;
+    }
+
+    age = pof_flow_mod_batch_now_ms() - pof_flow_mod_batch_time;
+    if(age >= POF_FLOW_MOD_BATCH_TIMEOUT){
+        (void)pof_flow_mod_batch_flush();
+        return POF_CHANNEL_POLL_TIMEOUT;
+    }
+    return POF_FLOW_MOD_BATCH_TIMEOUT - (uint32_t)age;
+}
+
+/* Drop the flow mods in the batch, when the Controller is lost. */
+void pof_flow_mod_batch_discard(){
+    pof_flow_mod_batch_num = 0;
+    return;
+}
+
+/* Add the flow mod to the batch. The batch is applied when it is full. */
+static uint32_t pof_flow_mod_batch_add(pof_flow_entry *flow_ptr){
+    if(pof_flow_mod_batch_num == 0){
+        pof_flow_mod_batch_time = pof_flow_mod_batch_now_ms();
+    }
+    pof_flow_mod_batch[pof_flow_mod_batch_num].flow = *flow_ptr;
+    pof_flow_mod_batch[pof_flow_mod_batch_num].xid = g_recv_xid;
+    pof_flow_mod_batch_num++;
+
+    if(pof_flow_mod_batch_num == POF_FLOW_MOD_BATCH_NUM){
+        return pof_flow_mod_batch_flush();
+    }
+    return POF_OK;
+}
+
 /*******************************************************************************
  * Parse the OpenFlow message received from the Controller.
  * Form:     uint32_t  pof_parse_msg_from_controller(char* msg_ptr)
@@ -42,6 +149,9 @@ uint32_t g_recv_xid = POF_INITIAL_XID;
  * Return:   POF_OK or Error code
  * Discribe: This function parses the OpenFlow message received from the Controller,
  *           and execute the response.
+ *           The flow mods are batched. The batch is applied before any
+ *           other message except echo request is handled, so the other
+ *           messages and BARRIER_REPLY see all the flow mods before them.
 *******************************************************************************/
 uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
     pof_switch_config *config_ptr;
@@ -52,6 +162,11 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
     pof_port          *port_ptr;
     pof_meter         *meter_ptr;
     pof_group         *group_ptr;
+    pof_multipart     *multipart_ptr;
+    pof_counter_multipart_request *counter_mp_ptr;
+    pof_port_stats_multipart_request *port_stats_mp_ptr;
+    pof_table_stats_multipart_request *table_stats_mp_ptr;
+    pof_packet_out    *packet_out_ptr;
     uint32_t          ret = POF_OK;
     uint16_t          len;
     uint8_t           msg_type;
@@ -73,6 +188,10 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
     msg_type = header_ptr->type;
     g_recv_xid = header_ptr->xid;
 
+    if(msg_type != POFT_FLOW_MOD && msg_type != POFT_ECHO_REQUEST){
+        (void)pof_flow_mod_batch_flush();
+    }
+
     /* Execute different responses according to the OpenFlow type. */
     switch(msg_type){
         case POFT_ECHO_REQUEST:
@@ -120,6 +239,8 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
             table_ptr = (pof_flow_table*)(msg_ptr + sizeof(pof_header));
             pof_NtoH_transfer_flow_table(table_ptr);
 
+            /* The flow timeout task retires entries concurrently. */
+            POFLR_FLOW_LOCK_ON;
             if(table_ptr->command == POFTC_ADD){
                 ret = poflr_create_flow_table(table_ptr->tid, \
                                               table_ptr->type, \
@@ -131,8 +252,10 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
             }else if(table_ptr->command == POFTC_DELETE){
                 ret = poflr_delete_flow_table(table_ptr->tid, table_ptr->type);
             }else{
+                POFLR_FLOW_LOCK_OFF;
                 POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_BAD_COMMAND, g_recv_xid);
             }
+            POFLR_FLOW_LOCK_OFF;
 
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
             break;
@@ -141,20 +264,20 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
             flow_ptr = (pof_flow_entry*)(msg_ptr + sizeof(pof_header));
             pof_NtoH_transfer_flow_entry(flow_ptr);
 
-            if(flow_ptr->command == POFFC_ADD){
-                ret = poflr_add_flow_entry(flow_ptr);
-            }else if(flow_ptr->command == POFFC_DELETE){
-                ret = poflr_delete_flow_entry(flow_ptr);
-            }else if(flow_ptr->command == POFFC_MODIFY){
-                ret = poflr_modify_flow_entry(flow_ptr);
-            }else{
-                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_COMMAND, g_recv_xid);
-            }
+            /* The flow mod is applied with the batch. */
+            ret = pof_flow_mod_batch_add(flow_ptr);
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 //            usr_cmd_tables();
 
             break;
 
+        case POFT_BARRIER_REQUEST:
+            /* All the flow mods before the barrier have been applied. */
+            if(POF_OK != pofec_reply_msg(POFT_BARRIER_REPLY, g_recv_xid, 0, NULL)){
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid);
+            }
+            break;
+
          case POFT_METER_MOD:
             meter_ptr = (pof_meter*)(msg_ptr + sizeof(pof_header));
             pof_NtoH_transfer_meter(meter_ptr);
@@ -214,6 +337,57 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr){
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
             break;
 
+        case POFT_MULTIPART_REQUEST:
+            if(len < sizeof(pof_header) + sizeof(pof_multipart)){
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_LEN, g_recv_xid);
+            }
+            multipart_ptr = (pof_multipart*)(msg_ptr + sizeof(pof_header));
+            pof_NtoH_transfer_multipart(multipart_ptr);
+
+            if(multipart_ptr->type == POFMP_COUNTER){
+                if(len < sizeof(pof_header) + sizeof(pof_multipart) + sizeof(pof_counter_multipart_request)){
+                    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_LEN, g_recv_xid);
+                }
+                counter_mp_ptr = (pof_counter_multipart_request*)(msg_ptr + sizeof(pof_header) + sizeof(pof_multipart));
+                pof_NtoH_transfer_counter_multipart_request(counter_mp_ptr);
+
+                ret = poflr_reply_counter_multipart(counter_mp_ptr->counter_id, counter_mp_ptr->counter_num);
+            }else if(multipart_ptr->type == POFMP_PORT_STATS){
+                if(len < sizeof(pof_header) + sizeof(pof_multipart) + sizeof(pof_port_stats_multipart_request)){
+                    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_LEN, g_recv_xid);
+                }
+                port_stats_mp_ptr = (pof_port_stats_multipart_request*)(msg_ptr + sizeof(pof_header) + sizeof(pof_multipart));
+                pof_NtoH_transfer_port_stats_multipart_request(port_stats_mp_ptr);
+
+                ret = poflr_reply_port_stats_multipart(port_stats_mp_ptr->port_id);
+            }else if(multipart_ptr->type == POFMP_TABLE_STATS){
+                if(len < sizeof(pof_header) + sizeof(pof_multipart) + sizeof(pof_table_stats_multipart_request)){
+                    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_LEN, g_recv_xid);
+                }
+                table_stats_mp_ptr = (pof_table_stats_multipart_request*)(msg_ptr + sizeof(pof_header) + sizeof(pof_multipart));
+
+                ret = poflr_reply_table_stats_multipart(table_stats_mp_ptr->table_id);
+            }else{
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_MULTIPART, g_recv_xid);
+            }
+
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+            break;
+
+        case POFT_PACKET_OUT:
+            if(len < sizeof(pof_header) + sizeof(pof_packet_out)){
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_LEN, g_recv_xid);
+            }
+            packet_out_ptr = (pof_packet_out*)(msg_ptr + sizeof(pof_header));
+            pof_NtoH_transfer_packet_out(packet_out_ptr);
+
+#ifdef POF_DATAPATH_ON
+            ret = pofdp_packet_out(packet_out_ptr, len - sizeof(pof_header) - sizeof(pof_packet_out));
+#endif // POF_DATAPATH_ON
+
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+            break;
+
         default:
             POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_BAD_TYPE, g_recv_xid);
             break;
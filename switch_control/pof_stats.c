@@ -0,0 +1,567 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_conn.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Path of the statistics socket. Empty means no statistics socket. */
+char pofsc_stats_socket_path[POF_STATS_SOCKET_PATH_MAX_LEN] = "\0";
+task_t pofsc_stats_task_id = 0;
+
+pofsc_channel_stats g_pofsc_channel_stats;
+
+/* Metric families. Every value belongs to one family, and the values of
+ * one family are printed together.
+ * METRIC(NAME, TYPE, HELP) */
+#define POFSC_STATS_METRICS \
+    METRIC(channel_state, gauge, "State of the control channel, 7 is running.")             \
+    METRIC(channel_connects_total, counter, "Times the control channel gets running.")       \
+    METRIC(channel_rx_messages_total, counter, "Messages received from the Controller.")     \
+    METRIC(channel_rx_bytes_total, counter, "Bytes received from the Controller.")           \
+    METRIC(channel_tx_messages_total, counter, "Messages sent to the Controller.")           \
+    METRIC(channel_tx_bytes_total, counter, "Bytes sent to the Controller.")                 \
+    METRIC(channel_queue_messages, gauge, "Messages waiting to be sent to the Controller.")  \
+    METRIC(channel_queue_bytes, gauge, "Bytes waiting to be sent to the Controller.")        \
+    METRIC(channel_queue_dropped_messages_total, counter, "Messages dropped as the sending queue is full.") \
+    METRIC(channel_queue_dropped_bytes_total, counter, "Bytes dropped as the sending queue is full.")       \
+    METRIC(datapath_queue_messages, gauge, "Packets waiting in the datapath queue.")         \
+    METRIC(datapath_queue_bytes, gauge, "Bytes waiting in the datapath queue.")              \
+    METRIC(packet_in_sent_total, counter, "Packet-in messages sent within the rate.")        \
+    METRIC(packet_in_dropped_total, counter, "Packet-in messages dropped over the rate.")    \
+    METRIC(packet_in_sampled_total, counter, "Packet-in messages sent over the rate by sampling.") \
+    METRIC(port_openflow_enabled, gauge, "1 if OpenFlow is enabled on the port.")            \
+    METRIC(port_link_up, gauge, "1 if the link of the port is up.")                          \
+    METRIC(port_rx_packets_total, counter, "Packets received and forwarded.")                \
+    METRIC(port_rx_bytes_total, counter, "Bytes received and forwarded.")                    \
+    METRIC(port_rx_errors_total, counter, "Receive failures.")                               \
+    METRIC(port_rx_dropped_total, counter, "Received packets dropped.")                      \
+    METRIC(port_tx_packets_total, counter, "Packets sent out.")                              \
+    METRIC(port_tx_bytes_total, counter, "Bytes sent out.")                                  \
+    METRIC(port_tx_errors_total, counter, "Send failures.")                                  \
+    METRIC(port_tx_dropped_total, counter, "Packets dropped before sent out.")               \
+    METRIC(flow_table_entries, gauge, "Flow entries in the table.")                          \
+    METRIC(flow_table_size, gauge, "Max flow entries of the table.")                         \
+    METRIC(flow_table_lookups_total, counter, "Packets looked up in the table.")             \
+    METRIC(flow_table_matches_total, counter, "Packets which hit an entry of the table.")    \
+    METRIC(flow_table_misses_total, counter, "Packets which hit no entry of the table.")     \
+    METRIC(flow_table_examined_entries_total, counter, "Entries compared in the lookups.")   \
+    METRIC(pool_used, gauge, "Resources in use.")                                            \
+    METRIC(pool_size, gauge, "Max resources.")                                               \
+    METRIC(latency_ns, gauge, "Datapath latency percentile in ns.")                          \
+    METRIC(latency_count_total, counter, "Datapath latency samples.")                        \
+    METRIC(latency_sum_ns_total, counter, "Sum of the datapath latency samples in ns.")      \
+    METRIC(log_dropped_total, counter, "Log records dropped as the log ring is full.")
+
+enum pofsc_stats_metric{
+#define METRIC(NAME,TYPE,HELP) POFSC_STATS_##NAME,
+    POFSC_STATS_METRICS
+#undef METRIC
+    POFSC_STATS_METRIC_NUM,
+};
+
+static const struct pofsc_stats_family{
+    const char *name;
+    const char *type;
+    const char *help;
+} pofsc_stats_family[POFSC_STATS_METRIC_NUM] = {
+#define METRIC(NAME,TYPE,HELP) {#NAME, #TYPE, HELP},
+    POFSC_STATS_METRICS
+#undef METRIC
+};
+
+/* One value in the snapshot, with at most three labels. */
+#define POFSC_STATS_LABEL_NUM (3)
+#define POFSC_STATS_LABEL_LEN (POF_NAME_MAX_LENGTH)
+typedef struct pofsc_stats_value{
+    uint32_t metric;
+    const char *label_key[POFSC_STATS_LABEL_NUM];
+    char label_value[POFSC_STATS_LABEL_NUM][POFSC_STATS_LABEL_LEN];
+    uint64_t value;
+} pofsc_stats_value;
+
+/* Snapshot of all the statistics, taken at once before it is formatted,
+ * so that the formatting does not hold anything the switch uses. */
+typedef struct pofsc_stats_snapshot{
+    uint64_t time;              /* CLOCK_REALTIME in ms. */
+    uint32_t num;
+    uint32_t max;
+    pofsc_stats_value *value;
+} pofsc_stats_snapshot;
+
+enum pofsc_stats_format{
+    POFSC_STATS_JSON = 0,
+    POFSC_STATS_PROMETHEUS,
+};
+
+static void pofsc_stats_add(pofsc_stats_snapshot *snap, uint32_t metric, uint64_t value, \
+                            const char *key0, const char *value0, \
+                            const char *key1, const char *value1, \
+                            const char *key2, const char *value2){
+    const char *key[POFSC_STATS_LABEL_NUM] = {key0, key1, key2};
+    const char *label[POFSC_STATS_LABEL_NUM] = {value0, value1, value2};
+    pofsc_stats_value *v;
+    uint32_t i;
+
+    if(snap->num == snap->max){
+        v = realloc(snap->value, (snap->max * 2 + 64) * sizeof *v);
+        if(v == NULL){
+            return;
+        }
+        snap->value = v;
+        snap->max = snap->max * 2 + 64;
+    }
+
+    v = &snap->value[snap->num++];
+    memset(v, 0, sizeof *v);
+    v->metric = metric;
+    v->value = value;
+    for(i=0; i<POFSC_STATS_LABEL_NUM && key[i] != NULL; i++){
+        v->label_key[i] = key[i];
+        strncpy(v->label_value[i], label[i], POFSC_STATS_LABEL_LEN - 1);
+    }
+    return;
+}
+
+#define POFSC_STATS_ADD(snap,metric,value) \
+    pofsc_stats_add(snap, POFSC_STATS_##metric, value, NULL, NULL, NULL, NULL, NULL, NULL)
+#define POFSC_STATS_ADD_1(snap,metric,value,k0,v0) \
+    pofsc_stats_add(snap, POFSC_STATS_##metric, value, k0, v0, NULL, NULL, NULL, NULL)
+#define POFSC_STATS_ADD_2(snap,metric,value,k0,v0,k1,v1) \
+    pofsc_stats_add(snap, POFSC_STATS_##metric, value, k0, v0, k1, v1, NULL, NULL)
+#define POFSC_STATS_ADD_3(snap,metric,value,k0,v0,k1,v1,k2,v2) \
+    pofsc_stats_add(snap, POFSC_STATS_##metric, value, k0, v0, k1, v1, k2, v2)
+
+static void pofsc_stats_take_channel(pofsc_stats_snapshot *snap){
+    const pofsc_channel_stats *c = &g_pofsc_channel_stats;
+
+    POFSC_STATS_ADD(snap, channel_state, pofsc_conn_desc.conn_status.state);
+    POFSC_STATS_ADD(snap, channel_connects_total, c->connect);
+    POFSC_STATS_ADD(snap, channel_rx_messages_total, c->rx_msg);
+    POFSC_STATS_ADD(snap, channel_rx_bytes_total, c->rx_byte);
+    POFSC_STATS_ADD(snap, channel_tx_messages_total, c->tx_msg);
+    POFSC_STATS_ADD(snap, channel_tx_bytes_total, c->tx_byte);
+    POFSC_STATS_ADD(snap, channel_queue_messages, pofsc_send_q.msg_num);
+    POFSC_STATS_ADD(snap, channel_queue_bytes, pofsc_send_q.byte_num);
+    POFSC_STATS_ADD(snap, channel_queue_dropped_messages_total, pofsc_send_q.drop_msg);
+    POFSC_STATS_ADD(snap, channel_queue_dropped_bytes_total, pofsc_send_q.drop_byte);
+    return;
+}
+
+#ifdef POF_DATAPATH_ON
+static void pofsc_stats_take_datapath(pofsc_stats_snapshot *snap){
+    static const char *quantile_str[] = {"0.5", "0.99", "0.999"};
+    static const double quantile[] = {50, 99, 99.9};
+    struct pofdp_packet_in_limit *l = &g_pofdp_packet_in_limit;
+    struct pofdp_hist *hist;
+    uint32_t msg_num, byte_num, i, j;
+    char str[POFSC_STATS_LABEL_LEN];
+
+    pofbf_queue_depth(g_pofdp_recv_q_id, &msg_num, &byte_num);
+    POFSC_STATS_ADD_1(snap, datapath_queue_messages, msg_num, "queue", "rx");
+    POFSC_STATS_ADD_1(snap, datapath_queue_bytes, byte_num, "queue", "rx");
+    pofbf_queue_depth(g_pofdp_send_q_id, &msg_num, &byte_num);
+    POFSC_STATS_ADD_1(snap, datapath_queue_messages, msg_num, "queue", "tx");
+    POFSC_STATS_ADD_1(snap, datapath_queue_bytes, byte_num, "queue", "tx");
+
+    /* Only the limited or used buckets are taken, as the packet_in
+     * command shows. */
+    for(i=0; i<POFDP_PACKET_IN_REASON_NUM; i++){
+        if(l->reason[i].ns_per_packet == 0 && l->reason[i].sent == 0){
+            continue;
+        }
+        snprintf(str, sizeof str, "%u", i);
+        POFSC_STATS_ADD_1(snap, packet_in_sent_total, l->reason[i].sent, "reason", str);
+        POFSC_STATS_ADD_1(snap, packet_in_dropped_total, l->reason[i].dropped, "reason", str);
+        POFSC_STATS_ADD_1(snap, packet_in_sampled_total, l->reason[i].sampled, "reason", str);
+    }
+    for(i=0; i<POFDP_PACKET_IN_PORT_NUM; i++){
+        if(l->port[i].sent == 0 && l->port[i].dropped == 0){
+            continue;
+        }
+        snprintf(str, sizeof str, "%u", i);
+        POFSC_STATS_ADD_1(snap, packet_in_sent_total, l->port[i].sent, "port_id", str);
+        POFSC_STATS_ADD_1(snap, packet_in_dropped_total, l->port[i].dropped, "port_id", str);
+        POFSC_STATS_ADD_1(snap, packet_in_sampled_total, l->port[i].sampled, "port_id", str);
+    }
+
+    hist = malloc(POFDP_STAGE_NUM * sizeof *hist);
+    if(hist == NULL){
+        return;
+    }
+    pofdp_latency_snapshot(hist);
+    for(i=0; i<POFDP_STAGE_NUM; i++){
+        for(j=0; j<sizeof(quantile)/sizeof(quantile[0]); j++){
+            POFSC_STATS_ADD_2(snap, latency_ns, pofdp_hist_percentile(&hist[i], quantile[j]), \
+                    "stage", g_pofdp_stage_str[i], "quantile", quantile_str[j]);
+        }
+        POFSC_STATS_ADD_1(snap, latency_count_total, hist[i].count, "stage", g_pofdp_stage_str[i]);
+        POFSC_STATS_ADD_1(snap, latency_sum_ns_total, hist[i].sum, "stage", g_pofdp_stage_str[i]);
+    }
+    free(hist);
+    return;
+}
+#endif // POF_DATAPATH_ON
+
+static void pofsc_stats_take_port(pofsc_stats_snapshot *snap){
+    pof_port *p = NULL;
+    pof_port_stats stats;
+    uint16_t port_num = 0, i;
+    char str[POFSC_STATS_LABEL_LEN];
+
+    poflr_get_port(&p);
+    poflr_get_port_number(&port_num);
+    for(i=0; i<port_num; i++){
+        snprintf(str, sizeof str, "%u", p[i].port_id);
+        POFSC_STATS_ADD_2(snap, port_openflow_enabled, (p[i].of_enable == POFLR_PORT_ENABLE), \
+                "port", p[i].name, "port_id", str);
+    }
+    for(i=0; i<port_num; i++){
+        snprintf(str, sizeof str, "%u", p[i].port_id);
+        POFSC_STATS_ADD_2(snap, port_link_up, (poflr_port_is_live(p[i].port_id) == TRUE), \
+                "port", p[i].name, "port_id", str);
+    }
+    for(i=0; i<port_num; i++){
+        snprintf(str, sizeof str, "%u", p[i].port_id);
+        poflr_get_port_stats(p[i].port_id, &stats);
+#define PORT_STATS_ADD(metric,value) \
+        POFSC_STATS_ADD_2(snap, metric, value, "port", p[i].name, "port_id", str)
+#define PORT_STATS_ADD_DROP(metric,reason,value) \
+        POFSC_STATS_ADD_3(snap, metric, value, "port", p[i].name, "port_id", str, "reason", reason)
+        PORT_STATS_ADD(port_rx_packets_total, stats.rx_packets);
+        PORT_STATS_ADD(port_rx_bytes_total, stats.rx_bytes);
+        PORT_STATS_ADD(port_rx_errors_total, stats.rx_errors);
+        PORT_STATS_ADD_DROP(port_rx_dropped_total, "disabled", stats.rx_disabled_dropped);
+        PORT_STATS_ADD_DROP(port_rx_dropped_total, "mtu", stats.rx_mtu_dropped);
+        PORT_STATS_ADD_DROP(port_rx_dropped_total, "filter", stats.rx_filter_dropped);
+        PORT_STATS_ADD_DROP(port_rx_dropped_total, "queue", stats.rx_queue_dropped);
+        PORT_STATS_ADD(port_tx_packets_total, stats.tx_packets);
+        PORT_STATS_ADD(port_tx_bytes_total, stats.tx_bytes);
+        PORT_STATS_ADD(port_tx_errors_total, stats.tx_errors);
+        PORT_STATS_ADD_DROP(port_tx_dropped_total, "mtu", stats.tx_mtu_dropped);
+        PORT_STATS_ADD_DROP(port_tx_dropped_total, "queue", stats.tx_queue_dropped);
+#undef PORT_STATS_ADD
+#undef PORT_STATS_ADD_DROP
+    }
+    return;
+}
+
+static void pofsc_stats_take_resource(pofsc_stats_snapshot *snap){
+    static const char *type_str[POF_MAX_TABLE_TYPE] = {"MM", "LPM", "EM", "DT"};
+    pof_flow_table_resource *res = NULL;
+    poflr_flow_table *t = NULL;
+    poflr_counters *counter = NULL;
+    pof_table_stats stats;
+    poflr_meters *meter = NULL;
+    poflr_groups *group = NULL;
+    uint8_t *table_num = NULL;
+    uint32_t type, id, entry_num = 0, entry_max = 0;
+    char str[POFSC_STATS_LABEL_LEN];
+
+    poflr_get_table_number(&table_num);
+    poflr_get_flow_table_resource(&res);
+    poflr_get_counter(&counter);
+    poflr_get_meter(&meter);
+    poflr_get_group(&group);
+
+    /* The tables are not freed while the lock is held. */
+    POFLR_FLOW_LOCK_ON;
+    for(type=0; type<POF_MAX_TABLE_TYPE; type++){
+        for(id=0; id<table_num[type]; id++){
+            poflr_get_flow_table(&t, type, id);
+            if(t->state == POFLR_STATE_INVALID){
+                continue;
+            }
+            snprintf(str, sizeof str, "%u", id);
+            POFSC_STATS_ADD_2(snap, flow_table_entries, t->entry_num, "type", type_str[type], "table_id", str);
+            POFSC_STATS_ADD_2(snap, flow_table_size, t->tbl_base_info.size, "type", type_str[type], "table_id", str);
+            poflr_get_table_stats(type, id, &stats);
+            POFSC_STATS_ADD_2(snap, flow_table_lookups_total, stats.lookup_count, "type", type_str[type], "table_id", str);
+            POFSC_STATS_ADD_2(snap, flow_table_matches_total, stats.matched_count, "type", type_str[type], "table_id", str);
+            POFSC_STATS_ADD_2(snap, flow_table_misses_total, stats.missed_count, "type", type_str[type], "table_id", str);
+            POFSC_STATS_ADD_2(snap, flow_table_examined_entries_total, stats.examined_count, "type", type_str[type], "table_id", str);
+            entry_num += t->entry_num;
+            entry_max += t->tbl_base_info.size;
+        }
+    }
+
+    POFSC_STATS_ADD_1(snap, pool_used, entry_num, "pool", "flow_entry");
+    POFSC_STATS_ADD_1(snap, pool_size, entry_max, "pool", "flow_entry");
+    POFSC_STATS_ADD_1(snap, pool_used, counter->counter_num, "pool", "counter");
+    POFSC_STATS_ADD_1(snap, pool_size, res->counter_num, "pool", "counter");
+    POFSC_STATS_ADD_1(snap, pool_used, meter->meter_num, "pool", "meter");
+    POFSC_STATS_ADD_1(snap, pool_size, res->meter_num, "pool", "meter");
+    POFSC_STATS_ADD_1(snap, pool_used, group->group_num, "pool", "group");
+    POFSC_STATS_ADD_1(snap, pool_size, res->group_num, "pool", "group");
+    POFLR_FLOW_LOCK_OFF;
+    return;
+}
+
+/* Take the snapshot of all the statistics. */
+static void pofsc_stats_take(pofsc_stats_snapshot *snap){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snap->time = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    pofsc_stats_take_channel(snap);
+#ifdef POF_DATAPATH_ON
+    pofsc_stats_take_datapath(snap);
+#endif // POF_DATAPATH_ON
+    pofsc_stats_take_port(snap);
+    pofsc_stats_take_resource(snap);
+    POFSC_STATS_ADD(snap, log_dropped_total, poflp_dropped());
+    return;
+}
+
+/* Print the string escaped for both of the JSON string and the
+ * Prometheus label value. */
+static void pofsc_stats_print_str(FILE *fp, const char *s){
+    for(; *s != '\0'; s++){
+        if(*s == '"' || *s == '\\'){
+            fputc('\\', fp);
+            fputc(*s, fp);
+        }else if((unsigned char)*s < 0x20){
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        }else{
+            fputc(*s, fp);
+        }
+    }
+    return;
+}
+
+static void pofsc_stats_print_json(FILE *fp, const pofsc_stats_snapshot *snap){
+    const pofsc_stats_value *v;
+    uint32_t m, i, k, first = TRUE;
+
+    fprintf(fp, "{\"timestamp_ms\":%llu,\"metrics\":[", (unsigned long long)snap->time);
+    for(m=0; m<POFSC_STATS_METRIC_NUM; m++){
+        for(i=0; i<snap->num; i++){
+            v = &snap->value[i];
+            if(v->metric != m){
+                continue;
+            }
+            fprintf(fp, "%s{\"name\":\"pofswitch_%s\",\"labels\":{", \
+                    (first == TRUE) ? "" : ",", pofsc_stats_family[m].name);
+            for(k=0; k<POFSC_STATS_LABEL_NUM && v->label_key[k] != NULL; k++){
+                fprintf(fp, "%s\"%s\":\"", (k == 0) ? "" : ",", v->label_key[k]);
+                pofsc_stats_print_str(fp, v->label_value[k]);
+                fputc('"', fp);
+            }
+            fprintf(fp, "},\"value\":%llu}", (unsigned long long)v->value);
+            first = FALSE;
+        }
+    }
+    fprintf(fp, "]}\n");
+    return;
+}
+
+static void pofsc_stats_print_prometheus(FILE *fp, const pofsc_stats_snapshot *snap){
+    const pofsc_stats_value *v;
+    uint32_t m, i, k, first;
+
+    for(m=0; m<POFSC_STATS_METRIC_NUM; m++){
+        first = TRUE;
+        for(i=0; i<snap->num; i++){
+            v = &snap->value[i];
+            if(v->metric != m){
+                continue;
+            }
+            if(first == TRUE){
+                fprintf(fp, "# HELP pofswitch_%s %s\n", pofsc_stats_family[m].name, pofsc_stats_family[m].help);
+                fprintf(fp, "# TYPE pofswitch_%s %s\n", pofsc_stats_family[m].name, pofsc_stats_family[m].type);
+                first = FALSE;
+            }
+            fprintf(fp, "pofswitch_%s", pofsc_stats_family[m].name);
+            for(k=0; k<POFSC_STATS_LABEL_NUM && v->label_key[k] != NULL; k++){
+                fprintf(fp, "%c%s=\"", (k == 0) ? '{' : ',', v->label_key[k]);
+                pofsc_stats_print_str(fp, v->label_value[k]);
+                fputc('"', fp);
+            }
+            fprintf(fp, "%s %llu\n", (k == 0) ? "" : "}", (unsigned long long)v->value);
+        }
+    }
+    return;
+}
+
+static uint32_t pofsc_stats_write(int fd, const char *buf, size_t len){
+    ssize_t ret;
+
+    while(len > 0){
+        ret = write(fd, buf, len);
+        if(ret > 0){
+            buf += ret;
+            len -= ret;
+            continue;
+        }
+        if(ret == -1 && errno == EINTR){
+            continue;
+        }
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+/* Serve one client. The client sends "json" or "prometheus", or an HTTP
+ * GET request whose path is "/metrics" for Prometheus and any other
+ * path for JSON. A client sending nothing gets JSON. */
+static void pofsc_stats_serve(int fd){
+    pofsc_stats_snapshot snap = {0};
+    struct pollfd pfd;
+    char req[256] = "\0", *body = NULL, head[128];
+    size_t body_len = 0;
+    uint32_t format = POFSC_STATS_JSON, http = FALSE;
+    ssize_t ret;
+    FILE *fp;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, POF_STATS_REQUEST_TIMEOUT) > 0){
+        ret = read(fd, req, sizeof(req) - 1);
+        req[(ret > 0) ? ret : 0] = '\0';
+    }
+    if(strncmp(req, "GET ", 4) == 0){
+        http = TRUE;
+        if(strncmp(req + 4, "/metrics", 8) == 0){
+            format = POFSC_STATS_PROMETHEUS;
+        }
+    }else if(strncmp(req, "prometheus", 10) == 0){
+        format = POFSC_STATS_PROMETHEUS;
+    }
+
+    if((fp = open_memstream(&body, &body_len)) == NULL){
+        return;
+    }
+    pofsc_stats_take(&snap);
+    if(format == POFSC_STATS_PROMETHEUS){
+        pofsc_stats_print_prometheus(fp, &snap);
+    }else{
+        pofsc_stats_print_json(fp, &snap);
+    }
+    fclose(fp);
+    free(snap.value);
+
+    if(http == TRUE){
+        snprintf(head, sizeof head, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\n\r\n", \
+                (format == POFSC_STATS_PROMETHEUS) ? "text/plain; version=0.0.4" : "application/json", \
+                (uint32_t)body_len);
+        pofsc_stats_write(fd, head, strlen(head));
+    }
+    pofsc_stats_write(fd, body, body_len);
+    free(body);
+    return;
+}
+
+/***********************************************************************
+ * Set the path of the statistics socket.
+ * Form:     uint32_t pofsc_set_stats_socket(const char *path)
+ * Input:    path
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function sets the path of the UNIX domain socket where
+ *           the statistics are served. It should be set before the
+ *           switch starts.
+ ***********************************************************************/
+uint32_t pofsc_set_stats_socket(const char *path){
+    if(strlen(path) >= POF_STATS_SOCKET_PATH_MAX_LEN){
+        POF_ERROR_CPRINT_FL(1,RED,"The path of the statistics socket is too long: %s", path);
+        return POF_ERROR;
+    }
+    strncpy(pofsc_stats_socket_path, path, POF_STATS_SOCKET_PATH_MAX_LEN - 1);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * The task function of the statistics task.
+ * Form:     uint32_t pofsc_stats_task(void *arg_ptr)
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This task listens on the statistics socket, and serves the
+ *           clients one by one. Every client gets a snapshot of all the
+ *           statistics taken when it connects, and the connection is
+ *           closed after that. The datapath tasks are not disturbed: the
+ *           counters are only read, and only the flow table lock of the
+ *           control path is held while the tables are read.
+ ***********************************************************************/
+uint32_t pofsc_stats_task(void *arg_ptr){
+    struct sockaddr_un addr;
+    int sock, fd;
+
+    if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1){
+        POF_ERROR_CPRINT_FL(1,RED,"Can't create the statistics socket.");
+        return POF_CREATE_SOCKET_FAILURE;
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if(snprintf(addr.sun_path, sizeof addr.sun_path, "%s", pofsc_stats_socket_path) \
+            >= (int)sizeof addr.sun_path){
+        POF_ERROR_CPRINT_FL(1,RED,"The path of the statistics socket is too long: %s", pofsc_stats_socket_path);
+        close(sock);
+        return POF_BIND_SOCKET_FAILURE;
+    }
+    unlink(pofsc_stats_socket_path);
+    if(bind(sock, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(sock, 8) != 0){
+        POF_ERROR_CPRINT_FL(1,RED,"Can't bind the statistics socket %s.", pofsc_stats_socket_path);
+        close(sock);
+        return POF_BIND_SOCKET_FAILURE;
+    }
+    POF_DEBUG_CPRINT_FL(1,GREEN,">>Serve the statistics on %s!", pofsc_stats_socket_path);
+
+    while(1){
+        if((fd = accept(sock, NULL, NULL)) == -1){
+            if(errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
+            POF_ERROR_CPRINT_FL(1,RED,"Statistics socket accept ERROR!");
+            break;
+        }
+        pofsc_stats_serve(fd);
+        close(fd);
+    }
+
+    close(sock);
+    return POF_OK;
+}
+
+/* Remove the statistics socket. The task should have been deleted. */
+void pofsc_stats_close(){
+    if(pofsc_stats_socket_path[0] != '\0'){
+        unlink(pofsc_stats_socket_path);
+    }
+    return;
+}
@@ -44,6 +44,12 @@
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 
 /* Controller ip. */
 char pofsc_controller_ip_addr[POF_IP_ADDRESS_STRING_LEN] = "192.168.1.1";
@@ -71,7 +77,10 @@ task_t pofsc_main_task_id = 0;
 task_t pofsc_send_task_id = 0;
 
 /* Message queue. */
-uint32_t pofsc_send_q_id = POF_INVALID_QUEUEID;
+pofbf_msg_queue pofsc_send_q;
+
+/* Number of the flush marks pushed into the message queue. */
+static volatile uint32_t pofsc_send_flush_num = 0;
 
 /* Timer. */
 uint32_t pofsc_echo_interval = POF_ECHO_INTERVAL;
@@ -94,12 +103,16 @@ static uint32_t pofsc_main_task(void *arg_ptr);
 static uint32_t pofsc_init();
 static uint32_t pofsc_destroy();
 static uint32_t pofsc_send_msg_task(void *arg_ptr);
+static uint32_t pofsc_send_flush();
 static uint32_t pofsc_echo_timer(uint32_t timer_id, int arg);
 static uint32_t pofsc_set_conn_attr(const char *controller_ip, uint16_t port, uint32_t retry_max, uint32_t retry_interval);
 static uint32_t pofsc_create_socket(int *socket_fd_ptr);
 static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port);
-static uint32_t pofsc_recv(int socket_fd, char* buf,  int buflen, int* plen);
+static uint32_t pofsc_channel_input(pofsc_dev_conn_desc *conn_desc_ptr);
+static uint32_t pofsc_channel_frame(pofsc_dev_conn_desc *conn_desc_ptr);
+static uint32_t pofsc_channel_handle(pofsc_dev_conn_desc *conn_desc_ptr, char *msg, uint16_t len);
 static uint32_t pofsc_send(int socket_fd, char* buf, int len);
+static uint32_t pofsc_sendv(int socket_fd, struct iovec *iov, uint32_t iov_num, uint32_t *sent_ptr);
 static uint32_t pofsc_run_process(char *message, uint16_t len);
 static uint32_t pofsc_build_header(pof_header *header, uint8_t type, uint16_t len, uint32_t xid);
 static uint32_t pofsc_set_error(uint16_t type, uint16_t code);
@@ -107,6 +120,8 @@ static uint32_t pofsc_build_error_msg(char *message, uint16_t *len_p);
 static uint32_t pofsc_wait_exit();
 static uint32_t pofsc_performance_after_ctrl_disconn();
 
+/* The benchmark program links every module and has a main of its own. */
+#ifndef POF_BENCH_ON
 int main(int argc, char *argv[]){
     uint32_t ret = POF_OK;
 
@@ -143,6 +158,7 @@ int main(int argc, char *argv[]){
     pofsc_wait_exit();
     return ret;
 }
+#endif // POF_BENCH_ON
 
 /***********************************************************************
  * Start the OpenFlow communication module in Soft Switch.
@@ -167,7 +183,7 @@ static uint32_t pofsc_init(){
                               pofsc_conn_retry_interval);
 
     /* Create one message queue for storing messages to be sent to controller. */
-    if (POF_OK != pofbf_queue_create(&(pofsc_send_q_id))){
+    if (POF_OK != pofbf_msg_queue_init(&pofsc_send_q, POF_SEND_QUEUE_MAX_SIZE)){
         POF_ERROR_CPRINT_FL(1,RED,"\nCreate message queue, fail and return!");
         return POF_ERROR;
     }
@@ -192,6 +208,14 @@ static uint32_t pofsc_init(){
         return POF_ERROR;
     }
 
+    /* Create one task serving the statistics if the socket is set. */
+    if(pofsc_stats_socket_path[0] != '\0'){
+        if (POF_OK != pofbf_task_create(NULL, (void *)pofsc_stats_task, &pofsc_stats_task_id)){
+            POF_ERROR_CPRINT_FL(1,RED,"\nCreate statistics task, fail and return!");
+            return POF_ERROR;
+        }
+    }
+
     return POF_OK;
 }
 
@@ -203,23 +227,30 @@ static uint32_t pofsc_init(){
  * Return:   VOID
  * Discribe: This task function keeps running the state machine of Soft
  *           Switch. The Soft Switch always works on one of states.
- *           Before the POFCS_CHANNEL_RUN state, this function
- *           builds the connection with the Cntroller by sending and
- *           receiving the "Hello" packet, replying the requests from the
- *           Controller, and so on. During the POFCS_CHANNEL_RUN state,
- *           it receive OpenFlow messages from the Controller and send
- *           them to the other modules to handle.
+ *           This function connects the Controller and sends the "Hello"
+ *           packet. After that, the socket is non-blocking and watched
+ *           by epoll, and every message received moves the state
+ *           machine in pofsc_channel_handle: receiving the "Hello"
+ *           packet, replying the requests from the Controller, and so on.
+ *           During the POFCS_CHANNEL_RUN state, the OpenFlow messages
+ *           from the Controller are sent to the other modules to handle.
  ***********************************************************************/
 static uint32_t pofsc_main_task(void *arg_ptr){
     pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc;
-    pof_header          *head_ptr, head;
-    int total_len = 0, tmp_len, left_len, rcv_len = 0, process_len = 0, packet_len = 0;
-    int socket_fd;
+    pof_header          head;
+    struct epoll_event  event;
+    int tmp_len, socket_fd, epoll_fd, event_num;
     uint32_t ret;
 
     /* Clear error record. */
     pofsc_protocol_error.type = 0xffff;
 
+    /* Create the epoll instance watching the channel socket. */
+    if((epoll_fd = epoll_create(1)) == -1){
+        POF_ERROR_CPRINT_FL(1,RED,">>Create epoll FAIL!");
+        terminate_handler();
+    }
+
     /* State machine of the control module in Soft Switch. */
     while(1)
     {
@@ -250,6 +281,25 @@ static uint32_t pofsc_main_task(void *arg_ptr){
                 if(ret == POF_OK){
                     POF_DEBUG_CPRINT_FL(1,GREEN,">>Connect to controler SUC! %s: %u", \
                                         pofsc_controller_ip_addr, POF_CONTROLLER_PORT_NUM);
+
+                    /* Receive the messages from now on by the events of
+                     * the non-blocking socket. */
+                    fcntl(conn_desc_ptr->sfd, F_SETFL, fcntl(conn_desc_ptr->sfd, F_GETFL) | O_NONBLOCK);
+
+                    /* The send task coalesces the messages itself, so do
+                     * not delay the last small segment. */
+                    tmp_len = 1;
+                    setsockopt(conn_desc_ptr->sfd, IPPROTO_TCP, TCP_NODELAY, &tmp_len, sizeof(tmp_len));
+                    memset(&event, 0, sizeof(event));
+                    event.events = EPOLLIN;
+                    event.data.fd = conn_desc_ptr->sfd;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn_desc_ptr->sfd, &event) == -1){
+                        POF_ERROR_CPRINT_FL(1,RED,">>Add socket to epoll FAIL!");
+                        terminate_handler();
+                    }
+                    conn_desc_ptr->recv_head = 0;
+                    conn_desc_ptr->recv_tail = 0;
+
                     conn_desc_ptr->conn_status.state = POFCS_CHANNEL_CONNECTED;
 					conn_desc_ptr->conn_retry_count = 0;
                 }else{
@@ -282,322 +332,297 @@ static uint32_t pofsc_main_task(void *arg_ptr){
                 break;
 
             case POFCS_HELLO:
-                /* Receive hello from controller. */
-                total_len = 0;
-                left_len = 0;
-                rcv_len = 0;
-                process_len = 0;
-                ret = pofsc_recv(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf , POF_RECV_BUF_MAX_SIZE, &total_len);
-                if(ret == POF_OK){
-                    POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie HELLO packet SUC!");
-					poflr_clear_resource();
-                    conn_desc_ptr->conn_status.state = POFCS_REQUEST_FEATURE;
-                }else{
-                    POF_ERROR_CPRINT_FL(1,RED,"Recv HELLO FAILE!");
-                    break;
-                }
-                rcv_len += total_len;
-
-                /* Parse. */
-                head_ptr = (pof_header *)conn_desc_ptr->recv_buf;
-                while(total_len < POF_NTOHS(head_ptr->length)){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf  + rcv_len, POF_RECV_BUF_MAX_SIZE -rcv_len,  &tmp_len);
-                    if(ret != POF_OK){
-                        POF_ERROR_CPRINT_FL(1,RED,"Recv HELLO FAILE!");
-                        break;
-                    }
-
-                    total_len += tmp_len;
-                    rcv_len += tmp_len;
-                }
-
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
-
-                /* Check any error. */
-                if(head_ptr->version > POF_VERSION){
-                    POF_ERROR_CPRINT_FL(1,RED,"Version of recv-packet is higher than support!");
-                    pofsc_set_error(POFET_HELLO_FAILED, POFHFC_INCOMPATIBLE);
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                }else if(head_ptr->type != POFT_HELLO){
-                    POF_ERROR_CPRINT_FL(1,RED,"Type of recv-packet is not HELLO, which we want to recv!");
-                    pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                }
-
-                process_len += POF_NTOHS(head_ptr->length);
-                left_len = rcv_len - process_len;
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
-
             case POFCS_REQUEST_FEATURE:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_SET_CONFIG;
-                    }else{
-                        POF_ERROR_CPRINT_FL(1,RED,"Feature request FAIL!");
-                        break;
-                    }
-
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL(1,RED,"Feature request FAIL!");
-                            break;
-                        }
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
-                }
-
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
-
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-
-                /* Check any error. */
-                if(head_ptr->type != POFT_FEATURES_REQUEST){
-                    pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
+            case POFCS_SET_CONFIG:
+            case POFCS_REQUEST_GET_CONFIG:
+            case POFCS_CHANNEL_RUN:
+                /* Do not read the requests from controller until the
+                 * replies waiting for sending drain, so the slow
+                 * controller is pushed back by TCP. */
+                if(pofsc_send_q.byte_num > POF_SEND_QUEUE_MAX_SIZE){
+                    pofbf_task_delay(10);
                     break;
                 }
 
-                POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie FEATURE_REQUEST packet SUC!");
-                conn_desc_ptr->conn_status.state = POFCS_SET_CONFIG;
-                packet_len = POF_NTOHS(head_ptr->length);
-
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len);
-
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL(1,RED,"Features request FAIL!");
+                /* Wait for the messages from controller. The state moves on
+                 * when the expected message is handled. */
+                event_num = epoll_wait(epoll_fd, &event, 1, pof_flow_mod_batch_timeout());
+                if(event_num > 0){
+                    pofsc_channel_input(conn_desc_ptr);
+                }else if(event_num == -1 && errno != EINTR){
+                    POF_ERROR_CPRINT_FL(1,RED,"Wait for channel event FAIL!");
                     terminate_handler();
-                    break;
-                }
-
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
                 }
 
+                /* Apply the flow mods waiting too long in the batch. */
+                (void)pof_flow_mod_batch_timeout();
                 break;
 
-            case POFCS_SET_CONFIG:
-                /* Receive set_config message from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_REQUEST_GET_CONFIG;
-                    }else{
-                        POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
-                        break;
-                    }
-
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
-                            break;
-                        }
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
-                }
-
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
-
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-
-                /* Check any error. */
-                if(head_ptr->version > POF_VERSION){
-                    POF_ERROR_CPRINT_FL(1,RED,"Version of recv-packet is higher than support!");
-                    pofsc_set_error(POFET_BAD_REQUEST, POFHFC_INCOMPATIBLE);
-                    POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }else if(head_ptr->type != POFT_SET_CONFIG){
-                    POF_ERROR_CPRINT_FL(1,RED,"Type of recv-packet is not SET_CONFIG, which we want to recv!");
-                    pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
-                    POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }
+            default:
+                conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
+                break;
+        }
 
-                POF_DEBUG_CPRINT_FL(1,BLUE,">>Recevie SET_CONFIG packet SUC!");
-                conn_desc_ptr->conn_status.state = POFCS_REQUEST_GET_CONFIG;
-                packet_len = POF_NTOHS(head_ptr->length);
+        /* If any error is detected, reply to controller immediately. */
+        if(pofsc_protocol_error.type != 0xffff){
+            tmp_len = 0;
+            /* Build error message. */
+            (void)pofsc_build_error_msg(conn_desc_ptr->send_buf, (uint16_t*)&tmp_len);
 
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len);
+            /* Write error message in queue for sending. */
+            ret = pofsc_send_packet_upward((uint8_t *)conn_desc_ptr->send_buf, (uint32_t)tmp_len);
+            POF_CHECK_RETVALUE_TERMINATE(ret);
+        }
+    }
+    return;
+}
 
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
-                    terminate_handler();
-                    break;
-                }
+/* Close the channel because of protocol error. */
+static void pofsc_channel_close(pofsc_dev_conn_desc *conn_desc_ptr){
+    (void)pof_flow_mod_batch_flush();
+    close(conn_desc_ptr->sfd);
+    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
+    return;
+}
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+/***********************************************************************
+ * Read the channel socket.
+ * Form:     static uint32_t pofsc_channel_input(pofsc_dev_conn_desc *conn_desc_ptr)
+ * Input:    connection description
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function reads the non-blocking socket into the receive
+ *           ring until no more data is ready, and handles every complete
+ *           message in the ring. The part of the message which has not
+ *           arrived stays in the ring for the next read.
+ ***********************************************************************/
+static uint32_t pofsc_channel_input(pofsc_dev_conn_desc *conn_desc_ptr){
+    uint32_t pos, space, len;
+    int ret;
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
+    while(1){
+        pos = conn_desc_ptr->recv_tail & (POF_RECV_BUF_MAX_SIZE - 1);
+        space = POF_RECV_BUF_MAX_SIZE - (conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head);
+        len = (space < POF_RECV_BUF_MAX_SIZE - pos) ? space : (POF_RECV_BUF_MAX_SIZE - pos);
+
+        ret = read(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf + pos, len);
+        if(ret > 0){
+            conn_desc_ptr->recv_tail += ret;
+            if(pofsc_channel_frame(conn_desc_ptr) != POF_OK){
+                return POF_ERROR;
+            }
+            continue;
+        }
+        if(ret == -1 && errno == EINTR){
+            continue;
+        }
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return POF_OK;
+        }
 
-            case POFCS_REQUEST_GET_CONFIG:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header)) && (left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_CHANNEL_RUN;
-                    }else{
-                        POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
-                        break;
-                    }
+        POF_ERROR_CPRINT_FL(1,RED,"closed socket fd!");
+        (void)pof_flow_mod_batch_flush();
+        close(conn_desc_ptr->sfd);
+        pofsc_performance_after_ctrl_disconn();
+        return POF_RECEIVE_MSG_FAILURE;
+    }
+}
 
-                    rcv_len += total_len;
-                    total_len += left_len;
+/***********************************************************************
+ * Extract the complete messages from the receive ring.
+ * Form:     static uint32_t pofsc_channel_frame(pofsc_dev_conn_desc *conn_desc_ptr)
+ * Input:    connection description
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function handles every complete message in the receive
+ *           ring. The message wrapping around the end of the ring is
+ *           copied into frame_buf to be contiguous. The message with a
+ *           length shorter than pof_header closes the channel, since the
+ *           stream can not be framed any more.
+ ***********************************************************************/
+static uint32_t pofsc_channel_frame(pofsc_dev_conn_desc *conn_desc_ptr){
+    pof_header head;
+    uint32_t pos, len, first;
+    char *msg;
+
+    while(conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head >= sizeof(pof_header)){
+        pos = conn_desc_ptr->recv_head & (POF_RECV_BUF_MAX_SIZE - 1);
+
+        /* Read the header, which may wrap around. */
+        first = POF_RECV_BUF_MAX_SIZE - pos;
+        if(first >= sizeof(pof_header)){
+            memcpy(&head, conn_desc_ptr->recv_buf + pos, sizeof(pof_header));
+        }else{
+            memcpy(&head, conn_desc_ptr->recv_buf + pos, first);
+            memcpy((char *)&head + first, conn_desc_ptr->recv_buf, sizeof(pof_header) - first);
+        }
 
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
-                            break;
-                        }
+        len = POF_NTOHS(head.length);
+        if(len < sizeof(pof_header)){
+            POF_ERROR_CPRINT_FL(1,RED,"Bad message length: %u", len);
+            pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_LEN);
+            pofsc_channel_close(conn_desc_ptr);
+            return POF_ERROR;
+        }
+        if(conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head < len){
+            break;
+        }
 
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
-                }
+        if(first >= len){
+            msg = conn_desc_ptr->recv_buf + pos;
+        }else{
+            memcpy(conn_desc_ptr->frame_buf, conn_desc_ptr->recv_buf + pos, first);
+            memcpy(conn_desc_ptr->frame_buf + first, conn_desc_ptr->recv_buf, len - first);
+            msg = conn_desc_ptr->frame_buf;
+        }
+        conn_desc_ptr->recv_head += len;
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+        g_pofsc_channel_stats.rx_msg++;
+        g_pofsc_channel_stats.rx_byte += len;
+        pofsc_channel_handle(conn_desc_ptr, msg, len);
+        if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
+            return POF_ERROR;
+        }
+    }
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                /* Check any error. */
-                if(head_ptr->type != POFT_GET_CONFIG_REQUEST){
-                    pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
-                    POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }
+    return POF_OK;
+}
 
-                POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie GET_CONFIG_REQUEST packet SUC!");
-                packet_len = POF_NTOHS(head_ptr->length);
+/***********************************************************************
+ * Handle one message from the Controller.
+ * Form:     static uint32_t pofsc_channel_handle(pofsc_dev_conn_desc *conn_desc_ptr, \
+ *                                                char *msg, uint16_t len)
+ * Input:    connection description, message, message length
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function drives the state machine of the channel. Before
+ *           the POFCS_CHANNEL_RUN state, the message must be the one the
+ *           state waits for, otherwise the channel is closed. During the
+ *           POFCS_CHANNEL_RUN state, the message is sent to the other
+ *           modules to handle.
+ ***********************************************************************/
+static uint32_t pofsc_channel_handle(pofsc_dev_conn_desc *conn_desc_ptr, char *msg, uint16_t len){
+    pof_header *head_ptr = (pof_header *)msg;
+    uint8_t    state = conn_desc_ptr->conn_status.state;
+    uint32_t   ret;
+
+    if(state == POFCS_CHANNEL_RUN){
+        /* Handle the message. Echo messages will be processed here and other messages will be forwarded to LUP. */
+        return pofsc_run_process(msg, len);
+    }
 
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len);
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
-                    terminate_handler();
-                    break;
-                }
+#ifndef POF_DEBUG_PRINT_ECHO_ON
+    if(head_ptr->type != POFT_ECHO_REPLY){
+#endif
+    POF_DEBUG_CPRINT_PACKET(msg,0,len);
+#ifndef POF_DEBUG_PRINT_ECHO_ON
+    }
+#endif
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+    switch(state){
+        case POFCS_HELLO:
+            /* Check any error. */
+            if(head_ptr->version > POF_VERSION){
+                POF_ERROR_CPRINT_FL(1,RED,"Version of recv-packet is higher than support!");
+                pofsc_set_error(POFET_HELLO_FAILED, POFHFC_INCOMPATIBLE);
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }else if(head_ptr->type != POFT_HELLO){
+                POF_ERROR_CPRINT_FL(1,RED,"Type of recv-packet is not HELLO, which we want to recv!");
+                pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie HELLO packet SUC!");
+            pof_flow_mod_batch_discard();
+            poflr_clear_resource();
+            pofsc_send_flush();
+            conn_desc_ptr->conn_status.state = POFCS_REQUEST_FEATURE;
+            break;
 
-				sleep(1);
-                conn_desc_ptr->conn_status.state = POFCS_CHANNEL_RUN;
-				POF_PRINT(1,GREEN,">>Connect to POFController successfully!\n");
+        case POFCS_REQUEST_FEATURE:
+            /* Check any error. */
+            if(head_ptr->type != POFT_FEATURES_REQUEST){
+                pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }
 
-                break;
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie FEATURE_REQUEST packet SUC!");
+            ret = pof_parse_msg_from_controller(msg);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL(1,RED,"Features request FAIL!");
+                terminate_handler();
+                return ret;
+            }
+            conn_desc_ptr->conn_status.state = POFCS_SET_CONFIG;
+            break;
 
-            case POFCS_CHANNEL_RUN:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                    /* Resv_buf has no space, so should move the left data to the head of the buf. */
-                    if(POF_RECV_BUF_MAX_SIZE == rcv_len){
-                        memcpy(conn_desc_ptr->recv_buf,  conn_desc_ptr->recv_buf  + process_len, left_len);
-                        rcv_len = left_len;
-                        process_len = 0;
-                    }
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len);
-                    if(ret != POF_OK){
-                        break;
-                    }
+        case POFCS_SET_CONFIG:
+            /* Check any error. */
+            if(head_ptr->version > POF_VERSION){
+                POF_ERROR_CPRINT_FL(1,RED,"Version of recv-packet is higher than support!");
+                pofsc_set_error(POFET_BAD_REQUEST, POFHFC_INCOMPATIBLE);
+                POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }else if(head_ptr->type != POFT_SET_CONFIG){
+                POF_ERROR_CPRINT_FL(1,RED,"Type of recv-packet is not SET_CONFIG, which we want to recv!");
+                pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
+                POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }
 
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len);
-                        if(ret != POF_OK){
-                            break;
-                        }
-                    total_len += tmp_len;
-                    rcv_len += tmp_len;
-                    }
-                }
+            POF_DEBUG_CPRINT_FL(1,BLUE,">>Recevie SET_CONFIG packet SUC!");
+            ret = pof_parse_msg_from_controller(msg);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL(1,RED,"Set config FAIL!");
+                terminate_handler();
+                return ret;
+            }
+            conn_desc_ptr->conn_status.state = POFCS_REQUEST_GET_CONFIG;
+            break;
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+        case POFCS_REQUEST_GET_CONFIG:
+            /* Check any error. */
+            if(head_ptr->type != POFT_GET_CONFIG_REQUEST){
+                pofsc_set_error(POFET_BAD_REQUEST, POFBRC_BAD_TYPE);
+                POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
+                pofsc_channel_close(conn_desc_ptr);
+                return POF_ERROR;
+            }
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                packet_len = POF_NTOHS(head_ptr->length);
-                /* Handle the message. Echo messages will be processed here and other messages will be forwarded to LUP. */
-                ret = pofsc_run_process(conn_desc_ptr->recv_buf + process_len, packet_len);
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie GET_CONFIG_REQUEST packet SUC!");
+            ret = pof_parse_msg_from_controller(msg);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL(1,RED,"Get config FAIL!");
+                terminate_handler();
+                return ret;
+            }
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+            conn_desc_ptr->conn_status.state = POFCS_CHANNEL_RUN;
+            g_pofsc_channel_stats.connect++;
+            POF_PRINT(1,GREEN,">>Connect to POFController successfully!\n");
+            break;
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
+        default:
+            conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
+            break;
+    }
 
-            default:
-                conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
-                break;
-        }
+    return POF_OK;
+}
 
-        /* If any error is detected, reply to controller immediately. */
-        if(pofsc_protocol_error.type != 0xffff){
-            tmp_len = 0;
-            /* Build error message. */
-            (void)pofsc_build_error_msg(conn_desc_ptr->send_buf, (uint16_t*)&tmp_len);
+/* Release the messages in the batch. */
+static void pofsc_send_batch_release(pofbf_msg **batch, uint32_t *batch_num_ptr){
+    uint32_t i;
 
-            /* Write error message in queue for sending. */
-            ret = pofbf_queue_write(pofsc_send_q_id, conn_desc_ptr->send_buf, (uint32_t)tmp_len, POF_WAIT_FOREVER);
-            POF_CHECK_RETVALUE_TERMINATE(ret);
-        }
+    for(i=0; i<*batch_num_ptr; i++){
+        pofbf_msg_release(batch[i]);
     }
+    *batch_num_ptr = 0;
     return;
 }
 
@@ -614,11 +639,21 @@ static uint32_t pofsc_main_task(void *arg_ptr){
  *           2. Asynchrous message.
  *           The two types messages are built and sent to queue by two
  *           different tasks.
+ *           When a message arrives, the messages already waiting in the
+ *           queue are appended behind it up to POF_SEND_BATCH_SIZE, and
+ *           all of them are sent by one writev from their own buffers.
+ *           The task never waits for more messages, so the batch adds no
+ *           latency. The messages not sent completely are released when
+ *           the channel breaks, and so are the messages popped while it
+ *           is down and those queued before the flush mark of the next
+ *           session, see pofsc_send_flush.
  ***********************************************************************/
 static uint32_t pofsc_send_msg_task(void *arg_ptr){
     pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc;
-    pof_header *head_ptr;
-    uint32_t   ret, queue_id = pofsc_send_q_id;
+    pofbf_msg    *batch[POF_SEND_BATCH_NUM], *msg;
+    struct iovec iov[POF_SEND_BATCH_NUM];
+    uint32_t     ret, batch_num = 0, batch_len, sent, flushed = 0, i;
+    uint8_t      state;
 
     /* Polling the message queue. If valid, fetch one message and send it to controller. */
     while(1){
@@ -635,28 +670,79 @@ static uint32_t pofsc_send_msg_task(void *arg_ptr){
             case POFCS_REQUEST_FEATURE:
             case POFCS_REQUEST_GET_CONFIG:
             case POFCS_CHANNEL_RUN:
+                /* Release the messages of the last session, up to the
+                 * flush mark of this one. */
+                while(flushed != pofsc_send_flush_num){
+                    if((msg = pofbf_msg_queue_pop(&pofsc_send_q, POF_WAIT_FOREVER)) == NULL){
+                        break;
+                    }
+                    if(msg->len == 0){
+                        flushed++;
+                    }
+                    pofbf_msg_release(msg);
+                }
+
                 /* Fetch one message from message queue. */
-                ret = pofbf_queue_read(queue_id, conn_desc_ptr->msg_buf, POF_QUEUE_MESSAGE_LEN, POF_WAIT_FOREVER);
-                if(ret != POF_OK){
-                    pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
+                msg = pofbf_msg_queue_pop(&pofsc_send_q, POF_WAIT_FOREVER);
+                if(msg == NULL){
+                    pofsc_set_error(POFET_SOFTWARE_FAILED, POF_READ_MSG_QUEUE_FAILURE);
                     break;
                 }
+                if(msg->len == 0){
+                    flushed++;
+                    pofbf_msg_release(msg);
+                    break;
+                }
+                batch[batch_num++] = msg;
+                batch_len = msg->len;
+
+                /* Append the messages already waiting in the queue. The
+                 * messages before a flush mark are released. */
+                while(batch_num < POF_SEND_BATCH_NUM && batch_len < POF_SEND_BATCH_SIZE){
+                    if((msg = pofbf_msg_queue_pop(&pofsc_send_q, POF_NO_WAIT)) == NULL){
+                        break;
+                    }
+                    if(msg->len == 0){
+                        flushed++;
+                        pofbf_msg_release(msg);
+                        pofsc_send_batch_release(batch, &batch_num);
+                        batch_len = 0;
+                        continue;
+                    }
+                    batch[batch_num++] = msg;
+                    batch_len += msg->len;
+                }
+                if(batch_num == 0){
+                    break;
+                }
+
+                /* The messages popped after the channel broke belong to
+                 * the lost session. */
+                state = conn_desc_ptr->conn_status.state;
+                if(state == POFCS_CHANNEL_INVALID || state == POFCS_CHANNEL_CONNECTING \
+                        || state == POFCS_CHANNEL_CONNECTED || state == POFCS_HELLO){
+                    pofsc_send_batch_release(batch, &batch_num);
+                    break;
+                }
+
+                /* Send messages to server. */
+                for(i=0; i<batch_num; i++){
+                    iov[i].iov_base = batch[i]->data;
+                    iov[i].iov_len = batch[i]->len;
+                }
+                sent = 0;
+                ret = pofsc_sendv(conn_desc_ptr->sfd, iov, batch_num, &sent);
+
+                /* The rest of the batch is meaningless to the Controller
+                 * of the next session, so it is released with the sent
+                 * messages. */
+                pofsc_send_batch_release(batch, &batch_num);
 
-                /* Send message to server. */
-                head_ptr = (pof_header*)conn_desc_ptr->msg_buf;
-                ret = pofsc_send(conn_desc_ptr->sfd, conn_desc_ptr->msg_buf, POF_HTONS(head_ptr->length));
                 if(ret != POF_OK){
                     /* Return to inalid state. */
                     conn_desc_ptr->conn_status.last_error = (uint8_t)ret;
                     conn_desc_ptr->sfd = 0;
                     conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-
-                    /* Put the message back to queue for sendding next time. */
-                    ret = pofbf_queue_write(queue_id, conn_desc_ptr->msg_buf, POF_HTONS(head_ptr->length), POF_WAIT_FOREVER);
-                    if(ret != POF_OK){
-                        pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
-                        break;
-                    }
                 }
                 break;
             default:
@@ -698,7 +784,7 @@ static uint32_t pofsc_echo_timer(uint32_t timer_id, int arg){
             pofsc_build_header(&head, POFT_ECHO_REQUEST, len, g_upward_xid++);
 
             /* Write error message into queue for sending. */
-            ret = pofbf_queue_write(pofsc_send_q_id, (char*)&head, len, POF_WAIT_FOREVER);
+            ret = pofsc_send_packet_upward((uint8_t *)&head, len);
             if(ret != POF_OK){
                 pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
             }
@@ -810,42 +896,6 @@ static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port){
     return POF_OK;
 }
 
-/***********************************************************************
- * Receive message.
- * Form:     uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen)
- * Input:    socket_fd, the max length of the buffer
- * Output:   data buffer, data length
- * Return:   POF_OK or ERROR code
- * Discribe: This function receive the messages from the Controller.
- ***********************************************************************/
-static uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen){
-    pof_header *header_ptr;
-    int len;
-
-    if ((len = read(socket_fd, buf, buflen)) <= 0){
-        POF_ERROR_CPRINT_FL(1,RED,"closed socket fd!");
-        close(socket_fd);
-        pofsc_performance_after_ctrl_disconn();
-        return (POF_RECEIVE_MSG_FAILURE);
-    }
-    *plen = len;
-
-    if(pofsc_conn_desc.conn_status.state == POFCS_CHANNEL_RUN){
-        return POF_OK;
-    }
-
-#ifndef POF_DEBUG_PRINT_ECHO_ON
-    header_ptr = (pof_header *)buf;
-    if(header_ptr->type != POFT_ECHO_REPLY){
-#endif
-    POF_DEBUG_CPRINT_PACKET(buf,0,len);
-#ifndef POF_DEBUG_PRINT_ECHO_ON
-    }
-#endif
-
-    return POF_OK;
-}
-
 /***********************************************************************
  * Send message.
  * Form:     uint32_t pofsc_send(int socket_fd, char* buf, int len)
@@ -855,24 +905,83 @@ static uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen){
  * Discribe: This function send messages to the Controller in send task.
  ***********************************************************************/
 static uint32_t pofsc_send(int socket_fd, char* buf, int len){
-    int ret;
+    struct iovec iov;
+    uint32_t sent = 0;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    return pofsc_sendv(socket_fd, &iov, 1, &sent);
+}
+
+/***********************************************************************
+ * Send messages gathered from several buffers.
+ * Form:     uint32_t pofsc_sendv(int socket_fd, struct iovec *iov, \
+ *                                uint32_t iov_num, uint32_t *sent_ptr)
+ * Input:    socket_fd, message buffers, number of buffers
+ * Output:   length sent before any error
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function sends all of the buffers to the Controller.
+ *           The short write is continued from where it stopped, and the
+ *           full socket buffer is waited for POF_CHANNEL_SEND_TIMEOUT.
+ *           The iov is changed by the short write.
+ ***********************************************************************/
+static uint32_t pofsc_sendv(int socket_fd, struct iovec *iov, uint32_t iov_num, uint32_t *sent_ptr){
+    struct pollfd pfd;
+    ssize_t ret;
+    uint32_t sent = 0, msg_num = 0, i;
+
+    for(i=0; i<iov_num; i++){
 #ifndef POF_DEBUG_PRINT_ECHO_ON
-    pof_header *header_ptr = (pof_header *)buf;
-    if(header_ptr->type != POFT_ECHO_REQUEST){
+        if(((pof_header *)iov[i].iov_base)->type == POFT_ECHO_REQUEST){
+            continue;
+        }
 #endif
-    POF_DEBUG_CPRINT_PACKET(buf,1,len);
-#ifndef POF_DEBUG_PRINT_ECHO_ON
+        POF_DEBUG_CPRINT_PACKET(iov[i].iov_base,1,iov[i].iov_len);
     }
-#endif
 
-    /* Send message to server. */
-    if ((ret = write(socket_fd, (char *)buf, len) == -1)){
+    /* Send message to server. The socket is non-blocking, so wait until
+     * it is writable if the socket buffer is full. */
+    while(iov_num > 0){
+        ret = writev(socket_fd, iov, iov_num);
+        if(ret > 0){
+            sent += ret;
+            /* Skip the buffers written. */
+            while(iov_num > 0 && (size_t)ret >= iov->iov_len){
+                ret -= iov->iov_len;
+                iov++;
+                iov_num--;
+                msg_num++;
+            }
+            if(iov_num > 0){
+                iov->iov_base = (char *)iov->iov_base + ret;
+                iov->iov_len -= ret;
+            }
+            continue;
+        }
+        if(ret == -1 && errno == EINTR){
+            continue;
+        }
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            pfd.fd = socket_fd;
+            pfd.events = POLLOUT;
+            ret = poll(&pfd, 1, POF_CHANNEL_SEND_TIMEOUT);
+            if(ret > 0 || (ret == -1 && errno == EINTR)){
+                continue;
+            }
+        }
+
+        *sent_ptr = sent;
+        __sync_fetch_and_add(&g_pofsc_channel_stats.tx_msg, msg_num);
+        __sync_fetch_and_add(&g_pofsc_channel_stats.tx_byte, sent);
         POF_ERROR_CPRINT_FL(1,RED,"Socket write ERROR!");
         close(socket_fd);
         pofsc_performance_after_ctrl_disconn();
         return (POF_SEND_MSG_FAILURE);
     }
 
+    *sent_ptr = sent;
+    __sync_fetch_and_add(&g_pofsc_channel_stats.tx_msg, msg_num);
+    __sync_fetch_and_add(&g_pofsc_channel_stats.tx_byte, sent);
     return (POF_OK);
 }
 
@@ -980,13 +1089,57 @@ static uint32_t pofsc_build_error_msg(char *message, uint16_t *len_p){
 
 /* Send packet upward to the Contrller through OpenFlow channel. */
 uint32_t pofsc_send_packet_upward(uint8_t *packet, uint32_t len){
-    if(POF_OK != pofbf_queue_write(pofsc_send_q_id, packet, len, POF_WAIT_FOREVER)){
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
-    }
+    pofbf_msg *msg;
+
+    msg = pofbf_msg_alloc(len);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg);
+    memcpy(msg->data, packet, len);
+
+	return pofsc_send_msg_upward(msg, FALSE);
+}
 
+/***********************************************************************
+ * Send message buffer upward to the Controller.
+ * Form:     uint32_t pofsc_send_msg_upward(pofbf_msg *msg, uint8_t droppable)
+ * Input:    message buffer, whether the message can be dropped
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: This function passes the reference of the message buffer to
+ *           the sending queue without copy, and never waits. When the
+ *           Controller is too slow, the droppable message is dropped and
+ *           counted in pofsc_send_q, which is not an error of the caller.
+ ***********************************************************************/
+uint32_t pofsc_send_msg_upward(pofbf_msg *msg, uint8_t droppable){
+    (void)pofbf_msg_queue_push(&pofsc_send_q, msg, droppable);
 	return POF_OK;
 }
 
+/***********************************************************************
+ * Drop the messages queued for the last Controller session.
+ * Form:     static uint32_t pofsc_send_flush()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: The replies, packet-ins and flow-removeds queued before the
+ *           new session carry xids and buffer ids which mean nothing to
+ *           it. Only the sending task pops the queue, so this function
+ *           pushes an empty message as the flush mark, and the sending
+ *           task releases all the messages before the mark instead of
+ *           sending them. It is called when the HELLO of the new session
+ *           is received, after the resource is cleared.
+ ***********************************************************************/
+static uint32_t pofsc_send_flush(){
+    pofbf_msg *msg;
+
+    msg = pofbf_msg_alloc(0);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg);
+
+    /* Count the mark first, so the sending task never sends the
+     * messages before it. */
+    __sync_fetch_and_add(&pofsc_send_flush_num, 1);
+    return pofsc_send_msg_upward(msg, FALSE);
+}
+
 /* Set the Controller's IP address. */
 uint32_t pofsc_set_controller_ip(char *ip_str){
 	strncpy(pofsc_controller_ip_addr, ip_str, POF_IP_ADDRESS_STRING_LEN);
@@ -1038,10 +1191,26 @@ static uint32_t pofsc_destroy(){
         pofbf_timer_delete(&pofsc_echo_timer_id);
     }
 
+    if(pofsc_stats_task_id != POF_INVALID_TASKID){
+        pofbf_task_delete(&pofsc_stats_task_id);
+    }
+    pofsc_stats_close();
+
+    if(g_poflr_counter_push_task_id != POF_INVALID_TASKID){
+        pofbf_task_delete(&g_poflr_counter_push_task_id);
+    }
+
+    if(g_poflr_flow_timeout_task_id != POF_INVALID_TASKID){
+        pofbf_task_delete(&g_poflr_flow_timeout_task_id);
+    }
+
 #ifdef POF_DATAPATH_ON
     if(g_pofdp_main_task_id != POF_INVALID_TASKID){
         pofbf_task_delete(&g_pofdp_main_task_id);
     }
+    if(g_poflr_port_link_task_id != POF_INVALID_TASKID){
+        pofbf_task_delete(&g_poflr_port_link_task_id);
+    }
     if(g_pofdp_send_raw_task_id != POF_INVALID_TASKID){
         pofbf_task_delete(&g_pofdp_send_raw_task_id);
     }
@@ -1061,9 +1230,7 @@ static uint32_t pofsc_destroy(){
     }
 #endif
 
-    if(pofsc_send_q_id != POF_INVALID_QUEUEID){
-        pofbf_queue_delete(&pofsc_send_q_id);
-    }
+    pofbf_msg_queue_destroy(&pofsc_send_q);
 
 	pof_close_log_file();
 